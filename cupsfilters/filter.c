@@ -19,6 +19,9 @@
 #include <errno.h>
 #include <signal.h>
 #include <sys/wait.h>
+#ifdef HAVE_MEMFD_CREATE
+#  include <sys/mman.h>
+#endif // HAVE_MEMFD_CREATE
 #include <cups/file.h>
 #include <cups/array.h>
 
@@ -508,6 +511,72 @@ compare_filter_pids(filter_function_pid_t *a,	// I - First filter
 }
 
 
+//
+// 'pdf_handoff_start()' - Create the memory file through which
+//                         cfFilterPDFToPDF() passes its output to
+//                         cfFilterPDFToRaster() and register it as
+//                         extension of the filter data, so that both
+//                         filter processes inherit it.
+//
+
+static cf_filter_pdf_handoff_t *            // O - Handoff record or NULL
+pdf_handoff_start(cf_filter_data_t *data)   // I - Job and printer data
+{
+#ifdef HAVE_MEMFD_CREATE
+  cf_filter_pdf_handoff_t *handoff;
+  int                     fd;
+  cf_logfunc_t            log = data->logfunc;
+  void                    *ld = data->logdata;
+
+
+  if ((fd = memfd_create(CF_FILTER_DATA_EXT_PDF_HANDOFF,
+			 MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0)
+  {
+    if (log) log(ld, CF_LOGLEVEL_DEBUG,
+		 "cfFilterChain: Could not create memory file for PDF handoff, using pipe: %s",
+		 strerror(errno));
+    return (NULL);
+  }
+
+  if ((handoff = calloc(1, sizeof(cf_filter_pdf_handoff_t))) == NULL)
+  {
+    close(fd);
+    return (NULL);
+  }
+  handoff->fd = fd;
+
+  free(cfFilterDataAddExt(data, CF_FILTER_DATA_EXT_PDF_HANDOFF, handoff));
+
+  if (log) log(ld, CF_LOGLEVEL_DEBUG,
+	       "cfFilterChain: Passing PDF from pdftopdf to pdftoraster in shared memory");
+
+  return (handoff);
+#else
+  (void)data;
+  return (NULL);
+#endif // HAVE_MEMFD_CREATE
+}
+
+
+//
+// 'pdf_handoff_finish()' - Remove the handoff record from the filter
+//                          data and close the parent's copy of the
+//                          memory file, after both filters are forked.
+//
+
+static void
+pdf_handoff_finish(cf_filter_data_t *data,            // I - Job and printer
+						      //     data
+		   cf_filter_pdf_handoff_t *handoff)  // I - Handoff record
+{
+  if (cfFilterDataGetExt(data, CF_FILTER_DATA_EXT_PDF_HANDOFF) == handoff)
+    cfFilterDataRemoveExt(data, CF_FILTER_DATA_EXT_PDF_HANDOFF);
+  if (handoff->fd >= 0)
+    close(handoff->fd);
+  free(handoff);
+}
+
+
 //
 // 'cfFilterChain()' - Call filter functions in a chain to do a data
 //                     format conversion which non of the individual
@@ -537,6 +606,8 @@ cfFilterChain(int inputfd,         // I - File descriptor input stream
   cups_array_t	*pids;		     // Executed filters array
   filter_function_pid_t	*pid_entry,  // Entry in executed filters array
 		key;		     // Search key for filters
+  cf_filter_pdf_handoff_t *handoff = NULL;
+				     // PDF handoff pdftopdf -> pdftoraster
   cf_logfunc_t log = data->logfunc;
   void          *ld = data->logdata;
   cf_filter_iscanceledfunc_t iscanceled = data->iscanceledfunc;
@@ -633,6 +704,17 @@ cfFilterChain(int inputfd,         // I - File descriptor input stream
     } else
       filterfds[1 - current][1] = outputfd;
 
+    //
+    // pdftopdf followed by pdftoraster: Hand over the PDF in shared
+    // memory, so that pdftoraster does not need to copy it from the pipe
+    // into a temporary file and parse it from there
+    //
+
+    if (next && !handoff &&
+	filter->function == cfFilterPDFToPDF &&
+	next->function == cfFilterPDFToRaster)
+      handoff = pdf_handoff_start(data);
+
     if ((pid = fork()) == 0) {
       //
       // Child process goes here...
@@ -676,6 +758,12 @@ cfFilterChain(int inputfd,         // I - File descriptor input stream
       pid_entry->pid = pid;
       pid_entry->name = filter->name ? filter->name : "Unspecified filter";
       cupsArrayAdd(pids, pid_entry);
+
+      if (handoff && filter->function == cfFilterPDFToRaster) {
+	// Both ends of the handoff are running now
+	pdf_handoff_finish(data, handoff);
+	handoff = NULL;
+      }
     } else {
       if (log) log(ld, CF_LOGLEVEL_ERROR,
 		   "cfFilterChain: Could not fork to start %s: %s",
@@ -687,6 +775,9 @@ cfFilterChain(int inputfd,         // I - File descriptor input stream
     inputseekable = 0;
   }
 
+  if (handoff)
+    pdf_handoff_finish(data, handoff);
+
   //
   // Close remaining pipes...
   //
@@ -79,6 +79,19 @@ typedef struct cf_filter_data_ext_s {
   void *ext;
 } cf_filter_data_ext_t;
 
+#  define CF_FILTER_DATA_EXT_PDF_HANDOFF "cf_pdf_handoff"
+
+typedef struct cf_filter_pdf_handoff_s { // Extension record set up by
+					 // cfFilterChain() between
+					 // cfFilterPDFToPDF() and
+					 // cfFilterPDFToRaster()
+  int fd;                    // Anonymous memory file (memfd) into which
+			     // pdftopdf writes its output PDF and seals it,
+			     // instead of sending it through the pipe.
+			     // pdftoraster maps it when nothing arrived
+			     // through the pipe.
+} cf_filter_pdf_handoff_t;
+
 typedef int (*cf_filter_function_t)(int inputfd, int outputfd,
 				    int inputseekable, cf_filter_data_t *data,
 				    void *parameters);
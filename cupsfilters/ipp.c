@@ -58,17 +58,30 @@ convert_to_port(char *a)
 
 static void
 log_printf(char *log,
+	   size_t logsize,
 	   const char *format, ...)
 {
   va_list arglist;
   va_start(arglist, format);
   vsnprintf(log + strlen(log),
-	    CF_GET_PRINTER_ATTRIBUTES_LOGSIZE - strlen(log) - 1,
+	    logsize - strlen(log) - 1,
 	    format, arglist);
-  log[CF_GET_PRINTER_ATTRIBUTES_LOGSIZE - 1] = '\0';
+  log[logsize - 1] = '\0';
   va_end(arglist);
 }
 
+static ipp_t *get_printer_attributes(http_t *http_printer,
+				     const char* raw_uri,
+				     const char* const pattrs[],
+				     int pattrs_size,
+				     const char* const req_attrs[],
+				     int req_attrs_size,
+				     int debug,
+				     int* driverless_info,
+				     int resolve_uri_type,
+				     char *log,
+				     size_t logsize);
+
 char *
 cfResolveURI(const char *raw_uri)
 {
@@ -206,6 +219,49 @@ cfGetPrinterAttributes5(http_t *http_printer,
 			int debug,
 			int* driverless_info,
 			int resolve_uri_type )
+{
+  return get_printer_attributes(http_printer, raw_uri, pattrs, pattrs_size,
+				req_attrs, req_attrs_size, debug,
+				driverless_info, resolve_uri_type,
+				cf_get_printer_attributes_log,
+				sizeof(cf_get_printer_attributes_log));
+}
+
+/* As cfGetPrinterAttributes3(), but log into the caller's buffer log of
+   logsize bytes instead of cf_get_printer_attributes_log, so that it can
+   be called from several threads at once. Note that resolving a
+   DNS-SD-service-name-based URI with cfResolveURI() redirects stderr, so
+   threads should only pass URIs which are already resolved */
+ipp_t *
+cfGetPrinterAttributes6(http_t *http_printer,
+			const char* raw_uri,
+			const char* const pattrs[],
+			int pattrs_size,
+			const char* const req_attrs[],
+			int req_attrs_size,
+			int debug,
+			int* driverless_info,
+			char *log,
+			size_t logsize)
+{
+  return get_printer_attributes(http_printer, raw_uri, pattrs, pattrs_size,
+				req_attrs, req_attrs_size, debug,
+				driverless_info, CUPS_BACKEND_URI_CONVERTER,
+				log, logsize);
+}
+
+static ipp_t *
+get_printer_attributes(http_t *http_printer,
+		       const char* raw_uri,
+		       const char* const pattrs[],
+		       int pattrs_size,
+		       const char* const req_attrs[],
+		       int req_attrs_size,
+		       int debug,
+		       int* driverless_info,
+		       int resolve_uri_type,
+		       char *log,
+		       size_t logsize)
 {
   char *uri;
   int have_http, uri_status, host_port, i = 0, total_attrs = 0, fallback,
@@ -260,17 +316,29 @@ cfGetPrinterAttributes5(http_t *http_printer,
       - Generate a PPD file for the printer
         (mainly driverless-capable printers with CUPS 2.x) */
 
-  cf_get_printer_attributes_log[0] = '\0';
+  log[0] = '\0';
 
-  /* Convert DNS-SD-service-name-based URIs to host-name-based URIs */
+  /* Convert DNS-SD-service-name-based URIs to host-name-based URIs,
+     cfResolveURI() is not needed (and not thread-safe) for other URIs */
   if(resolve_uri_type == CUPS_BACKEND_URI_CONVERTER)
-    uri = cfResolveURI(raw_uri);
+  {
+    if (httpSeparateURI(HTTP_URI_CODING_ALL, raw_uri,
+			scheme, sizeof(scheme),
+			userpass, sizeof(userpass),
+			host_name, sizeof(host_name),
+			&(host_port),
+			resource, sizeof(resource)) >= HTTP_URI_OK &&
+	strstr(host_name, "._tcp") == NULL)
+      uri = strdup(raw_uri);
+    else
+      uri = cfResolveURI(raw_uri);
+  }
   else
     uri = cfippfindBasedURIConverter(raw_uri, resolve_uri_type);
 
   if (uri == NULL)
   {
-    log_printf(cf_get_printer_attributes_log,
+    log_printf(log, logsize,
         "get-printer-attibutes: Cannot resolve URI: %s\n", raw_uri);
     return NULL;
   }
@@ -284,7 +352,7 @@ cfGetPrinterAttributes5(http_t *http_printer,
 			       resource, sizeof(resource));
   if (uri_status != HTTP_URI_OK) {
     /* Invalid URI */
-    log_printf(cf_get_printer_attributes_log,
+    log_printf(log, logsize,
 	       "get-printer-attributes: Cannot parse the printer URI: %s\n",
 	       uri);
     if (uri) free(uri);
@@ -302,7 +370,7 @@ cfGetPrinterAttributes5(http_t *http_printer,
     if ((http_printer =
 	 httpConnect2 (host_name, host_port, NULL, AF_UNSPEC, 
 		       encryption, 1, 3000, NULL)) == NULL) {
-      log_printf(cf_get_printer_attributes_log,
+      log_printf(log, logsize,
 		 "get-printer-attributes: Cannot connect to printer with URI %s.\n",
 		 uri);
       if (uri) free(uri);
@@ -348,25 +416,25 @@ cfGetPrinterAttributes5(http_t *http_printer,
     ipp_status = cupsLastError();
 
     if (response) {
-      log_printf(cf_get_printer_attributes_log,
+      log_printf(log, logsize,
 		 "Requested IPP attributes (get-printer-attributes) for printer with URI %s\n",
 		 uri);
       /* Log all printer attributes for debugging and count them */
       if (debug)
-	log_printf(cf_get_printer_attributes_log,
+	log_printf(log, logsize,
 		   "Full list of all IPP attributes:\n");
       attr = ippFirstAttribute(response);
       while (attr) {
 	total_attrs ++;
 	if (debug) {
 	  ippAttributeString(attr, valuebuffer, sizeof(valuebuffer));
-	  log_printf(cf_get_printer_attributes_log,
+	  log_printf(log, logsize,
 		     "  Attr: %s\n",ippGetName(attr));
-	  log_printf(cf_get_printer_attributes_log,
+	  log_printf(log, logsize,
 		     "  Value: %s\n", valuebuffer);
 	  for (i = 0; i < ippGetCount(attr); i ++) {
 	    if ((kw = ippGetString(attr, i, NULL)) != NULL) {
-	      log_printf(cf_get_printer_attributes_log, "  Keyword: %s\n", kw);
+	      log_printf(log, logsize, "  Keyword: %s\n", kw);
 	    }
 	  }
 	}
@@ -383,20 +451,20 @@ cfGetPrinterAttributes5(http_t *http_printer,
       if (ipp_status == IPP_STATUS_ERROR_BAD_REQUEST ||
 	  ipp_status == IPP_STATUS_ERROR_VERSION_NOT_SUPPORTED ||
 	  (req_attrs && i > 0) || (cap && total_attrs < 20)) {
-	log_printf(cf_get_printer_attributes_log,
+	log_printf(log, logsize,
 		   "get-printer-attributes IPP request failed:\n");
 	if (ipp_status == IPP_STATUS_ERROR_BAD_REQUEST)
-	  log_printf(cf_get_printer_attributes_log,
+	  log_printf(log, logsize,
 		     "  - ipp_status == IPP_STATUS_ERROR_BAD_REQUEST\n");
 	else if (ipp_status == IPP_STATUS_ERROR_VERSION_NOT_SUPPORTED)
-	  log_printf(cf_get_printer_attributes_log,
+	  log_printf(log, logsize,
 		     "  - ipp_status == IPP_STATUS_ERROR_VERSION_NOT_SUPPORTED\n");
 	if (req_attrs && i > 0)
-	  log_printf(cf_get_printer_attributes_log,
+	  log_printf(log, logsize,
 		     "  - Required IPP attribute %s not found\n",
 		     req_attrs[i - 1]);
 	if (cap && total_attrs < 20)
-	  log_printf(cf_get_printer_attributes_log,
+	  log_printf(log, logsize,
 		     "  - Too few IPP attributes: %d (30 or more expected)\n",
 		     total_attrs);
 	ippDelete(response);
@@ -407,24 +475,24 @@ cfGetPrinterAttributes5(http_t *http_printer,
 	return response;
       }
     } else {
-      log_printf(cf_get_printer_attributes_log,
+      log_printf(log, logsize,
 		 "Request for IPP attributes (get-printer-attributes) for printer with URI %s failed: %s\n",
 		 uri, cupsLastErrorString());
-      log_printf(cf_get_printer_attributes_log, "get-printer-attributes IPP request failed:\n");
-      log_printf(cf_get_printer_attributes_log, "  - No response\n");
+      log_printf(log, logsize, "get-printer-attributes IPP request failed:\n");
+      log_printf(log, logsize, "  - No response\n");
     }
     if (fallback == 1 + cap) {
-      log_printf(cf_get_printer_attributes_log,
+      log_printf(log, logsize,
 		 "No further fallback available, giving up\n");
       if (driverless_info != NULL)
         *driverless_info = CF_DRVLESS_CHECKERR;
     } else if (cap && fallback == 1) {
-      log_printf(cf_get_printer_attributes_log,
+      log_printf(log, logsize,
 		 "The server doesn't support the standard IPP request, trying request without media-col\n");
       if (driverless_info != NULL)
         *driverless_info = CF_DRVLESS_INCOMPLETEIPP;
     } else if (fallback == 0) {
-      log_printf(cf_get_printer_attributes_log,
+      log_printf(log, logsize,
 		 "The server doesn't support IPP2.0 request, trying IPP1.1 request\n");
       if (driverless_info != NULL)
         *driverless_info = CF_DRVLESS_IPP11;
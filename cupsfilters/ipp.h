@@ -124,6 +124,16 @@ ipp_t   *cfGetPrinterAttributes5(http_t *http_printer,
 				 int debug,
 				 int* driverless_support,
 				 int resolve_uri_type);
+ipp_t   *cfGetPrinterAttributes6(http_t *http_printer,
+				 const char* raw_uri,
+				 const char* const pattrs[],
+				 int pattrs_size,
+				 const char* const req_attrs[],
+				 int req_attrs_size,
+				 int debug,
+				 int* driverless_support,
+				 char *log,
+				 size_t logsize);
 
 const char* cfIPPAttrEnumValForPrinter(ipp_t *printer_attrs,
 				       ipp_t *job_attrs,
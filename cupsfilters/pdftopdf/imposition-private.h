@@ -0,0 +1,85 @@
+#ifndef _CUPS_FILTERS_PDFTOPDF_IMPOSITION_H_
+#define _CUPS_FILTERS_PDFTOPDF_IMPOSITION_H_
+
+#include "pdftopdf-processor-private.h"
+#include "nup-private.h"
+#include <vector>
+
+// One input page placed onto an output sheet
+struct _cfPDFToPDFImpositionSlot
+{
+  int page;                    // index into the list of input pages,
+                               // -1 for a blank filler (booklet)
+  _cfPDFToPDFPageRect rect;    // rectangle of the input page (for borders)
+  _cfPDFToPDFPageRect label;   // output page rectangle (for page labels)
+  _cfPDFToPDFNupPageEdit edit; // N-up cell, as from _cfPDFToPDFNupState
+  float xpos, ypos, scale;     // placement, as passed to add_subpage()
+
+  void dump(pdftopdf_doc_t *doc) const;
+};
+
+// One output sheet (i.e. one side of the paper)
+struct _cfPDFToPDFImpositionSheet
+{
+  int outputpage;              // 1-based, as counted for page-ranges and
+                               // page-set
+  bool selected;               // false: dropped by page-ranges/page-set
+  float width, height;
+  int first_slot, num_slots;   // range in _cfPDFToPDFImpositionPlan::slots
+};
+
+//
+//  The imposition plan is computed once, before any page gets touched, for
+//  the complete combination of booklet (with signatures), number-up,
+//  page-ranges/page-set, reverse, even-duplex and copies. Afterwards each
+//  sheet and each of its pages is simply looked up by index:
+//
+//  _cfPDFToPDFImpositionPlan plan;
+//  plan.compute(rects, shuffle, param, xpos, ypos);
+//  for (int iS = 0; iS < plan.num_sheets(); iS ++)
+//    for (int iP = 0; iP < plan.sheet(iS).num_slots; iP ++)
+//      place(plan.slot(iS, iP));
+//
+
+class _cfPDFToPDFImpositionPlan
+{
+ public:
+  _cfPDFToPDFImpositionPlan();
+
+  // rects: rectangles of the input pages (after cropping),
+  // shuffle: order in which the input pages are placed (booklet), entries
+  //          >= rects.size() are blank fillers,
+  // xpos, ypos: offset of the printable area on the sheet
+  void compute(const std::vector<_cfPDFToPDFPageRect> &rects,
+	       const std::vector<int> &shuffle,
+	       const _cfPDFToPDFProcessingParameters &param,
+	       double xpos, double ypos);
+
+  int num_sheets() const { return (sheets.size()); }
+  const _cfPDFToPDFImpositionSheet &sheet(int sheet_no) const
+    { return (sheets[sheet_no]); }
+  const _cfPDFToPDFImpositionSlot &slot(int sheet_no, int slot_no) const
+    { return (slots[sheets[sheet_no].first_slot + slot_no]); }
+
+  int num_slots() const { return (slots.size()); }
+
+  int num_output_pages() const { return (num_selected); }
+
+  void dump(pdftopdf_doc_t *doc) const;
+
+  // --- applied when adding the sheets ---
+  bool reverse;      // sheets are inserted in front of the previous ones
+  int copies;
+  bool collate;
+
+  // blank sheet to be appended for duplex (even-duplex, page-set=even)
+  bool blank_at_end;
+  float blank_width, blank_height;
+
+ private:
+  std::vector<_cfPDFToPDFImpositionSheet> sheets;
+  std::vector<_cfPDFToPDFImpositionSlot> slots;
+  int num_selected;
+};
+
+#endif // !_CUPS_FILTERS_PDFTOPDF_IMPOSITION_H_
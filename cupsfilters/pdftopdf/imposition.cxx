@@ -0,0 +1,178 @@
+#include "imposition-private.h"
+#include <stdio.h>
+#include "cupsfilters/debug-internal.h"
+#include <algorithm>
+
+void
+_cfPDFToPDFImpositionSlot::dump(pdftopdf_doc_t *doc) const // {{{
+{
+  if (page < 0)
+  {
+    if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_DEBUG,
+				   "cfFilterPDFToPDF:   (blank)");
+    return;
+  }
+  if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_DEBUG,
+				 "cfFilterPDFToPDF:   page %d: xpos: %f, "
+				 "ypos: %f, scale: %f",
+				 page + 1, xpos, ypos, scale);
+}
+// }}}
+
+_cfPDFToPDFImpositionPlan::_cfPDFToPDFImpositionPlan() // {{{
+  : reverse(false),
+    copies(1),
+    collate(false),
+    blank_at_end(false),
+    blank_width(0),
+    blank_height(0),
+    num_selected(0)
+{
+}
+// }}}
+
+// rectangle of a page created by _cfPDFToPDFProcessor::new_page()
+static _cfPDFToPDFPageRect
+blank_rect(float width,
+	   float height) // {{{
+{
+  _cfPDFToPDFPageRect ret;
+  ret.left = 0;
+  ret.bottom = 0;
+  ret.right = ret.width = width;
+  ret.top = ret.height = height;
+  return (ret);
+}
+// }}}
+
+void
+_cfPDFToPDFImpositionPlan::compute
+    (const std::vector<_cfPDFToPDFPageRect> &rects,
+     const std::vector<int> &shuffle,
+     const _cfPDFToPDFProcessingParameters &param,
+     double xpos,
+     double ypos) // {{{
+{
+  const int numOrigPages = rects.size();
+  const int numPages = std::max(shuffle.size(), rects.size());
+  const int nup = std::max(param.nup.nupX * param.nup.nupY, 1);
+
+  sheets.clear();
+  slots.clear();
+  sheets.reserve((numPages + nup - 1) / nup);
+  slots.reserve(numPages);
+
+  reverse = param.reverse;
+  copies = param.num_copies;
+  collate = param.collate;
+  num_selected = 0;
+
+  // Without a requested page size each sheet takes the size of its first
+  // input page
+  _cfPDFToPDFPageRect page = param.page;
+
+  _cfPDFToPDFNupState nupstate(param.nup);
+  _cfPDFToPDFNupPageEdit pgedit;
+  for (int iA = 0; iA < numPages; iA ++)
+  {
+    _cfPDFToPDFImpositionSlot slot;
+    if (shuffle[iA] < numOrigPages)
+    {
+      slot.page = shuffle[iA];
+      slot.rect = rects[slot.page];
+    }
+    else
+    {
+      // empty page as filler
+      slot.page = -1;
+      slot.rect = blank_rect(page.width, page.height);
+    }
+
+    if (!param.pagesize_requested)
+    {
+      page.width = page.right = slot.rect.width;
+      page.height = page.top = slot.rect.height;
+    }
+
+    if (nupstate.mext_page(slot.rect.width, slot.rect.height, pgedit))
+    {
+      _cfPDFToPDFImpositionSheet sheet;
+      sheet.outputpage = sheets.size() + 1;
+      sheet.selected = param.with_page(sheet.outputpage);
+      sheet.width = page.width;
+      sheet.height = page.height;
+      sheet.first_slot = slots.size();
+      sheet.num_slots = 0;
+      sheets.push_back(sheet);
+      if (sheet.selected)
+	num_selected ++;
+    }
+
+    slot.edit = pgedit;
+    slot.label = page;
+
+    if (param.cropfit && (param.nup.nupX == 1) && (param.nup.nupY == 1))
+    {
+      slot.scale = 1;
+      if ((page.height - page.width) *
+	  (slot.rect.height - slot.rect.width) < 0)
+      {
+	double xpos2 = (page.width - slot.rect.height) / 2,
+	       ypos2 = (page.height - slot.rect.width) / 2;
+	slot.xpos = ypos2 + xpos;
+	slot.ypos = xpos2 + ypos;
+      }
+      else
+      {
+	double xpos2 = (page.width - slot.rect.width) / 2,
+	       ypos2 = (page.height - slot.rect.height) / 2;
+	slot.xpos = xpos2 + xpos;
+	slot.ypos = ypos2 + ypos;
+      }
+    }
+    else
+    {
+      slot.xpos = pgedit.xpos + xpos;
+      slot.ypos = pgedit.ypos + ypos;
+      slot.scale = pgedit.scale;
+    }
+
+    slots.push_back(slot);
+    sheets.back().num_slots ++;
+  }
+
+  // need to output empty page to not confuse duplex
+  blank_at_end = ((param.even_duplex || !param.odd_pages) &&
+		  (num_selected & 1));
+  blank_width = page.width;
+  blank_height = page.height;
+}
+// }}}
+
+void
+_cfPDFToPDFImpositionPlan::dump(pdftopdf_doc_t *doc) const // {{{
+{
+  if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_DEBUG,
+				 "cfFilterPDFToPDF: Imposition plan: %d sheets "
+				 "(%d selected), reverse: %s, copies: %d, "
+				 "collate: %s, blank sheet at end: %s",
+				 (int)sheets.size(), num_selected,
+				 (reverse) ? "true" : "false", copies,
+				 (collate) ? "true" : "false",
+				 (blank_at_end) ? "true" : "false");
+
+  const int len = sheets.size();
+  for (int iS = 0; iS < len; iS ++)
+  {
+    const _cfPDFToPDFImpositionSheet &sh = sheets[iS];
+    if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_DEBUG,
+				   "cfFilterPDFToPDF: Sheet %d%s: "
+				   "width: %f, height: %f",
+				   sh.outputpage,
+				   (sh.selected) ? "" : " (not selected)",
+				   sh.width, sh.height);
+    for (int iP = 0; iP < sh.num_slots; iP ++)
+      slot(iS, iP).dump(doc);
+  }
+}
+// }}}
@@ -123,6 +123,27 @@ _cfPDFToPDFProcessingParameters()
   void dump(pdftopdf_doc_t *doc) const;
 };
 
+// Content which goes around the content of an input page (border, page
+// label). Filling it in only formats strings and does not touch the PDF,
+// so it can be done on any thread.
+struct _cfPDFToPDFPageDecoration
+{
+  _cfPDFToPDFPageDecoration() : label_font(-1) {}
+
+  // rect: in page space, see _cfPDFToPDFPageHandle::page_space_rect()
+  void add_border(const _cfPDFToPDFPageRect &rect,
+		  pdftopdf_border_type_e border, float fscale);
+  void add_label(const _cfPDFToPDFPageRect &rect, const std::string &label);
+
+  bool empty() const { return (streams.empty()); }
+
+  // One content stream each, in the order add_border_rect() and
+  // add_label() add them; second: before (true) or after the page content
+  std::vector<std::pair<std::string, bool>> streams;
+  int label_font; // index in streams before which the page label font
+                  // gets added, -1: not needed
+};
+
 enum pdftopdf_arg_ownership_e {
   CF_PDFTOPDF_WILL_STAY_ALIVE,
   CF_PDFTOPDF_MUST_DUPLICATE,
@@ -162,6 +183,14 @@ class _cfPDFToPDFPageHandle {
 
   virtual void add_label(const _cfPDFToPDFPageRect &rect,
 			 const std::string label) = 0;
+
+  // add_border_rect() and add_label() in steps, to render the decorations
+  // of many pages in parallel: page_space_rect() and add_decoration() access
+  // the PDF and so must only be called from the main thread
+  virtual _cfPDFToPDFPageRect
+    page_space_rect(const _cfPDFToPDFPageRect &rect) = 0;
+
+  virtual void add_decoration(const _cfPDFToPDFPageDecoration &deco) = 0;
 };
 
 // TODO: ... error output?
@@ -199,6 +228,13 @@ class _cfPDFToPDFProcessor { // abstract interface
 
   virtual void multiply(int copies, bool collate) = 0;
 
+  // used[i] tells whether input page i+1 ends up on an output page;
+  // the other pages are pruned from the document and document-wide passes
+  // (form flattening, auto-rotation, color management) are only done for
+  // the used ones
+  virtual void select_pages(const std::vector<bool> &used,
+			    pdftopdf_doc_t *doc) = 0;
+
   virtual void auto_rotate_all(bool dst_lscape,
 			       pdftopdf_rotation_e normal_landscape) = 0;
                                                // TODO elsewhere?!
@@ -1,8 +1,12 @@
 #include "pdftopdf-processor-private.h"
 #include "qpdf-pdftopdf-processor-private.h"
+#include "imposition-private.h"
 #include <stdio.h>
 #include "cupsfilters/debug-internal.h"
 #include <numeric>
+#include <thread>
+#include <system_error>
+#include <algorithm>
 
 void
 BookletMode_dump(pdftopdf_booklet_mode_e bkm,
@@ -187,6 +191,99 @@ _cfPDFToPDFBookletShuffle(int numPages,
 }
 // }}}
 
+// Borders and page labels of all pages on the selected sheets. The page
+// geometry is read from the PDF on the main thread, the content streams
+// get formatted by a pool of worker threads, and the results only get
+// attached to the pages (again on the main thread) when placing them.
+static void
+render_decorations(const _cfPDFToPDFImpositionPlan &plan,
+		   const std::vector<std::shared_ptr<_cfPDFToPDFPageHandle>>
+		     &pages,
+		   const _cfPDFToPDFProcessingParameters &param,
+		   std::vector<_cfPDFToPDFPageDecoration> &ret) // {{{
+{
+  struct job_t
+  {
+    int slot;
+    _cfPDFToPDFPageRect border, label;
+    float fscale;
+  };
+  std::vector<job_t> jobs;
+  const bool with_border = (param.border != pdftopdf_border_type_e::NONE),
+             with_label = !param.page_label.empty();
+
+  ret.assign(plan.num_slots(), _cfPDFToPDFPageDecoration());
+  if (!with_border && !with_label)
+    return;
+
+  jobs.reserve(plan.num_slots());
+  for (int iS = 0; iS < plan.num_sheets(); iS ++)
+  {
+    const _cfPDFToPDFImpositionSheet &sheet = plan.sheet(iS);
+    if (!sheet.selected)
+      continue;
+    for (int iP = 0; iP < sheet.num_slots; iP ++)
+    {
+      const _cfPDFToPDFImpositionSlot &slot = plan.slot(iS, iP);
+      if (slot.page < 0)
+	continue;
+
+      job_t job;
+      job.slot = sheet.first_slot + iP;
+      job.fscale = 1.0 / slot.edit.scale;
+      if (with_border)
+	job.border = pages[slot.page]->page_space_rect(slot.rect);
+      if (with_label)
+	job.label = pages[slot.page]->page_space_rect(slot.label);
+      jobs.push_back(job);
+    }
+  }
+
+  auto render = [&](size_t from, size_t to)
+  {
+    for (size_t iA = from; iA < to; iA ++)
+    {
+      _cfPDFToPDFPageDecoration &deco = ret[jobs[iA].slot];
+      if (with_border)
+	deco.add_border(jobs[iA].border, param.border, jobs[iA].fscale);
+      if (with_label)
+	deco.add_label(jobs[iA].label, param.page_label);
+    }
+  };
+
+  // Threads only pay off for larger documents
+  const size_t len = jobs.size();
+  size_t nthreads = std::min(std::thread::hardware_concurrency(), 8u);
+  if ((len < 64) || (nthreads < 2))
+  {
+    render(0, len);
+    return;
+  }
+
+  const size_t chunk = (len + nthreads - 1) / nthreads;
+  std::vector<std::thread> workers;
+  size_t rest = len; // jobs from here on have no worker
+  for (size_t iT = 1; iT < nthreads; iT ++)
+  {
+    try
+    {
+      workers.emplace_back(render, std::min(iT * chunk, len),
+			   std::min((iT + 1) * chunk, len));
+    }
+    catch (const std::system_error &)
+    {
+      // Out of threads, do the rest here
+      rest = std::min(iT * chunk, len);
+      break;
+    }
+  }
+  render(0, std::min(chunk, len));
+  render(rest, len);
+  for (auto &worker : workers)
+    worker.join();
+}
+// }}}
+
 bool
 _cfProcessPDFToPDF(_cfPDFToPDFProcessor &proc,
 		   _cfPDFToPDFProcessingParameters &param,
@@ -215,17 +312,18 @@ _cfProcessPDFToPDF(_cfPDFToPDFProcessor &proc,
   if (param.paper_is_landscape)
     std::swap(param.nup.nupX, param.nup.nupY);
 
-  if (param.auto_rotate)
-    proc.auto_rotate_all(dst_lscape, param.normal_landscape);
-
   std::vector<std::shared_ptr<_cfPDFToPDFPageHandle>> pages =
     proc.get_pages(doc);
   
   std::vector<std::shared_ptr<_cfPDFToPDFPageHandle>> input_page_range_list;
+  std::vector<int> input_page_range_nos; // 0-based index into pages
    
   for (int i = 1; i <= (int)pages.size(); i ++)
     if (param.have_page(i))
+    {
       input_page_range_list.push_back(pages[i - 1]);
+      input_page_range_nos.push_back(i - 1);
+    }
 
   const int numOrigPages = input_page_range_list.size(); 
 
@@ -250,6 +348,22 @@ _cfProcessPDFToPDF(_cfPDFToPDFProcessor &proc,
   }
   const int numPages=std::max(shuffle.size(), input_page_range_list.size());
 
+  // Find out which input pages really land on a selected output page.
+  // All others get pruned from the document before anything else is done,
+  // so that form flattening, auto-rotation, ... skip them and they do not
+  // end up in the output file.
+  std::vector<bool> used(pages.size(), false);
+  {
+    const int nup = std::max(param.nup.nupX * param.nup.nupY, 1);
+    for (int iA = 0; iA < numPages; iA ++)
+      if ((shuffle[iA] < numOrigPages) && param.with_page(iA / nup + 1))
+	used[input_page_range_nos[shuffle[iA]]] = true;
+  }
+  proc.select_pages(used, doc);
+
+  if (param.auto_rotate)
+    proc.auto_rotate_all(dst_lscape, param.normal_landscape);
+
   if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_DEBUG,
 				 "cfFilterPDFToPDF: \"print-scaling\" IPP attribute: %s",
 				 (param.autoprint ? "auto" :
@@ -336,6 +450,8 @@ _cfProcessPDFToPDF(_cfPDFToPDFProcessor &proc,
   {
     for (int i = 0; i < (int)input_page_range_list.size(); i ++)
     {
+      if (!used[input_page_range_nos[i]])
+	continue;
       std::shared_ptr<_cfPDFToPDFPageHandle> page = input_page_range_list[i];
       pdftopdf_rotation_e orientation;
       if (page->is_landscape(param.orientation))
@@ -350,10 +466,6 @@ _cfProcessPDFToPDF(_cfPDFToPDFProcessor &proc,
       param.fitplot = true;
   }
 
-  std::shared_ptr<_cfPDFToPDFPageHandle> curpage;
-  int outputpage = 0;
-  int outputno = 0;
-
   if ((param.nup.nupX == 1) && (param.nup.nupY == 1) && !param.fitplot)
   {
     param.nup.width = param.page.width;
@@ -395,100 +507,64 @@ _cfProcessPDFToPDF(_cfPDFToPDFProcessor &proc,
     }
   }
 
-  _cfPDFToPDFNupState nupstate(param.nup);
-  _cfPDFToPDFNupPageEdit pgedit;
-  for (int iA = 0; iA < numPages; iA ++)
+  // Work out the placement of all pages on all sheets up front
+  std::vector<_cfPDFToPDFPageRect> rects;
+  rects.reserve(numOrigPages);
+  for (int i = 0; i < numOrigPages; i ++)
+    rects.push_back(input_page_range_list[i]->get_rect());
+
+  _cfPDFToPDFImpositionPlan plan;
+  plan.compute(rects, shuffle, param, xpos, ypos);
+#ifdef DEBUG
+  plan.dump(doc);
+#endif
+
+  std::vector<_cfPDFToPDFPageDecoration> decorations;
+  render_decorations(plan, input_page_range_list, param, decorations);
+
+  int outputno = 0;
+  for (int iS = 0; iS < plan.num_sheets(); iS ++)
   {
-    std::shared_ptr<_cfPDFToPDFPageHandle> page;
-    if (shuffle[iA] >= numOrigPages)
-      // add empty page as filler
-      page = proc.new_page(param.page.width, param.page.height, doc);
-    else
-      page = input_page_range_list[shuffle[iA]];
+    const _cfPDFToPDFImpositionSheet &sheet = plan.sheet(iS);
+    if (!sheet.selected)
+      // Sheet not selected by page-ranges/page-set, do not place anything
+      // on it
+      continue;
 
-    _cfPDFToPDFPageRect rect;
-    rect = page->get_rect();
-    //rect.dump(doc);
-    if (!param.pagesize_requested)
-    {
-      param.page.width = param.page.right = rect.width;
-      param.page.height = param.page.top = rect.height;
-    }
+    std::shared_ptr<_cfPDFToPDFPageHandle> curpage =
+      proc.new_page(sheet.width, sheet.height, doc);
 
-    bool newPage = nupstate.mext_page(rect.width, rect.height, pgedit);
-    if (newPage)
+    for (int iP = 0; iP < sheet.num_slots; iP ++)
     {
-      if ((curpage) && (param.with_page(outputpage)))
-      {
-	curpage->rotate(param.orientation);
-	if (param.mirror)
-	  curpage->mirror();
-	  // TODO? update rect? --- not needed any more
-	proc.add_page(curpage, param.reverse); // reverse -> insert at beginning
-	// Log page in /var/log/cups/page_log
-	outputno ++;
-	if (param.page_logging == 1)
-	  if (doc->logfunc) doc->logfunc(doc->logdata,
-					 CF_LOGLEVEL_CONTROL,
-					 "PAGE: %d %d", outputno,
-					 param.copies_to_be_logged);
-      }
-      curpage = proc.new_page(param.page.width, param.page.height, doc);
-      outputpage++;
-    }
+      const _cfPDFToPDFImpositionSlot &slot = plan.slot(iS, iP);
+      if (slot.page < 0)
+	continue; // blank filler
 
-    if (shuffle[iA] >= numOrigPages)
-      continue;
+      std::shared_ptr<_cfPDFToPDFPageHandle> page =
+	input_page_range_list[slot.page];
 
-    if (param.border != pdftopdf_border_type_e::NONE)
-      // TODO FIXME... border gets cutted away, if orignal page had wrong size
+      // Border and page label
+      // TODO FIXME... border gets cutted away, if orignal page had wrong
+      // size
       // page->"uncrop"(rect);  // page->setMedia()
       // Note: currently "fixed" in add_subpage(...&rect);
-      page->add_border_rect(rect, param.border, 1.0 / pgedit.scale);
+      const _cfPDFToPDFPageDecoration &deco =
+	decorations[sheet.first_slot + iP];
+      if (!deco.empty())
+	page->add_decoration(deco);
 
-    if (!param.page_label.empty())
-      page->add_label(param.page, param.page_label);
-
-    if (param.cropfit)
-    {
-      if ((param.nup.nupX == 1) && (param.nup.nupY == 1))
-      {
-	double xpos2, ypos2;
-	if ((param.page.height - param.page.width) *
-	    (page->get_rect().height - page->get_rect().width) < 0)
-	{
-	  xpos2 = (param.page.width - (page->get_rect().height)) / 2;
-	  ypos2 = (param.page.height - (page->get_rect().width)) / 2;
-	  curpage->add_subpage(page, ypos2 + xpos, xpos2 + ypos, 1);
-	}
-	else
-	{
-	  xpos2 = (param.page.width - (page->get_rect().width)) / 2;
-	  ypos2 = (param.page.height - (page->get_rect().height)) / 2;
-	  curpage->add_subpage(page, xpos2 + xpos, ypos2 + ypos, 1);
-	}
-      }
-      else
-	curpage->add_subpage(page, pgedit.xpos + xpos, pgedit.ypos + ypos,
-			     pgedit.scale);
-    }
-    else
-      curpage->add_subpage(page, pgedit.xpos + xpos, pgedit.ypos + ypos,
-			   pgedit.scale);
+      curpage->add_subpage(page, slot.xpos, slot.ypos, slot.scale);
 
 #ifdef DEBUG
-    if (auto dbg=dynamic_cast<_cfPDFToPDFQPDFPageHandle *>(curpage.get()))
-      dbg->debug(pgedit.sub, xpos, ypos);
+      if (auto dbg=dynamic_cast<_cfPDFToPDFQPDFPageHandle *>(curpage.get()))
+	dbg->debug(slot.edit.sub, xpos, ypos);
 #endif
+    }
 
-    //pgedit.dump(doc);
-  }
-  if ((curpage) && (param.with_page(outputpage)))
-  {
     curpage->rotate(param.orientation);
     if (param.mirror)
       curpage->mirror();
-    proc.add_page(curpage, param.reverse); // reverse -> insert at beginning
+    proc.add_page(curpage, plan.reverse); // reverse -> insert at beginning
     // Log page in /var/log/cups/page_log
     outputno ++;
     if (param.page_logging == 1)
@@ -497,10 +573,11 @@ _cfProcessPDFToPDF(_cfPDFToPDFProcessor &proc,
 				     param.copies_to_be_logged);
   }
 
-  if ((param.even_duplex || !param.odd_pages) && (outputno & 1)) {
+  if (plan.blank_at_end)
+  {
     // need to output empty page to not confuse duplex
-    proc.add_page(proc.new_page(param.page.width,
-				param.page.height, doc), param.reverse);
+    proc.add_page(proc.new_page(plan.blank_width,
+				plan.blank_height, doc), plan.reverse);
     // Log page in /var/log/cups/page_log
     if (param.page_logging == 1)
       if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_CONTROL,
@@ -508,7 +585,7 @@ _cfProcessPDFToPDF(_cfPDFToPDFProcessor &proc,
 				     param.copies_to_be_logged);
   }
 
-  proc.multiply(param.num_copies, param.collate);
+  proc.multiply(plan.copies, plan.collate);
 
   return (true);
 }
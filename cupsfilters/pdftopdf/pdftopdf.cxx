@@ -835,6 +835,55 @@ copy_fd_to_temp(int infd,
 }
 // }}}
 
+// If cfFilterChain() has set up a shared memory handoff to the next
+// filter (pdftoraster), write the PDF into it and seal it, so that
+// nothing needs to go through the pipe. Returns false if there is no
+// handoff or it could not be used.
+static bool
+emit_to_handoff(_cfPDFToPDFProcessor &proc,
+		cf_filter_data_t *data,
+		pdftopdf_doc_t *doc) // {{{
+{
+  cf_filter_pdf_handoff_t *handoff =
+    (cf_filter_pdf_handoff_t *)cfFilterDataGetExt(data,
+					CF_FILTER_DATA_EXT_PDF_HANDOFF);
+  FILE *fp;
+  int fd;
+
+  if (!handoff || handoff->fd < 0)
+    return (false);
+
+  if ((fd = dup(handoff->fd)) < 0 ||
+      (fp = fdopen(fd, "w")) == NULL)
+  {
+    if (fd >= 0)
+      close(fd);
+    return (false);
+  }
+
+  proc.emit_file(fp, doc, CF_PDFTOPDF_WILL_STAY_ALIVE);
+  if (fclose(fp) != 0)
+  {
+    // Do not leave a partial PDF behind, pdftoraster falls back to the
+    // pipe when the memory file is empty
+    if (ftruncate(handoff->fd, 0) < 0 && doc->logfunc)
+      doc->logfunc(doc->logdata, CF_LOGLEVEL_ERROR,
+		   "cfFilterPDFToPDF: Could not reset shared memory handoff");
+    return (false);
+  }
+
+#ifdef F_ADD_SEALS
+  // Mark the PDF as complete, pdftoraster only maps sealed files
+  fcntl(handoff->fd, F_ADD_SEALS,
+	F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif // F_ADD_SEALS
+
+  if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_DEBUG,
+				 "cfFilterPDFToPDF: Passed output PDF to next filter in shared memory");
+  return (true);
+}
+// }}}
+
 // check whether a given file is empty
 bool is_empty(FILE *f) // {{{
 {
@@ -982,7 +1031,8 @@ cfFilterPDFToPDF(int inputfd,            // I - File descriptor input stream
     if (!streaming)
     {
       // Pass on the processed input data
-      proc->emit_file(outputfp, &doc, CF_PDFTOPDF_WILL_STAY_ALIVE);
+      if (!emit_to_handoff(*proc, data, &doc))
+	proc->emit_file(outputfp, &doc, CF_PDFTOPDF_WILL_STAY_ALIVE);
       // proc->emit_filename(NULL);
     }
     else
@@ -2,11 +2,14 @@
 #define _CUPS_FILTERS_PDFTOPDF_QPDF_CM_H_
 
 #include <qpdf/QPDF.hh>
+#include <vector>
 
 bool _cfPDFToPDFHasOutputIntent(QPDF &pdf);
 void _cfPDFToPDFAddOutputIntent(QPDF &pdf, const char *filename);
 
 void _cfPDFToPDFAddDefaultRGB(QPDF &pdf, QPDFObjectHandle srcicc);
+void _cfPDFToPDFAddDefaultRGB(std::vector<QPDFObjectHandle> pages,
+			      QPDFObjectHandle srcicc);
 QPDFObjectHandle _cfPDFToPDFSetDefaultICC(QPDF &pdf, const char *filename);
 
 #endif // !_CUPS_FILTERS_PDFTOPDF_QPDF_CM_H_
@@ -111,10 +111,18 @@ _cfPDFToPDFAddOutputIntent(QPDF &pdf,
 // TODO? test
 void
 _cfPDFToPDFAddDefaultRGB(QPDF &pdf, QPDFObjectHandle srcicc) // {{{
+{
+  _cfPDFToPDFAddDefaultRGB(pdf.getAllPages(), srcicc);
+}
+// }}}
+
+// only for the given pages, e.g. those selected by page-ranges
+void
+_cfPDFToPDFAddDefaultRGB(std::vector<QPDFObjectHandle> pages,
+			 QPDFObjectHandle srcicc) // {{{
 {
   srcicc.assertStream();
 
-  auto pages = pdf.getAllPages();
   for (auto it = pages.begin(), end = pages.end(); it != end; ++ it)
   {
     if (!it->hasKey("/Resources"))
@@ -16,6 +16,8 @@ class _cfPDFToPDFQPDFPageHandle : public _cfPDFToPDFPageHandle {
   virtual void rotate(pdftopdf_rotation_e rot);
   virtual void add_label(const _cfPDFToPDFPageRect &rect,
 			 const std::string label);
+  virtual _cfPDFToPDFPageRect page_space_rect(const _cfPDFToPDFPageRect &rect);
+  virtual void add_decoration(const _cfPDFToPDFPageDecoration &deco);
   virtual pdftopdf_rotation_e crop(const _cfPDFToPDFPageRect &cropRect,
 				   pdftopdf_rotation_e orientation,
 				   pdftopdf_rotation_e param_orientation,
@@ -68,6 +70,9 @@ class _cfPDFToPDFQPDFProcessor : public _cfPDFToPDFProcessor {
 
   virtual void multiply(int copies, bool collate);
 
+  virtual void select_pages(const std::vector<bool> &used,
+			    pdftopdf_doc_t *doc);
+
   virtual void auto_rotate_all(bool dst_lscape,
 			       pdftopdf_rotation_e normal_landscape);
   virtual void add_cm(const char *defaulticc, const char *outputicc);
@@ -83,9 +88,14 @@ class _cfPDFToPDFQPDFProcessor : public _cfPDFToPDFProcessor {
  private:
   void close_file();
   void start(int flatten_forms);
+  bool is_used(int iA) const;
+  void flatten_used_pages(pdftopdf_doc_t *doc);
+  void prune_unused_pages(pdftopdf_doc_t *doc);
  private:
   std::unique_ptr<QPDF> pdf;
   std::vector<QPDFObjectHandle> orig_pages;
+  std::vector<bool> used_pages; // empty: all pages
+  bool flatten_pending;
 
   bool hasCM;
   std::string extraheader;
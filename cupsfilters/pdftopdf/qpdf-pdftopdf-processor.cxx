@@ -2,6 +2,7 @@
 #include <stdarg.h>
 #include "cupsfilters/debug-internal.h"
 #include <stdexcept>
+#include <set>
 #include <qpdf/QPDFWriter.hh>
 #include <qpdf/QUtil.hh>
 #include <qpdf/QPDFPageDocumentHelper.hh>
@@ -37,6 +38,131 @@ debug_box(const _cfPDFToPDFPageRect &box,
 }
 // }}}
 
+// Only formats the content stream snippets, does not touch the PDF, so
+// that it can run on any thread
+void
+_cfPDFToPDFPageDecoration::add_border(const _cfPDFToPDFPageRect &rect,
+				      pdftopdf_border_type_e border,
+				      float fscale) // {{{
+{
+  DEBUG_assert(border != pdftopdf_border_type_e::NONE);
+
+  // straight from pstops
+  const double lw = (border & THICK) ? 0.5 : 0.24;
+  double line_width = lw * fscale;
+  double margin = 2.25 * fscale;
+  // (PageLeft + margin, PageBottom + margin)
+  //   rect (PageRight - PageLeft - 2 * margin, ...)   ...
+  //   for nup > 1: PageLeft = 0, etc.
+  // if (double) margin += 2 * fscale ...rect...
+
+  DEBUG_assert(rect.left <= rect.right);
+  DEBUG_assert(rect.bottom <= rect.top);
+
+  std::string boxcmd="q\n";
+  boxcmd += "  " +QUtil::double_to_string(line_width) + " w 0 G \n";
+  boxcmd += "  " +QUtil::double_to_string(rect.left + margin) + " " +
+    QUtil::double_to_string(rect.bottom + margin) + "  " +
+    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
+    QUtil::double_to_string(rect.top - rect.bottom - 2 * margin) + " re S \n";
+  if (border & TWO)
+  {
+    margin += 2 * fscale;
+    boxcmd += "  " + QUtil::double_to_string(rect.left + margin) + " " +
+      QUtil::double_to_string(rect.bottom + margin) + "  " +
+      QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
+      QUtil::double_to_string(rect.top - rect.bottom - 2 * margin) + " re S \n";
+  }
+  boxcmd += "Q\n";
+
+#ifdef DEBUG  // draw it on top
+  static const char *pre = "%pdftopdf q\n"
+    "q\n",
+    *post = "%pdftopdf Q\n"
+    "Q\n";
+
+  streams.push_back(std::make_pair(std::string(pre), true));
+  streams.push_back(std::make_pair(std::string(post) + boxcmd, false));
+#else
+  streams.push_back(std::make_pair(boxcmd, true));
+#endif
+}
+// }}}
+
+void
+_cfPDFToPDFPageDecoration::add_label(const _cfPDFToPDFPageRect &rect,
+				     const std::string &label) // {{{
+{
+  DEBUG_assert(rect.left <= rect.right);
+  DEBUG_assert(rect.bottom <= rect.top);
+
+  double margin = 2.25;
+  double height = 12;
+
+  std::string boxcmd = "q\n";
+
+  // White filled rectangle (top)
+  boxcmd += "  1 1 1 rg\n";
+  boxcmd += "  " +
+    QUtil::double_to_string(rect.left + margin) + " " +
+    QUtil::double_to_string(rect.top - height - 2 * margin) + " " +
+    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
+    QUtil::double_to_string(height + 2 * margin) + " re f\n";
+
+  // White filled rectangle (bottom)
+  boxcmd += "  " +
+    QUtil::double_to_string(rect.left + margin) + " " +
+    QUtil::double_to_string(rect.bottom + height + margin) + " " +
+    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
+    QUtil::double_to_string(height + 2 * margin) + " re f\n";
+
+  // Black outline (top)
+  boxcmd += "  0 0 0 RG\n";
+  boxcmd += "  " +
+    QUtil::double_to_string(rect.left + margin) + " " +
+    QUtil::double_to_string(rect.top - height - 2 * margin) + " " +
+    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
+    QUtil::double_to_string(height + 2 * margin) + " re S\n";
+
+  // Black outline (bottom)
+  boxcmd += "  " +
+    QUtil::double_to_string(rect.left + margin) + " " +
+    QUtil::double_to_string(rect.bottom + height + margin) + " " +
+    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
+    QUtil::double_to_string(height + 2 * margin) + " re S\n";
+
+  // Black text (top)
+  boxcmd += "  0 0 0 rg\n";
+  boxcmd += "  BT\n";
+  boxcmd += "  /pagelabel-font 12 Tf\n";
+  boxcmd += "  " +
+    QUtil::double_to_string(rect.left + 2 * margin) + " " +
+    QUtil::double_to_string(rect.top - height - margin) + " Td\n";
+  boxcmd += "  (" + label + ") Tj\n";
+  boxcmd += "  ET\n";
+
+  // Black text (bottom)
+  boxcmd += "  BT\n";
+  boxcmd += "  /pagelabel-font 12 Tf\n";
+  boxcmd += "  " +
+    QUtil::double_to_string(rect.left + 2 * margin) + " " +
+    QUtil::double_to_string(rect.bottom + height + 2 * margin) + " Td\n";
+  boxcmd += "  (" + label + ") Tj\n";
+  boxcmd += "  ET\n";
+
+  boxcmd += "Q\n";
+
+  static const char *pre = "%pdftopdf q\n"
+    "q\n",
+    *post="%pdftopdf Q\n"
+    "Q\n";
+
+  label_font = streams.size();
+  streams.push_back(std::make_pair(std::string(pre), true));
+  streams.push_back(std::make_pair(std::string(post) + boxcmd, false));
+}
+// }}}
+
 _cfPDFToPDFQPDFPageHandle::_cfPDFToPDFQPDFPageHandle(QPDFObjectHandle page,
 						     int orig_no) // {{{
   : page(page),
@@ -160,64 +286,53 @@ _cfPDFToPDFQPDFPageHandle::add_border_rect(const _cfPDFToPDFPageRect &_rect,
   DEBUG_assert(is_existing());
   DEBUG_assert(border != pdftopdf_border_type_e::NONE);
 
-  // straight from pstops
-  const double lw = (border & THICK) ? 0.5 : 0.24;
-  double line_width = lw * fscale;
-  double margin = 2.25 * fscale;
-  // (PageLeft + margin, PageBottom + margin)
-  //   rect (PageRight - PageLeft - 2 * margin, ...)   ...
-  //   for nup > 1: PageLeft = 0, etc.
-  // if (double) margin += 2 * fscale ...rect...
-
-  _cfPDFToPDFPageRect rect = ungetRect(_rect, *this, rotation, page);
-
-  DEBUG_assert(rect.left <= rect.right);
-  DEBUG_assert(rect.bottom <= rect.top);
+  _cfPDFToPDFPageDecoration deco;
+  deco.add_border(page_space_rect(_rect), border, fscale);
+  add_decoration(deco);
+}
+// }}}
 
-  std::string boxcmd="q\n";
-  boxcmd += "  " +QUtil::double_to_string(line_width) + " w 0 G \n";
-  boxcmd += "  " +QUtil::double_to_string(rect.left + margin) + " " +
-    QUtil::double_to_string(rect.bottom + margin) + "  " +
-    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
-    QUtil::double_to_string(rect.top - rect.bottom - 2 * margin) + " re S \n";
-  if (border & TWO)
-  {
-    margin += 2 * fscale;
-    boxcmd += "  " + QUtil::double_to_string(rect.left + margin) + " " +
-      QUtil::double_to_string(rect.bottom + margin) + "  " +
-      QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
-      QUtil::double_to_string(rect.top - rect.bottom - 2 * margin) + " re S \n";
-  }
-  boxcmd += "Q\n";
+_cfPDFToPDFPageRect
+_cfPDFToPDFQPDFPageHandle::page_space_rect(const _cfPDFToPDFPageRect &rect)
+                                                                      // {{{
+{
+  page.assertInitialized();
+  return (ungetRect(rect, *this, rotation, page));
+}
+// }}}
 
-  // if (!is_existing())
-  //   // TODO: only after
-  //   return;
-  
+void
+_cfPDFToPDFQPDFPageHandle::add_decoration
+    (const _cfPDFToPDFPageDecoration &deco) // {{{
+{
+  DEBUG_assert(is_existing());
   DEBUG_assert(page.getOwningQPDF()); // existing pages are always indirect
-#ifdef DEBUG  // draw it on top
-  static const char *pre = "%pdftopdf q\n"
-    "q\n",
-    *post = "%pdftopdf Q\n"
-    "Q\n";
 
-  QPDFObjectHandle stm1 = QPDFObjectHandle::newStream(page.getOwningQPDF(),
-						      pre),
-                   stm2 = QPDFObjectHandle::newStream(page.getOwningQPDF(),
-						      std::string(post) +
-						      boxcmd);
+  for (size_t i = 0; i < deco.streams.size(); i ++)
+  {
+    if ((int)i == deco.label_font)
+    {
+      // TODO: Only add in the font once, not once per page.
+      QPDFObjectHandle font = page.getOwningQPDF()->makeIndirectObject
+	(QPDFObjectHandle::parse(
+	  "<<"
+	  " /Type /Font"
+	  " /Subtype /Type1"
+	  " /Name /pagelabel-font"
+	  " /BaseFont /Helvetica" // TODO: support UTF-8 labels?
+	  ">>"));
+      QPDFObjectHandle resources = page.getKey ("/Resources");
+      QPDFObjectHandle rfont = resources.getKey ("/Font");
+      rfont.replaceKey ("/pagelabel-font", font);
+    }
 
-  page.addPageContents(stm1, true); // before
-  page.addPageContents(stm2, false); // after
-#else
-  QPDFObjectHandle stm = QPDFObjectHandle::newStream(page.getOwningQPDF(),
-						     boxcmd);
-  page.addPageContents(stm, true); // before
-#endif
+    page.addPageContents(QPDFObjectHandle::newStream(page.getOwningQPDF(),
+						     deco.streams[i].first),
+			 deco.streams[i].second); // before or after
+  }
 }
 // }}}
 
-
 //
 //  This crop function is written for print-scaling=fill option.
 //  Trim Box is used for trimming the page in required size.
@@ -450,94 +565,9 @@ _cfPDFToPDFQPDFPageHandle::add_label(const _cfPDFToPDFPageRect &_rect,
 {
   DEBUG_assert(is_existing());
 
-  _cfPDFToPDFPageRect rect = ungetRect (_rect, *this, rotation, page);
-
-  DEBUG_assert(rect.left <= rect.right);
-  DEBUG_assert(rect.bottom <= rect.top);
-
-  // TODO: Only add in the font once, not once per page.
-  QPDFObjectHandle font = page.getOwningQPDF()->makeIndirectObject
-    (QPDFObjectHandle::parse(
-      "<<"
-      " /Type /Font"
-      " /Subtype /Type1"
-      " /Name /pagelabel-font"
-      " /BaseFont /Helvetica" // TODO: support UTF-8 labels?
-      ">>"));
-  QPDFObjectHandle resources = page.getKey ("/Resources");
-  QPDFObjectHandle rfont = resources.getKey ("/Font");
-  rfont.replaceKey ("/pagelabel-font", font);
-
-  double margin = 2.25;
-  double height = 12;
-
-  std::string boxcmd = "q\n";
-
-  // White filled rectangle (top)
-  boxcmd += "  1 1 1 rg\n";
-  boxcmd += "  " +
-    QUtil::double_to_string(rect.left + margin) + " " +
-    QUtil::double_to_string(rect.top - height - 2 * margin) + " " +
-    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
-    QUtil::double_to_string(height + 2 * margin) + " re f\n";
-
-  // White filled rectangle (bottom)
-  boxcmd += "  " +
-    QUtil::double_to_string(rect.left + margin) + " " +
-    QUtil::double_to_string(rect.bottom + height + margin) + " " +
-    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
-    QUtil::double_to_string(height + 2 * margin) + " re f\n";
-
-  // Black outline (top)
-  boxcmd += "  0 0 0 RG\n";
-  boxcmd += "  " +
-    QUtil::double_to_string(rect.left + margin) + " " +
-    QUtil::double_to_string(rect.top - height - 2 * margin) + " " +
-    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
-    QUtil::double_to_string(height + 2 * margin) + " re S\n";
-
-  // Black outline (bottom)
-  boxcmd += "  " +
-    QUtil::double_to_string(rect.left + margin) + " " +
-    QUtil::double_to_string(rect.bottom + height + margin) + " " +
-    QUtil::double_to_string(rect.right - rect.left - 2 * margin) + " " +
-    QUtil::double_to_string(height + 2 * margin) + " re S\n";
-
-  // Black text (top)
-  boxcmd += "  0 0 0 rg\n";
-  boxcmd += "  BT\n";
-  boxcmd += "  /pagelabel-font 12 Tf\n";
-  boxcmd += "  " +
-    QUtil::double_to_string(rect.left + 2 * margin) + " " +
-    QUtil::double_to_string(rect.top - height - margin) + " Td\n";
-  boxcmd += "  (" + label + ") Tj\n";
-  boxcmd += "  ET\n";
-
-  // Black text (bottom)
-  boxcmd += "  BT\n";
-  boxcmd += "  /pagelabel-font 12 Tf\n";
-  boxcmd += "  " +
-    QUtil::double_to_string(rect.left + 2 * margin) + " " +
-    QUtil::double_to_string(rect.bottom + height + 2 * margin) + " Td\n";
-  boxcmd += "  (" + label + ") Tj\n";
-  boxcmd += "  ET\n";
-
-  boxcmd += "Q\n";
-
-  DEBUG_assert(page.getOwningQPDF()); // existing pages are always indirect
-  static const char *pre = "%pdftopdf q\n"
-    "q\n",
-    *post="%pdftopdf Q\n"
-    "Q\n";
-
-  QPDFObjectHandle stm1 = QPDFObjectHandle::newStream(page.getOwningQPDF(),
-						      std::string(pre)),
-                   stm2 = QPDFObjectHandle::newStream(page.getOwningQPDF(),
-						      std::string(post) +
-						      boxcmd);
-
-  page.addPageContents(stm1, true); // before
-  page.addPageContents(stm2, false); // after
+  _cfPDFToPDFPageDecoration deco;
+  deco.add_label(page_space_rect(_rect), label);
+  add_decoration(deco);
 }
 // }}}
 
@@ -555,6 +585,9 @@ void
 _cfPDFToPDFQPDFProcessor::close_file() // {{{
 {
   pdf.reset();
+  orig_pages.clear();
+  used_pages.clear();
+  flatten_pending = false;
   hasCM = false;
 }
 // }}}
@@ -648,14 +681,9 @@ _cfPDFToPDFQPDFProcessor::start(int flatten_forms) // {{{
 {
   DEBUG_assert(pdf);
 
-  if (flatten_forms)
-  {
-    QPDFAcroFormDocumentHelper afdh(*pdf);
-    afdh.generateAppearancesIfNeeded();
-
-    QPDFPageDocumentHelper dh(*pdf);
-    dh.flattenAnnotations(an_print);
-  }
+  // Form flattening is deferred to select_pages(), so that only the pages
+  // which actually get printed are touched
+  flatten_pending = flatten_forms;
 
   pdf->pushInheritedAttributesToPage();
   orig_pages = pdf->getAllPages();
@@ -735,6 +763,218 @@ _cfPDFToPDFQPDFProcessor::add_page(std::shared_ptr<_cfPDFToPDFPageHandle> page,
 }
 // }}}
 
+bool
+_cfPDFToPDFQPDFProcessor::is_used(int iA) const // {{{
+{
+  if (used_pages.empty())
+    return (true);
+  return ((iA < (int)used_pages.size()) && used_pages[iA]);
+}
+// }}}
+
+void
+_cfPDFToPDFQPDFProcessor::flatten_used_pages(pdftopdf_doc_t *doc) // {{{
+{
+  DEBUG_assert(pdf);
+
+  // generateAppearancesIfNeeded() and flattenAnnotations() walk the page
+  // tree, which start() has emptied. Temporarily re-insert only the
+  // selected pages which carry annotations, so that the widgets of pages
+  // which do not get printed are never looked at.
+  std::vector<QPDFObjectHandle> annotated;
+  const int len = orig_pages.size();
+  for (int iA = 0; iA < len; iA ++)
+    if (is_used(iA) && orig_pages[iA].hasKey("/Annots"))
+      annotated.push_back(orig_pages[iA]);
+
+  if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_DEBUG,
+				 "cfFilterPDFToPDF: Flattening forms on %d of %d pages",
+				 (int)annotated.size(), len);
+  if (annotated.empty())
+    return;
+
+  for (auto &page : annotated)
+    pdf->addPage(page, false);
+
+  QPDFAcroFormDocumentHelper afdh(*pdf);
+  afdh.generateAppearancesIfNeeded();
+
+  QPDFPageDocumentHelper dh(*pdf);
+  dh.flattenAnnotations(an_print);
+
+  for (auto &page : annotated)
+    pdf->removePage(page);
+}
+// }}}
+
+// Remove (recursively) the AcroForm fields whose widgets sit on one of the
+// dropped pages, returns true if the field itself should go away
+static bool
+prune_field(QPDFObjectHandle field,
+	    const std::set<QPDFObjGen> &dropped,
+	    int depth) // {{{
+{
+  if (!field.isDictionary() || depth > 32)
+    return (false);
+
+  QPDFObjectHandle kids = field.getKey("/Kids");
+  if (kids.isArray())
+  {
+    for (int iA = kids.getArrayNItems() - 1; iA >= 0; iA --)
+      if (prune_field(kids.getArrayItem(iA), dropped, depth + 1))
+	kids.eraseItem(iA);
+    return (kids.getArrayNItems() == 0);
+  }
+
+  QPDFObjectHandle page = field.getKey("/P");
+  return (page.isIndirect() && dropped.count(page.getObjGen()));
+}
+// }}}
+
+// Whether a destination (array or dictionary with /D) points to one of the
+// dropped pages
+static bool
+dest_on_dropped_page(QPDFObjectHandle dest,
+		     const std::set<QPDFObjGen> &dropped) // {{{
+{
+  if (dest.isDictionary())
+    dest = dest.getKey("/D");
+  if (!dest.isArray() || dest.getArrayNItems() == 0)
+    return (false);
+
+  QPDFObjectHandle page = dest.getArrayItem(0);
+  return (page.isIndirect() && dropped.count(page.getObjGen()));
+}
+// }}}
+
+// Remove the named destinations pointing to dropped pages from a node of
+// the /Names/Dests name tree and its kids; the /Limits are left as they are,
+// they still enclose the remaining names
+static void
+prune_dest_tree(QPDFObjectHandle node,
+		const std::set<QPDFObjGen> &dropped,
+		int depth) // {{{
+{
+  if (!node.isDictionary() || depth > 32)
+    return;
+
+  QPDFObjectHandle names = node.getKey("/Names");
+  if (names.isArray())
+    for (int iA = names.getArrayNItems() / 2 - 1; iA >= 0; iA --)
+      if (dest_on_dropped_page(names.getArrayItem(2 * iA + 1), dropped))
+      {
+	names.eraseItem(2 * iA + 1);
+	names.eraseItem(2 * iA);
+      }
+
+  QPDFObjectHandle kids = node.getKey("/Kids");
+  if (kids.isArray())
+    for (int iA = 0; iA < kids.getArrayNItems(); iA ++)
+      prune_dest_tree(kids.getArrayItem(iA), dropped, depth + 1);
+}
+// }}}
+
+// Whether an article thread has a bead on one of the dropped pages
+static bool
+thread_on_dropped_page(QPDFObjectHandle thread,
+		       const std::set<QPDFObjGen> &dropped) // {{{
+{
+  if (!thread.isDictionary())
+    return (false);
+
+  QPDFObjectHandle first = thread.getKey("/F"),
+		   bead = first;
+  for (int iA = 0; iA < 10000 && bead.isDictionary(); iA ++)
+  {
+    QPDFObjectHandle page = bead.getKey("/P");
+    if (page.isIndirect() && dropped.count(page.getObjGen()))
+      return (true);
+
+    bead = bead.getKey("/N");
+    if (bead.isIndirect() && first.isIndirect() &&
+	bead.getObjGen() == first.getObjGen())
+      break;
+  }
+  return (false);
+}
+// }}}
+
+void
+_cfPDFToPDFQPDFProcessor::prune_unused_pages(pdftopdf_doc_t *doc) // {{{
+{
+  DEBUG_assert(pdf);
+
+  std::set<QPDFObjGen> dropped;
+  const int len = orig_pages.size();
+  for (int iA = 0; iA < len; iA ++)
+    if (!is_used(iA))
+      dropped.insert(orig_pages[iA].getObjGen());
+  if (dropped.empty())
+    return;
+
+  if (doc->logfunc) doc->logfunc(doc->logdata, CF_LOGLEVEL_DEBUG,
+				 "cfFilterPDFToPDF: Pruning %d of %d pages",
+				 (int)dropped.size(), len);
+
+  // The pages are already unlinked from the page tree (see start()), but
+  // QPDFWriter emits everything reachable from the trailer, so cut the
+  // catalog entries which refer to the dropped pages and would keep them
+  // (and with them their content streams, fonts and images) alive.
+  // Objects which are not reachable any more are neither loaded nor
+  // written. Entries for the kept pages stay untouched.
+  //
+  // The /StructTreeRoot is kept as a whole: its elements of dropped pages
+  // are also referenced from the /ParentTree and the marked content of the
+  // kept pages, so taking them out would break the tagged-PDF structure;
+  // this only means that a tagged PDF still carries its dropped pages.
+  QPDFObjectHandle root = pdf->getRoot();
+
+  QPDFObjectHandle dests = root.getKey("/Dests");
+  if (dests.isDictionary())
+    for (auto &key : dests.getKeys())
+      if (dest_on_dropped_page(dests.getKey(key), dropped))
+	dests.removeKey(key);
+
+  QPDFObjectHandle names = root.getKey("/Names");
+  if (names.isDictionary())
+    prune_dest_tree(names.getKey("/Dests"), dropped, 0);
+
+  QPDFObjectHandle threads = root.getKey("/Threads");
+  if (threads.isArray())
+    for (int iA = threads.getArrayNItems() - 1; iA >= 0; iA --)
+      if (thread_on_dropped_page(threads.getArrayItem(iA), dropped))
+	threads.eraseItem(iA);
+
+  QPDFObjectHandle acroform = root.getKey("/AcroForm");
+  if (acroform.isDictionary())
+  {
+    QPDFObjectHandle fields = acroform.getKey("/Fields");
+    if (fields.isArray())
+      for (int iA = fields.getArrayNItems() - 1; iA >= 0; iA --)
+	if (prune_field(fields.getArrayItem(iA), dropped, 0))
+	  fields.eraseItem(iA);
+  }
+}
+// }}}
+
+void
+_cfPDFToPDFQPDFProcessor::select_pages(const std::vector<bool> &used,
+				       pdftopdf_doc_t *doc) // {{{
+{
+  DEBUG_assert(pdf);
+
+  used_pages = used;
+
+  prune_unused_pages(doc);
+
+  if (flatten_pending)
+  {
+    flatten_used_pages(doc);
+    flatten_pending = false;
+  }
+}
+// }}}
+
 #if 0
 // we remove stuff now probably defunct  TODO
 pdf->getRoot().removeKey("/PageMode");
@@ -778,6 +1018,9 @@ _cfPDFToPDFQPDFProcessor::auto_rotate_all(bool dst_lscape,
   const int len = orig_pages.size();
   for (int iA = 0; iA < len; iA ++)
   {
+    if (!is_used(iA))
+      continue;
+
     QPDFObjectHandle page = orig_pages[iA];
 
     pdftopdf_rotation_e src_rot = _cfPDFToPDFGetRotate(page);
@@ -816,7 +1059,12 @@ _cfPDFToPDFQPDFProcessor::add_cm(const char *defaulticc,
 
   QPDFObjectHandle srcicc = _cfPDFToPDFSetDefaultICC(*pdf, defaulticc);
                                             // TODO? rename to putDefaultICC?
-  _cfPDFToPDFAddDefaultRGB(*pdf, srcicc);
+  std::vector<QPDFObjectHandle> pages;
+  const int len = orig_pages.size();
+  for (int iA = 0; iA < len; iA ++)
+    if (is_used(iA))
+      pages.push_back(orig_pages[iA]);
+  _cfPDFToPDFAddDefaultRGB(pages, srcicc);
 
   _cfPDFToPDFAddOutputIntent(*pdf, outputicc);
 
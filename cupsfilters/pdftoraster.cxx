@@ -55,6 +55,10 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <cupsfilters/bitmap.h>
 #include <strings.h>
 #include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <poppler/cpp/poppler-document.h>
 #include <poppler/cpp/poppler-page.h>
 #include <poppler/cpp/poppler-global.h>
@@ -442,6 +446,40 @@ static void parse_pdftopdf_comment(FILE *fp, int* deviceCopies, bool* deviceColl
   }
 }
 
+/*
+ * 'map_pdf_handoff()' - Map the PDF which cfFilterPDFToPDF() has written
+ *                       into the shared memory handoff, NULL if there is
+ *                       none (or it is incomplete)
+ */
+
+static char *map_pdf_handoff(int fd, size_t *size)
+{
+  struct stat st;
+  void *addr;
+
+#ifdef F_GET_SEALS
+  /* pdftopdf seals the file only after having written it completely */
+  int seals = fcntl(fd, F_GET_SEALS);
+  if (seals < 0 || !(seals & F_SEAL_WRITE))
+    return (NULL);
+#endif /* F_GET_SEALS */
+
+  if (fstat(fd, &st) < 0 || st.st_size <= 0)
+    return (NULL);
+
+  /* Complete, but too large for load_from_raw_data(), the caller opens it
+     by path then */
+  *size = (size_t)st.st_size;
+  if (st.st_size > INT_MAX)
+    return (NULL);
+
+  addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED)
+    return (NULL);
+
+  return ((char *)addr);
+}
+
 static unsigned char *reverse_line(unsigned char *src, unsigned char *dst,
      unsigned int row, unsigned int plane, unsigned int pixels,
      unsigned int size, pdftoraster_doc_t* doc, convert_cspace_func convertCSpace)
@@ -1629,6 +1667,12 @@ int cfFilterPDFToRaster(int inputfd,         /* I - File descriptor input stream
   char name[BUFSIZ];
   char buf[BUFSIZ];
   int n;
+  size_t total = 0;
+  cf_filter_pdf_handoff_t *handoff =
+    (cf_filter_pdf_handoff_t *)cfFilterDataGetExt(data,
+					CF_FILTER_DATA_EXT_PDF_HANDOFF);
+  char *handoff_data = NULL;
+  size_t handoff_size = 0;
 
   fd = cupsTempFd(name,sizeof(name));
   if (fd < 0) {
@@ -1639,6 +1683,7 @@ int cfFilterPDFToRaster(int inputfd,         /* I - File descriptor input stream
 
   /* copy input data to the tmp file */
   while ((n = read(inputfd, buf, BUFSIZ)) > 0) {
+    total += n;
     if (write(fd, buf, n) != n) {
       if (log) log(ld, CF_LOGLEVEL_ERROR,
 		   "cfFilterPDFToRaster: Can't copy input data to temporary file.");
@@ -1649,21 +1694,71 @@ int cfFilterPDFToRaster(int inputfd,         /* I - File descriptor input stream
   }
   close(fd);
 
+ /*
+  * Nothing came through the pipe but pdftopdf has put the PDF into the
+  * shared memory handoff set up by cfFilterChain(), map it instead of
+  * copying it...
+  */
+
+  if (handoff && handoff->fd >= 0 && total == 0)
+  {
+    handoff_data = map_pdf_handoff(handoff->fd, &handoff_size);
+    if (!handoff_data && handoff_size > 0)
+    {
+      /* Too large to be mapped, let Poppler open it by path */
+      unlink(name);
+      snprintf(name, sizeof(name), "/proc/self/fd/%d", handoff->fd);
+    }
+  }
+
   if (parse_opts(data, &outformat, &doc) == 1)
   {
+    if (handoff_data)
+      munmap(handoff_data, handoff_size);
     unlink(name);
     return (1);
   }
 
-  doc.poppler_doc = poppler::document::load_from_file(name, "", "");
-  unlink(name);
-
   FILE *fp;
-  if ((fp = fdopen(inputfd,"rb")) == 0) {
-    if (log) log(ld, CF_LOGLEVEL_ERROR,
-		 "cfFilterPDFToRaster: Can't open input file.");
-    ret = 1;
-    goto out;
+  if (handoff_data)
+  {
+    if (log) log(ld, CF_LOGLEVEL_DEBUG,
+		 "cfFilterPDFToRaster: Reading %lu bytes of PDF from shared memory.",
+		 (unsigned long)handoff_size);
+    doc.poppler_doc =
+      poppler::document::load_from_raw_data(handoff_data, (int)handoff_size,
+					    "", "");
+    unlink(name);
+
+    if ((fp = fmemopen(handoff_data, handoff_size, "r")) == NULL) {
+      if (log) log(ld, CF_LOGLEVEL_ERROR,
+		   "cfFilterPDFToRaster: Can't open input file.");
+      ret = 1;
+      goto out;
+    }
+  }
+  else if (handoff_size > 0)
+  {
+    doc.poppler_doc = poppler::document::load_from_file(name, "", "");
+
+    if ((fp = fopen(name, "rb")) == NULL) {
+      if (log) log(ld, CF_LOGLEVEL_ERROR,
+		   "cfFilterPDFToRaster: Can't open input file.");
+      ret = 1;
+      goto out;
+    }
+  }
+  else
+  {
+    doc.poppler_doc = poppler::document::load_from_file(name, "", "");
+    unlink(name);
+
+    if ((fp = fdopen(inputfd,"rb")) == 0) {
+      if (log) log(ld, CF_LOGLEVEL_ERROR,
+		   "cfFilterPDFToRaster: Can't open input file.");
+      ret = 1;
+      goto out;
+    }
   }
 
   parse_pdftopdf_comment(fp, &deviceCopies, &deviceCollate);
@@ -1822,6 +1917,11 @@ int cfFilterPDFToRaster(int inputfd,         /* I - File descriptor input stream
   if (doc.colour_profile.colorTransform != NULL) {
     cmsDeleteTransform(doc.colour_profile.colorTransform);
   }
+  if (handoff_data) {
+    /* Poppler reads from the mapped data until the document is gone */
+    delete doc.poppler_doc;
+    munmap(handoff_data, handoff_size);
+  }
 
   return (ret);
 }
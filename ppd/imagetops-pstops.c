@@ -129,6 +129,7 @@ typedef struct				/**** Document information ****/
                 PageLength;             /* Total page length */
   cups_file_t	*inputfp;		/* Temporary file, if any */
   FILE		*outputfp;		/* Temporary file, if any */
+  ppd_emit_t	*emit;			/* Code for marked options, if any */
   cf_logfunc_t logfunc;             /* Logging function, NULL for no
 					   logging */
   void          *logdata;               /* User data for logging function, can
@@ -184,10 +185,14 @@ static ssize_t		copy_trailer(pstops_doc_t *doc,
 				     ssize_t linelen, size_t linesize);
 static void		do_prolog(pstops_doc_t *doc, ppd_file_t *ppd);
 static void 		do_setup(pstops_doc_t *doc, ppd_file_t *ppd);
+static void		doc_emit(pstops_doc_t *doc, ppd_file_t *ppd,
+			         ppd_section_t section);
 static void		doc_printf(pstops_doc_t *doc, const char *format, ...);
 static void		doc_putc(pstops_doc_t *doc, const char c);
 static void		doc_puts(pstops_doc_t *doc, const char *s);
 static void		doc_write(pstops_doc_t *doc, const char *s, size_t len);
+static const char	*emit_code(pstops_doc_t *doc, ppd_file_t *ppd,
+			          ppd_section_t section, size_t *length);
 static void		end_nup(pstops_doc_t *doc, int number);
 static int		include_feature(pstops_doc_t *doc, ppd_file_t *ppd,
 					const char *line, int num_options,
@@ -500,6 +505,8 @@ ppdFilterPSToPS(int inputfd,         /* I - File descriptor input stream */
     unlink(doc.tempfile);
   }
 
+  ppdEmitDestroy(doc.emit);
+
   if (doc.pages)
   {
     for (pageinfo = (pstops_page_t *)cupsArrayFirst(doc.pages);
@@ -1480,9 +1487,9 @@ ppdFilterImageToPS(int inputfd,            /* I - File descriptor input stream *
     doc_putc(&doc, '\n');
   }
 
-  ppdEmit(ppd, doc.outputfp, PPD_ORDER_DOCUMENT);
-  ppdEmit(ppd, doc.outputfp, PPD_ORDER_ANY);
-  ppdEmit(ppd, doc.outputfp, PPD_ORDER_PROLOG);
+  doc_emit(&doc, ppd, PPD_ORDER_DOCUMENT);
+  doc_emit(&doc, ppd, PPD_ORDER_ANY);
+  doc_emit(&doc, ppd, PPD_ORDER_PROLOG);
 
   if (g != 1.0 || b != 1.0)
     doc_printf(&doc,
@@ -1541,6 +1548,7 @@ ppdFilterImageToPS(int inputfd,            /* I - File descriptor input stream *
     log(ld, CF_LOGLEVEL_ERROR,
 	"ppdFilterImageToPS: Could not allocate memory.");
     cfImageClose(img);
+    ppdEmitDestroy(doc.emit);
     return (2);
   }
 
@@ -1697,7 +1705,7 @@ ppdFilterImageToPS(int inputfd,            /* I - File descriptor input stream *
 
         doc_printf(&doc, "%%%%Page: %d %d\n", page, page);
 
-        ppdEmit(ppd, doc.outputfp, PPD_ORDER_PAGE);
+        doc_emit(&doc, ppd, PPD_ORDER_PAGE);
 
 	doc_puts(&doc, "gsave\n");
 
@@ -1843,6 +1851,7 @@ ppdFilterImageToPS(int inputfd,            /* I - File descriptor input stream *
   */
 
   cfImageClose(img);
+  ppdEmitDestroy(doc.emit);
   fclose(doc.outputfp);
   close(outputfd);
 
@@ -2112,6 +2121,9 @@ copy_comments(pstops_doc_t *doc,	/* I - Document info */
 	ppdMarkOption(ppd, "ARDuplex", "None");
 	ppdMarkOption(ppd, "KD03Duplex", "None");
 	ppdMarkOption(ppd, "JCLDuplex", "None");
+
+	ppdEmitDestroy(doc->emit);
+	doc->emit = NULL;
       }
     }
     else if (!strncmp(line, "%%BoundingBox:", 14))
@@ -2545,6 +2557,8 @@ copy_non_dsc(pstops_doc_t *doc,		/* I - Document info */
   int		copy;			/* Current copy */
   char		buffer[8192];		/* Copy buffer */
   ssize_t	bytes;			/* Number of bytes copied */
+  const char	*code;			/* Page setup code */
+  size_t	length;			/* Length of page setup code */
   cf_logfunc_t log = doc->logfunc;
   void          *ld = doc->logdata;
   cf_filter_iscanceledfunc_t iscanceled = doc->iscanceledfunc;
@@ -2642,7 +2656,8 @@ copy_non_dsc(pstops_doc_t *doc,		/* I - Document info */
 
   doc_puts(doc, "%%Page: 1 1\n");
   doc_puts(doc, "%%BeginPageSetup\n");
-  ppdEmit(ppd, doc->outputfp, PPD_ORDER_PAGE);
+  if ((code = emit_code(doc, ppd, PPD_ORDER_PAGE, &length)) != NULL)
+    fwrite(code, 1, length, doc->outputfp);
   doc_puts(doc, "%%EndPageSetup\n");
   doc_puts(doc, "%%BeginDocument: nondsc\n");
 
@@ -2696,7 +2711,8 @@ copy_non_dsc(pstops_doc_t *doc,		/* I - Document info */
 
       doc_printf(doc, "%%%%Page: %d %d\n", copy + 1, copy + 1);
       doc_puts(doc, "%%BeginPageSetup\n");
-      ppdEmit(ppd, doc->outputfp, PPD_ORDER_PAGE);
+      if ((code = emit_code(doc, ppd, PPD_ORDER_PAGE, &length)) != NULL)
+        fwrite(code, 1, length, doc->outputfp);
       doc_puts(doc, "%%EndPageSetup\n");
       doc_puts(doc, "%%BeginDocument: nondsc\n");
 
@@ -3091,9 +3107,6 @@ copy_page(pstops_doc_t *doc,		/* I - Document info */
 
   if (first_page)
   {
-    char	*page_setup;		/* PageSetup commands to send */
-
-
     if (pageinfo->num_options > 0)
       write_options(doc, ppd, pageinfo->num_options, pageinfo->options);
 
@@ -3101,13 +3114,7 @@ copy_page(pstops_doc_t *doc,		/* I - Document info */
     * Output commands for the current page...
     */
 
-    page_setup = ppdEmitString(ppd, PPD_ORDER_PAGE, 0);
-
-    if (page_setup)
-    {
-      doc_puts(doc, page_setup);
-      free(page_setup);
-    }
+    doc_emit(doc, ppd, PPD_ORDER_PAGE);
   }
 
  /*
@@ -3403,9 +3410,6 @@ static void
 do_prolog(pstops_doc_t *doc,		/* I - Document information */
           ppd_file_t   *ppd)		/* I - PPD file */
 {
-  char	*ps;				/* PS commands */
-
-
  /*
   * Send the document prolog commands...
   */
@@ -3417,11 +3421,7 @@ do_prolog(pstops_doc_t *doc,		/* I - Document information */
     doc_puts(doc, "\n%%EndFeature\n");
   }
 
-  if ((ps = ppdEmitString(ppd, PPD_ORDER_PROLOG, 0.0)) != NULL)
-  {
-    doc_puts(doc, ps);
-    free(ps);
-  }
+  doc_emit(doc, ppd, PPD_ORDER_PROLOG);
 
  /*
   * Define ESPshowpage here so that applications that define their
@@ -3442,9 +3442,6 @@ static void
 do_setup(pstops_doc_t *doc,		/* I - Document information */
          ppd_file_t   *ppd)		/* I - PPD file */
 {
-  char	*ps;				/* PS commands */
-
-
  /*
   * Disable CTRL-D so that embedded files don't cause printing
   * errors...
@@ -3457,17 +3454,8 @@ do_setup(pstops_doc_t *doc,		/* I - Document information */
   * Send all the printer-specific setup commands...
   */
 
-  if ((ps = ppdEmitString(ppd, PPD_ORDER_DOCUMENT, 0.0)) != NULL)
-  {
-    doc_puts(doc, ps);
-    free(ps);
-  }
-
-  if ((ps = ppdEmitString(ppd, PPD_ORDER_ANY, 0.0)) != NULL)
-  {
-    doc_puts(doc, ps);
-    free(ps);
-  }
+  doc_emit(doc, ppd, PPD_ORDER_DOCUMENT);
+  doc_emit(doc, ppd, PPD_ORDER_ANY);
 
  /*
   * Set the number of copies for the job...
@@ -3525,6 +3513,25 @@ do_setup(pstops_doc_t *doc,		/* I - Document information */
 }
 
 
+/*
+ * 'doc_emit()' - Send the code for marked options in a section to the
+ *                output and/or the temp file.
+ */
+
+static void
+doc_emit(pstops_doc_t  *doc,		/* I - Document information */
+         ppd_file_t    *ppd,		/* I - PPD file */
+	 ppd_section_t section)		/* I - Section to send */
+{
+  const char	*code;			/* Option code */
+  size_t	length;			/* Length of option code */
+
+
+  if ((code = emit_code(doc, ppd, section, &length)) != NULL)
+    doc_write(doc, code, length);
+}
+
+
 /*
  * 'doc_printf()' - Send a formatted string to the output file and/or the
  *                  temp file.
@@ -3609,6 +3616,26 @@ doc_write(pstops_doc_t *doc,		/* I - Document information */
 }
 
 
+/*
+ * 'emit_code()' - Get the code for marked options in a section.
+ *
+ * The code of all sections is collected once and reused until options are
+ * marked again.
+ */
+
+static const char *			/* O - Option code or NULL */
+emit_code(pstops_doc_t  *doc,		/* I - Document information */
+          ppd_file_t    *ppd,		/* I - PPD file */
+	  ppd_section_t section,	/* I - Section */
+	  size_t        *length)	/* O - Length of option code */
+{
+  if (!doc->emit && ppd)
+    doc->emit = ppdEmitCreate(ppd);
+
+  return (ppdEmitGetCode(doc->emit, section, length));
+}
+
+
 /*
  * 'end_nup()' - End processing for N-up printing.
  */
@@ -5165,6 +5192,9 @@ write_options(
 
   ppdMarkOptions(ppd, num_options, options);
 
+  ppdEmitDestroy(doc->emit);
+  doc->emit = NULL;
+
   doc_setup = ppdEmitString(ppd, PPD_ORDER_DOCUMENT, min_order);
   any_setup = ppdEmitString(ppd, PPD_ORDER_ANY, min_order);
 
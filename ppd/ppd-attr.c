@@ -13,7 +13,7 @@
  */
 
 #include "string-private.h"
-#include "ppd.h"
+#include "ppd-private.h"
 #include "debug-internal.h"
 
 
@@ -28,6 +28,7 @@ ppdFindAttr(ppd_file_t *ppd,		/* I - PPD file data */
             const char *name,		/* I - Attribute name */
             const char *spec)		/* I - Specifier string or @code NULL@ */
 {
+  int		i;			/* Position of attribute */
   ppd_attr_t	key,			/* Search key */
 		*attr;			/* Current attribute */
 
@@ -49,6 +50,19 @@ ppdFindAttr(ppd_file_t *ppd,		/* I - PPD file data */
   memset(&key, 0, sizeof(key));
   strlcpy(key.name, name, sizeof(key.name));
 
+  if ((i = _ppdIndexFindAttr(ppd, key.name, spec, &attr)) != -2)
+  {
+   /*
+    * Found in the index, make it the current attribute for
+    * ppdFindNextAttr()...
+    */
+
+    cupsArrayIndex(ppd->sorted_attrs,
+                   i < 0 ? cupsArrayCount(ppd->sorted_attrs) : i);
+
+    return (attr);
+  }
+
  /*
   * Return the first matching attribute, if any...
   */
@@ -20,6 +20,8 @@
 #include <math.h>
 #include <limits.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 
 /*
@@ -3969,6 +3971,7 @@ ppdCacheWriteFile(
   ppd_pwg_finishings_t	*f;		/* Current finishing option */
   cups_option_t		*option;	/* Current option */
   const char		*value;		/* String value */
+  int			fd;		/* New file descriptor */
   char			newfile[1024];	/* New filename */
 
 
@@ -3986,13 +3989,23 @@ ppdCacheWriteFile(
   * Open the file and write with compression...
   */
 
-  snprintf(newfile, sizeof(newfile), "%s.N", filename);
-  if ((fp = cupsFileOpen(newfile, "w9")) == NULL)
+  snprintf(newfile, sizeof(newfile), "%s.XXXXXX", filename);
+  if ((fd = mkstemp(newfile)) < 0)
   {
     set_error(strerror(errno), 0);
     return (0);
   }
 
+  fchmod(fd, 0644);
+
+  if ((fp = cupsFileOpenFd(fd, "w9")) == NULL)
+  {
+    set_error(strerror(errno), 0);
+    close(fd);
+    unlink(newfile);
+    return (0);
+  }
+
  /*
   * Standard header...
   */
@@ -4190,8 +4203,13 @@ ppdCacheWriteFile(
     return (0);
   }
 
-  unlink(filename);
-  return (!rename(newfile, filename));
+  if (rename(newfile, filename))
+  {
+    unlink(newfile);
+    return (0);
+  }
+
+  return (1);
 }
 
 
@@ -22,7 +22,11 @@
 #include "ppdc.h"
 #include "file-private.h"
 #include "array-private.h"
+#include "thread-private.h"
 #include <regex.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 
 
@@ -47,6 +51,16 @@
 #define TAR_FIFO	'6'		/* FIFO special file */
 #define TAR_CONTIG	'7'		/* Contiguous file */
 
+#define PPD_DAT_PRODUCTS 0		/* Index of product strings */
+#define PPD_DAT_LANGUAGES 1		/* Index of languages */
+#define PPD_DAT_MODELS	2		/* Index of words in make and model */
+#define PPD_DAT_DEVICE_IDS 3		/* Index of words in device IDs */
+#define PPD_DAT_MAX_INDEX 4		/* Number of string indices */
+#define PPD_DAT_MAX_WORDS 64		/* Maximum words looked up per query */
+#define PPD_MAX_SCANNERS 8		/* Maximum number of scanning threads */
+#define PPD_MAX_DRVS	4		/* Maximum number of parsed driver
+					   information files kept */
+
 
 /*
  * PPD information structures...
@@ -76,16 +90,113 @@ typedef union				/**** TAR record format ****/
   }	header;
 } tar_rec_t;
 
+typedef struct				/**** Indexed ppds.dat header ****/
+{
+  unsigned	sync,			/* Sync word (PPD_SYNC2) */
+		record_size,		/* sizeof(ppd_rec_t) */
+		num_ppds,		/* Number of PPD records */
+		num_keys[PPD_DAT_MAX_INDEX],
+					/* Number of keys in each index */
+		num_files;		/* Number of file fingerprints */
+} ppd_dat_header_t;
+
+typedef struct				/**** File fingerprint ****/
+{
+  time_t	mtime;			/* Modification time */
+  off_t		size;			/* Size in bytes */
+  ino_t		inode;			/* Inode number */
+  char		filename[512];		/* Actual filename */
+} ppd_dat_file_t;
+
+typedef struct				/**** Index key ****/
+{
+  unsigned	record;			/* Record number */
+  unsigned short offset,		/* Offset of string in record */
+		length;			/* Length of string */
+} ppd_dat_key_t;
+
+typedef struct				/**** Index key being sorted ****/
+{
+  const char	*s;			/* String */
+  ppd_dat_key_t	key;			/* Key */
+} ppd_dat_sort_t;
+
+/*
+ * The indexed ppds.dat file consists of the header, the fingerprints of
+ * all files found in the collections sorted by filename, the PPD records
+ * sorted by filename and name, the record numbers sorted by make and model,
+ * and the keys of each string index, sorted case-insensitively.  The file is
+ * used in place, so listing PPDs only touches the records which match, and
+ * only files whose fingerprint changed get opened again.
+ */
+
+typedef struct				/**** Indexed ppds.dat ****/
+{
+  void		*data;			/* File data */
+  size_t	length;			/* Length of file data */
+  int		mapped;			/* Is the data mmap'd? */
+  int		num_files;		/* Number of file fingerprints */
+  const ppd_dat_file_t *files;		/* File fingerprints sorted by
+					   filename */
+  int		num_ppds;		/* Number of PPD records */
+  const ppd_rec_t *records;		/* PPD records sorted by filename and
+					   name */
+  const unsigned *models;		/* Record numbers sorted by make and
+					   model */
+  int		num_keys[PPD_DAT_MAX_INDEX];
+					/* Number of keys in each index */
+  const ppd_dat_key_t *keys[PPD_DAT_MAX_INDEX];
+					/* Keys of each index */
+  char		*found;			/* Found flags of the records */
+} ppd_dat_t;
+
+typedef struct				/**** File to (re)scan ****/
+{
+  char		filename[1024],		/* Actual filename */
+		name[1024];		/* Name to the rest of the world */
+  struct stat	fileinfo;		/* File information */
+  int		serial;			/* Must be scanned by the main thread? */
+} ppd_scan_t;
+
 typedef struct
 {
   cups_array_t	*Inodes;	/* Inodes of directories we've visited*/
+  cups_array_t	*Files,		/* Fingerprints of the files found */
+		*Scans;		/* Files which need to be (re)scanned */
   cups_array_t	*PPDsByName,
 				/* PPD files sorted by filename and name */
 		*PPDsByMakeModel;
 				/* PPD files sorted by make and model */
+  ppd_dat_t	PPDsDat;	/* Indexed ppds.dat file */
   int		ChangedPPD;	/* Did we change the PPD database? */
 } ppd_list_t;
 
+typedef struct				/**** Files being scanned ****/
+{
+  _ppd_mutex_t	mutex;			/* Lock for the next file */
+  ppd_scan_t	**scans;		/* Files to scan */
+  int		num_scans,		/* Number of files */
+		next;			/* Next file to scan */
+  _ppd_mutex_t	logmutex;		/* Lock for the log function */
+  cf_logfunc_t	log;			/* Log function */
+  void		*ld;			/* Aux. data for log function */
+} ppd_scan_queue_t;
+
+typedef struct				/**** Scanning thread ****/
+{
+  ppd_scan_queue_t *queue;		/* Shared queue of files */
+  ppd_list_t	ppdlist;		/* PPDs found by this thread */
+  _ppd_thread_t	thread;			/* Thread ID */
+} ppd_scanner_t;
+
+typedef struct				/**** Parsed driver information file ****/
+{
+  char		filename[1024];		/* Actual filename */
+  time_t	mtime;			/* Modification time */
+  off_t		size;			/* Size in bytes */
+  ppdcSource	*src;			/* Parsed file */
+} ppd_drv_t;
+
 //typedef int (*cupsd_compare_func_t)(const void *, const void *);
 
 
@@ -106,12 +217,21 @@ static const char * const PPDTypes[] =	/* ppd-type values */
 			  "drv",
 			  "archive"
 			};
+static _ppd_mutex_t	DrvMutex = _PPD_MUTEX_INITIALIZER;
+					/* Lock for the parsed driver
+					   information files */
+static ppd_drv_t	Drvs[PPD_MAX_DRVS];
+					/* Parsed driver information files,
+					   most recently used first */
+static int		NumDrvs = 0;	/* Number of parsed files */
 
 
 /*
  * Local functions...
  */
 
+static void		add_file(const char *filename, const char *name,
+				 struct stat *fileinfo, ppd_list_t *ppdlist);
 static ppd_info_t	*add_ppd(const char *filename, const char *name,
 			         const char *language, const char *make,
 				 const char *make_and_model,
@@ -120,6 +240,9 @@ static ppd_info_t	*add_ppd(const char *filename, const char *name,
 				 size_t size, int model_number, int type,
 				 const char *scheme, ppd_list_t *ppdlist,
 				 cf_logfunc_t log, void *ld);
+static int		add_words(const char *start, const char *end,
+				  const char **words, size_t *lengths,
+				  int num_words);
 static cups_file_t	*cat_drv(const char *name, char *ppdname,
 				 cf_logfunc_t log, void *ld);
 static cups_file_t	*cat_static(const char *name,
@@ -127,14 +250,33 @@ static cups_file_t	*cat_static(const char *name,
 static cups_file_t	*cat_tar(const char *name, char *ppdname,
 				 cf_logfunc_t log, void *ld);
 static int		compare_inodes(struct stat *a, struct stat *b);
+static int		compare_files(const ppd_dat_file_t *f0,
+				      const ppd_dat_file_t *f1);
+static int		compare_keys(const void *a, const void *b);
 static int		compare_matches(const ppd_info_t *p0,
 			                const ppd_info_t *p1);
+static int		compare_models(const void *a, const void *b);
 static int		compare_names(const ppd_info_t *p0,
 			              const ppd_info_t *p1);
 static int		compare_ppds(const ppd_info_t *p0,
 			             const ppd_info_t *p1);
+static int		compare_records(const void *a, const void *b);
+static int		compare_words(const char *s, size_t slen,
+			              const char *t, size_t tlen);
+static ppd_info_t	*copy_ppd(const ppd_rec_t *record, int matches);
+static int		find_ppds_dat(ppd_dat_t *dat, const char *filename);
+static int		find_ppds_file(ppd_dat_t *dat, const char *filename);
+static int		find_ppds_keys(ppd_dat_t *dat, int index,
+				       const char *s, size_t len, int prefix,
+				       int *first);
 static void		free_array(cups_array_t *a);
 static void		free_ppdlist(ppd_list_t *ppdlist);
+static void		free_ppds_dat(ppd_dat_t *dat);
+static int		get_words(const char *s, int device_id,
+				  const char **words, size_t *lengths);
+static int		index_ppds_dat(const ppd_rec_t **records,
+				       int num_ppds, int index,
+				       ppd_dat_sort_t *keys);
 static int		load_driver(const char *filename,
 				    const char *name,
 				    ppd_list_t *ppdlist,
@@ -143,6 +285,13 @@ static int		load_drv(const char *filename, const char *name,
 			         cups_file_t *fp, time_t mtime, off_t size,
 				 ppd_list_t *ppdlist,
 				 cf_logfunc_t log, void *ld);
+static ppdcSource	*load_drv_source(const char *filename,
+					 cups_file_t *fp, time_t mtime,
+					 off_t size,
+					 cf_logfunc_t log, void *ld);
+static void		load_file(const char *filename, const char *name,
+				  struct stat *fileinfo, ppd_list_t *ppdlist,
+				  cf_logfunc_t log, void *ld);
 static void		load_ppd(const char *filename, const char *name,
 			         const char *scheme, struct stat *fileinfo,
 			         ppd_info_t *ppd, cups_file_t *fp, off_t end,
@@ -158,6 +307,10 @@ static int		load_tar(const char *filename, const char *name,
 			         cups_file_t *fp, time_t mtime, off_t size,
 				 ppd_list_t *ppdlist,
 				 cf_logfunc_t log, void *ld);
+static int		make_ppds_dat(ppd_list_t *ppdlist,
+				      cf_logfunc_t log, void *ld);
+static int		map_ppds_dat(ppd_dat_t *dat, void *data,
+				     size_t length, int mapped);
 static int		read_tar(cups_file_t *fp, char *name, size_t namesize,
 			         struct stat *info,
 				 cf_logfunc_t log, void *ld);
@@ -165,6 +318,18 @@ static regex_t		*regex_device_id(const char *device_id,
 					 cf_logfunc_t log, void *ld);
 static regex_t		*regex_string(const char *s,
 				      cf_logfunc_t log, void *ld);
+static void		scan_log(void *data, cf_loglevel_t level,
+				 const char *message, ...);
+static void		scan_ppds(ppd_list_t *ppdlist,
+				  cf_logfunc_t log, void *ld);
+static void		scan_queue(ppd_scan_queue_t *queue,
+				   ppd_list_t *ppdlist);
+static void		*scan_thread(ppd_scanner_t *scanner);
+static int		select_ppds(ppd_dat_t *dat, char *selected,
+				    const char *device_id,
+				    const char *language, const char *make,
+				    const char *make_and_model,
+				    const char *product);
 static int		CompareNames(const char *s, const char *t);
 static cups_array_t	*CreateStringsArray(const char *s);
 static int		ExecCommand(const char *command, char **argv);
@@ -189,11 +354,16 @@ ppdCollectionListPPDs(
 	cf_logfunc_t log,		/* I - Log function */
 	void *ld)			/* I - Aux. data for log function */
 {
-  int		i;			/* Looping var */
+  int		i, j;			/* Looping vars */
   ppd_collection_t *col;		/* Pointer to PPD collection */
   int		count;			/* Number of PPDs to list */
   ppd_info_t	*ppd,			/* Current PPD file */
 		*newppd;		/* Copy of current PPD */
+  ppd_dat_t	*dat;			/* Indexed ppds.dat file */
+  const ppd_rec_t *record;		/* Current PPD record */
+  const char	*last_make;		/* Last ppd-make listed */
+  char		*selected;		/* PPD records which can match */
+  int		score;			/* Match score of current PPD */
   cups_file_t	*fp;			/* ppds.dat file */
   cups_array_t	*include,		/* PPD schemes to include */
 		*exclude;		/* PPD schemes to exclude */
@@ -219,7 +389,6 @@ ppdCollectionListPPDs(
   cups_array_t	*matches,		/* Matching PPDs */
 		*result;		/* Resulting PPD list */
   ppd_list_t	ppdlist;		/* Lists of all available PPDs */
-  int		matches_array_created = 0;
 
 
  /*
@@ -230,7 +399,14 @@ ppdCollectionListPPDs(
 					  NULL);
   ppdlist.PPDsByMakeModel = cupsArrayNew((cups_array_func_t)compare_ppds,
 					  NULL);
+  ppdlist.Inodes          = NULL;
+  ppdlist.Files           = cupsArrayNew((cups_array_func_t)compare_files,
+					  NULL);
+  ppdlist.Scans           = cupsArrayNew(NULL, NULL);
   ppdlist.ChangedPPD      = 0;
+  dat                     = &ppdlist.PPDsDat;
+
+  memset(dat, 0, sizeof(ppd_dat_t));
 
 
  /*
@@ -256,6 +432,15 @@ ppdCollectionListPPDs(
     load_ppds(col->path, col->name ? col->name : col->path, 1, &ppdlist,
 	      log, ld);
 
+ /*
+  * Scan the new and changed files, and see whether any files went away...
+  */
+
+  scan_ppds(&ppdlist, log, ld);
+
+  if (cupsArrayCount(ppdlist.Files) != dat->num_files)
+    ppdlist.ChangedPPD = 1;
+
   if (cachename && cachename[0])
   {
    /*
@@ -278,6 +463,35 @@ ppdCollectionListPPDs(
 	ppdlist.ChangedPPD = 1;
       }
 
+   /*
+    * Records of the ppds.dat file which were not found get dropped when
+    * the file is rebuilt...
+    */
+
+    for (i = 0; i < dat->num_ppds; i ++)
+      if (!dat->found[i])
+      {
+	ppdlist.ChangedPPD = 1;
+	break;
+      }
+  }
+
+ /*
+  * New and changed PPD files, and the records of an old-style ppds.dat
+  * file, are not in the index yet, so (re)build it...
+  */
+
+  if (cupsArrayCount(ppdlist.PPDsByName) > 0)
+    ppdlist.ChangedPPD = 1;
+
+  if (ppdlist.ChangedPPD && make_ppds_dat(&ppdlist, log, ld))
+  {
+    free_ppdlist(&ppdlist);
+    return(NULL);
+  }
+
+  if (cachename && cachename[0])
+  {
    /*
     * Write the new ppds.dat file...
     */
@@ -294,15 +508,7 @@ ppdCollectionListPPDs(
 
       if ((fp = cupsFileOpen(newname, "w")) != NULL)
       {
-	unsigned ppdsync = PPD_SYNC;	/* Sync word */
-
-	cupsFileWrite(fp, (char *)&ppdsync, sizeof(ppdsync));
-
-	for (ppd = (ppd_info_t *)cupsArrayFirst(ppdlist.PPDsByName);
-	     ppd;
-	     ppd = (ppd_info_t *)cupsArrayNext(ppdlist.PPDsByName))
-	  cupsFileWrite(fp, (char *)&(ppd->record), sizeof(ppd_rec_t));
-
+	cupsFileWrite(fp, (char *)dat->data, dat->length);
 	cupsFileClose(fp);
 
 	if (rename(newname, cachename))
@@ -314,7 +520,7 @@ ppdCollectionListPPDs(
 	else
 	  if (log) log(ld, CF_LOGLEVEL_INFO,
 		       "libppd: [PPD Collections] Wrote \"%s\", %d PPDs...",
-		       cachename, cupsArrayCount(ppdlist.PPDsByName));
+		       cachename, dat->num_ppds);
       }
       else
 	if (log) log(ld, CF_LOGLEVEL_ERROR,
@@ -388,8 +594,8 @@ ppdCollectionListPPDs(
 		 "libppd: [PPD Collections] %s=\"%s\"", options[i].name,
 		 options[i].value);
 
-  if (limit <= 0 || limit > cupsArrayCount(ppdlist.PPDsByMakeModel))
-    count = cupsArrayCount(ppdlist.PPDsByMakeModel);
+  if (limit <= 0 || limit > dat->num_ppds)
+    count = dat->num_ppds;
   else
     count = limit;
 
@@ -397,7 +603,6 @@ ppdCollectionListPPDs(
       product)
   {
     matches = cupsArrayNew((cups_array_func_t)compare_matches, NULL);
-    matches_array_created = 1;
 
     if (device_id)
       device_id_re = regex_device_id(device_id, log, ld);
@@ -409,9 +614,24 @@ ppdCollectionListPPDs(
     else
       make_and_model_re = NULL;
 
-    for (ppd = (ppd_info_t *)cupsArrayFirst(ppdlist.PPDsByMakeModel);
-	 ppd;
-	 ppd = (ppd_info_t *)cupsArrayNext(ppdlist.PPDsByMakeModel))
+   /*
+    * Use the indices of the ppds.dat file to select the PPDs which can
+    * match, unless we also score values which are not indexed...
+    */
+
+    if (model_number_str || psversion || type_str)
+      selected = NULL;
+    else if ((selected = (char *)calloc((size_t)dat->num_ppds + 1, 1)) !=
+             NULL &&
+	     !select_ppds(dat, selected, device_id_re ? device_id : NULL,
+	                  language, make,
+			  make_and_model_re ? make_and_model : NULL, product))
+    {
+      free(selected);
+      selected = NULL;
+    }
+
+    for (j = 0; j < dat->num_ppds; j ++)
     {
      /*
       * Filter PPDs based on make, model, product, language, model number,
@@ -422,18 +642,23 @@ ppdCollectionListPPDs(
       * by score, highest score first.
       */
 
-      if (ppd->record.type < PPD_TYPE_POSTSCRIPT ||
-	  ppd->record.type >= PPD_TYPE_DRV)
+      if (selected && !selected[dat->models[j]])
+        continue;
+
+      record = dat->records + dat->models[j];
+
+      if (record->type < PPD_TYPE_POSTSCRIPT ||
+	  record->type >= PPD_TYPE_DRV)
 	continue;
 
-      if (cupsArrayFind(exclude, ppd->record.scheme) ||
-          (include && !cupsArrayFind(include, ppd->record.scheme)))
+      if (cupsArrayFind(exclude, (void *)record->scheme) ||
+          (include && !cupsArrayFind(include, (void *)record->scheme)))
         continue;
 
-      ppd->matches = 0;
+      score = 0;
 
       if (device_id_re &&
-	  !regexec(device_id_re, ppd->record.device_id,
+	  !regexec(device_id_re, record->device_id,
                    (size_t)(sizeof(re_matches) / sizeof(re_matches[0])),
 		   re_matches, 0))
       {
@@ -444,26 +669,26 @@ ppdCollectionListPPDs(
 
         for (i = 1; i < (int)(sizeof(re_matches) / sizeof(re_matches[0])); i ++)
 	  if (re_matches[i].rm_so >= 0)
-	    ppd->matches ++;
+	    score ++;
       }
 
       if (language)
       {
 	for (i = 0; i < PPD_MAX_LANG; i ++)
-	  if (!ppd->record.languages[i][0])
+	  if (!record->languages[i][0])
 	    break;
-	  else if (!strcmp(ppd->record.languages[i], language))
+	  else if (!strcmp(record->languages[i], language))
 	  {
-	    ppd->matches ++;
+	    score ++;
 	    break;
 	  }
       }
 
-      if (make && !_ppd_strcasecmp(ppd->record.make, make))
-        ppd->matches ++;
+      if (make && !_ppd_strcasecmp(record->make, make))
+        score ++;
 
       if (make_and_model_re &&
-          !regexec(make_and_model_re, ppd->record.make_and_model,
+          !regexec(make_and_model_re, record->make_and_model,
 	           (size_t)(sizeof(re_matches) / sizeof(re_matches[0])),
 		   re_matches, 0))
       {
@@ -471,31 +696,31 @@ ppdCollectionListPPDs(
 	if (re_matches[0].rm_so == 0)
 	{
 	  if ((size_t)re_matches[0].rm_eo == make_and_model_len)
-	    ppd->matches += 3;		// Exact match
+	    score += 3;			// Exact match
 	  else
-	    ppd->matches += 2;		// Prefix match
+	    score += 2;			// Prefix match
 	}
 	else
-	  ppd->matches ++;		// Infix match
+	  score ++;			// Infix match
       }
 
-      if (model_number_str && ppd->record.model_number == model_number)
-        ppd->matches ++;
+      if (model_number_str && record->model_number == model_number)
+        score ++;
 
       if (product)
       {
 	for (i = 0; i < PPD_MAX_PROD; i ++)
-	  if (!ppd->record.products[i][0])
+	  if (!record->products[i][0])
 	    break;
-	  else if (!_ppd_strcasecmp(ppd->record.products[i], product))
+	  else if (!_ppd_strcasecmp(record->products[i], product))
 	  {
-	    ppd->matches += 3;
+	    score += 3;
 	    break;
 	  }
-	  else if (!_ppd_strncasecmp(ppd->record.products[i], product,
+	  else if (!_ppd_strncasecmp(record->products[i], product,
 	                              product_len))
 	  {
-	    ppd->matches += 2;
+	    score += 2;
 	    break;
 	  }
       }
@@ -503,70 +728,85 @@ ppdCollectionListPPDs(
       if (psversion)
       {
 	for (i = 0; i < PPD_MAX_VERS; i ++)
-	  if (!ppd->record.psversions[i][0])
+	  if (!record->psversions[i][0])
 	    break;
-	  else if (!_ppd_strcasecmp(ppd->record.psversions[i], psversion))
+	  else if (!_ppd_strcasecmp(record->psversions[i], psversion))
 	  {
-	    ppd->matches ++;
+	    score ++;
 	    break;
 	  }
       }
 
-      if (type_str && ppd->record.type == type)
-        ppd->matches ++;
+      if (type_str && record->type == type)
+        score ++;
 
-      if (ppd->matches)
+      if (score)
       {
 	if (log) log(ld, CF_LOGLEVEL_DEBUG,
 		     "libppd: [PPD Collections] %s matches with score %d!",
-		     ppd->record.name, ppd->matches);
-        cupsArrayAdd(matches, ppd);
+		     record->name, score);
+
+       /*
+        * Only the matching records get copied out of the ppds.dat file...
+	*/
+
+	if ((ppd = copy_ppd(record, score)) != NULL)
+	  cupsArrayAdd(matches, ppd);
       }
     }
+
+    if (selected)
+      free(selected);
     if (device_id_re)
       free(device_id_re);
     if (make_and_model_re)
       free(make_and_model_re);
   }
-  else if (include || exclude)
+  else
+    matches = NULL;
+
+  result    = cupsArrayNew(NULL, NULL);
+  last_make = NULL;
+  ppd       = NULL;
+
+  for (j = 0; count > 0; j ++)
   {
-    matches = cupsArrayNew((cups_array_func_t)compare_ppds, NULL);
-    matches_array_created = 1;
+   /*
+    * Get the next matching PPD, or the next PPD in make and model order
+    * if we don't score the PPDs...
+    */
 
-    for (ppd = (ppd_info_t *)cupsArrayFirst(ppdlist.PPDsByMakeModel);
-	 ppd;
-	 ppd = (ppd_info_t *)cupsArrayNext(ppdlist.PPDsByMakeModel))
+    if (matches)
     {
-     /*
-      * Filter PPDs based on the include/exclude lists.
-      */
+      if ((ppd = (ppd_info_t *)(j ? cupsArrayNext(matches) :
+                                    cupsArrayFirst(matches))) == NULL)
+        break;
 
-      if (ppd->record.type < PPD_TYPE_POSTSCRIPT ||
-	  ppd->record.type >= PPD_TYPE_DRV)
-	continue;
+      record = &(ppd->record);
+    }
+    else if (j < dat->num_ppds)
+      record = dat->records + dat->models[j];
+    else
+      break;
 
-      if (cupsArrayFind(exclude, ppd->record.scheme) ||
-          (include && !cupsArrayFind(include, ppd->record.scheme)))
-        continue;
+   /*
+    * Skip invalid and excluded PPDs...
+    */
 
-      cupsArrayAdd(matches, ppd);
-    }
-  }
-  else
-    matches = ppdlist.PPDsByMakeModel;
+    if (record->type < PPD_TYPE_POSTSCRIPT ||
+        record->type >= PPD_TYPE_DRV)
+      continue;
 
-  result = cupsArrayNew(NULL, NULL);
+    if (cupsArrayFind(exclude, (void *)record->scheme) ||
+	(include && !cupsArrayFind(include, (void *)record->scheme)))
+      continue;
 
-  for (ppd = (ppd_info_t *)cupsArrayFirst(ppdlist.PPDsByMakeModel), i = 0;
-       count > 0 && ppd;
-       ppd = (ppd_info_t *)cupsArrayNext(ppdlist.PPDsByMakeModel), i ++)
-  {
    /*
-    * Skip invalid PPDs...
+    * If we have only requested the make, then skip
+    * the remaining PPDs with this make...
     */
 
-    if (ppd->record.type < PPD_TYPE_POSTSCRIPT ||
-        ppd->record.type >= PPD_TYPE_DRV)
+    if (only_makes && last_make && !_ppd_strcasecmp(last_make, record->make))
       continue;
 
    /*
@@ -575,43 +815,22 @@ ppdCollectionListPPDs(
 
     if (log) log(ld, CF_LOGLEVEL_DEBUG,
 		 "libppd: [PPD Collections] Sending %s (%s)...",
-		 ppd->record.name, ppd->record.make_and_model);
+		 record->name, record->make_and_model);
 
     count --;
 
-    if (only_makes)
-      cupsArrayAdd(result, strdup(ppd->record.make));
-    else
-    {
-      newppd = (ppd_info_t *)malloc(sizeof(ppd_info_t));
-      memcpy(newppd, ppd, sizeof(ppd_info_t));
-      cupsArrayAdd(result, newppd);
-    }
-
-   /*
-    * If we have only requested the make, then skip
-    * the remaining PPDs with this make...
-    */
-
     if (only_makes)
     {
-      const char	*this_make;	/* This ppd-make */
-
-
-      for (this_make = ppd->record.make,
-               ppd = (ppd_info_t *)cupsArrayNext(matches);
-	   ppd;
-	   ppd = (ppd_info_t *)cupsArrayNext(matches))
-	if (_ppd_strcasecmp(this_make, ppd->record.make))
-	  break;
-
-      cupsArrayPrev(matches);
+      cupsArrayAdd(result, strdup(record->make));
+      last_make = record->make;
     }
+    else if ((newppd = copy_ppd(record, ppd ? ppd->matches : 0)) != NULL)
+      cupsArrayAdd(result, newppd);
   }
 
   free_ppdlist(&ppdlist);
-  if (matches_array_created)
-    cupsArrayDelete(matches);
+  if (matches)
+    free_array(matches);
 
   return(result);
 }
@@ -813,7 +1032,9 @@ ppdCollectionDumpCache(const char *filename,	/* I - Filename */
 		       void *ld)		/* I - Aux. data for log
 						       function */
 {
+  int		i;			/* Looping var */
   ppd_info_t	*ppd;			/* Current PPD */
+  const ppd_rec_t *record;		/* Current PPD record */
   ppd_list_t	ppdlist;		/* Lists of all available PPDs */
 
 
@@ -822,12 +1043,16 @@ ppdCollectionDumpCache(const char *filename,	/* I - Filename */
   */
 
   ppdlist.Inodes = NULL;
+  ppdlist.Files  = NULL;
+  ppdlist.Scans  = NULL;
   ppdlist.PPDsByName      = cupsArrayNew((cups_array_func_t)compare_names,
 					  NULL);
   ppdlist.PPDsByMakeModel = cupsArrayNew((cups_array_func_t)compare_ppds,
 					  NULL);
   ppdlist.ChangedPPD      = 0;
 
+  memset(&ppdlist.PPDsDat, 0, sizeof(ppdlist.PPDsDat));
+
 
  /*
   * See if we a PPD database file...
@@ -840,23 +1065,99 @@ ppdCollectionDumpCache(const char *filename,	/* I - Filename */
 
   puts("mtime,size,model_number,type,filename,name,languages0,products0,"
        "psversions0,make,make_and_model,device_id,scheme");
-  for (ppd = (ppd_info_t *)cupsArrayFirst(ppdlist.PPDsByName);
-       ppd;
-       ppd = (ppd_info_t *)cupsArrayNext(ppdlist.PPDsByName))
+
+ /*
+  * Indexed files have their records in the PPDsDat image, old-style files
+  * in the PPDsByName array...
+  */
+
+  for (i = 0, ppd = (ppd_info_t *)cupsArrayFirst(ppdlist.PPDsByName);
+       i < ppdlist.PPDsDat.num_ppds || ppd;
+       i ++)
+  {
+    if (i < ppdlist.PPDsDat.num_ppds)
+      record = ppdlist.PPDsDat.records + i;
+    else
+    {
+      record = &(ppd->record);
+      ppd    = (ppd_info_t *)cupsArrayNext(ppdlist.PPDsByName);
+    }
+
     printf("%d,%ld,%d,%d,\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\","
            "\"%s\",\"%s\"\n",
-           (int)ppd->record.mtime, (long)ppd->record.size,
-	   ppd->record.model_number, ppd->record.type, ppd->record.filename,
-	   ppd->record.name, ppd->record.languages[0], ppd->record.products[0],
-	   ppd->record.psversions[0], ppd->record.make,
-	   ppd->record.make_and_model, ppd->record.device_id,
-	   ppd->record.scheme);
+           (int)record->mtime, (long)record->size,
+	   record->model_number, record->type, record->filename,
+	   record->name, record->languages[0], record->products[0],
+	   record->psversions[0], record->make,
+	   record->make_and_model, record->device_id,
+	   record->scheme);
+  }
 
   free_ppdlist(&ppdlist);
   return(0);
 }
 
 
+/*
+ * 'add_file()' - Add the fingerprint of a file and queue it for scanning.
+ */
+
+static void
+add_file(const char  *filename,		/* I - Actual filename */
+         const char  *name,		/* I - Name to the rest of the world or
+					       NULL if the file is unchanged */
+	 struct stat *fileinfo,		/* I - File information */
+	 ppd_list_t  *ppdlist)		/* I - PPD list */
+{
+  ppd_dat_file_t *file;			/* New fingerprint */
+  ppd_scan_t	*scan;			/* New file to scan */
+  const char	*ptr;			/* Pointer to extension */
+
+
+ /*
+  * Files with names which do not fit into the fingerprint simply get
+  * scanned every time...
+  */
+
+  if (strlen(filename) < sizeof(file->filename) &&
+      (file = (ppd_dat_file_t *)calloc(1, sizeof(ppd_dat_file_t))) != NULL)
+  {
+    file->mtime = fileinfo->st_mtime;
+    file->size  = fileinfo->st_size;
+    file->inode = fileinfo->st_ino;
+    strlcpy(file->filename, filename, sizeof(file->filename));
+
+    if (cupsArrayFind(ppdlist->Files, file))
+      free(file);
+    else
+      cupsArrayAdd(ppdlist->Files, file);
+  }
+
+  if (!name || (scan = (ppd_scan_t *)calloc(1, sizeof(ppd_scan_t))) == NULL)
+    return;
+
+  strlcpy(scan->filename, filename, sizeof(scan->filename));
+  strlcpy(scan->name, name, sizeof(scan->name));
+  memcpy(&(scan->fileinfo), fileinfo, sizeof(struct stat));
+
+ /*
+  * Driver information files redirect stderr while they are compiled, and
+  * driver executables are run from a forked child, so neither can be done
+  * from a scanning thread...
+  */
+
+  if ((ptr = strstr(filename, ".tar")) != NULL &&
+      (!strcmp(ptr, ".tar") || !strcmp(ptr, ".tar.gz")))
+    scan->serial = 0;
+  else if ((ptr = strstr(filename, ".drv")) != NULL && !strcmp(ptr, ".drv"))
+    scan->serial = 1;
+  else
+    scan->serial = (fileinfo->st_mode & 0111) && S_ISREG(fileinfo->st_mode);
+
+  cupsArrayAdd(ppdlist->Scans, scan);
+}
+
+
 /*
  * 'add_ppd()' - Add a PPD file.
  */
@@ -933,6 +1234,43 @@ add_ppd(const char *filename,		/* I - PPD filename */
 }
 
 
+/*
+ * 'add_words()' - Add the words inside of a literal string.
+ */
+
+static int				/* O - Number of words */
+add_words(const char *start,		/* I - Start of string */
+          const char *end,		/* I - End of string */
+	  const char **words,		/* O - Words */
+	  size_t     *lengths,		/* O - Lengths of words */
+	  int        num_words)		/* I - Number of words so far */
+{
+  const char	*word,			/* Start of word */
+		*ptr;			/* Pointer into string */
+
+
+ /*
+  * Words at the start or end of the string may be part of longer words in
+  * the PPD, so only add words which have other characters on both sides...
+  */
+
+  for (word = start; word < end && num_words < PPD_DAT_MAX_WORDS; word = ptr)
+  {
+    for (ptr = word; ptr < end && _ppd_isalnum(*ptr); ptr ++);
+
+    if (ptr == word)
+      ptr ++;
+    else if (word > start && ptr < end)
+    {
+      words[num_words]      = word;
+      lengths[num_words ++] = (size_t)(ptr - word);
+    }
+  }
+
+  return (num_words);
+}
+
+
 /*
  * 'cat_drv()' - Generate a PPD from a driver info file.
  */
@@ -943,7 +1281,7 @@ cat_drv(const char *filename,		/* I - *.drv file name */
 	cf_logfunc_t log,		/* I - Log function */
 	void *ld)			/* I - Aux. data for log function */
 {
-  cups_file_t	*fp;			// File pointer
+  struct stat	fileinfo;		// File information
   int		fd;
   char		tempname[1024];		// Name for the temporary file
   ppdcSource	*src;			// PPD source file data
@@ -951,7 +1289,7 @@ cat_drv(const char *filename,		/* I - *.drv file name */
   cups_file_t	*out = NULL;		// PPD output to temp file
   int           fd1, fd2;
 
-  if ((fp = cupsFileOpen(filename, "r")) == NULL)
+  if (stat(filename, &fileinfo))
   {
     if (log) log(ld, CF_LOGLEVEL_ERROR,
 		 "libppd: [PPD Collections] Unable to open \"%s\" - %s\n",
@@ -967,7 +1305,18 @@ cat_drv(const char *filename,		/* I - *.drv file name */
   dup2(fd2, 2);
   close(fd2);
 
-  src = new ppdcSource(filename, fp);
+  /* The parsed file is shared with other calls, so keep it locked while
+     we use it */
+  _ppdMutexLock(&DrvMutex);
+
+  if ((src = load_drv_source(filename, NULL, fileinfo.st_mtime,
+			     fileinfo.st_size, log, ld)) == NULL)
+  {
+    _ppdMutexUnlock(&DrvMutex);
+    dup2(fd1, 2);
+    close(fd1);
+    return (NULL);
+  }
 
   for (d = (ppdcDriver *)src->drivers->first();
        d;
@@ -1022,7 +1371,8 @@ cat_drv(const char *filename,		/* I - *.drv file name */
 		 "libppd: [PPD Collections] PPD \"%s\" not found.\n", ppdname);
 
   src->release();
-  cupsFileClose(fp);
+
+  _ppdMutexUnlock(&DrvMutex);
 
   /* Re-activate stderr output */
   dup2(fd1, 2);
@@ -1164,6 +1514,18 @@ cat_tar(const char *filename,		/* I - Archive name */
 }
 
 
+/*
+ * 'compare_files()' - Compare the filenames of two file fingerprints.
+ */
+
+static int				/* O - Result of comparison */
+compare_files(const ppd_dat_file_t *f0,	/* I - First fingerprint */
+              const ppd_dat_file_t *f1)	/* I - Second fingerprint */
+{
+  return (strcmp(f0->filename, f1->filename));
+}
+
+
 /*
  * 'compare_inodes()' - Compare two inodes.
  */
@@ -1179,6 +1541,29 @@ compare_inodes(struct stat *a,		/* I - First inode */
 }
 
 
+/*
+ * 'compare_keys()' - Compare index keys for sorting.
+ */
+
+static int				/* O - Result of comparison */
+compare_keys(const void *a,		/* I - First key */
+             const void *b)		/* I - Second key */
+{
+  const ppd_dat_sort_t	*k0 = (const ppd_dat_sort_t *)a,
+			*k1 = (const ppd_dat_sort_t *)b;
+  int			diff;		/* Difference between strings */
+
+
+  if ((diff = compare_words(k0->s, k0->key.length, k1->s,
+                            k1->key.length)) != 0)
+    return (diff);
+  else if (k0->key.record < k1->key.record)
+    return (-1);
+  else
+    return (k0->key.record > k1->key.record);
+}
+
+
 /*
  * 'compare_matches()' - Compare PPD match scores for sorting.
  */
@@ -1195,6 +1580,35 @@ compare_matches(const ppd_info_t *p0,	/* I - First PPD */
 }
 
 
+/*
+ * 'compare_models()' - Compare PPD record make and model names for sorting.
+ */
+
+static int				/* O - Result of comparison */
+compare_models(const void *a,		/* I - First PPD record pointer */
+               const void *b)		/* I - Second PPD record pointer */
+{
+  const ppd_rec_t	*r0 = *(const ppd_rec_t * const *)a,
+			*r1 = *(const ppd_rec_t * const *)b;
+  int			diff;		/* Difference between strings */
+
+
+ /*
+  * First compare manufacturers...
+  */
+
+  if ((diff = _ppd_strcasecmp(r0->make, r1->make)) != 0)
+    return (diff);
+  else if ((diff = CompareNames(r0->make_and_model,
+                                r1->make_and_model)) != 0)
+    return (diff);
+  else if ((diff = strcmp(r0->languages[0], r1->languages[0])) != 0)
+    return (diff);
+  else
+    return (compare_records(a, b));
+}
+
+
 /*
  * 'compare_names()' - Compare PPD filenames for sorting.
  */
@@ -1203,13 +1617,11 @@ static int				/* O - Result of comparison */
 compare_names(const ppd_info_t *p0,	/* I - First PPD file */
               const ppd_info_t *p1)	/* I - Second PPD file */
 {
-  int	diff;				/* Difference between strings */
+  const ppd_rec_t	*r0 = &(p0->record),
+			*r1 = &(p1->record);
 
 
-  if ((diff = strcmp(p0->record.filename, p1->record.filename)) != 0)
-    return (diff);
-  else
-    return (strcmp(p0->record.name, p1->record.name));
+  return (compare_records(&r0, &r1));
 }
 
 
@@ -1221,68 +1633,420 @@ static int				/* O - Result of comparison */
 compare_ppds(const ppd_info_t *p0,	/* I - First PPD file */
              const ppd_info_t *p1)	/* I - Second PPD file */
 {
-  int	diff;				/* Difference between strings */
+  const ppd_rec_t	*r0 = &(p0->record),
+			*r1 = &(p1->record);
 
 
- /*
-  * First compare manufacturers...
-  */
+  return (compare_models(&r0, &r1));
+}
 
-  if ((diff = _ppd_strcasecmp(p0->record.make, p1->record.make)) != 0)
-    return (diff);
-  else if ((diff = CompareNames(p0->record.make_and_model,
-                                     p1->record.make_and_model)) != 0)
-    return (diff);
-  else if ((diff = strcmp(p0->record.languages[0],
-                          p1->record.languages[0])) != 0)
+
+/*
+ * 'compare_records()' - Compare PPD record filenames for sorting.
+ */
+
+static int				/* O - Result of comparison */
+compare_records(const void *a,		/* I - First PPD record pointer */
+                const void *b)		/* I - Second PPD record pointer */
+{
+  const ppd_rec_t	*r0 = *(const ppd_rec_t * const *)a,
+			*r1 = *(const ppd_rec_t * const *)b;
+  int			diff;		/* Difference between strings */
+
+
+  if ((diff = strcmp(r0->filename, r1->filename)) != 0)
     return (diff);
   else
-    return (compare_names(p0, p1));
+    return (strcmp(r0->name, r1->name));
 }
 
 
 /*
- * 'free_array()' - Free an array of strings.
+ * 'compare_words()' - Compare two strings case-insensitively for the
+ *                     indices of ppds.dat.
  */
 
-static void
-free_array(cups_array_t *a)		/* I - Array to free */
+static int				/* O - Result of comparison */
+compare_words(const char *s,		/* I - First string */
+              size_t     slen,		/* I - Length of first string */
+	      const char *t,		/* I - Second string */
+	      size_t     tlen)		/* I - Length of second string */
 {
-  char	*ptr;				/* Pointer to string */
+  int	diff;				/* Difference between characters */
 
 
-  for (ptr = (char *)cupsArrayFirst(a);
-       ptr;
-       ptr = (char *)cupsArrayNext(a))
-    free(ptr);
+  for (; slen > 0 && tlen > 0; s ++, t ++, slen --, tlen --)
+    if ((diff = _ppd_tolower(*s) - _ppd_tolower(*t)) != 0)
+      return (diff);
 
-  cupsArrayDelete(a);
+  if (slen > 0)
+    return (1);
+  else if (tlen > 0)
+    return (-1);
+  else
+    return (0);
 }
 
 
 /*
- * 'free_ppdlist()' - Free the PPD list arrays.
+ * 'copy_ppd()' - Copy a PPD record into a new PPD.
  */
 
-static void
-free_ppdlist(ppd_list_t *ppdlist)	/* I - PPD list to free */
+static ppd_info_t *			/* O - New PPD or NULL */
+copy_ppd(const ppd_rec_t *record,	/* I - PPD record */
+         int             matches)	/* I - Match score */
 {
-  struct stat	*dinfoptr;		/* Pointer to Inode info */
-  ppd_info_t	*ppd;			/* Pointer to PPD info */
+  ppd_info_t	*ppd;			/* New PPD */
 
 
-  for (dinfoptr = (struct stat *)cupsArrayFirst(ppdlist->Inodes);
-       dinfoptr;
-       dinfoptr = (struct stat *)cupsArrayNext(ppdlist->Inodes))
-    free(dinfoptr);
+  if ((ppd = (ppd_info_t *)malloc(sizeof(ppd_info_t))) != NULL)
+  {
+    ppd->found   = 1;
+    ppd->matches = matches;
+
+    memcpy(&(ppd->record), record, sizeof(ppd_rec_t));
+  }
+
+  return (ppd);
+}
+
+
+/*
+ * 'find_ppds_dat()' - Find the first PPD record of a file in the ppds.dat
+ *                     file.
+ */
+
+static int				/* O - Record number or -1 */
+find_ppds_dat(ppd_dat_t  *dat,		/* I - Indexed ppds.dat file */
+              const char *filename)	/* I - PPD filename */
+{
+  int	left,				/* Left side of search */
+	right,				/* Right side of search */
+	current;			/* Current record */
+
+
+  left  = 0;
+  right = dat->num_ppds;
+
+  while (left < right)
+  {
+    current = (left + right) / 2;
+
+    if (strcmp(dat->records[current].filename, filename) < 0)
+      left = current + 1;
+    else
+      right = current;
+  }
+
+  if (left < dat->num_ppds && !strcmp(dat->records[left].filename, filename))
+    return (left);
+  else
+    return (-1);
+}
+
+
+/*
+ * 'find_ppds_file()' - Find the fingerprint of a file in the ppds.dat file.
+ */
+
+static int				/* O - Fingerprint number or -1 */
+find_ppds_file(ppd_dat_t  *dat,		/* I - Indexed ppds.dat file */
+               const char *filename)	/* I - Actual filename */
+{
+  int	left,				/* Left side of search */
+	right,				/* Right side of search */
+	current,			/* Current fingerprint */
+	diff;				/* Result of comparison */
+
+
+  left  = 0;
+  right = dat->num_files - 1;
+
+  while (left <= right)
+  {
+    current = (left + right) / 2;
+
+    if ((diff = strcmp(filename, dat->files[current].filename)) == 0)
+      return (current);
+    else if (diff < 0)
+      right = current - 1;
+    else
+      left = current + 1;
+  }
+
+  return (-1);
+}
+
+
+/*
+ * 'find_ppds_keys()' - Find the keys for a string in an index of the
+ *                      ppds.dat file.
+ */
+
+static int				/* O - Number of matching keys */
+find_ppds_keys(ppd_dat_t  *dat,		/* I - Indexed ppds.dat file */
+               int        index,	/* I - Index to search */
+	       const char *s,		/* I - String */
+	       size_t     len,		/* I - Length of string */
+	       int        prefix,	/* I - Match keys starting with s? */
+	       int        *first)	/* O - First matching key */
+{
+  const ppd_dat_key_t *key;		/* Current key */
+  size_t	keylen;			/* Length of key string */
+  int		i,			/* Looping var */
+		bounds[2],		/* First and last+1 matching key */
+		left,			/* Left side of search */
+		right,			/* Right side of search */
+		current,		/* Current key */
+		diff;			/* Result of comparison */
+
+
+ /*
+  * Find the first key which is not less than the string, then the first
+  * key which is greater than it.  For prefix matches only the first len
+  * characters of the keys are compared...
+  */
+
+  for (i = 0; i < 2; i ++)
+  {
+    left  = 0;
+    right = dat->num_keys[index];
+
+    while (left < right)
+    {
+      current = (left + right) / 2;
+      key     = dat->keys[index] + current;
+      keylen  = key->length;
+
+      if (prefix && keylen > len)
+        keylen = len;
+
+      diff = compare_words((const char *)(dat->records + key->record) +
+                               key->offset, keylen, s, len);
+
+      if (diff < 0 || (i && !diff))
+        left = current + 1;
+      else
+        right = current;
+    }
+
+    bounds[i] = left;
+  }
+
+  *first = bounds[0];
+
+  return (bounds[1] - bounds[0]);
+}
+
+
+/*
+ * 'free_array()' - Free an array of strings.
+ */
+
+static void
+free_array(cups_array_t *a)		/* I - Array to free */
+{
+  char	*ptr;				/* Pointer to string */
+
+
+  for (ptr = (char *)cupsArrayFirst(a);
+       ptr;
+       ptr = (char *)cupsArrayNext(a))
+    free(ptr);
+
+  cupsArrayDelete(a);
+}
+
+
+/*
+ * 'free_ppdlist()' - Free the PPD list arrays.
+ */
+
+static void
+free_ppdlist(ppd_list_t *ppdlist)	/* I - PPD list to free */
+{
+  struct stat	*dinfoptr;		/* Pointer to Inode info */
+  ppd_info_t	*ppd;			/* Pointer to PPD info */
+
+
+  for (dinfoptr = (struct stat *)cupsArrayFirst(ppdlist->Inodes);
+       dinfoptr;
+       dinfoptr = (struct stat *)cupsArrayNext(ppdlist->Inodes))
+    free(dinfoptr);
   cupsArrayDelete(ppdlist->Inodes);
 
+  free_array(ppdlist->Files);
+  free_array(ppdlist->Scans);
+
   for (ppd = (ppd_info_t *)cupsArrayFirst(ppdlist->PPDsByName);
        ppd;
        ppd = (ppd_info_t *)cupsArrayNext(ppdlist->PPDsByName))
     free(ppd);
   cupsArrayDelete(ppdlist->PPDsByName);
   cupsArrayDelete(ppdlist->PPDsByMakeModel);
+
+  free_ppds_dat(&ppdlist->PPDsDat);
+}
+
+
+/*
+ * 'free_ppds_dat()' - Free the ppds.dat file.
+ */
+
+static void
+free_ppds_dat(ppd_dat_t *dat)		/* I - Indexed ppds.dat file */
+{
+  if (dat->data)
+  {
+    if (dat->mapped)
+      munmap(dat->data, dat->length);
+    else
+      free(dat->data);
+  }
+
+  if (dat->found)
+    free(dat->found);
+
+  memset(dat, 0, sizeof(ppd_dat_t));
+}
+
+
+/*
+ * 'get_words()' - Get the words which a PPD matching a ppd-device-id or
+ *                 ppd-make-and-model value has to contain.
+ *
+ * The regular expressions allow any text around the value and, for device
+ * IDs, around the parts of the values which end with a colon, so only the
+ * words inside of these literal strings are known to be whole words.
+ */
+
+static int				/* O - Number of words, 0 if unknown */
+get_words(const char *s,		/* I - Value */
+          int        device_id,		/* I - 1 for ppd-device-id */
+	  const char **words,		/* O - Words */
+	  size_t     *lengths)		/* O - Lengths of words */
+{
+  int		num_words;		/* Number of words */
+  const char	*start;			/* Start of literal string */
+
+
+ /*
+  * Long values get truncated by regex_device_id() and regex_string(), and
+  * some characters are not escaped and remain regular expression operators.
+  */
+
+  if (strlen(s) > 1024 || strpbrk(s, device_id ? "+?" : "(){}"))
+    return (0);
+
+  if (!device_id)
+    return (add_words(s, s + strlen(s), words, lengths, 0));
+
+  for (num_words = 0; *s;)
+  {
+    if (!_ppd_strncasecmp(s, "MANUFACTURER:", 13) ||
+        !_ppd_strncasecmp(s, "MFG:", 4) ||
+        !_ppd_strncasecmp(s, "MFR:", 4) ||
+        !_ppd_strncasecmp(s, "MODEL:", 6) ||
+        !_ppd_strncasecmp(s, "MDL:", 4))
+    {
+     /*
+      * KEY:.*value.*; - the optional command set is not used...
+      */
+
+      s = strchr(s, ':') + 1;
+
+      while (*s && *s != ';')
+      {
+        for (start = s; *s && *s != ';' && *s != ':'; s ++);
+
+        if (*s == ':')
+	  s ++;
+
+        num_words = add_words(start, s, words, lengths, num_words);
+      }
+    }
+    else if ((s = strchr(s, ';')) == NULL)
+      break;
+    else
+      s ++;
+  }
+
+  return (num_words);
+}
+
+
+/*
+ * 'index_ppds_dat()' - Collect the keys of an index of the ppds.dat file.
+ */
+
+static int				/* O - Number of keys */
+index_ppds_dat(const ppd_rec_t **records,/* I - PPD records */
+               int             num_ppds,/* I - Number of PPD records */
+	       int             index,	/* I - Index */
+	       ppd_dat_sort_t  *keys)	/* O - Keys or NULL to count */
+{
+  int		i, j,			/* Looping vars */
+		num_keys;		/* Number of keys */
+  const ppd_rec_t *record;		/* Current record */
+  const char	*s,			/* Current string */
+		*word;			/* Start of word */
+
+
+  for (i = 0, num_keys = 0; i < num_ppds; i ++)
+  {
+    record = records[i];
+
+    for (j = 0, s = NULL;; j ++)
+    {
+     /*
+      * Get the next string or word to index...
+      */
+
+      if (index == PPD_DAT_PRODUCTS)
+      {
+        if (j >= PPD_MAX_PROD || !record->products[j][0])
+	  break;
+
+        word = record->products[j];
+	s    = word + strlen(word);
+      }
+      else if (index == PPD_DAT_LANGUAGES)
+      {
+        if (j >= PPD_MAX_LANG || !record->languages[j][0])
+	  break;
+
+        word = record->languages[j];
+	s    = word + strlen(word);
+      }
+      else
+      {
+        if (j == 0)
+	  s = index == PPD_DAT_MODELS ? record->make_and_model :
+	                                record->device_id;
+
+        while (*s && !_ppd_isalnum(*s))
+	  s ++;
+
+        if (!*s)
+	  break;
+
+        for (word = s; _ppd_isalnum(*s); s ++);
+      }
+
+      if (keys)
+      {
+        keys[num_keys].s          = word;
+	keys[num_keys].key.record = (unsigned)i;
+	keys[num_keys].key.offset = (unsigned short)(word -
+	                                             (const char *)record);
+	keys[num_keys].key.length = (unsigned short)(s - word);
+      }
+
+      num_keys ++;
+    }
+  }
+
+  return (num_keys);
 }
 
 
@@ -1489,14 +2253,17 @@ load_drv(const char  *filename,		/* I - Actual filename */
   * Load the driver info file...
   */
 
-  src = new ppdcSource(filename, fp);
+  _ppdMutexLock(&DrvMutex);
 
-  if (src->drivers->count == 0)
+  if ((src = load_drv_source(filename, fp, mtime, size, log, ld)) == NULL ||
+      src->drivers->count == 0)
   {
     if (log) log(ld, CF_LOGLEVEL_ERROR,
 		 "libppd: [PPD Collections] Bad driver information file \"%s\"!\n",
 		 filename);
-    src->release();
+    if (src)
+      src->release();
+    _ppdMutexUnlock(&DrvMutex);
     /* Re-activate stderr output */
     dup2(fd1, 2);
     close(fd1);
@@ -1588,6 +2355,8 @@ load_drv(const char  *filename,		/* I - Actual filename */
 
   src->release();
 
+  _ppdMutexUnlock(&DrvMutex);
+
  /*
   * Re-activate stderr output
   */
@@ -1599,6 +2368,157 @@ load_drv(const char  *filename,		/* I - Actual filename */
 }
 
 
+/*
+ * 'load_drv_source()' - Get the parsed data of a driver information file.
+ *
+ * The last few parsed files are kept, so a file only gets parsed again when
+ * it changes.  The caller must hold DrvMutex and release the returned data.
+ */
+
+static ppdcSource *			/* O - Parsed file or NULL */
+load_drv_source(const char  *filename,	/* I - Actual filename */
+		cups_file_t *fp,	/* I - File to read from or NULL */
+		time_t      mtime,	/* I - Mod time of driver info file */
+		off_t       size,	/* I - Size of driver info file */
+		cf_logfunc_t log,	/* I - Log function */
+		void        *ld)	/* I - Aux. data for log function */
+{
+  int		i;			/* Looping var */
+  ppd_drv_t	drv;			/* Current parsed file */
+  cups_file_t	*drvfp;			/* File to read from */
+
+
+  for (i = 0; i < NumDrvs; i ++)
+    if (!strcmp(Drvs[i].filename, filename))
+      break;
+
+  if (i < NumDrvs)
+  {
+    drv = Drvs[i];
+    NumDrvs --;
+    memmove(Drvs + i, Drvs + i + 1, (size_t)(NumDrvs - i) * sizeof(ppd_drv_t));
+
+    if (drv.mtime != mtime || drv.size != size)
+    {
+     /*
+      * The file changed, parse it again...
+      */
+
+      drv.src->release();
+      drv.src = NULL;
+    }
+  }
+  else
+    drv.src = NULL;
+
+  if (!drv.src)
+  {
+    if ((drvfp = fp) == NULL &&
+        (drvfp = cupsFileOpen(filename, "r")) == NULL)
+    {
+      if (log) log(ld, CF_LOGLEVEL_ERROR,
+		   "libppd: [PPD Collections] Unable to open \"%s\" - %s\n",
+		   filename, strerror(errno));
+      return (NULL);
+    }
+
+    strlcpy(drv.filename, filename, sizeof(drv.filename));
+    drv.mtime = mtime;
+    drv.size  = size;
+    drv.src   = new ppdcSource(filename, drvfp);
+
+    if (drvfp != fp)
+      cupsFileClose(drvfp);
+
+    if (NumDrvs >= PPD_MAX_DRVS)
+    {
+      NumDrvs --;
+      Drvs[NumDrvs].src->release();
+    }
+  }
+
+ /*
+  * Put the file first, it is the most recently used one...
+  */
+
+  memmove(Drvs + 1, Drvs, (size_t)NumDrvs * sizeof(ppd_drv_t));
+  Drvs[0] = drv;
+  NumDrvs ++;
+
+  drv.src->retain();
+
+  return (drv.src);
+}
+
+
+/*
+ * 'load_file()' - Load the PPD files of a new or changed file.
+ */
+
+static void
+load_file(const char  *filename,	/* I - Actual filename */
+          const char  *name,		/* I - Name to the rest of the world */
+	  struct stat *fileinfo,	/* I - File information */
+	  ppd_list_t  *ppdlist,		/* I - PPD list */
+	  cf_logfunc_t log,		/* I - Log function */
+	  void        *ld)		/* I - Aux. data for log function */
+{
+  cups_file_t	*fp;			/* Pointer to file */
+  char		line[256];		/* Line from file */
+  const char	*ptr;			/* Pointer into name */
+
+
+  if ((fp = cupsFileOpen(filename, "r")) == NULL)
+    return;
+
+ /*
+  * Now see if this is a PPD file...
+  */
+
+  line[0] = '\0';
+  cupsFileGets(fp, line, sizeof(line));
+
+  if (!strncmp(line, "*PPD-Adobe:", 11))
+  {
+   /*
+    * Yes, load it...
+    */
+
+    load_ppd(filename, name, "file", fileinfo, NULL, fp, 0, ppdlist, log, ld);
+  }
+  else
+  {
+   /*
+    * Nope, treat it as a an archive, a PPD-generating executable, or a
+    * driver information file...
+    */
+
+    cupsFileRewind(fp);
+
+    if ((ptr = strstr(filename, ".tar")) != NULL &&
+        (!strcmp(ptr, ".tar") || !strcmp(ptr, ".tar.gz")))
+      load_tar(filename, name, fp, fileinfo->st_mtime, fileinfo->st_size,
+	       ppdlist, log, ld);
+    else if ((ptr = strstr(filename, ".drv")) != NULL &&
+	     !strcmp(ptr, ".drv"))
+      load_drv(filename, name, fp, fileinfo->st_mtime, fileinfo->st_size,
+	       ppdlist, log, ld);
+    else if ((fileinfo->st_mode & 0111) && S_ISREG(fileinfo->st_mode))
+    {
+      /* File is not a PPD, not an archive, but executable, try whether
+	 it generates PPDs... */
+      load_driver(filename, name, ppdlist, log, ld);
+    }
+  }
+
+ /*
+  * Close the file...
+  */
+
+  cupsFileClose(fp);
+}
+
+
 /*
  * 'load_ppd()' - Load a PPD file.
  */
@@ -2041,17 +2961,13 @@ load_ppds(const char *d,		/* I - Actual directory */
 	  cf_logfunc_t log,		/* I - Log function */
 	  void *ld)			/* I - Aux. data for log function */
 {
+  int		i;			/* Record in ppds.dat */
   struct stat	dinfo,			/* Directory information */
 		*dinfoptr;		/* Pointer to match */
-  cups_file_t	*fp;			/* Pointer to file */
   cups_dir_t	*dir;			/* Directory pointer */
   cups_dentry_t	*dent;			/* Directory entry */
   char		filename[1024],		/* Name of PPD or directory */
-		line[256],		/* Line from file */
-		*ptr,			/* Pointer into name */
 		name[1024];		/* Name of PPD file */
-  ppd_info_t	*ppd,			/* New PPD file */
-		key;			/* Search key */
 
 
  /*
@@ -2162,86 +3078,33 @@ load_ppds(const char *d,		/* I - Actual directory */
     * See if this file has been scanned before...
     */
 
-    strlcpy(key.record.filename, filename, sizeof(key.record.filename));
-    strlcpy(key.record.name, name, sizeof(key.record.name));
-
-    ppd = (ppd_info_t *)cupsArrayFind(ppdlist->PPDsByName, &key);
-
-    if (ppd &&
-	ppd->record.size == dent->fileinfo.st_size &&
-	ppd->record.mtime == dent->fileinfo.st_mtime)
+    if ((i = find_ppds_file(&ppdlist->PPDsDat, filename)) >= 0 &&
+        ppdlist->PPDsDat.files[i].size == dent->fileinfo.st_size &&
+	ppdlist->PPDsDat.files[i].mtime == dent->fileinfo.st_mtime &&
+	ppdlist->PPDsDat.files[i].inode == dent->fileinfo.st_ino)
     {
      /*
-      * Rewind to the first entry for this file...
-      */
-
-      while ((ppd = (ppd_info_t *)cupsArrayPrev(ppdlist->PPDsByName)) != NULL &&
-	     !strcmp(ppd->record.filename, filename));
-
-     /*
-      * Then mark all of the matches for this file as found...
+      * Yes, mark all of the records for this file in the ppds.dat file as
+      * found...
       */
 
-      while ((ppd = (ppd_info_t *)cupsArrayNext(ppdlist->PPDsByName)) != NULL &&
-	     !strcmp(ppd->record.filename, filename))
-        ppd->found = 1;
+      for (i = find_ppds_dat(&ppdlist->PPDsDat, filename);
+           i >= 0 && i < ppdlist->PPDsDat.num_ppds &&
+	       !strcmp(ppdlist->PPDsDat.records[i].filename, filename);
+	   i ++)
+        ppdlist->PPDsDat.found[i] = 1;
 
+      add_file(filename, NULL, &dent->fileinfo, ppdlist);
       continue;
     }
 
    /*
-    * No, file is new/changed, so re-scan it...
-    */
-
-    if ((fp = cupsFileOpen(filename, "r")) == NULL)
-      continue;
-
-   /*
-    * Now see if this is a PPD file...
+    * No, file is new/changed, so re-scan it later...
     */
 
-    line[0] = '\0';
-    cupsFileGets(fp, line, sizeof(line));
-
-    if (!strncmp(line, "*PPD-Adobe:", 11))
-    {
-     /*
-      * Yes, load it...
-      */
-
-      load_ppd(filename, name, "file", &dent->fileinfo, ppd, fp, 0, ppdlist,
-	       log, ld);
-    }
-    else
-    {
-     /*
-      * Nope, treat it as a an archive, a PPD-generating executable, or a
-      * driver information file...
-      */
-
-      cupsFileRewind(fp);
-
-      if ((ptr = strstr(filename, ".tar")) != NULL &&
-          (!strcmp(ptr, ".tar") || !strcmp(ptr, ".tar.gz")))
-        load_tar(filename, name, fp, dent->fileinfo.st_mtime,
-                 dent->fileinfo.st_size, ppdlist, log, ld);
-      else if ((ptr = strstr(filename, ".drv")) != NULL && !strcmp(ptr, ".drv"))
-	load_drv(filename, name, fp, dent->fileinfo.st_mtime,
-		 dent->fileinfo.st_size, ppdlist, log, ld);
-      else if ((dent->fileinfo.st_mode & 0111) &&
-	       S_ISREG(dent->fileinfo.st_mode))
-      {
-	/* File is not a PPD, not an archive, but executable, try whether
-	   it generates PPDs... */
-	load_driver(filename, name, ppdlist, log, ld);
-      }
-    }
-
-   /*
-    * Close the file...
-    */
+    add_file(filename, name, &dent->fileinfo, ppdlist);
 
-    cupsFileClose(fp);
+    ppdlist->ChangedPPD = 1;
   }
 
   cupsDirClose(dir);
@@ -2264,10 +3127,49 @@ load_ppds_dat(const char *filename,	/* I - Filename */
   ppd_info_t	*ppd;			/* Current PPD file */
   cups_file_t	*fp;			/* ppds.dat file */
   struct stat	fileinfo;		/* ppds.dat information */
+  int		fd;			/* ppds.dat file descriptor */
+  void		*data;			/* Mapped ppds.dat file */
+
+
+  if (filename == NULL || !filename[0])
+    return(0);
 
+ /*
+  * Indexed ppds.dat files are mapped into memory and used in place...
+  */
+
+  if ((fd = open(filename, O_RDONLY)) >= 0)
+  {
+    if (!fstat(fd, &fileinfo) &&
+        fileinfo.st_size >= (off_t)sizeof(ppd_dat_header_t) &&
+	(data = mmap(NULL, (size_t)fileinfo.st_size, PROT_READ, MAP_PRIVATE,
+		     fd, 0)) != MAP_FAILED)
+    {
+      if (((ppd_dat_header_t *)data)->sync != PPD_SYNC2)
+        munmap(data, (size_t)fileinfo.st_size);
+      else if (map_ppds_dat(&ppdlist->PPDsDat, data,
+                            (size_t)fileinfo.st_size, 1))
+      {
+	if (verbose)
+	  if (log) log(ld, CF_LOGLEVEL_ERROR,
+		       "libppd: [PPD Collections] Bad ppds.dat file \"%s\" "
+		       "ignored!", filename);
+	close(fd);
+	return(0);
+      }
+      else
+      {
+	if (verbose)
+	  if (log) log(ld, CF_LOGLEVEL_INFO,
+		       "libppd: [PPD Collections] Mapped \"%s\", %d PPDs...",
+		       filename, ppdlist->PPDsDat.num_ppds);
+	close(fd);
+	return(0);
+      }
+    }
 
-  if (filename == NULL || !filename[0])
-    return(0);
+    close(fd);
+  }
 
   if ((fp = cupsFileOpen(filename, "r")) != NULL)
   {
@@ -2381,6 +3283,257 @@ load_tar(const char  *filename,		/* I - Actual filename */
 }
 
 
+/*
+ * 'make_ppds_dat()' - Make a new indexed ppds.dat file from the PPD records
+ *                     found.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+make_ppds_dat(ppd_list_t   *ppdlist,	/* I - PPD list */
+	      cf_logfunc_t log,		/* I - Log function */
+	      void         *ld)		/* I - Aux. data for log function */
+{
+  int		i,			/* Looping var */
+		num_files,		/* Number of file fingerprints */
+		num_ppds,		/* Number of PPD records */
+		num_keys[PPD_DAT_MAX_INDEX],
+					/* Number of keys in each index */
+		max_keys;		/* Maximum number of keys in an index */
+  ppd_dat_t	*dat = &(ppdlist->PPDsDat);
+					/* Current ppds.dat file */
+  ppd_info_t	*ppd;			/* Current PPD */
+  ppd_dat_file_t *file;			/* Current file fingerprint */
+  const ppd_rec_t **records;		/* PPD records to write */
+  ppd_dat_sort_t *keys;			/* Keys of current index */
+  size_t	length;			/* Length of new ppds.dat file */
+  char		*data;			/* New ppds.dat file */
+  ppd_dat_header_t *header;		/* Header of new file */
+  ppd_dat_file_t *newfiles;		/* Fingerprints in new file */
+  ppd_rec_t	*newrecords;		/* Records in new file */
+  unsigned	*models;		/* Make and model order in new file */
+  ppd_dat_key_t	*newkeys;		/* Keys in new file */
+
+
+ /*
+  * Collect the records found in the old ppds.dat file and the new ones, and
+  * sort them by filename and name...
+  */
+
+  num_ppds = cupsArrayCount(ppdlist->PPDsByName);
+  for (i = 0; i < dat->num_ppds; i ++)
+    if (dat->found[i])
+      num_ppds ++;
+
+  if ((records = (const ppd_rec_t **)calloc((size_t)num_ppds + 1,
+                                            sizeof(ppd_rec_t *))) == NULL)
+  {
+    if (log) log(ld, CF_LOGLEVEL_ERROR,
+		 "libppd: [PPD Collections] Ran out of memory for %d PPD "
+		 "files!", num_ppds);
+    return (-1);
+  }
+
+  for (i = 0, num_ppds = 0; i < dat->num_ppds; i ++)
+    if (dat->found[i])
+      records[num_ppds ++] = dat->records + i;
+
+  for (ppd = (ppd_info_t *)cupsArrayFirst(ppdlist->PPDsByName);
+       ppd;
+       ppd = (ppd_info_t *)cupsArrayNext(ppdlist->PPDsByName))
+    records[num_ppds ++] = &(ppd->record);
+
+  qsort(records, (size_t)num_ppds, sizeof(ppd_rec_t *), compare_records);
+
+ /*
+  * Allocate the new file...
+  */
+
+  num_files = cupsArrayCount(ppdlist->Files);
+  length    = sizeof(ppd_dat_header_t) +
+              (size_t)num_files * sizeof(ppd_dat_file_t) +
+              (size_t)num_ppds * (sizeof(ppd_rec_t) + sizeof(unsigned));
+  max_keys = 0;
+
+  for (i = 0; i < PPD_DAT_MAX_INDEX; i ++)
+  {
+    num_keys[i] = index_ppds_dat(records, num_ppds, i, NULL);
+    length      += (size_t)num_keys[i] * sizeof(ppd_dat_key_t);
+
+    if (num_keys[i] > max_keys)
+      max_keys = num_keys[i];
+  }
+
+  if ((data = (char *)calloc(1, length)) == NULL ||
+      (keys = (ppd_dat_sort_t *)calloc((size_t)max_keys + 1,
+                                       sizeof(ppd_dat_sort_t))) == NULL)
+  {
+    if (log) log(ld, CF_LOGLEVEL_ERROR,
+		 "libppd: [PPD Collections] Ran out of memory for %d PPD "
+		 "files!", num_ppds);
+    free(data);
+    free(records);
+    return (-1);
+  }
+
+  header     = (ppd_dat_header_t *)data;
+  newfiles   = (ppd_dat_file_t *)(header + 1);
+  newrecords = (ppd_rec_t *)(newfiles + num_files);
+  models     = (unsigned *)(newrecords + num_ppds);
+  newkeys    = (ppd_dat_key_t *)(models + num_ppds);
+
+  header->sync        = PPD_SYNC2;
+  header->record_size = sizeof(ppd_rec_t);
+  header->num_ppds    = (unsigned)num_ppds;
+  header->num_files   = (unsigned)num_files;
+
+  for (file = (ppd_dat_file_t *)cupsArrayFirst(ppdlist->Files);
+       file;
+       file = (ppd_dat_file_t *)cupsArrayNext(ppdlist->Files))
+    memcpy(newfiles ++, file, sizeof(ppd_dat_file_t));
+
+  for (i = 0; i < num_ppds; i ++)
+  {
+    memcpy(newrecords + i, records[i], sizeof(ppd_rec_t));
+    records[i] = newrecords + i;
+  }
+
+ /*
+  * Sort the keys of each index...
+  */
+
+  for (i = 0; i < PPD_DAT_MAX_INDEX; i ++)
+  {
+    header->num_keys[i] = (unsigned)num_keys[i];
+
+    index_ppds_dat(records, num_ppds, i, keys);
+    qsort(keys, (size_t)num_keys[i], sizeof(ppd_dat_sort_t), compare_keys);
+
+    for (max_keys = 0; max_keys < num_keys[i]; max_keys ++)
+      *newkeys++ = keys[max_keys].key;
+  }
+
+  free(keys);
+
+ /*
+  * Then the make and model order...
+  */
+
+  qsort(records, (size_t)num_ppds, sizeof(ppd_rec_t *), compare_models);
+
+  for (i = 0; i < num_ppds; i ++)
+    models[i] = (unsigned)(records[i] - newrecords);
+
+  free(records);
+
+ /*
+  * Replace the old ppds.dat file...
+  */
+
+  free_ppds_dat(dat);
+
+  return (map_ppds_dat(dat, data, length, 0));
+}
+
+
+/*
+ * 'map_ppds_dat()' - Use an indexed ppds.dat file.
+ *
+ * The data is freed if it is not a valid ppds.dat file.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+map_ppds_dat(ppd_dat_t *dat,		/* I - Indexed ppds.dat file */
+             void      *data,		/* I - File data */
+	     size_t    length,		/* I - Length of file data */
+	     int       mapped)		/* I - Is the data mmap'd? */
+{
+  int			i, j;		/* Looping vars */
+  const ppd_dat_header_t *header = (const ppd_dat_header_t *)data;
+					/* File header */
+  const ppd_dat_key_t	*key;		/* Current key */
+  size_t		total;		/* Expected length */
+
+
+  memset(dat, 0, sizeof(ppd_dat_t));
+
+  dat->data   = data;
+  dat->length = length;
+  dat->mapped = mapped;
+
+ /*
+  * Validate the header and the size of the file...
+  */
+
+  if (length < sizeof(ppd_dat_header_t) || header->sync != PPD_SYNC2 ||
+      header->record_size != sizeof(ppd_rec_t) ||
+      header->num_ppds > length / sizeof(ppd_rec_t) ||
+      header->num_files > length / sizeof(ppd_dat_file_t))
+    goto bad_dat;
+
+  total = sizeof(ppd_dat_header_t) +
+          header->num_files * sizeof(ppd_dat_file_t) +
+          header->num_ppds * (sizeof(ppd_rec_t) + sizeof(unsigned));
+
+  for (i = 0; i < PPD_DAT_MAX_INDEX; i ++)
+  {
+    if (header->num_keys[i] > length / sizeof(ppd_dat_key_t))
+      goto bad_dat;
+
+    total += header->num_keys[i] * sizeof(ppd_dat_key_t);
+  }
+
+  if (total != length)
+    goto bad_dat;
+
+ /*
+  * Set up the pointers into the file and validate the record numbers and
+  * key strings...
+  */
+
+  dat->num_files = (int)header->num_files;
+  dat->files     = (const ppd_dat_file_t *)(header + 1);
+  dat->num_ppds  = (int)header->num_ppds;
+  dat->records   = (const ppd_rec_t *)(dat->files + dat->num_files);
+  dat->models    = (const unsigned *)(dat->records + dat->num_ppds);
+  key            = (const ppd_dat_key_t *)(dat->models + dat->num_ppds);
+
+  for (i = 0; i < dat->num_files; i ++)
+    if (memchr(dat->files[i].filename, 0, sizeof(dat->files[i].filename)) ==
+            NULL)
+      goto bad_dat;
+
+  for (i = 0; i < dat->num_ppds; i ++)
+    if (dat->models[i] >= header->num_ppds)
+      goto bad_dat;
+
+  for (i = 0; i < PPD_DAT_MAX_INDEX; i ++)
+  {
+    dat->num_keys[i] = (int)header->num_keys[i];
+    dat->keys[i]     = key;
+
+    for (j = 0; j < dat->num_keys[i]; j ++, key ++)
+      if (key->record >= header->num_ppds ||
+          (size_t)key->offset + key->length > sizeof(ppd_rec_t))
+	goto bad_dat;
+  }
+
+  if ((dat->found = (char *)calloc((size_t)dat->num_ppds + 1, 1)) == NULL)
+    goto bad_dat;
+
+  return (0);
+
+ /*
+  * If we get here the file is not usable...
+  */
+
+  bad_dat:
+
+  free_ppds_dat(dat);
+
+  return (-1);
+}
+
+
 /*
  * 'read_tar()' - Read a file header from an archive.
  *
@@ -2612,6 +3765,322 @@ regex_string(const char *s,		/* I - String to compare */
 }
 
 
+/*
+ * 'scan_log()' - Log function for the scanning threads.
+ *
+ * The caller's log function does not need to be thread-safe, so the
+ * scanning threads call it one at a time.
+ */
+
+static void
+scan_log(void          *data,		/* I - Queue of files */
+	 cf_loglevel_t level,		/* I - Log level */
+	 const char    *message,	/* I - Printf-style message */
+	 ...)				/* I - Additional arguments */
+{
+  ppd_scan_queue_t	*queue = (ppd_scan_queue_t *)data;
+					/* Queue of files */
+  va_list		ap;		/* Pointer to arguments */
+  char			buffer[2048];	/* Formatted message */
+
+
+  va_start(ap, message);
+  vsnprintf(buffer, sizeof(buffer), message, ap);
+  va_end(ap);
+
+  _ppdMutexLock(&(queue->logmutex));
+  queue->log(queue->ld, level, "%s", buffer);
+  _ppdMutexUnlock(&(queue->logmutex));
+}
+
+
+/*
+ * 'scan_ppds()' - Scan the new and changed files for PPDs.
+ *
+ * PPD files and archives are scanned by a few threads, each one adding the
+ * PPDs it finds to a list of its own.  Driver information files and driver
+ * executables are then done by the main thread.
+ */
+
+static void
+scan_ppds(ppd_list_t   *ppdlist,	/* I - PPD list */
+	  cf_logfunc_t log,		/* I - Log function */
+	  void         *ld)		/* I - Aux. data for log function */
+{
+  int			i,		/* Looping var */
+			num_scanners;	/* Number of scanning threads */
+  long			num_cpus;	/* Number of processors */
+  ppd_scan_t		*scan;		/* Current file */
+  ppd_scan_queue_t	queue;		/* Files for the scanning threads */
+  ppd_scanner_t		scanners[PPD_MAX_SCANNERS];
+					/* Scanning threads */
+  ppd_info_t		*ppd;		/* Current PPD */
+
+
+  if (cupsArrayCount(ppdlist->Scans) == 0)
+    return;
+
+ /*
+  * Queue the files which can be scanned in parallel...
+  */
+
+  memset(&queue, 0, sizeof(queue));
+  _ppdMutexInit(&queue.mutex);
+  _ppdMutexInit(&queue.logmutex);
+
+  queue.log = log;
+  queue.ld  = ld;
+
+  if ((queue.scans = (ppd_scan_t **)calloc((size_t)cupsArrayCount(ppdlist->Scans),
+                                           sizeof(ppd_scan_t *))) != NULL)
+  {
+    for (scan = (ppd_scan_t *)cupsArrayFirst(ppdlist->Scans);
+	 scan;
+	 scan = (ppd_scan_t *)cupsArrayNext(ppdlist->Scans))
+      if (!scan->serial)
+	queue.scans[queue.num_scans ++] = scan;
+  }
+
+ /*
+  * Start one thread per processor, the main thread being one of them...
+  */
+
+#ifdef _SC_NPROCESSORS_ONLN
+  num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+  num_cpus = 1;
+#endif /* _SC_NPROCESSORS_ONLN */
+
+  if (num_cpus > PPD_MAX_SCANNERS)
+    num_cpus = PPD_MAX_SCANNERS;
+  if (num_cpus > queue.num_scans)
+    num_cpus = queue.num_scans;
+
+  if (log) log(ld, CF_LOGLEVEL_DEBUG,
+	       "libppd: [PPD Collections] Scanning %d new or changed files, "
+	       "%d in parallel...",
+	       cupsArrayCount(ppdlist->Scans), queue.num_scans);
+
+  memset(scanners, 0, sizeof(scanners));
+
+  for (num_scanners = 0; num_scanners < num_cpus - 1; num_scanners ++)
+  {
+    scanners[num_scanners].queue = &queue;
+    scanners[num_scanners].ppdlist.PPDsByName =
+        cupsArrayNew((cups_array_func_t)compare_names, NULL);
+    scanners[num_scanners].ppdlist.PPDsByMakeModel =
+        cupsArrayNew((cups_array_func_t)compare_ppds, NULL);
+
+    if ((scanners[num_scanners].thread =
+             _ppdThreadCreate((_ppd_thread_func_t)scan_thread,
+	                      scanners + num_scanners)) == 0)
+    {
+      cupsArrayDelete(scanners[num_scanners].ppdlist.PPDsByName);
+      cupsArrayDelete(scanners[num_scanners].ppdlist.PPDsByMakeModel);
+      break;
+    }
+  }
+
+  scan_queue(&queue, ppdlist);
+
+ /*
+  * Wait for the threads and merge their PPDs...
+  */
+
+  for (i = 0; i < num_scanners; i ++)
+  {
+    _ppdThreadWait(scanners[i].thread);
+
+    for (ppd = (ppd_info_t *)cupsArrayFirst(scanners[i].ppdlist.PPDsByName);
+	 ppd;
+	 ppd = (ppd_info_t *)cupsArrayNext(scanners[i].ppdlist.PPDsByName))
+    {
+      cupsArrayAdd(ppdlist->PPDsByName, ppd);
+      cupsArrayAdd(ppdlist->PPDsByMakeModel, ppd);
+    }
+
+    if (scanners[i].ppdlist.ChangedPPD)
+      ppdlist->ChangedPPD = 1;
+
+    cupsArrayDelete(scanners[i].ppdlist.PPDsByName);
+    cupsArrayDelete(scanners[i].ppdlist.PPDsByMakeModel);
+  }
+
+ /*
+  * Then do the rest...
+  */
+
+  for (scan = (ppd_scan_t *)cupsArrayFirst(ppdlist->Scans);
+       scan;
+       scan = (ppd_scan_t *)cupsArrayNext(ppdlist->Scans))
+    if (scan->serial || !queue.scans)
+      load_file(scan->filename, scan->name, &(scan->fileinfo), ppdlist, log,
+		ld);
+
+  free(queue.scans);
+}
+
+
+/*
+ * 'scan_queue()' - Scan the queued files until none are left.
+ */
+
+static void
+scan_queue(ppd_scan_queue_t *queue,	/* I - Queue of files */
+           ppd_list_t       *ppdlist)	/* I - PPD list to add to */
+{
+  ppd_scan_t	*scan;			/* Current file */
+
+
+  for (;;)
+  {
+    _ppdMutexLock(&(queue->mutex));
+
+    if (queue->next < queue->num_scans)
+      scan = queue->scans[queue->next ++];
+    else
+      scan = NULL;
+
+    _ppdMutexUnlock(&(queue->mutex));
+
+    if (!scan)
+      break;
+
+    load_file(scan->filename, scan->name, &(scan->fileinfo), ppdlist,
+	      queue->log ? scan_log : NULL, queue);
+  }
+}
+
+
+/*
+ * 'scan_thread()' - Scan queued files in a separate thread.
+ */
+
+static void *				/* O - Thread exit status */
+scan_thread(ppd_scanner_t *scanner)	/* I - Scanning thread */
+{
+  scan_queue(scanner->queue, &(scanner->ppdlist));
+
+  return (NULL);
+}
+
+
+/*
+ * 'select_ppds()' - Select the PPD records which can match using the indices
+ *                   of the ppds.dat file.
+ */
+
+static int				/* O - 1 if selected, 0 if all PPDs need
+					       to be checked */
+select_ppds(ppd_dat_t  *dat,		/* I - Indexed ppds.dat file */
+            char       *selected,	/* I - Selected flags of the records */
+	    const char *device_id,	/* I - ppd-device-id or NULL */
+	    const char *language,	/* I - ppd-natural-language or NULL */
+	    const char *make,		/* I - ppd-make or NULL */
+	    const char *make_and_model,	/* I - ppd-make-and-model or NULL */
+	    const char *product)	/* I - ppd-product or NULL */
+{
+  int		i, j,			/* Looping vars */
+		index,			/* Index to search */
+		num_words,		/* Number of words */
+		first,			/* First matching key */
+		count,			/* Number of matching keys */
+		best_first,		/* First key of the rarest word */
+		best_count,		/* Number of keys of the rarest word */
+		left,			/* Left side of search */
+		right;			/* Right side of search */
+  const char	*value,			/* Value to look up */
+		*words[PPD_DAT_MAX_WORDS];
+					/* Words of value */
+  size_t	lengths[PPD_DAT_MAX_WORDS];
+					/* Lengths of words */
+
+
+ /*
+  * PPDs can only match the device ID and make and model if they contain all
+  * of the words we know about, so select the PPDs with the rarest word...
+  */
+
+  for (i = 0; i < 2; i ++)
+  {
+    if (i == 0)
+    {
+      value = device_id;
+      index = PPD_DAT_DEVICE_IDS;
+    }
+    else
+    {
+      value = make_and_model;
+      index = PPD_DAT_MODELS;
+    }
+
+    if (!value)
+      continue;
+
+    if ((num_words = get_words(value, !i, words, lengths)) == 0)
+      return (0);
+
+    for (j = 0, best_first = 0, best_count = -1; j < num_words; j ++)
+      if ((count = find_ppds_keys(dat, index, words[j], lengths[j], 0,
+                                  &first)) < best_count || best_count < 0)
+      {
+        best_first = first;
+	best_count = count;
+      }
+
+    for (j = best_first; j < best_first + best_count; j ++)
+      selected[dat->keys[index][j].record] = 1;
+  }
+
+ /*
+  * Languages are matched exactly, products by prefix...
+  */
+
+  if (language)
+  {
+    count = find_ppds_keys(dat, PPD_DAT_LANGUAGES, language, strlen(language),
+                           0, &first);
+
+    for (j = first; j < first + count; j ++)
+      selected[dat->keys[PPD_DAT_LANGUAGES][j].record] = 1;
+  }
+
+  if (product)
+  {
+    count = find_ppds_keys(dat, PPD_DAT_PRODUCTS, product, strlen(product), 1,
+                           &first);
+
+    for (j = first; j < first + count; j ++)
+      selected[dat->keys[PPD_DAT_PRODUCTS][j].record] = 1;
+  }
+
+ /*
+  * The PPDs of a make are next to each other in make and model order...
+  */
+
+  if (make)
+  {
+    for (left = 0, right = dat->num_ppds; left < right;)
+    {
+      j = (left + right) / 2;
+
+      if (_ppd_strcasecmp(dat->records[dat->models[j]].make, make) < 0)
+        left = j + 1;
+      else
+        right = j;
+    }
+
+    for (j = left;
+         j < dat->num_ppds &&
+	     !_ppd_strcasecmp(dat->records[dat->models[j]].make, make);
+	 j ++)
+      selected[dat->models[j]] = 1;
+  }
+
+  return (1);
+}
+
+
 /*
  * 'CompareNames()' - Compare two names.
  *
@@ -31,12 +31,70 @@ enum
 };
 
 
+/*
+ * Local types...
+ *
+ * The constraints get compiled into an index when they are loaded: each
+ * option which is used in a constraint gets an entry with the list of
+ * constraints using it, and each constraint gets the list of its terms,
+ * referring to the option entries.  The options and choices which a test
+ * is done for get looked up once per option and test, testing a term is
+ * then a comparison of choice pointers.
+ */
+
+typedef struct ppd_uiterm_s		/**** Term of a constraint ****/
+{
+  int		option;			/* Index of option entry */
+  ppd_choice_t	*choice,		/* Constrained choice or @code NULL@ */
+		*match;			/* First choice with the same name */
+  int		page_size;		/* PageSize/PageRegion choice? */
+} ppd_uiterm_t;
+
+typedef struct ppd_uiconst_s		/**** Compiled constraint ****/
+{
+  ppd_cups_uiconsts_t *consts;		/* Constraint */
+  int		first_term,		/* First term */
+		num_terms;		/* Number of terms */
+  unsigned	serial;			/* Test the constraint is selected for */
+} ppd_uiconst_t;
+
+typedef struct ppd_uioption_s		/**** Option used in constraints ****/
+{
+  ppd_option_t	*option;		/* Option */
+  int		first_ref,		/* First constraint using the option */
+		num_refs;		/* Number of constraints using it */
+  unsigned	serial;			/* Test the values below are for */
+  int		use_marked,		/* Use the marked choices? */
+		enabled;		/* Option not None/Off/False? */
+  ppd_choice_t	*value,			/* Choice to test */
+		*firstvalue;		/* AP_FIRSTPAGE_ choice to test */
+} ppd_uioption_t;
+
+typedef struct ppd_uiindex_s		/**** Index of constraints ****/
+{
+  unsigned	serial;			/* Current test */
+  int		num_consts,		/* Number of constraints */
+		num_options;		/* Number of options */
+  ppd_uiconst_t	*consts;		/* Constraints */
+  ppd_uioption_t *options;		/* Options, sorted by keyword */
+  ppd_uiterm_t	*terms;			/* Terms of the constraints */
+  int		*refs;			/* Constraints using each option */
+} ppd_uiindex_t;
+
+
 /*
  * Local functions...
  */
 
+static int		ppd_compare_uioptions(const void *a, const void *b);
+static ppd_choice_t	*ppd_find_uichoice(ppd_option_t *option,
+			                   const char *choice);
+static int		ppd_find_uioption(ppd_uiindex_t *index,
+			                  const char *keyword);
+static void		ppd_index_constraints(ppd_file_t *ppd);
 static int		ppd_is_installable(ppd_group_t *installable,
 			                   const char *option);
+static int		ppd_is_off(const char *choice);
 static void		ppd_load_constraints(ppd_file_t *ppd);
 static cups_array_t	*ppd_test_constraints(ppd_file_t *ppd,
 			                      const char *option,
@@ -44,6 +102,10 @@ static cups_array_t	*ppd_test_constraints(ppd_file_t *ppd,
 			                      int num_options,
 			                      cups_option_t *options,
 					      int which);
+static ppd_uioption_t	*ppd_test_option(ppd_file_t *ppd, int option_index,
+			                 const char *option,
+					 const char *choice, int num_options,
+					 cups_option_t *options);
 
 
 /*
@@ -664,6 +726,234 @@ ppdInstallableConflict(
 }
 
 
+/*
+ * 'ppd_compare_uioptions()' - Compare two option entries of the constraint
+ *                             index.
+ */
+
+static int				/* O - Result of comparison */
+ppd_compare_uioptions(const void *a,	/* I - First option entry */
+                      const void *b)	/* I - Second option entry */
+{
+  const ppd_option_t	*oa = ((const ppd_uioption_t *)a)->option,
+			*ob = ((const ppd_uioption_t *)b)->option;
+					/* Options */
+  int			result;		/* Result of comparison */
+
+
+  if ((result = _ppd_strcasecmp(oa->keyword, ob->keyword)) != 0)
+    return (result);
+  else if (oa < ob)
+    return (-1);
+  else
+    return (oa > ob);
+}
+
+
+/*
+ * 'ppd_find_uichoice()' - Find the first choice with the given name.
+ *
+ * Unlike ppdFindChoice() the name is used as is, so that choices are
+ * matched just like the names were compared before.
+ */
+
+static ppd_choice_t *			/* O - Choice or @code NULL@ */
+ppd_find_uichoice(ppd_option_t *option,	/* I - Option */
+                  const char   *choice)	/* I - Name of choice */
+{
+  int		i;			/* Looping var */
+  ppd_choice_t	*c;			/* Current choice */
+
+
+  if (!choice)
+    return (NULL);
+
+  for (i = option->num_choices, c = option->choices; i > 0; i --, c ++)
+    if (!_ppd_strcasecmp(c->choice, choice))
+      return (c);
+
+  return (NULL);
+}
+
+
+/*
+ * 'ppd_find_uioption()' - Find the first option entry of the constraint
+ *                         index with the given keyword.
+ */
+
+static int				/* O - Index of entry or -1 */
+ppd_find_uioption(
+    ppd_uiindex_t *index,		/* I - Constraint index */
+    const char    *keyword)		/* I - Option keyword */
+{
+  int	left,				/* Left side of search */
+	right,				/* Right side of search */
+	current;			/* Current entry */
+
+
+  for (left = 0, right = index->num_options; left < right;)
+  {
+    current = (left + right) / 2;
+
+    if (_ppd_strcasecmp(index->options[current].option->keyword, keyword) < 0)
+      left = current + 1;
+    else
+      right = current;
+  }
+
+  if (left < index->num_options &&
+      !_ppd_strcasecmp(index->options[left].option->keyword, keyword))
+    return (left);
+  else
+    return (-1);
+}
+
+
+/*
+ * 'ppd_index_constraints()' - Create the index of the loaded constraints.
+ */
+
+static void
+ppd_index_constraints(ppd_file_t *ppd)	/* I - PPD file */
+{
+  int			i, j,		/* Looping vars */
+			num_consts,	/* Number of constraints */
+			num_terms,	/* Number of terms */
+			num_options;	/* Number of options */
+  ppd_cups_uiconsts_t	*consts;	/* Current constraints */
+  ppd_cups_uiconst_t	*constptr;	/* Current constraint */
+  ppd_uiindex_t		*index;		/* Constraint index */
+  ppd_uiconst_t		*c;		/* Current compiled constraint */
+  ppd_uiterm_t		*t;		/* Current term */
+  ppd_uioption_t	*o;		/* Current option entry */
+
+
+  num_consts = cupsArrayCount(ppd->cups_uiconstraints);
+
+  for (num_terms = 0,
+           consts = (ppd_cups_uiconsts_t *)cupsArrayFirst(ppd->cups_uiconstraints);
+       consts;
+       consts = (ppd_cups_uiconsts_t *)cupsArrayNext(ppd->cups_uiconstraints))
+    num_terms += consts->num_constraints;
+
+ /*
+  * Allocate the index with all of its arrays in one block, there are
+  * at most as many options and constraint references as terms...
+  */
+
+  if ((index = calloc(1, sizeof(ppd_uiindex_t) +
+                         (size_t)num_consts * sizeof(ppd_uiconst_t) +
+			 (size_t)num_terms * (sizeof(ppd_uioption_t) +
+			                      sizeof(ppd_uiterm_t) +
+					      sizeof(int)))) == NULL)
+  {
+    DEBUG_puts("8ppd_index_constraints: Unable to allocate memory for "
+	       "constraint index!");
+    return;
+  }
+
+  index->num_consts = num_consts;
+  index->consts     = (ppd_uiconst_t *)(index + 1);
+  index->options    = (ppd_uioption_t *)(index->consts + num_consts);
+  index->terms      = (ppd_uiterm_t *)(index->options + num_terms);
+  index->refs       = (int *)(index->terms + num_terms);
+
+ /*
+  * Collect the options, sorted by keyword...
+  */
+
+  for (num_options = 0,
+           consts = (ppd_cups_uiconsts_t *)cupsArrayFirst(ppd->cups_uiconstraints);
+       consts;
+       consts = (ppd_cups_uiconsts_t *)cupsArrayNext(ppd->cups_uiconstraints))
+    for (i = consts->num_constraints, constptr = consts->constraints;
+         i > 0;
+	 i --, constptr ++)
+      index->options[num_options ++].option = constptr->option;
+
+  if (num_options > 1)
+    qsort(index->options, (size_t)num_options, sizeof(ppd_uioption_t),
+          ppd_compare_uioptions);
+
+  for (i = 0, j = 0; i < num_options; i ++)
+    if (j == 0 || index->options[j - 1].option != index->options[i].option)
+      index->options[j ++].option = index->options[i].option;
+
+  index->num_options = num_options = j;
+
+ /*
+  * Compile the constraints and count the constraints using each option...
+  */
+
+  for (i = 0, t = index->terms,
+           consts = (ppd_cups_uiconsts_t *)cupsArrayFirst(ppd->cups_uiconstraints);
+       consts;
+       i ++,
+           consts = (ppd_cups_uiconsts_t *)cupsArrayNext(ppd->cups_uiconstraints))
+  {
+    c             = index->consts + i;
+    c->consts     = consts;
+    c->first_term = (int)(t - index->terms);
+    c->num_terms  = consts->num_constraints;
+
+    for (j = consts->num_constraints, constptr = consts->constraints;
+         j > 0;
+	 j --, constptr ++, t ++)
+    {
+      for (t->option = ppd_find_uioption(index, constptr->option->keyword);
+           index->options[t->option].option != constptr->option;
+	   t->option ++);
+
+      t->choice    = constptr->choice;
+      t->match     = ppd_find_uichoice(constptr->option,
+                                       constptr->choice ?
+				           constptr->choice->choice : NULL);
+      t->page_size = constptr->choice &&
+                     (!_ppd_strcasecmp(constptr->option->keyword,
+		                       "PageSize") ||
+                      !_ppd_strcasecmp(constptr->option->keyword,
+		                       "PageRegion"));
+
+      o = index->options + t->option;
+      if (o->serial != (unsigned)i + 1)
+      {
+        o->serial = (unsigned)i + 1;
+	o->num_refs ++;
+      }
+    }
+  }
+
+ /*
+  * Then fill in the constraints using each option, in the order of the
+  * constraints...
+  */
+
+  for (i = 0, j = 0, o = index->options; i < num_options; i ++, o ++)
+  {
+    o->first_ref = j;
+    j            += o->num_refs;
+    o->num_refs  = 0;
+    o->serial    = 0;
+  }
+
+  for (i = 0, c = index->consts; i < num_consts; i ++, c ++)
+    for (j = c->num_terms, t = index->terms + c->first_term; j > 0; j --, t ++)
+    {
+      o = index->options + t->option;
+      if (o->serial != (unsigned)i + 1)
+      {
+        o->serial = (unsigned)i + 1;
+	index->refs[o->first_ref + o->num_refs ++] = i;
+      }
+    }
+
+  for (i = 0, o = index->options; i < num_options; i ++, o ++)
+    o->serial = 0;
+
+  ppd->cups_uiindex = index;
+}
+
+
 /*
  * 'ppd_is_installable()' - Determine whether an option is in the
  *                          InstallableOptions group.
@@ -691,6 +981,19 @@ ppd_is_installable(
 }
 
 
+/*
+ * 'ppd_is_off()' - Determine whether a choice disables its option.
+ */
+
+static int				/* O - 1 if None/Off/False, 0 otherwise */
+ppd_is_off(const char *choice)		/* I - Choice */
+{
+  return (!_ppd_strcasecmp(choice, "None") ||
+          !_ppd_strcasecmp(choice, "Off") ||
+	  !_ppd_strcasecmp(choice, "False"));
+}
+
+
 /*
  * 'ppd_load_constraints()' - Load constraints from a PPD file.
  */
@@ -933,6 +1236,12 @@ ppd_load_constraints(ppd_file_t *ppd)	/* I - PPD file */
       free(consts);
     }
   }
+
+ /*
+  * Finally compile them for testing...
+  */
+
+  ppd_index_constraints(ppd);
 }
 
 
@@ -949,15 +1258,23 @@ ppd_test_constraints(
     cups_option_t *options,		/* I - Additional options */
     int           which)		/* I - Which constraints to test */
 {
-  int			i;		/* Looping var */
+  int			i, j, k,	/* Looping vars */
+			num_selected,	/* Number of constraints to test */
+			*selected = NULL,/* Constraints to test */
+			num_matched = 0;/* Number of option entries */
+  ppd_uiindex_t		*index;		/* Constraint index */
+  ppd_uiconst_t		*c;		/* Current compiled constraint */
+  ppd_uiterm_t		*t;		/* Current term */
+  ppd_uioption_t	*o,		/* Current option entry */
+			*matched = NULL;/* Option entry of current option */
   ppd_cups_uiconsts_t	*consts;	/* Current constraints */
-  ppd_cups_uiconst_t	*constptr;	/* Current constraint */
-  ppd_choice_t		key,		/* Search key */
-			*marked;	/* Marked choice */
   cups_array_t		*active = NULL;	/* Active constraints */
-  const char		*value,		/* Current value */
-			*firstvalue;	/* AP_FIRSTPAGE_Keyword value */
-  char			firstpage[255];	/* AP_FIRSTPAGE_Keyword string */
+  const char		*keyword,	/* Keyword of current option */
+			*value = NULL,	/* Current page size */
+			*firstvalue = NULL;
+					/* AP_FIRSTPAGE_PageSize value */
+  int			have_page_size = 0;
+					/* Page size looked up? */
 
 
   DEBUG_printf(("7ppd_test_constraints(ppd=%p, option=\"%s\", choice=\"%s\", "
@@ -970,12 +1287,77 @@ ppd_test_constraints(
   DEBUG_printf(("9ppd_test_constraints: %d constraints!",
 	        cupsArrayCount(ppd->cups_uiconstraints)));
 
+  if ((index = ppd->cups_uiindex) == NULL)
+    return (NULL);
+
+ /*
+  * Start a new test, the choices looked up for the previous one are not
+  * valid anymore...
+  */
+
+  if (++ index->serial == 0)
+  {
+    for (i = 0; i < index->num_options; i ++)
+      index->options[i].serial = 0;
+
+    for (i = 0; i < index->num_consts; i ++)
+      index->consts[i].serial = 0;
+
+    index->serial = 1;
+  }
+
+  if ((which == _PPD_OPTION_CONSTRAINTS || which == _PPD_INSTALLABLE_CONSTRAINTS) && option)
+  {
+   /*
+    * Only test the constraints which involve the current option...
+    */
+
+    for (keyword = option; keyword;
+         keyword = (keyword == option &&
+	            !_ppd_strncasecmp(option, "AP_FIRSTPAGE_", 13)) ?
+		       option + 13 : NULL)
+    {
+      for (k = ppd_find_uioption(index, keyword);
+           k >= 0 && k < index->num_options &&
+	       !_ppd_strcasecmp(index->options[k].option->keyword, keyword);
+	   k ++)
+      {
+        matched = index->options + k;
+	num_matched ++;
+
+	for (j = 0; j < matched->num_refs; j ++)
+	  index->consts[index->refs[matched->first_ref + j]].serial =
+	      index->serial;
+      }
+    }
+
+    if (num_matched == 0)
+      return (NULL);
+    else if (num_matched == 1)
+    {
+      num_selected = matched->num_refs;
+      selected     = index->refs + matched->first_ref;
+    }
+    else if ((selected = malloc((size_t)index->num_consts *
+                                sizeof(int))) == NULL)
+      return (NULL);
+    else
+    {
+      for (i = 0, num_selected = 0; i < index->num_consts; i ++)
+        if (index->consts[i].serial == index->serial)
+	  selected[num_selected ++] = i;
+    }
+  }
+  else
+    num_selected = index->num_consts;
+
   cupsArraySave(ppd->marked);
 
-  for (consts = (ppd_cups_uiconsts_t *)cupsArrayFirst(ppd->cups_uiconstraints);
-       consts;
-       consts = (ppd_cups_uiconsts_t *)cupsArrayNext(ppd->cups_uiconstraints))
+  for (j = 0; j < num_selected; j ++)
   {
+    c      = index->consts + (selected ? selected[j] : j);
+    consts = c->consts;
+
     DEBUG_printf(("9ppd_test_constraints: installable=%d, resolver=\"%s\", "
                   "num_constraints=%d option1=\"%s\", choice1=\"%s\", "
 		  "option2=\"%s\", choice2=\"%s\", ...",
@@ -993,40 +1375,17 @@ ppd_test_constraints(
     if (!consts->installable && which == _PPD_INSTALLABLE_CONSTRAINTS)
       continue;				/* Skip non-installable option constraint */
 
-    if ((which == _PPD_OPTION_CONSTRAINTS || which == _PPD_INSTALLABLE_CONSTRAINTS) && option)
-    {
-     /*
-      * Skip constraints that do not involve the current option...
-      */
-
-      for (i = consts->num_constraints, constptr = consts->constraints;
-	   i > 0;
-	   i --, constptr ++)
-      {
-        if (!_ppd_strcasecmp(constptr->option->keyword, option))
-	  break;
-
-        if (!_ppd_strncasecmp(option, "AP_FIRSTPAGE_", 13) &&
-	    !_ppd_strcasecmp(constptr->option->keyword, option + 13))
-	  break;
-      }
-
-      if (!i)
-        continue;
-    }
-
     DEBUG_puts("9ppd_test_constraints: Testing...");
 
-    for (i = consts->num_constraints, constptr = consts->constraints;
+    for (i = c->num_terms, t = index->terms + c->first_term;
          i > 0;
-	 i --, constptr ++)
+	 i --, t ++)
     {
-      DEBUG_printf(("9ppd_test_constraints: %s=%s?", constptr->option->keyword,
-		    constptr->choice ? constptr->choice->choice : ""));
+      DEBUG_printf(("9ppd_test_constraints: %s=%s?",
+                    index->options[t->option].option->keyword,
+		    t->choice ? t->choice->choice : ""));
 
-      if (constptr->choice &&
-          (!_ppd_strcasecmp(constptr->option->keyword, "PageSize") ||
-           !_ppd_strcasecmp(constptr->option->keyword, "PageRegion")))
+      if (t->page_size)
       {
        /*
         * PageSize and PageRegion are used depending on the selected input slot
@@ -1034,138 +1393,77 @@ ppd_test_constraints(
 	* of an individual option...
 	*/
 
-        if (option && choice &&
-	    (!_ppd_strcasecmp(option, "PageSize") ||
-	     !_ppd_strcasecmp(option, "PageRegion")))
+        if (!have_page_size)
 	{
-	  value = choice;
-        }
-	else if ((value = cupsGetOption("PageSize", num_options,
-	                                options)) == NULL)
-	  if ((value = cupsGetOption("PageRegion", num_options,
-	                             options)) == NULL)
-	    if ((value = cupsGetOption("media", num_options, options)) == NULL)
-	    {
-	      ppd_size_t *size = ppdPageSize(ppd, NULL);
+	  if (option && choice &&
+	      (!_ppd_strcasecmp(option, "PageSize") ||
+	       !_ppd_strcasecmp(option, "PageRegion")))
+	  {
+	    value = choice;
+          }
+	  else if ((value = cupsGetOption("PageSize", num_options,
+	                                  options)) == NULL)
+	    if ((value = cupsGetOption("PageRegion", num_options,
+	                               options)) == NULL)
+	      if ((value = cupsGetOption("media", num_options, options)) == NULL)
+	      {
+	        ppd_size_t *size = ppdPageSize(ppd, NULL);
 
-              if (size)
-	        value = size->name;
-	    }
+                if (size)
+	          value = size->name;
+	      }
 
-        if (value && !_ppd_strncasecmp(value, "Custom.", 7))
-	  value = "Custom";
+          if (value && !_ppd_strncasecmp(value, "Custom.", 7))
+	    value = "Custom";
 
-        if (option && choice &&
-	    (!_ppd_strcasecmp(option, "AP_FIRSTPAGE_PageSize") ||
-	     !_ppd_strcasecmp(option, "AP_FIRSTPAGE_PageRegion")))
-	{
-	  firstvalue = choice;
-        }
-	else if ((firstvalue = cupsGetOption("AP_FIRSTPAGE_PageSize",
-	                                     num_options, options)) == NULL)
-	  firstvalue = cupsGetOption("AP_FIRSTPAGE_PageRegion", num_options,
-	                             options);
+          if (option && choice &&
+	      (!_ppd_strcasecmp(option, "AP_FIRSTPAGE_PageSize") ||
+	       !_ppd_strcasecmp(option, "AP_FIRSTPAGE_PageRegion")))
+	  {
+	    firstvalue = choice;
+          }
+	  else if ((firstvalue = cupsGetOption("AP_FIRSTPAGE_PageSize",
+	                                       num_options, options)) == NULL)
+	    firstvalue = cupsGetOption("AP_FIRSTPAGE_PageRegion", num_options,
+	                               options);
 
-        if (firstvalue && !_ppd_strncasecmp(firstvalue, "Custom.", 7))
-	  firstvalue = "Custom";
+          if (firstvalue && !_ppd_strncasecmp(firstvalue, "Custom.", 7))
+	    firstvalue = "Custom";
+
+	  have_page_size = 1;
+	}
 
-        if ((!value || _ppd_strcasecmp(value, constptr->choice->choice)) &&
-	    (!firstvalue || _ppd_strcasecmp(firstvalue, constptr->choice->choice)))
+        if ((!value || _ppd_strcasecmp(value, t->choice->choice)) &&
+	    (!firstvalue || _ppd_strcasecmp(firstvalue, t->choice->choice)))
 	{
 	  DEBUG_puts("9ppd_test_constraints: NO");
 	  break;
 	}
+
+	continue;
       }
-      else if (constptr->choice)
-      {
-       /*
-        * Compare against the constrained choice...
-	*/
 
-        if (option && choice && !_ppd_strcasecmp(option, constptr->option->keyword))
-	{
-	  if (!_ppd_strncasecmp(choice, "Custom.", 7))
-	    value = "Custom";
-	  else
-	    value = choice;
-	}
-        else if ((value = cupsGetOption(constptr->option->keyword, num_options,
-	                                options)) != NULL)
-        {
-	  if (!_ppd_strncasecmp(value, "Custom.", 7))
-	    value = "Custom";
-	}
-        else if (constptr->choice->marked)
-	  value = constptr->choice->choice;
-	else
-	  value = NULL;
+      o = ppd_test_option(ppd, t->option, option, choice, num_options,
+                          options);
 
+      if (t->choice)
+      {
        /*
-        * Now check AP_FIRSTPAGE_option...
+        * Compare against the constrained choice...
 	*/
 
-        snprintf(firstpage, sizeof(firstpage), "AP_FIRSTPAGE_%s",
-	         constptr->option->keyword);
-
-        if (option && choice && !_ppd_strcasecmp(option, firstpage))
-	{
-	  if (!_ppd_strncasecmp(choice, "Custom.", 7))
-	    firstvalue = "Custom";
-	  else
-	    firstvalue = choice;
-	}
-        else if ((firstvalue = cupsGetOption(firstpage, num_options,
-	                                     options)) != NULL)
-        {
-	  if (!_ppd_strncasecmp(firstvalue, "Custom.", 7))
-	    firstvalue = "Custom";
-	}
-	else
-	  firstvalue = NULL;
-
-        DEBUG_printf(("9ppd_test_constraints: value=%s, firstvalue=%s", value,
-	              firstvalue));
-
-        if ((!value || _ppd_strcasecmp(value, constptr->choice->choice)) &&
-	    (!firstvalue || _ppd_strcasecmp(firstvalue, constptr->choice->choice)))
-	{
-	  DEBUG_puts("9ppd_test_constraints: NO");
-	  break;
-	}
-      }
-      else if (option && choice &&
-               !_ppd_strcasecmp(option, constptr->option->keyword))
-      {
-	if (!_ppd_strcasecmp(choice, "None") || !_ppd_strcasecmp(choice, "Off") ||
-	    !_ppd_strcasecmp(choice, "False"))
-	{
-	  DEBUG_puts("9ppd_test_constraints: NO");
-	  break;
-	}
-      }
-      else if ((value = cupsGetOption(constptr->option->keyword, num_options,
-				      options)) != NULL)
-      {
-	if (!_ppd_strcasecmp(value, "None") || !_ppd_strcasecmp(value, "Off") ||
-	    !_ppd_strcasecmp(value, "False"))
+        if ((o->use_marked ? !t->choice->marked :
+	                     !o->value || o->value != t->match) &&
+	    (!o->firstvalue || o->firstvalue != t->match))
 	{
 	  DEBUG_puts("9ppd_test_constraints: NO");
 	  break;
 	}
       }
-      else
+      else if (!o->enabled)
       {
-	key.option = constptr->option;
-
-	if ((marked = (ppd_choice_t *)cupsArrayFind(ppd->marked, &key))
-		== NULL ||
-	    (!_ppd_strcasecmp(marked->choice, "None") ||
-	     !_ppd_strcasecmp(marked->choice, "Off") ||
-	     !_ppd_strcasecmp(marked->choice, "False")))
-	{
-	  DEBUG_puts("9ppd_test_constraints: NO");
-	  break;
-	}
+	DEBUG_puts("9ppd_test_constraints: NO");
+	break;
       }
     }
 
@@ -1181,8 +1479,94 @@ ppd_test_constraints(
 
   cupsArrayRestore(ppd->marked);
 
+  if (num_matched > 1)
+    free(selected);
+
   DEBUG_printf(("8ppd_test_constraints: Found %d active constraints!",
                 cupsArrayCount(active)));
 
   return (active);
 }
+
+
+/*
+ * 'ppd_test_option()' - Look up the choices of an option which are to be
+ *                       tested against the constraints.
+ *
+ * The choices come from "option" and "choice" if "option" is the option or
+ * its AP_FIRSTPAGE_ variant, then from "options", otherwise the marked
+ * choices are used.  They are looked up once for each test.
+ */
+
+static ppd_uioption_t *			/* O - Option entry */
+ppd_test_option(
+    ppd_file_t    *ppd,			/* I - PPD file */
+    int           option_index,		/* I - Index of option entry */
+    const char    *option,		/* I - Current option */
+    const char    *choice,		/* I - Current choice */
+    int           num_options,		/* I - Number of additional options */
+    cups_option_t *options)		/* I - Additional options */
+{
+  ppd_uiindex_t		*index = ppd->cups_uiindex;
+					/* Constraint index */
+  ppd_uioption_t	*o = index->options + option_index;
+					/* Option entry */
+  const char		*keyword = o->option->keyword,
+					/* Option keyword */
+			*value;		/* Current value */
+  char			firstpage[255];	/* AP_FIRSTPAGE_Keyword string */
+  ppd_choice_t		key,		/* Search key */
+			*marked;	/* Marked choice */
+
+
+  if (o->serial == index->serial)
+    return (o);
+
+  o->serial = index->serial;
+
+  if (option && choice && !_ppd_strcasecmp(option, keyword))
+    value = choice;
+  else
+    value = cupsGetOption(keyword, num_options, options);
+
+  if (value)
+  {
+    o->use_marked = 0;
+    o->enabled    = !ppd_is_off(value);
+    o->value      = ppd_find_uichoice(o->option,
+                                      _ppd_strncasecmp(value, "Custom.", 7) ?
+				          value : "Custom");
+  }
+  else
+  {
+    key.option = o->option;
+    marked     = (ppd_choice_t *)cupsArrayFind(ppd->marked, &key);
+
+    o->use_marked = 1;
+    o->enabled    = marked && !ppd_is_off(marked->choice);
+    o->value      = NULL;
+  }
+
+ /*
+  * Now check AP_FIRSTPAGE_option...
+  */
+
+  snprintf(firstpage, sizeof(firstpage), "AP_FIRSTPAGE_%s", keyword);
+
+  if (option && choice && !_ppd_strcasecmp(option, firstpage))
+    value = choice;
+  else
+    value = cupsGetOption(firstpage, num_options, options);
+
+  if (value && !_ppd_strncasecmp(value, "Custom.", 7))
+    value = "Custom";
+
+  o->firstvalue = ppd_find_uichoice(o->option, value);
+
+  DEBUG_printf(("9ppd_test_option: %s: value=%s, firstvalue=%s, enabled=%d",
+                keyword, o->use_marked ? "(marked)" :
+		             o->value ? o->value->choice : "(none)",
+		o->firstvalue ? o->firstvalue->choice : "(none)", o->enabled));
+
+  return (o);
+}
@@ -21,12 +21,42 @@
 #  include <io.h>
 #else
 #  include <unistd.h>
+#  include <sys/uio.h>
 #endif /* _WIN32 || __EMX__ */
 #include <errno.h>
 #include <ctype.h>
 #include <string.h>
 
 
+/*
+ * Local constants...
+ */
+
+#define PPD_NUM_SECTIONS	(PPD_ORDER_PROLOG + 1)
+					/* Number of sections */
+#define PPD_MAX_IOVEC		16	/* Maximum I/O vectors per write */
+
+
+/*
+ * Types...
+ */
+
+struct ppd_emit_s			/**** Option code of all sections ****/
+{
+  char		*code[PPD_NUM_SECTIONS];/* Code for each section or NULL */
+  size_t	length[PPD_NUM_SECTIONS];
+					/* Length of code for each section */
+};
+
+#if defined(_WIN32) || defined(__EMX__)
+struct iovec				/**** I/O vector for write() ****/
+{
+  void		*iov_base;		/* Start of data */
+  size_t	iov_len;		/* Length of data */
+};
+#endif /* _WIN32 || __EMX__ */
+
+
 /*
  * Local functions...
  */
@@ -285,6 +315,67 @@ ppdEmitAfterOrder(
 }
 
 
+/*
+ * 'ppdEmitCreate()' - Collect the code for marked options of all sections.
+ *
+ * The code of each section is generated once, as ppdEmitString() would
+ * return it for a "min_order" of 0, and can then be sent any number of
+ * times with ppdEmitGetCode() or ppdEmitWriteFd() without collecting or
+ * allocating anything again.  The code is not updated when options are
+ * marked later on, create a new object after marking options.
+ *
+ * The returned object should be freed using @link ppdEmitDestroy@ when you
+ * are done with it.
+ *
+ * @since cups-filters 2.0.0@
+ */
+
+ppd_emit_t *				/* O - Option code or @code NULL@ on error */
+ppdEmitCreate(ppd_file_t *ppd)		/* I - PPD file record */
+{
+  int		section;		/* Current section */
+  ppd_emit_t	*emit;			/* Option code */
+
+
+  DEBUG_printf(("ppdEmitCreate(ppd=%p)", ppd));
+
+  if (!ppd)
+    return (NULL);
+
+  if ((emit = calloc(1, sizeof(ppd_emit_t))) == NULL)
+    return (NULL);
+
+  for (section = 0; section < PPD_NUM_SECTIONS; section ++)
+    if ((emit->code[section] = ppdEmitString(ppd, (ppd_section_t)section,
+                                             0.0)) != NULL)
+      emit->length[section] = strlen(emit->code[section]);
+
+  return (emit);
+}
+
+
+/*
+ * 'ppdEmitDestroy()' - Free the option code from ppdEmitCreate().
+ *
+ * @since cups-filters 2.0.0@
+ */
+
+void
+ppdEmitDestroy(ppd_emit_t *emit)	/* I - Option code */
+{
+  int	section;			/* Current section */
+
+
+  if (!emit)
+    return;
+
+  for (section = 0; section < PPD_NUM_SECTIONS; section ++)
+    free(emit->code[section]);
+
+  free(emit);
+}
+
+
 /*
  * 'ppdEmitFd()' - Emit code for marked options to a file.
  */
@@ -353,6 +444,33 @@ ppdEmitFd(ppd_file_t    *ppd,		/* I - PPD file record */
 }
 
 
+/*
+ * 'ppdEmitGetCode()' - Get the code for marked options in a section.
+ *
+ * The returned string belongs to the option code object and must not be
+ * freed.
+ *
+ * @since cups-filters 2.0.0@
+ */
+
+const char *				/* O - Option code or @code NULL@ if there is no option code */
+ppdEmitGetCode(ppd_emit_t    *emit,	/* I - Option code */
+               ppd_section_t section,	/* I - Section */
+	       size_t        *length)	/* O - Length of option code or @code NULL@ */
+{
+  const char	*code = NULL;		/* Option code */
+
+
+  if (emit && (int)section >= 0 && (int)section < PPD_NUM_SECTIONS)
+    code = emit->code[section];
+
+  if (length)
+    *length = code ? emit->length[section] : 0;
+
+  return (code);
+}
+
+
 /*
  * 'ppdEmitJCL()' - Emit code for JCL options to a file (for PostScript
  *                  output).
@@ -1160,6 +1278,90 @@ ppdEmitString(ppd_file_t    *ppd,	/* I - PPD file record */
 }
 
 
+/*
+ * 'ppdEmitWriteFd()' - Write the code for marked options of one or more
+ *                      sections to a file.
+ *
+ * The code of all sections is written in order with as few write calls as
+ * possible.
+ *
+ * @since cups-filters 2.0.0@
+ */
+
+int					/* O - 0 on success, -1 on failure */
+ppdEmitWriteFd(
+    ppd_emit_t          *emit,		/* I - Option code */
+    int                 fd,		/* I - File to write to */
+    int                 num_sections,	/* I - Number of sections */
+    const ppd_section_t *sections)	/* I - Sections to write */
+{
+  struct iovec	iov[PPD_MAX_IOVEC],	/* Code to write */
+		*iovptr;		/* Current code */
+  int		iovcnt;			/* Number of code strings left */
+  ssize_t	bytes;			/* Bytes written */
+
+
+ /*
+  * Range check input...
+  */
+
+  if (!emit || fd < 0 || num_sections < 0 || (num_sections > 0 && !sections))
+    return (-1);
+
+  while (num_sections > 0)
+  {
+   /*
+    * Gather the code of as many sections as we can...
+    */
+
+    for (iovcnt = 0; iovcnt < PPD_MAX_IOVEC && num_sections > 0;
+         num_sections --, sections ++)
+      if ((int)*sections >= 0 && (int)*sections < PPD_NUM_SECTIONS &&
+          emit->length[*sections] > 0)
+      {
+        iov[iovcnt].iov_base = emit->code[*sections];
+	iov[iovcnt].iov_len  = emit->length[*sections];
+	iovcnt ++;
+      }
+
+   /*
+    * Then write it, continuing after partial writes...
+    */
+
+    for (iovptr = iov; iovcnt > 0;)
+    {
+#if defined(_WIN32) || defined(__EMX__)
+      if ((bytes = (ssize_t)write(fd, iovptr->iov_base,
+                                  (unsigned)iovptr->iov_len)) < 0)
+#else
+      if ((bytes = writev(fd, iovptr, iovcnt)) < 0)
+#endif /* _WIN32 || __EMX__ */
+      {
+        if (errno == EAGAIN || errno == EINTR)
+	  continue;
+
+	return (-1);
+      }
+
+      while (iovcnt > 0 && (size_t)bytes >= iovptr->iov_len)
+      {
+        bytes -= (ssize_t)iovptr->iov_len;
+	iovptr ++;
+	iovcnt --;
+      }
+
+      if (iovcnt > 0)
+      {
+        iovptr->iov_base = (char *)iovptr->iov_base + bytes;
+	iovptr->iov_len  -= (size_t)bytes;
+      }
+    }
+  }
+
+  return (0);
+}
+
+
 /*
  * 'ppdHandleMedia()' - Handle media selection...
  */
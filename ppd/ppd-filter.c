@@ -21,6 +21,10 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <utime.h>
 #include <cups/file.h>
 #include <cups/array.h>
 
@@ -203,11 +207,23 @@ ppdFilterLoadPPDFile(cf_filter_data_t *data, /* I/O - Job and printer data */
   ppd_file_t       *ppd;                  /* PPD data */
   cf_logfunc_t     log = data->logfunc;   /* Log function */
   void             *ld = data->logdata;   /* log function data */
+  const char       *cachedir;             /* Directory for PPD images */
 
   if (!ppdfile || !ppdfile[0])
     return (-1);
 
-  if ((ppd = ppdOpenFile(ppdfile)) == NULL)
+  /*
+   * Filters of a job chain open the same PPD file one after the other,
+   * when running under CUPS use a precompiled image of it in CUPS' cache
+   * directory to not parse it each time
+   */
+
+  if ((cachedir = getenv("CUPS_CACHEDIR")) != NULL && cachedir[0])
+    ppd = ppdOpenFileImage(ppdfile, cachedir);
+  else
+    ppd = ppdOpenFile(ppdfile);
+
+  if (ppd == NULL)
   {
     if (log) log(ld, CF_LOGLEVEL_ERROR,
 		 "ppdFilterLoadPPDFile: Could not load PPD file %s: %s",
@@ -226,6 +242,222 @@ ppdFilterLoadPPDFile(cf_filter_data_t *data, /* I/O - Job and printer data */
 }
 
 
+/*
+ * 'ppd_filter_cache_stamp()' - Make the string identifying the version of
+ *                              the PPD file a cache file was made from.
+ */
+
+static void
+ppd_filter_cache_stamp(struct stat *ppdinfo, /* I - PPD file information */
+		       char        *stamp,   /* O - Stamp string */
+		       size_t      stampsize)/* I - Size of stamp string */
+{
+  snprintf(stamp, stampsize, "%lld %lld %lld %lld %lld",
+	   (long long)ppdinfo->st_dev, (long long)ppdinfo->st_ino,
+	   (long long)ppdinfo->st_size, (long long)ppdinfo->st_mtime,
+	   (long long)ppdinfo->st_ctime);
+}
+
+
+/*
+ * 'ppd_filter_read_cache()' - Read a PPD cache file written by
+ *                             ppd_filter_load_cache() if it is up to date.
+ *
+ * The cache file is up to date if its modification time is the one of the
+ * PPD file and the device, inode, size, modification and change time of
+ * the PPD file stored in it (ppd_filter_cache_stamp()) are the current
+ * ones, as a PPD file replaced within the same second keeps its mtime.
+ */
+
+static ppd_cache_t *			/* O - PPD cache or NULL */
+ppd_filter_read_cache(const char  *cachefile, /* I - PPD cache file */
+		      struct stat *ppdinfo,   /* I - PPD file information */
+		      cf_logfunc_t log,	      /* I - Log function */
+		      void        *ld)	      /* I - Log function data */
+{
+  ppd_cache_t	  *pc;			/* PPD cache */
+  struct stat	  cacheinfo;		/* Cache file information */
+  ipp_t		  *attrs = NULL;	/* Attributes stored with the cache */
+  ipp_attribute_t *attr;		/* Time for creating the cache */
+  struct timeval  start,		/* Start of reading */
+		  end;			/* End of reading */
+  double	  msecs;		/* Time for reading */
+  char		  stamp[256];		/* Stamp of the PPD file */
+
+
+  if (stat(cachefile, &cacheinfo) ||
+      cacheinfo.st_mtime != ppdinfo->st_mtime)
+    return (NULL);
+
+  gettimeofday(&start, NULL);
+  if ((pc = ppdCacheCreateWithFile(cachefile, &attrs)) == NULL)
+    return (NULL);
+  gettimeofday(&end, NULL);
+
+  ppd_filter_cache_stamp(ppdinfo, stamp, sizeof(stamp));
+  if ((attr = ippFindAttribute(attrs, "cups-filters-cache-ppd-stamp",
+			       IPP_TAG_TEXT)) == NULL ||
+      strcmp(ippGetString(attr, 0, NULL), stamp))
+  {
+    if (log) log(ld, CF_LOGLEVEL_DEBUG,
+		 "ppdFilterLoadPPD: PPD cache %s is outdated", cachefile);
+    ppdCacheDestroy(pc);
+    ippDelete(attrs);
+    return (NULL);
+  }
+
+  msecs = 1000.0 * (end.tv_sec - start.tv_sec) +
+          0.001 * (end.tv_usec - start.tv_usec);
+  if ((attr = ippFindAttribute(attrs, "cups-filters-cache-create-usec",
+			       IPP_TAG_INTEGER)) != NULL)
+  {
+    if (log) log(ld, CF_LOGLEVEL_DEBUG,
+		 "ppdFilterLoadPPD: Read PPD cache from %s in %.3f ms, "
+		 "%.3f ms less than creating it",
+		 cachefile, msecs, 0.001 * ippGetInteger(attr, 0) - msecs);
+  }
+  else if (log)
+    log(ld, CF_LOGLEVEL_DEBUG,
+	"ppdFilterLoadPPD: Read PPD cache from %s in %.3f ms",
+	cachefile, msecs);
+
+  ippDelete(attrs);
+
+  return (pc);
+}
+
+
+/*
+ * 'ppd_filter_load_cache()' - Load the PPD cache of a PPD file from the
+ *                             cache directory of CUPS, or create it and
+ *                             save it there.
+ *
+ * The cache files are named by a hash of the PPD file's path and get the
+ * modification time of the PPD file.  Creating the cache is serialized
+ * with a lock file, so that the filters of a job which start at the same
+ * time create it only once.  ppdCacheWriteFile() writes the file under a
+ * temporary name and renames it, readers therefore do not need the lock.
+ * The lock file is removed when the cache file is written, filters still
+ * waiting on it find the new cache file.
+ */
+
+static ppd_cache_t *			/* O - PPD cache or NULL */
+ppd_filter_load_cache(ppd_file_t   *ppd,     /* I - PPD file */
+		      const char   *ppdfile, /* I - PPD file name */
+		      cf_logfunc_t log,	     /* I - Log function */
+		      void         *ld)	     /* I - Log function data */
+{
+  ppd_cache_t	 *pc;			/* PPD cache */
+  const char	 *cachedir;		/* CUPS cache directory */
+  char		 *path,			/* Absolute path of the PPD file */
+		 cachefile[1024],	/* PPD cache file */
+		 lockfile[1024],	/* Lock file */
+		 hash_string[65];	/* Hex string of the hash */
+  unsigned char	 hash[32];		/* SHA-256 hash of the path */
+  ssize_t	 hashlen;		/* Length of hash */
+  struct stat	 ppdinfo;		/* PPD file information */
+  struct utimbuf times;			/* Times for the cache file */
+  struct timeval start,			/* Start of creating the cache */
+		 end;			/* End of creating the cache */
+  ipp_t		 *attrs;		/* Attributes stored with the cache */
+  int		 create_usec;		/* Time for creating the cache */
+  int		 fd;			/* Lock file */
+  char		 stamp[256];		/* Stamp of the PPD file */
+
+
+  if (!ppdfile || (cachedir = getenv("CUPS_CACHEDIR")) == NULL ||
+      !cachedir[0] || stat(ppdfile, &ppdinfo))
+    return (ppdCacheCreateWithPPD(ppd));
+
+  if ((path = realpath(ppdfile, NULL)) != NULL)
+  {
+    hashlen = cupsHashData("sha2-256", path, strlen(path), hash, sizeof(hash));
+    free(path);
+  }
+  else
+    hashlen = cupsHashData("sha2-256", ppdfile, strlen(ppdfile), hash,
+			   sizeof(hash));
+
+  if (hashlen < 0)
+    return (ppdCacheCreateWithPPD(ppd));
+
+  cupsHashString(hash, (size_t)hashlen, hash_string, sizeof(hash_string));
+  snprintf(cachefile, sizeof(cachefile), "%s/%.32s.pwg", cachedir,
+	   hash_string);
+  snprintf(lockfile, sizeof(lockfile), "%s.lock", cachefile);
+
+  if ((pc = ppd_filter_read_cache(cachefile, &ppdinfo, log, ld)) != NULL)
+    return (pc);
+
+ /*
+  * Not cached yet or outdated, create the cache, unless another filter
+  * did it while we were waiting for the lock...
+  */
+
+  if ((fd = open(lockfile, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+		 0644)) >= 0)
+  {
+    if (lockf(fd, F_LOCK, 0))
+    {
+      close(fd);
+      fd = -1;
+    }
+    else if ((pc = ppd_filter_read_cache(cachefile, &ppdinfo, log,
+					 ld)) != NULL)
+    {
+      close(fd);
+      return (pc);
+    }
+  }
+
+  gettimeofday(&start, NULL);
+  pc = ppdCacheCreateWithPPD(ppd);
+  gettimeofday(&end, NULL);
+
+  create_usec = (int)(1000000 * (end.tv_sec - start.tv_sec) +
+		      (end.tv_usec - start.tv_usec));
+  if (log) log(ld, CF_LOGLEVEL_DEBUG,
+	       "ppdFilterLoadPPD: Created PPD cache in %.3f ms",
+	       0.001 * create_usec);
+
+  if (pc && fd >= 0)
+  {
+    attrs = ippNew();
+    ippAddInteger(attrs, IPP_TAG_PRINTER, IPP_TAG_INTEGER,
+		  "cups-filters-cache-create-usec", create_usec);
+    ppd_filter_cache_stamp(&ppdinfo, stamp, sizeof(stamp));
+    ippAddString(attrs, IPP_TAG_PRINTER, IPP_TAG_TEXT,
+		 "cups-filters-cache-ppd-stamp", NULL, stamp);
+
+    if (ppdCacheWriteFile(pc, cachefile, attrs))
+    {
+      times.actime  = ppdinfo.st_mtime;
+      times.modtime = ppdinfo.st_mtime;
+      utime(cachefile, &times);
+    }
+    else if (log)
+      log(ld, CF_LOGLEVEL_DEBUG,
+	  "ppdFilterLoadPPD: Unable to write PPD cache file %s: %s",
+	  cachefile, cupsLastErrorString());
+
+    ippDelete(attrs);
+  }
+
+  if (fd >= 0)
+  {
+   /*
+    * Remove the lock file while still holding the lock, filters waiting
+    * for it re-read the cache file when they get it
+    */
+
+    unlink(lockfile);
+    close(fd);
+  }
+
+  return (pc);
+}
+
+
 /*
  * 'ppdFilterLoadPPD()' - When preparing the filter data structure for
  *                        calling one or more filter functions, and a
@@ -288,7 +520,7 @@ ppdFilterLoadPPD(cf_filter_data_t *data) /* I/O - Job and printer data */
   */
 
   ppd = filter_data_ext->ppd;
-  ppd->cache = ppdCacheCreateWithPPD(ppd);
+  ppd->cache = ppd_filter_load_cache(ppd, filter_data_ext->ppdfile, log, ld);
   ppdMarkDefaults(ppd);
   ppdMarkOptions(ppd, data->num_options, data->options);
   num_job_attr_options = ppdGetOptions(&job_attr_options, data->printer_attrs,
@@ -23,6 +23,7 @@
 #include <cups/dir.h>
 #include <ppd/ppd.h>
 #include <ppd/string-private.h>
+#include <ppd/thread-private.h>
 #include <cupsfilters/ipp.h>
 #include <cupsfilters/catalog.h>
 
@@ -143,15 +144,54 @@ ppdCreatePPDFromIPP(char         *buffer,          /* I - Filename buffer */
 }
 
 /*
- * 'ppdCreatePPDFromIPP2()' - Create a PPD file describing the
- *                            capabilities of an IPP printer, with
- *                            extra parameters for PPDs from a merged
- *                            IPP record for printer clusters
+ * 'ppd_generator_uris()' - Write the lines of the PPD file which refer to
+ *                          the individual printer and not to its model
  */
 
-char *                                              /* O - PPD filename or NULL
-						           on error */
-ppdCreatePPDFromIPP2(char         *buffer,          /* I - Filename buffer */
+static void
+ppd_generator_uris(cups_file_t *fp,		/* I - PPD file */
+		   ipp_t       *response,	/* I - Get-Printer-Attributes
+						       response */
+		   int         strings_loaded,	/* I - Printer strings loaded
+						       from printer-strings-uri? */
+		   int         block)		/* I - 0: after *cupsLanguages,
+						       1: after accounting */
+{
+  ipp_attribute_t	*attr;			/* Attribute */
+
+
+  if (block == 1)
+  {
+    if ((attr = ippFindAttribute(response, "printer-privacy-policy-uri",
+				 IPP_TAG_URI)) != NULL)
+      cupsFilePrintf(fp, "*cupsPrivacyURI: \"%s\"\n", ippGetString(attr, 0,
+								   NULL));
+    return;
+  }
+
+  if ((attr = ippFindAttribute(response, "printer-more-info", IPP_TAG_URI)) !=
+      NULL)
+    cupsFilePrintf(fp, "*APSupplies: \"%s\"\n", ippGetString(attr, 0, NULL));
+
+  if ((attr = ippFindAttribute(response, "printer-charge-info-uri",
+			       IPP_TAG_URI)) != NULL)
+    cupsFilePrintf(fp, "*cupsChargeInfoURI: \"%s\"\n", ippGetString(attr, 0,
+								    NULL));
+
+  if (strings_loaded &&
+      (attr = ippFindAttribute(response, "printer-strings-uri",
+			       IPP_TAG_URI)) != NULL)
+    cupsFilePrintf(fp, "*cupsStringsURI: \"%s\"\n", ippGetString(attr, 0,
+								 NULL));
+}
+
+/*
+ * 'ppd_generate()' - Generate the PPD file for ppdCreatePPDFromIPP2(),
+ *                    without looking into the cache
+ */
+
+static char *
+ppd_generate(char         *buffer,          /* I - Filename buffer */
 		     size_t       bufsize,          /* I - Size of filename
 						           buffer */
 		     ipp_t        *response,        /* I - Get-Printer-
@@ -176,8 +216,16 @@ ppdCreatePPDFromIPP2(char         *buffer,          /* I - Filename buffer */
 		     char         *status_msg,      /* I - Status message
 						           buffer, NULL to
 							   ignore message */
-		     size_t       status_msg_size)  /* I - Size of status
+		     size_t       status_msg_size,  /* I - Size of status
 						           message buffer */
+		     off_t        *uri_offsets,     /* O - Start and end of
+							   the two blocks of
+							   printer URI lines
+							   (4 values), NULL
+							   to ignore */
+		     int          *strings_loaded)  /* O - Printer strings
+							   loaded? NULL to
+							   ignore */
 {
   cups_file_t		*fp;		/* PPD file */
   cups_array_t		*printer_sizes;	/* Media sizes we've added */
@@ -384,15 +432,6 @@ ppdCreatePPDFromIPP2(char         *buffer,          /* I - Filename buffer */
   cupsFilePuts(fp, "*cupsSNMPSupplies: False\n");
   cupsFilePuts(fp, "*cupsLanguages: \"en\"\n");
 
-  if ((attr = ippFindAttribute(response, "printer-more-info", IPP_TAG_URI)) !=
-      NULL)
-    cupsFilePrintf(fp, "*APSupplies: \"%s\"\n", ippGetString(attr, 0, NULL));
-
-  if ((attr = ippFindAttribute(response, "printer-charge-info-uri",
-			       IPP_TAG_URI)) != NULL)
-    cupsFilePrintf(fp, "*cupsChargeInfoURI: \"%s\"\n", ippGetString(attr, 0,
-								    NULL));
-
   /* Message catalogs for UI strings */
   opt_strings_catalog = cfCatalogOptionArrayNew();
   cfCatalogLoad(NULL, opt_strings_catalog);
@@ -401,11 +440,18 @@ ppdCreatePPDFromIPP2(char         *buffer,          /* I - Filename buffer */
     printer_opt_strings_catalog = cfCatalogOptionArrayNew();
     cfCatalogLoad(ippGetString(attr, 0, NULL),
 		  printer_opt_strings_catalog);
-    if (cupsArrayCount(printer_opt_strings_catalog) > 0)
-      cupsFilePrintf(fp, "*cupsStringsURI: \"%s\"\n", ippGetString(attr, 0,
-								   NULL));
   }
 
+  /* URIs of this printer, not cached, see gen_cache_add() */
+  if (strings_loaded)
+    *strings_loaded = cupsArrayCount(printer_opt_strings_catalog) > 0;
+  if (uri_offsets)
+    uri_offsets[0] = cupsFileTell(fp);
+  ppd_generator_uris(fp, response,
+		     cupsArrayCount(printer_opt_strings_catalog) > 0, 0);
+  if (uri_offsets)
+    uri_offsets[1] = cupsFileTell(fp);
+
  /*
   * Accounting...
   */
@@ -419,8 +465,12 @@ ppdCreatePPDFromIPP2(char         *buffer,          /* I - Filename buffer */
 				     IPP_TAG_BOOLEAN), 0))
     cupsFilePuts(fp, "*cupsJobAccountingUserId: True\n");
 
-  if ((attr = ippFindAttribute(response, "printer-privacy-policy-uri", IPP_TAG_URI)) != NULL)
-    cupsFilePrintf(fp, "*cupsPrivacyURI: \"%s\"\n", ippGetString(attr, 0, NULL));
+  if (uri_offsets)
+    uri_offsets[2] = cupsFileTell(fp);
+  ppd_generator_uris(fp, response,
+		     cupsArrayCount(printer_opt_strings_catalog) > 0, 1);
+  if (uri_offsets)
+    uri_offsets[3] = cupsFileTell(fp);
 
   if ((attr = ippFindAttribute(response, "printer-mandatory-job-attributes", IPP_TAG_KEYWORD)) != NULL)
   {
@@ -2436,3 +2486,614 @@ ppdCreatePPDFromIPP2(char         *buffer,          /* I - Filename buffer */
 
   return (NULL);
 }
+
+
+/*
+ * PPD generation cache
+ *
+ * Identical printer models on the network (think of 200 copiers of the
+ * same model in an office building) make ppdCreatePPDFromIPP2() generate
+ * the same PPD file again and again. So we keep the last generated PPD
+ * files in memory, keyed by a hash of everything which goes into the
+ * generator: the IPP attributes (without the ones which only describe
+ * the state or identity of the printer), the DNS-SD info, and the
+ * cluster parameters. The lines referring to the individual printer
+ * (see ppd_generator_uris()) are not cached but written for each
+ * printer, at the positions which ppd_generate() reports for them. From
+ * printer-strings-uri only the path goes into the hash, assuming that
+ * printers of the same model serve the same strings.
+ */
+
+#define GEN_CACHE_SIZE 16		/* Default maximum of cached PPDs */
+
+typedef struct gen_cache_entry_s	/**** Cached PPD file ****/
+{
+  unsigned char	key[32];		/* SHA-256 of the generator input */
+  char		*data;			/* PPD file without printer URIs */
+  size_t	datalen,		/* Length of data */
+		uripos[2];		/* Where the two blocks of printer
+					   URI lines go */
+  int		strings_loaded;		/* Printer strings loaded? */
+  char		*status_msg;		/* Status message of the generator */
+  unsigned long	used;			/* Last use, for evicting entries */
+} gen_cache_entry_t;
+
+typedef struct gen_key_buffer_s		/**** Input for the hash ****/
+{
+  char		*data;			/* Buffer */
+  size_t	len,			/* Bytes used */
+		size;			/* Bytes allocated */
+} gen_key_buffer_t;
+
+static _ppd_mutex_t	gen_cache_mutex = _PPD_MUTEX_INITIALIZER;
+					/* Mutex for the cache */
+static cups_array_t	*gen_cache = NULL;
+					/* Cached PPD files */
+static int		gen_cache_max = GEN_CACHE_SIZE;
+					/* Maximum number of cached PPD files */
+static unsigned long	gen_cache_hits = 0,
+					/* Number of cache hits */
+			gen_cache_misses = 0,
+					/* Number of cache misses */
+			gen_cache_uses = 0;
+					/* Use counter for LRU */
+
+/* Attributes which the generator does not look at (prefixes) */
+static const char * const gen_cache_ignored_attrs[] =
+{
+  "marker-",
+  "printer-alert",
+  "printer-config-change-",
+  "printer-current-time",
+  "printer-dns-sd-name",
+  "printer-firmware-",
+  "printer-geo-location",
+  "printer-icons",
+  "printer-id",
+  "printer-impressions-completed",
+  "printer-info",
+  "printer-is-accepting-jobs",
+  "printer-location",
+  "printer-media-sheets-completed",
+  "printer-name",
+  "printer-organization",
+  "printer-pages-completed",
+  "printer-serial-number",
+  "printer-state",
+  "printer-supply",
+  "printer-up-time",
+  "printer-uuid",
+  "queued-job-count"
+};
+
+
+/*
+ * 'gen_cache_free()' - Free a cache entry.
+ */
+
+static void
+gen_cache_free(gen_cache_entry_t *entry)	/* I - Cache entry */
+{
+  free(entry->data);
+  free(entry->status_msg);
+  free(entry);
+}
+
+
+/*
+ * 'gen_key_add()' - Add data to the input for the hash.
+ */
+
+static void
+gen_key_add(gen_key_buffer_t *kb,		/* I - Key buffer */
+	    const char       *s,		/* I - Data */
+	    size_t           len)		/* I - Length of data */
+{
+  char	*data;				/* New buffer */
+
+
+  if (kb->data == NULL)
+    return;
+
+  if (kb->len + len + 1 > kb->size)
+  {
+    kb->size = 2 * (kb->len + len + 1);
+    if ((data = realloc(kb->data, kb->size)) == NULL)
+    {
+      free(kb->data);
+      kb->data = NULL;
+      return;
+    }
+    kb->data = data;
+  }
+
+  memcpy(kb->data + kb->len, s, len);
+  kb->len += len;
+}
+
+
+/*
+ * 'gen_key_puts()' - Add a string and a line break to the input for the
+ *                    hash.
+ */
+
+static void
+gen_key_puts(gen_key_buffer_t *kb,		/* I - Key buffer */
+	     const char       *s)		/* I - String or NULL */
+{
+  if (s)
+    gen_key_add(kb, s, strlen(s));
+  gen_key_add(kb, "\n", 1);
+}
+
+
+/*
+ * 'gen_cache_key()' - Compute the hash of the input of the generator.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+gen_cache_key(unsigned char *key,	/* O - SHA-256 hash */
+	      ipp_t         *response,	/* I - Get-Printer-Attributes
+					       response */
+	      const char    *make_model,/* I - Make and model from DNS-SD */
+	      const char    *pdl,	/* I - List of PDLs from DNS-SD */
+	      int           color,	/* I - Color printer? */
+	      int           duplex,	/* I - Duplex printer? */
+	      cups_array_t  *conflicts,	/* I - Array of constraints */
+	      cups_array_t  *sizes,	/* I - Media sizes */
+	      const char    *default_pagesize,
+					/* I - Default page size */
+	      const char    *default_cluster_color)
+					/* I - Cluster default color */
+{
+  gen_key_buffer_t	kb;		/* Input for the hash */
+  ipp_attribute_t	*attr;		/* Current attribute */
+  const char		*name;		/* Attribute name */
+  char			*value = NULL,	/* Attribute value */
+			*ptr;
+  size_t		valuesize = 0,	/* Size of value buffer */
+			len;		/* Length of value */
+  char			scheme[32],	/* URI components */
+			userpass[256],
+			host[256],
+			resource[1024],
+			line[1024];
+  int			port,
+			i,
+			num_ignored = sizeof(gen_cache_ignored_attrs) /
+				      sizeof(gen_cache_ignored_attrs[0]);
+  cups_size_t		*size;		/* Media size */
+  const char		*constraint;	/* Constraint */
+  ssize_t		hashlen;	/* Length of hash */
+
+
+  kb.len  = 0;
+  kb.size = 65536;
+  if ((kb.data = malloc(kb.size)) == NULL)
+    return (0);
+
+  for (attr = ippFirstAttribute(response); attr;
+       attr = ippNextAttribute(response))
+  {
+    if ((name = ippGetName(attr)) == NULL)
+      continue;
+
+    for (i = 0; i < num_ignored; i ++)
+      if (!strncmp(name, gen_cache_ignored_attrs[i],
+		   strlen(gen_cache_ignored_attrs[i])))
+	break;
+    if (i < num_ignored ||
+	!strcmp(name, "printer-more-info") ||
+	!strcmp(name, "printer-charge-info-uri") ||
+	!strcmp(name, "printer-privacy-policy-uri"))
+      continue;
+
+    snprintf(line, sizeof(line), "%d %d %s=", ippGetGroupTag(attr),
+	     ippGetValueTag(attr), name);
+    gen_key_add(&kb, line, strlen(line));
+
+    if (!strcmp(name, "printer-uri-supported"))
+    {
+     /*
+      * Only used to find out whether we have a fax queue, see
+      * ppd_generate()
+      */
+
+      ippAttributeString(attr, line, 256);
+      gen_key_puts(&kb, strcasestr(line, "faxout") ? "faxout" : "");
+      continue;
+    }
+    else if (!strcmp(name, "printer-strings-uri"))
+    {
+      if (httpSeparateURI(HTTP_URI_CODING_ALL, ippGetString(attr, 0, NULL),
+			  scheme, sizeof(scheme), userpass, sizeof(userpass),
+			  host, sizeof(host), &port, resource,
+			  sizeof(resource)) < HTTP_URI_STATUS_OK)
+	gen_key_puts(&kb, ippGetString(attr, 0, NULL));
+      else
+	gen_key_puts(&kb, resource);
+      continue;
+    }
+
+    /* Do not let long values (media-col-database) get truncated */
+    if (value == NULL && (value = malloc(valuesize = 65536)) == NULL)
+      break;
+    while ((len = ippAttributeString(attr, value, valuesize)) >=
+	   valuesize - 1)
+    {
+      if ((ptr = realloc(value, valuesize * 4)) == NULL)
+	break;
+      value = ptr;
+      valuesize *= 4;
+    }
+    if (len >= valuesize - 1)
+      break;
+    gen_key_add(&kb, value, len);
+    gen_key_add(&kb, "\n", 1);
+  }
+  free(value);
+
+  if (attr)
+  {
+    free(kb.data);
+    return (0);
+  }
+
+  gen_key_puts(&kb, "--");
+
+ /*
+  * The output also depends on the locale (number formatting via
+  * localeconv()) and on CUPS_LOCALEDIR (UI string catalog)
+  */
+
+  if ((ptr = setlocale(LC_ALL, NULL)) != NULL)
+    gen_key_puts(&kb, ptr);
+  gen_key_puts(&kb, getenv("CUPS_LOCALEDIR"));
+
+  gen_key_puts(&kb, make_model);
+  gen_key_puts(&kb, pdl);
+  snprintf(line, sizeof(line), "%d %d", color, duplex);
+  gen_key_puts(&kb, line);
+  gen_key_puts(&kb, default_pagesize);
+  gen_key_puts(&kb, default_cluster_color);
+
+  gen_key_puts(&kb, "-- conflicts");
+  for (i = 0; i < cupsArrayCount(conflicts); i ++)
+    if ((constraint = (const char *)cupsArrayIndex(conflicts, i)) != NULL)
+      gen_key_puts(&kb, constraint);
+
+  gen_key_puts(&kb, sizes ? "-- sizes" : "-- no sizes");
+  for (i = 0; i < cupsArrayCount(sizes); i ++)
+    if ((size = (cups_size_t *)cupsArrayIndex(sizes, i)) != NULL)
+    {
+      snprintf(line, sizeof(line), "%s %d %d %d %d %d %d", size->media,
+	       size->width, size->length, size->bottom, size->left,
+	       size->right, size->top);
+      gen_key_puts(&kb, line);
+    }
+
+  if (kb.data == NULL)
+    return (0);
+
+  hashlen = cupsHashData("sha2-256", kb.data, kb.len, key, 32);
+  free(kb.data);
+
+  return (hashlen == 32);
+}
+
+
+/*
+ * 'gen_cache_find()' - Find a cached PPD file, the caller must hold
+ *                      gen_cache_mutex.
+ */
+
+static gen_cache_entry_t *		/* O - Cache entry or NULL */
+gen_cache_find(const unsigned char *key)/* I - Hash of the generator input */
+{
+  gen_cache_entry_t	*entry;		/* Current entry */
+
+
+  for (entry = (gen_cache_entry_t *)cupsArrayFirst(gen_cache); entry;
+       entry = (gen_cache_entry_t *)cupsArrayNext(gen_cache))
+    if (!memcmp(entry->key, key, sizeof(entry->key)))
+      return (entry);
+
+  return (NULL);
+}
+
+
+/*
+ * 'gen_cache_write()' - Write a PPD file from a cache entry, the caller
+ *                       must hold gen_cache_mutex.
+ */
+
+static char *				/* O - PPD filename or NULL */
+gen_cache_write(gen_cache_entry_t *entry,/* I - Cache entry */
+		char              *buffer,/* I - Filename buffer */
+		size_t            bufsize,/* I - Size of filename buffer */
+		ipp_t             *response)
+					/* I - Get-Printer-Attributes
+					       response */
+{
+  cups_file_t	*fp;			/* PPD file */
+
+
+  if ((fp = cupsTempFile2(buffer, (int)bufsize)) == NULL)
+    return (NULL);
+
+  cupsFileWrite(fp, entry->data, entry->uripos[0]);
+  ppd_generator_uris(fp, response, entry->strings_loaded, 0);
+  cupsFileWrite(fp, entry->data + entry->uripos[0],
+		entry->uripos[1] - entry->uripos[0]);
+  ppd_generator_uris(fp, response, entry->strings_loaded, 1);
+  cupsFileWrite(fp, entry->data + entry->uripos[1],
+		entry->datalen - entry->uripos[1]);
+
+  if (cupsFileClose(fp))
+  {
+    unlink(buffer);
+    *buffer = '\0';
+    return (NULL);
+  }
+
+  return (buffer);
+}
+
+
+/*
+ * 'gen_cache_add()' - Add a generated PPD file to the cache.
+ */
+
+static void
+gen_cache_add(const unsigned char *key,	/* I - Hash of the generator input */
+	      const char          *filename,
+					/* I - Generated PPD file */
+	      const char          *status_msg,
+					/* I - Status message */
+	      const off_t         *uri_offsets,
+					/* I - Printer URI lines in the file,
+					       see ppd_generate() */
+	      int                 strings_loaded)
+					/* I - Printer strings loaded? */
+{
+  cups_file_t		*fp;		/* PPD file */
+  gen_cache_entry_t	*entry,		/* New cache entry */
+			*current,	/* Current entry */
+			*oldest;	/* Least recently used entry */
+  char			*data;		/* New buffer */
+  size_t		size = 65536,	/* Size of data buffer */
+			len0,		/* Lengths of the URI blocks */
+			len1;
+  ssize_t		bytes;		/* Bytes read */
+
+
+  if ((entry = calloc(1, sizeof(gen_cache_entry_t))) == NULL)
+    return;
+  memcpy(entry->key, key, sizeof(entry->key));
+  entry->status_msg = status_msg ? strdup(status_msg) : NULL;
+  entry->strings_loaded = strings_loaded;
+
+  if ((entry->data = malloc(size)) == NULL ||
+      (fp = cupsFileOpen(filename, "r")) == NULL)
+  {
+    gen_cache_free(entry);
+    return;
+  }
+
+  while ((bytes = cupsFileRead(fp, entry->data + entry->datalen,
+			       size - entry->datalen - 1)) > 0)
+  {
+    entry->datalen += (size_t)bytes;
+    if (entry->datalen + 1 >= size)
+    {
+      size *= 2;
+      if ((data = realloc(entry->data, size)) == NULL)
+	break;
+      entry->data = data;
+    }
+  }
+  cupsFileClose(fp);
+  entry->data[entry->datalen] = '\0';
+
+ /*
+  * Cut out the printer URI lines, they get written for each printer
+  * by gen_cache_write()...
+  */
+
+  if (bytes != 0 || uri_offsets[0] < 0 || uri_offsets[1] < uri_offsets[0] ||
+      uri_offsets[2] < uri_offsets[1] || uri_offsets[3] < uri_offsets[2] ||
+      (size_t)uri_offsets[3] > entry->datalen)
+  {
+    gen_cache_free(entry);
+    return;
+  }
+
+  len0 = (size_t)(uri_offsets[1] - uri_offsets[0]);
+  len1 = (size_t)(uri_offsets[3] - uri_offsets[2]);
+  memmove(entry->data + uri_offsets[2], entry->data + uri_offsets[3],
+	  entry->datalen - (size_t)uri_offsets[3] + 1);
+  memmove(entry->data + uri_offsets[0], entry->data + uri_offsets[1],
+	  entry->datalen - len1 - (size_t)uri_offsets[1] + 1);
+  entry->datalen -= len0 + len1;
+  entry->uripos[0] = (size_t)uri_offsets[0];
+  entry->uripos[1] = (size_t)uri_offsets[2] - len0;
+
+  _ppdMutexLock(&gen_cache_mutex);
+
+  if (!gen_cache)
+    gen_cache = cupsArrayNew(NULL, NULL);
+
+  if (!gen_cache || gen_cache_max <= 0 || gen_cache_find(key))
+  {
+    _ppdMutexUnlock(&gen_cache_mutex);
+    gen_cache_free(entry);
+    return;
+  }
+
+  while (cupsArrayCount(gen_cache) >= gen_cache_max)
+  {
+    for (oldest = current = (gen_cache_entry_t *)cupsArrayFirst(gen_cache);
+	 current; current = (gen_cache_entry_t *)cupsArrayNext(gen_cache))
+      if (current->used < oldest->used)
+	oldest = current;
+    cupsArrayRemove(gen_cache, oldest);
+    gen_cache_free(oldest);
+  }
+
+  entry->used = ++ gen_cache_uses;
+  cupsArrayAdd(gen_cache, entry);
+
+  _ppdMutexUnlock(&gen_cache_mutex);
+}
+
+
+/*
+ * 'ppdCreatePPDFromIPP2()' - Create a PPD file describing the
+ *                            capabilities of an IPP printer, with
+ *                            extra parameters for PPDs from a merged
+ *                            IPP record for printer clusters
+ */
+
+char *                                              /* O - PPD filename or NULL
+						           on error */
+ppdCreatePPDFromIPP2(char         *buffer,          /* I - Filename buffer */
+		     size_t       bufsize,          /* I - Size of filename
+						           buffer */
+		     ipp_t        *response,        /* I - Get-Printer-
+						           Attributes response*/
+		     const char   *make_model,      /* I - Make and model from
+						           DNS-SD */
+		     const char   *pdl,             /* I - List of PDLs from
+						           DNS-SD */
+		     int          color,            /* I - Color printer? (from
+						           DNS-SD) */
+		     int          duplex,           /* I - Duplex printer? (from
+						           DNS-SD) */
+		     cups_array_t *conflicts,       /* I - Array of
+						           constraints */
+		     cups_array_t *sizes,           /* I - Media sizes we've
+						           added */ 
+		     char*        default_pagesize, /* I - Default page size*/
+		     const char   *default_cluster_color, /* I - cluster def
+							   color (if cluster's
+							   attributes are
+							   returned) */
+		     char         *status_msg,      /* I - Status message
+						           buffer, NULL to
+							   ignore message */
+		     size_t       status_msg_size)  /* I - Size of status
+						           message buffer */
+{
+  unsigned char		key[32];	/* Hash of the generator input */
+  int			have_key,	/* Hash computed? */
+			strings_loaded = 0;
+					/* Printer strings loaded? */
+  off_t			uri_offsets[4] = { -1, -1, -1, -1 };
+					/* Printer URI lines in the PPD */
+  gen_cache_entry_t	*entry;		/* Cache entry */
+  char			*ret;		/* Return value */
+  char			msg[1024];	/* Status message */
+
+
+  if (buffer)
+    *buffer = '\0';
+
+  if (!buffer || bufsize < 1 || !response || gen_cache_max <= 0)
+    return (ppd_generate(buffer, bufsize, response, make_model, pdl, color,
+			 duplex, conflicts, sizes, default_pagesize,
+			 default_cluster_color, status_msg, status_msg_size,
+			 NULL, NULL));
+
+  have_key = gen_cache_key(key, response, make_model, pdl, color, duplex,
+			   conflicts, sizes, default_pagesize,
+			   default_cluster_color);
+
+  if (have_key)
+  {
+    _ppdMutexLock(&gen_cache_mutex);
+    if ((entry = gen_cache_find(key)) != NULL)
+    {
+      gen_cache_hits ++;
+      entry->used = ++ gen_cache_uses;
+      ret = gen_cache_write(entry, buffer, bufsize, response);
+      if (ret && status_msg && status_msg_size)
+	snprintf(status_msg, status_msg_size, "%s",
+		 entry->status_msg ? entry->status_msg : "");
+      _ppdMutexUnlock(&gen_cache_mutex);
+      if (ret)
+	return (ret);
+    }
+    else
+    {
+      gen_cache_misses ++;
+      _ppdMutexUnlock(&gen_cache_mutex);
+    }
+  }
+
+  msg[0] = '\0';
+  ret = ppd_generate(buffer, bufsize, response, make_model, pdl, color,
+		     duplex, conflicts, sizes, default_pagesize,
+		     default_cluster_color, msg, sizeof(msg), uri_offsets,
+		     &strings_loaded);
+  if (status_msg && status_msg_size)
+    snprintf(status_msg, status_msg_size, "%s", msg);
+
+  if (ret && have_key)
+    gen_cache_add(key, ret, msg, uri_offsets, strings_loaded);
+
+  return (ret);
+}
+
+
+/*
+ * 'ppdCreatePPDFromIPPCacheSize()' - Set the maximum number of PPD files
+ *                                    kept by ppdCreatePPDFromIPP2(), 0 turns
+ *                                    off the cache
+ */
+
+void
+ppdCreatePPDFromIPPCacheSize(int max_ppds)	/* I - Maximum number of
+						       cached PPD files */
+{
+  gen_cache_entry_t	*entry;		/* Current entry */
+
+
+  _ppdMutexLock(&gen_cache_mutex);
+
+  gen_cache_max = (max_ppds > 0 ? max_ppds : 0);
+
+  while (cupsArrayCount(gen_cache) > gen_cache_max)
+  {
+    entry = (gen_cache_entry_t *)cupsArrayFirst(gen_cache);
+    cupsArrayRemove(gen_cache, entry);
+    gen_cache_free(entry);
+  }
+
+  _ppdMutexUnlock(&gen_cache_mutex);
+}
+
+
+/*
+ * 'ppdCreatePPDFromIPPCacheStats()' - Get the statistics of the cache of
+ *                                     ppdCreatePPDFromIPP2()
+ */
+
+void
+ppdCreatePPDFromIPPCacheStats(unsigned long *hits,
+					/* O - Number of cache hits */
+			      unsigned long *misses,
+					/* O - Number of cache misses */
+			      int           *num_ppds)
+					/* O - Number of cached PPD files */
+{
+  _ppdMutexLock(&gen_cache_mutex);
+
+  if (hits)
+    *hits = gen_cache_hits;
+  if (misses)
+    *misses = gen_cache_misses;
+  if (num_ppds)
+    *num_ppds = cupsArrayCount(gen_cache);
+
+  _ppdMutexUnlock(&gen_cache_mutex);
+}
@@ -0,0 +1,422 @@
+/*
+ * Option, choice, and attribute hash index for libppd.
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "string-private.h"
+#include "ppd-private.h"
+#include "debug-internal.h"
+#include <stdint.h>
+
+
+/*
+ * Local constants...
+ */
+
+enum
+{
+  PPD_INDEX_OPTION,			/* Option by keyword */
+  PPD_INDEX_CHOICE,			/* Choice by option and name */
+  PPD_INDEX_ATTR,			/* Attribute by name */
+  PPD_INDEX_SPEC			/* Attribute by name and spec */
+};
+
+
+/*
+ * Local types...
+ */
+
+typedef struct ppd_index_entry_s	/**** Hash table entry ****/
+{
+  unsigned	hash;			/* Hash of the key */
+  int		pos;			/* Position in sorted attributes */
+  void		*ptr;			/* Option, choice, or attribute */
+} ppd_index_entry_t;
+
+typedef struct ppd_index_table_s	/**** Open addressing hash table ****/
+{
+  unsigned	mask;			/* Number of entries - 1 */
+  ppd_index_entry_t *entries;		/* Entries, ptr is NULL if unused */
+} ppd_index_table_t;
+
+typedef struct ppd_index_s		/**** Index of a PPD file ****/
+{
+  ppd_index_table_t options,		/* Options by keyword */
+		choices,		/* Choices by option and name */
+		attrs,			/* First attribute by name */
+		specs;			/* First attribute by name and spec */
+} ppd_index_t;
+
+
+/*
+ * Local functions...
+ */
+
+static void		ppd_index_add(ppd_index_table_t *table, int type,
+			              unsigned hash, void *ptr, int pos);
+static unsigned		ppd_index_hash(const char *name, const char *spec,
+			               const void *parent);
+static int		ppd_index_size(ppd_index_table_t *table, int count);
+
+
+/*
+ * '_ppdIndexCreate()' - Create the hash index of the options, choices, and
+ *                       attributes of a PPD file.
+ *
+ * This is called once the options array is set up and the file won't get
+ * any new options or attributes.  Until then _ppdIndexFindAttr() and
+ * _ppdIndexFindOption() find nothing and the callers search the arrays.
+ */
+
+void
+_ppdIndexCreate(ppd_file_t *ppd)	/* I - PPD file */
+{
+  int			i;		/* Looping var */
+  int			num_choices = 0;/* Number of choices */
+  ppd_index_t		*index;		/* Index */
+  ppd_option_t		*option;	/* Current option */
+  ppd_choice_t		*choice;	/* Current choice */
+  ppd_attr_t		*attr;		/* Current attribute */
+
+
+  _ppdIndexDelete(ppd);
+
+  if ((index = calloc(1, sizeof(ppd_index_t))) == NULL)
+    return;
+
+  for (option = (ppd_option_t *)cupsArrayFirst(ppd->options);
+       option;
+       option = (ppd_option_t *)cupsArrayNext(ppd->options))
+    num_choices += option->num_choices;
+
+  if (!ppd_index_size(&index->options, cupsArrayCount(ppd->options)) ||
+      !ppd_index_size(&index->choices, num_choices) ||
+      !ppd_index_size(&index->attrs, cupsArrayCount(ppd->sorted_attrs)) ||
+      !ppd_index_size(&index->specs, cupsArrayCount(ppd->sorted_attrs)))
+  {
+    DEBUG_puts("3_ppdIndexCreate: Unable to allocate memory for index.");
+
+    ppd->cups_index = index;
+    _ppdIndexDelete(ppd);
+    return;
+  }
+
+ /*
+  * Add the options and their choices, the first one with a name wins just
+  * like with a linear search...
+  */
+
+  for (option = (ppd_option_t *)cupsArrayFirst(ppd->options);
+       option;
+       option = (ppd_option_t *)cupsArrayNext(ppd->options))
+  {
+    ppd_index_add(&index->options, PPD_INDEX_OPTION,
+                  ppd_index_hash(option->keyword, NULL, NULL), option, 0);
+
+    for (i = option->num_choices, choice = option->choices;
+         i > 0;
+	 i --, choice ++)
+      ppd_index_add(&index->choices, PPD_INDEX_CHOICE,
+                    ppd_index_hash(choice->choice, NULL, option), choice, 0);
+  }
+
+ /*
+  * Add the first attribute for each name and for each name and spec...
+  */
+
+  for (i = 0, attr = (ppd_attr_t *)cupsArrayFirst(ppd->sorted_attrs);
+       attr;
+       i ++, attr = (ppd_attr_t *)cupsArrayNext(ppd->sorted_attrs))
+  {
+    ppd_index_add(&index->attrs, PPD_INDEX_ATTR,
+                  ppd_index_hash(attr->name, NULL, NULL), attr, i);
+    ppd_index_add(&index->specs, PPD_INDEX_SPEC,
+                  ppd_index_hash(attr->name, attr->spec, NULL), attr, i);
+  }
+
+  ppd->cups_index = index;
+}
+
+
+/*
+ * '_ppdIndexDelete()' - Free the hash index of a PPD file.
+ */
+
+void
+_ppdIndexDelete(ppd_file_t *ppd)	/* I - PPD file */
+{
+  ppd_index_t	*index = ppd->cups_index;/* Index */
+
+
+  if (!index)
+    return;
+
+  free(index->options.entries);
+  free(index->choices.entries);
+  free(index->attrs.entries);
+  free(index->specs.entries);
+  free(index);
+
+  ppd->cups_index = NULL;
+}
+
+
+/*
+ * '_ppdIndexFindAttr()' - Find the first attribute with a name and
+ *                         optionally a spec.
+ *
+ * Returns the position of the attribute in the sorted attributes array,
+ * -1 if there is no such attribute, or -2 if the PPD file has no index.
+ */
+
+int					/* O - Position of attribute */
+_ppdIndexFindAttr(ppd_file_t *ppd,	/* I - PPD file */
+                  const char *name,	/* I - Attribute name */
+		  const char *spec,	/* I - Spec or @code NULL@ for any */
+		  ppd_attr_t **attr)	/* O - Attribute */
+{
+  ppd_index_t		*index = ppd->cups_index;
+					/* Index */
+  ppd_index_table_t	*table;		/* Hash table */
+  ppd_index_entry_t	*entry;		/* Current entry */
+  ppd_attr_t		*a;		/* Current attribute */
+  unsigned		hash,		/* Hash of the key */
+			i;		/* Current slot */
+
+
+  *attr = NULL;
+
+  if (!index)
+    return (-2);
+
+  table = spec ? &index->specs : &index->attrs;
+  hash  = ppd_index_hash(name, spec, NULL);
+
+  for (i = hash & table->mask;
+       (entry = table->entries + i)->ptr;
+       i = (i + 1) & table->mask)
+  {
+    a = (ppd_attr_t *)entry->ptr;
+
+    if (entry->hash == hash && !_ppd_strcasecmp(a->name, name) &&
+        (!spec || !_ppd_strcasecmp(a->spec, spec)))
+    {
+      *attr = a;
+      return (entry->pos);
+    }
+  }
+
+  return (-1);
+}
+
+
+/*
+ * '_ppdIndexFindChoice()' - Find the first choice of an option with a name.
+ *
+ * Unlike ppdFindChoice() the name is used as is.
+ */
+
+ppd_choice_t *				/* O - Choice or @code NULL@ */
+_ppdIndexFindChoice(
+    ppd_file_t   *ppd,			/* I - PPD file */
+    ppd_option_t *option,		/* I - Option */
+    const char   *choice)		/* I - Name of choice */
+{
+  int			i;		/* Looping var */
+  ppd_index_t		*index = ppd->cups_index;
+					/* Index */
+  ppd_index_entry_t	*entry;		/* Current entry */
+  ppd_choice_t		*c;		/* Current choice */
+  unsigned		hash,		/* Hash of the key */
+			slot;		/* Current slot */
+
+
+  if (!index)
+  {
+    for (i = option->num_choices, c = option->choices; i > 0; i --, c ++)
+      if (!_ppd_strcasecmp(c->choice, choice))
+        return (c);
+
+    return (NULL);
+  }
+
+  hash = ppd_index_hash(choice, NULL, option);
+
+  for (slot = hash & index->choices.mask;
+       (entry = index->choices.entries + slot)->ptr;
+       slot = (slot + 1) & index->choices.mask)
+  {
+    c = (ppd_choice_t *)entry->ptr;
+
+    if (entry->hash == hash && c->option == option &&
+        !_ppd_strcasecmp(c->choice, choice))
+      return (c);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * '_ppdIndexFindOption()' - Find an option by its keyword.
+ *
+ * Returns @code NULL@ if there is no such option or the PPD file has no
+ * index.
+ */
+
+ppd_option_t *				/* O - Option or @code NULL@ */
+_ppdIndexFindOption(
+    ppd_file_t *ppd,			/* I - PPD file */
+    const char *keyword)		/* I - Option keyword */
+{
+  ppd_index_t		*index = ppd->cups_index;
+					/* Index */
+  ppd_index_entry_t	*entry;		/* Current entry */
+  unsigned		hash,		/* Hash of the key */
+			i;		/* Current slot */
+
+
+  if (!index)
+    return (NULL);
+
+  hash = ppd_index_hash(keyword, NULL, NULL);
+
+  for (i = hash & index->options.mask;
+       (entry = index->options.entries + i)->ptr;
+       i = (i + 1) & index->options.mask)
+    if (entry->hash == hash &&
+        !_ppd_strcasecmp(((ppd_option_t *)entry->ptr)->keyword, keyword))
+      return ((ppd_option_t *)entry->ptr);
+
+  return (NULL);
+}
+
+
+/*
+ * 'ppd_index_add()' - Add an entry to a hash table unless there already is
+ *                     one with the same key.
+ *
+ * The first option, choice, or attribute with a name wins, just like with a
+ * linear search.
+ */
+
+static void
+ppd_index_add(ppd_index_table_t *table,	/* I - Hash table */
+              int               type,	/* I - Type of entries */
+              unsigned          hash,	/* I - Hash of the key */
+	      void              *ptr,	/* I - Option, choice, or attribute */
+	      int               pos)	/* I - Position of attribute */
+{
+  unsigned		i;		/* Current slot */
+  ppd_index_entry_t	*entry;		/* Current entry */
+  int			same;		/* Same key? */
+
+
+  for (i = hash & table->mask;
+       (entry = table->entries + i)->ptr;
+       i = (i + 1) & table->mask)
+  {
+    if (entry->hash != hash)
+      continue;
+
+    switch (type)
+    {
+      case PPD_INDEX_OPTION :
+          same = !_ppd_strcasecmp(((ppd_option_t *)entry->ptr)->keyword,
+	                          ((ppd_option_t *)ptr)->keyword);
+	  break;
+
+      case PPD_INDEX_CHOICE :
+          same = ((ppd_choice_t *)entry->ptr)->option ==
+	             ((ppd_choice_t *)ptr)->option &&
+		 !_ppd_strcasecmp(((ppd_choice_t *)entry->ptr)->choice,
+	                          ((ppd_choice_t *)ptr)->choice);
+	  break;
+
+      case PPD_INDEX_SPEC :
+          if (_ppd_strcasecmp(((ppd_attr_t *)entry->ptr)->spec,
+	                      ((ppd_attr_t *)ptr)->spec))
+	  {
+	    same = 0;
+	    break;
+	  }
+
+      default :
+          same = !_ppd_strcasecmp(((ppd_attr_t *)entry->ptr)->name,
+	                          ((ppd_attr_t *)ptr)->name);
+	  break;
+    }
+
+    if (same)
+      return;
+  }
+
+  entry->hash = hash;
+  entry->pos  = pos;
+  entry->ptr  = ptr;
+}
+
+
+/*
+ * 'ppd_index_hash()' - Compute the case-insensitive hash of a key.
+ */
+
+static unsigned				/* O - Hash */
+ppd_index_hash(const char *name,	/* I - Name */
+               const char *spec,	/* I - Spec or @code NULL@ */
+	       const void *parent)	/* I - Option of a choice or @code NULL@ */
+{
+  unsigned	hash = 2166136261U;	/* FNV-1a hash */
+
+
+  for (; *name; name ++)
+    hash = (hash ^ (unsigned)_ppd_tolower(*name & 255)) * 16777619U;
+
+  if (spec)
+  {
+    hash = (hash ^ 0xff) * 16777619U;
+
+    for (; *spec; spec ++)
+      hash = (hash ^ (unsigned)_ppd_tolower(*spec & 255)) * 16777619U;
+  }
+
+  if (parent)
+    hash = (hash ^ (unsigned)((uintptr_t)parent >> 4)) * 16777619U;
+
+ /*
+  * Mix the high bits into the low bits that select the slot...
+  */
+
+  return (hash ^ (hash >> 15));
+}
+
+
+/*
+ * 'ppd_index_size()' - Allocate a hash table for a number of keys.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+ppd_index_size(ppd_index_table_t *table,/* I - Hash table */
+               int               count)	/* I - Number of keys */
+{
+  unsigned	size = 16;		/* Number of entries */
+
+
+ /*
+  * Keep the table at most half full...
+  */
+
+  while (size < 2 * (unsigned)count)
+    size *= 2;
+
+  table->mask    = size - 1;
+  table->entries = calloc(size, sizeof(ppd_index_entry_t));
+
+  return (table->entries != NULL);
+}
@@ -15,7 +15,7 @@
  */
 
 #include "string-private.h"
-#include "ppd.h"
+#include "ppd-private.h"
 #include "debug-internal.h"
 
 
@@ -428,7 +428,20 @@ ppdFindOption(ppd_file_t *ppd,		/* I - PPD file data */
   if (!ppd || !option)
     return (NULL);
 
-  if (ppd->options)
+  if (ppd->cups_index)
+  {
+   /*
+    * Look up in the index...
+    */
+
+    char	keyword[PPD_MAX_NAME];	/* Option keyword */
+
+
+    strlcpy(keyword, option, sizeof(keyword));
+
+    return (_ppdIndexFindOption(ppd, keyword));
+  }
+  else if (ppd->options)
   {
    /*
     * Search in the array...
@@ -979,15 +992,8 @@ ppd_mark_option(ppd_file_t *ppd,	/* I - PPD file */
       cupsFreeOptions(num_vals, vals);
     }
   }
-  else
-  {
-    for (i = o->num_choices, c = o->choices; i > 0; i --, c ++)
-      if (!_ppd_strcasecmp(c->choice, choice))
-        break;
-
-    if (!i)
-      return;
-  }
+  else if ((c = _ppdIndexFindChoice(ppd, o, choice)) == NULL)
+    return;
 
  /*
   * Option found; mark it and then handle unmarking any other options.
@@ -0,0 +1,46 @@
+/*
+ * Private PPD definitions for libppd.
+ *
+ * Licensed under Apache License v2.0.  See the file "LICENSE" for more
+ * information.
+ */
+
+#ifndef _PPD_PPD_PRIVATE_H_
+#  define _PPD_PPD_PRIVATE_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include "ppd.h"
+
+
+/*
+ * C++ magic...
+ */
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+
+/*
+ * Prototypes...
+ */
+
+extern void		_ppdIndexCreate(ppd_file_t *ppd);
+extern void		_ppdIndexDelete(ppd_file_t *ppd);
+extern int		_ppdIndexFindAttr(ppd_file_t *ppd, const char *name,
+			                  const char *spec, ppd_attr_t **attr);
+extern ppd_choice_t	*_ppdIndexFindChoice(ppd_file_t *ppd,
+			                     ppd_option_t *option,
+					     const char *choice);
+extern ppd_option_t	*_ppdIndexFindOption(ppd_file_t *ppd,
+			                     const char *keyword);
+extern void		_ppdRasterDeleteCache(ppd_file_t *ppd);
+
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+#endif /* !_PPD_PPD_PRIVATE_H_ */
@@ -17,8 +17,11 @@
 #include "string-private.h"
 #include "language-private.h"
 #include "thread-private.h"
-#include "ppd.h"
+#include "ppd-private.h"
 #include "debug-internal.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 /*
@@ -32,6 +35,14 @@
 
 #define PPD_HASHSIZE	512		/* Size of hash */
 
+#define PPD_IMAGE_MAGIC	"PPDIMG\n"	/* Start of a PPD image file */
+#define PPD_IMAGE_VERSION 2		/* Version of the PPD image format */
+#define PPD_IMAGE_SUFFIX ".image"	/* PPD image next to the PPD file */
+#define PPD_IMAGE_PTR(offset)	((void *)(uintptr_t)(offset))
+					/* Offset stored in a pointer */
+#define PPD_IMAGE_OFFSET(ptr)	((size_t)(uintptr_t)(ptr))
+					/* Offset from a stored pointer */
+
 
 /*
  * Line buffer structure...
@@ -41,8 +52,69 @@ typedef struct _ppd_line_s
 {
   char		*buffer;		/* Pointer to buffer */
   size_t	bufsize;		/* Size of the buffer */
+  char		*block;			/* Block read from the file */
+  size_t	blocklen,		/* Bytes in the block */
+		blockpos;		/* Current position in the block */
 } _ppd_line_t;
 
+#define PPD_BLOCK_SIZE	65536		/* Size of blocks read by ppd_read() */
+
+
+/*
+ * PPD image structures...
+ *
+ * A PPD image is a binary copy of a parsed PPD file which
+ * ppdOpenFileImage() maps into memory and turns into a ppd_file_t
+ * without parsing the PPD file again.  It holds the libppd records
+ * (ppd_file_t, ppd_group_t, ppd_option_t, ...) as they are, only with
+ * each pointer replaced by the offset of the data in the image, so the
+ * image does not depend on the address it gets mapped to:
+ *
+ * - Strings and arrays of records are stored by their offset,
+ * - "attrs" is the offset of an array of ppd_attr_t records,
+ * - "coptions" and "params" are the offset of a ppd_image_array_t,
+ * - the ppd_file_t strings which point into the value of an attribute
+ *   ("modelname", "manufacturer", ...) are stored as the index of the
+ *   attribute + 1.
+ */
+
+typedef struct ppd_image_header_s	/**** PPD image file header ****/
+{
+  char		magic[8];		/* PPD_IMAGE_MAGIC */
+  int		version,		/* PPD_IMAGE_VERSION */
+		conform;		/* Conformance level used for parsing */
+  size_t	layout;			/* Sizes of the records */
+  dev_t		dev;			/* Device of the PPD file */
+  ino_t		ino;			/* Inode of the PPD file */
+  time_t	mtime,			/* Modification time of the PPD file */
+		ctime;			/* Status change time of the PPD file */
+  off_t		size;			/* Size of the PPD file */
+  char		language[16];		/* Language of the localization */
+  size_t	length,			/* Length of the image */
+		ppd;			/* Offset of the ppd_file_t record */
+} ppd_image_header_t;
+
+typedef struct ppd_image_array_s	/**** Array of records in an image ****/
+{
+  size_t	count,			/* Number of records */
+		offset;			/* Offset of the first record */
+} ppd_image_array_t;
+
+typedef struct ppd_image_buffer_s	/**** PPD image being created ****/
+{
+  unsigned char	*data;			/* Image data */
+  size_t	used,			/* Bytes used */
+		size;			/* Bytes allocated */
+  int		error;			/* Out of memory? */
+} ppd_image_buffer_t;
+
+typedef struct ppd_image_s		/**** PPD image being loaded ****/
+{
+  const unsigned char *data;		/* Mapped image */
+  size_t	length;			/* Length of the image */
+  int		error;			/* Bad offset or out of memory? */
+} ppd_image_t;
+
 
 /*
  * Local globals...
@@ -56,6 +128,32 @@ static pthread_once_t	ppd_globals_key_once = PTHREAD_ONCE_INIT;
 #endif /* HAVE_PTHREAD_H */
 
 
+/*
+ * Characters which ppd_read() has to look at one by one: line ends,
+ * control characters (except tab), and the colon and quote which start
+ * and end a quoted value...
+ */
+
+static const char ppd_special_chars[256] =
+{
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
 /*
  * Local functions...
  */
@@ -90,10 +188,52 @@ static void		ppd_globals_free(ppd_globals_t *g);
 static void		ppd_globals_init(void);
 #endif /* HAVE_PTHREAD_H */
 static int		ppd_hash_option(ppd_option_t *option);
+static size_t		ppd_image_add(ppd_image_buffer_t *buf,
+				      const void *data, size_t length);
+static size_t		ppd_image_add_groups(ppd_image_buffer_t *buf,
+					     ppd_group_t *groups,
+					     int num_groups);
+static size_t		ppd_image_add_string(ppd_image_buffer_t *buf,
+					     const char *s);
+static size_t		ppd_image_add_strings(ppd_image_buffer_t *buf,
+					      char **strings,
+					      int num_strings);
+static int		ppd_image_attr_index(ppd_file_t *ppd,
+					     const char *value);
+static int		ppd_image_check_name(ppd_image_t *img,
+					     const char *s, size_t size);
+static const void	*ppd_image_get(ppd_image_t *img, const void *ptr,
+				       size_t count, size_t size);
+static size_t		ppd_image_layout(void);
+static ppd_file_t	*ppd_image_load(const char *imagefile,
+					struct stat *fileinfo,
+					const char *language, int conform);
+static void		ppd_image_load_groups(ppd_image_t *img,
+					      const ppd_group_t *src,
+					      ppd_group_t *groups,
+					      int num_groups, int depth);
+static char		*ppd_image_load_string(ppd_image_t *img,
+					       const void *ptr);
+static char		**ppd_image_load_strings(ppd_image_t *img,
+						 const void *ptr,
+						 int num_strings);
+static int		ppd_image_name(const char *filename,
+				       const char *cachedir,
+				       const char *language,
+				       char *imagefile, size_t imagesize);
+static void		ppd_image_write(ppd_file_t *ppd,
+					const char *imagefile,
+					struct stat *fileinfo,
+					const char *language, int conform);
+static int		ppd_peek_char(cups_file_t *fp, _ppd_line_t *line);
 static int		ppd_read(cups_file_t *fp, _ppd_line_t *line,
 			         char *keyword, char *option, char *text,
 				 char **string, int ignoreblank,
 				 ppd_globals_t *pg);
+static int		ppd_read_block(cups_file_t *fp, _ppd_line_t *line);
+static int		ppd_read_char(cups_file_t *fp, _ppd_line_t *line);
+static void		ppd_read_end(cups_file_t *fp, _ppd_line_t *line);
+static void		ppd_setup_options(ppd_file_t *ppd);
 static int		ppd_update_filters(ppd_file_t *ppd,
 			                   ppd_globals_t *pg);
 
@@ -260,6 +400,12 @@ ppdClose(ppd_file_t *ppd)		/* I - PPD file record */
     cupsArrayDelete(ppd->cups_uiconstraints);
   }
 
+  free(ppd->cups_uiindex);
+
+  _ppdIndexDelete(ppd);
+
+  _ppdRasterDeleteCache(ppd);
+
  /*
   * Free any PPD cache/mapping data...
   */
@@ -410,6 +556,10 @@ ppdLastError(int *line)			/* O - Line number */
 /*
  * 'ppdOpenWithLocalization()' - Read a PPD file into memory.
  *
+ * The file is read in blocks, afterwards its position is put back to the
+ * end of the PPD data which got parsed.  This works on any file which
+ * @code cupsFileSeek@ supports; on a pipe the data read ahead is lost.
+ *
  * @since CUPS 1.2/macOS 10.5@
  */
 
@@ -418,7 +568,7 @@ ppdOpenWithLocalization(
     cups_file_t		*fp,		/* I - File to read from */
     ppd_localization_t	localization)	/* I - Localization to load */
 {
-  int			i, j, k;	/* Looping vars */
+  int			i, j;		/* Looping vars */
   _ppd_line_t		line;		/* Line buffer */
   ppd_file_t		*ppd;		/* PPD file record */
   ppd_group_t		*group,		/* Current group */
@@ -591,8 +741,7 @@ ppdOpenWithLocalization(
   * Grab the first line and make sure it reads '*PPD-Adobe: "major.minor"'...
   */
 
-  line.buffer  = NULL;
-  line.bufsize = 0;
+  memset(&line, 0, sizeof(line));
 
   mask = ppd_read(fp, &line, keyword, name, text, &string, 0, pg);
 
@@ -610,7 +759,7 @@ ppdOpenWithLocalization(
       pg->ppd_status = PPD_MISSING_PPDADOBE4;
 
     free(string);
-    free(line.buffer);
+    ppd_read_end(fp, &line);
 
     return (NULL);
   }
@@ -626,7 +775,7 @@ ppdOpenWithLocalization(
     pg->ppd_status = PPD_ALLOC_ERROR;
 
     free(string);
-    free(line.buffer);
+    ppd_read_end(fp, &line);
 
     return (NULL);
   }
@@ -2025,7 +2174,7 @@ ppdOpenWithLocalization(
     goto error;
   }
 
-  free(line.buffer);
+  ppd_read_end(fp, &line);
 
  /*
   * Reset language preferences...
@@ -2060,40 +2209,11 @@ ppdOpenWithLocalization(
   }
 
  /*
-  * Create the sorted options array and set the option back-pointer for
-  * each choice and custom option...
-  */
-
-  ppd->options = cupsArrayNew2((cups_array_func_t)ppd_compare_options, NULL,
-                               (cups_ahash_func_t)ppd_hash_option,
-			       PPD_HASHSIZE);
-
-  for (i = ppd->num_groups, group = ppd->groups;
-       i > 0;
-       i --, group ++)
-  {
-    for (j = group->num_options, option = group->options;
-         j > 0;
-	 j --, option ++)
-    {
-      ppd_coption_t	*coption;	/* Custom option */
-
-
-      cupsArrayAdd(ppd->options, option);
-
-      for (k = 0; k < option->num_choices; k ++)
-        option->choices[k].option = option;
-
-      if ((coption = ppdFindCustomOption(ppd, option->keyword)) != NULL)
-        coption->option = option;
-    }
-  }
-
- /*
-  * Create an array to track the marked choices...
+  * Create the sorted options array and the array to track the marked
+  * choices...
   */
 
-  ppd->marked = cupsArrayNew((cups_array_func_t)ppd_compare_choices, NULL);
+  ppd_setup_options(ppd);
 
  /*
   * Return the PPD file structure...
@@ -2108,7 +2228,7 @@ ppdOpenWithLocalization(
   error:
 
   free(string);
-  free(line.buffer);
+  ppd_read_end(fp, &line);
 
   ppdClose(ppd);
 
@@ -2153,6 +2273,9 @@ ppdOpen(FILE *fp)			/* I - File to read from */
 /*
  * 'ppdOpen2()' - Read a PPD file into memory.
  *
+ * See @link ppdOpenWithLocalization@ for the position of the file
+ * afterwards.
+ *
  * @since CUPS 1.2/macOS 10.5@
  */
 
@@ -2275,6 +2398,72 @@ ppdOpenFile(const char *filename)	/* I - File to read from */
 }
 
 
+/*
+ * 'ppdOpenFileImage()' - Read a PPD file into memory, using a binary
+ *                        image of the parsed PPD file if available.
+ *
+ * The image gets loaded with mmap() and turned into the PPD file record
+ * without parsing the PPD file.  If there is no image, or it does not
+ * match the modification time and size of the PPD file, or it was made
+ * for another language, the PPD file gets parsed as with ppdOpenFile()
+ * and the image gets (re-)created.  The image is
+ * "<cachedir>/<hash>.ppd.image", or "<filename>.image" if "cachedir" is
+ * @code NULL@.  Failing to create the image is not an error.
+ */
+
+ppd_file_t *				/* O - PPD file record or @code NULL@ if the PPD file could not be opened. */
+ppdOpenFileImage(const char *filename,	/* I - File to read from */
+		 const char *cachedir)	/* I - Directory for the image or @code NULL@ */
+{
+  ppd_file_t		*ppd;		/* PPD file record */
+  struct stat		fileinfo;	/* PPD file information */
+  char			imagefile[1024];/* PPD image file */
+  cups_lang_t		*lang;		/* Language data */
+  const char		*language;	/* Language of the localization */
+  ppd_globals_t	*pg = ppdGlobals();
+					/* Global data */
+
+
+  if (filename == NULL || stat(filename, &fileinfo) ||
+      !S_ISREG(fileinfo.st_mode))
+    return (ppdOpenFile(filename));
+
+  if ((lang = cupsLangDefault()) != NULL)
+    language = lang->language;
+  else
+    language = "C";
+
+  if (!ppd_image_name(filename, cachedir, language, imagefile,
+		      sizeof(imagefile)))
+    return (ppdOpenFile(filename));
+
+ /*
+  * Use the image if it is up to date...
+  */
+
+  if ((ppd = ppd_image_load(imagefile, &fileinfo, language,
+			    (int)pg->ppd_conform)) != NULL)
+  {
+    DEBUG_printf(("1ppdOpenFileImage: Loaded \"%s\".", imagefile));
+
+    pg->ppd_line   = 0;
+    pg->ppd_status = PPD_OK;
+
+    return (ppd);
+  }
+
+ /*
+  * Otherwise parse the PPD file and save the image for the next time...
+  */
+
+  if ((ppd = ppdOpenFile(filename)) != NULL)
+    ppd_image_write(ppd, imagefile, &fileinfo, language,
+		    (int)pg->ppd_conform);
+
+  return (ppd);
+}
+
+
 /*
  * 'ppdSetConformance()' - Set the conformance level for PPD files.
  *
@@ -2859,204 +3048,1472 @@ ppd_hash_option(ppd_option_t *option)	/* I - Option */
 
 
 /*
- * 'ppd_read()' - Read a line from a PPD file, skipping comment lines as
- *                necessary.
+ * 'ppd_image_add()' - Add data to a PPD image, returns its offset.
  */
 
-static int				/* O - Bitmask of fields read */
-ppd_read(cups_file_t    *fp,		/* I - File to read from */
-         _ppd_line_t    *line,		/* I - Line buffer */
-         char           *keyword,	/* O - Keyword from line */
-	 char           *option,	/* O - Option from line */
-         char           *text,		/* O - Human-readable text from line */
-	 char           **string,	/* O - Code/string data */
-         int            ignoreblank,	/* I - Ignore blank lines? */
-	 ppd_globals_t *pg)		/* I - Global data */
+static size_t				/* O - Offset of the data, 0 on error */
+ppd_image_add(ppd_image_buffer_t *buf,	/* I - PPD image */
+	      const void         *data,	/* I - Data or @code NULL@ for zeros */
+	      size_t             length)/* I - Length of data */
 {
-  int		ch,			/* Character from file */
-		col,			/* Column in line */
-		colon,			/* Colon seen? */
-		endquote,		/* Waiting for an end quote */
-		mask,			/* Mask to be returned */
-		startline,		/* Start line */
-		textlen;		/* Length of text */
-  char		*keyptr,		/* Keyword pointer */
-		*optptr,		/* Option pointer */
-		*textptr,		/* Text pointer */
-		*strptr,		/* Pointer into string */
-		*lineptr;		/* Current position in line buffer */
+  size_t	offset;			/* Offset of the data */
+  size_t	size;			/* New size of the buffer */
+  unsigned char	*temp;			/* New buffer */
+
 
+  if (buf->error)
+    return (0);
 
  /*
-  * Now loop until we have a valid line...
+  * Keep all data 8-byte aligned, so that the records in the mapped image
+  * can be read in place...
   */
 
-  *string   = NULL;
-  col       = 0;
-  startline = pg->ppd_line + 1;
+  offset = (buf->used + 7) & ~(size_t)7;
 
-  if (!line->buffer)
+  if (offset + length > buf->size)
   {
-    line->bufsize = 1024;
-    line->buffer  = malloc(1024);
+    for (size = buf->size ? buf->size : 65536; offset + length > size;
+	 size *= 2);
 
-    if (!line->buffer)
+    if ((temp = realloc(buf->data, size)) == NULL)
+    {
+      buf->error = 1;
       return (0);
+    }
+
+    memset(temp + buf->size, 0, size - buf->size);
+    buf->data = temp;
+    buf->size = size;
   }
 
-  do
-  {
-   /*
-    * Read the line...
-    */
+  if (data)
+    memcpy(buf->data + offset, data, length);
 
-    lineptr  = line->buffer;
-    endquote = 0;
-    colon    = 0;
+  buf->used = offset + length;
 
-    while ((ch = cupsFileGetChar(fp)) != EOF)
-    {
-      if (lineptr >= (line->buffer + line->bufsize - 1))
-      {
-       /*
-        * Expand the line buffer...
-	*/
+  return (offset);
+}
 
-        char *temp;			/* Temporary line pointer */
 
+/*
+ * 'ppd_image_add_groups()' - Add an array of groups to a PPD image.
+ */
 
-        line->bufsize += 1024;
-	if (line->bufsize > 262144)
-	{
-	 /*
-	  * Don't allow lines longer than 256k!
-	  */
+static size_t				/* O - Offset of the groups */
+ppd_image_add_groups(
+    ppd_image_buffer_t *buf,		/* I - PPD image */
+    ppd_group_t        *groups,		/* I - Groups */
+    int                num_groups)	/* I - Number of groups */
+{
+  int		i, j, k;		/* Looping vars */
+  size_t	offset,			/* Offset of the groups */
+		options,		/* Offset of the options */
+		choices,		/* Offset of the choices */
+		subgroups,		/* Offset of the sub-groups */
+		code;			/* Offset of choice code */
+  ppd_group_t	*group;			/* Current group */
+  ppd_option_t	*option;		/* Current option */
 
-          pg->ppd_line   = startline;
-          pg->ppd_status = PPD_LINE_TOO_LONG;
 
-	  return (0);
-	}
+  if (num_groups <= 0)
+    return (0);
 
-        temp = realloc(line->buffer, line->bufsize);
-	if (!temp)
-	{
-          pg->ppd_line   = startline;
-          pg->ppd_status = PPD_LINE_TOO_LONG;
+  offset = ppd_image_add(buf, groups, (size_t)num_groups * sizeof(ppd_group_t));
 
-	  return (0);
-	}
+  for (i = 0, group = groups; i < num_groups; i ++, group ++)
+  {
+    options = 0;
 
-        lineptr      = temp + (lineptr - line->buffer);
-	line->buffer = temp;
-      }
+    if (group->num_options > 0)
+    {
+      options = ppd_image_add(buf, group->options,
+			      (size_t)group->num_options *
+			      sizeof(ppd_option_t));
 
-      if (ch == '\r' || ch == '\n')
+      for (j = 0, option = group->options; j < group->num_options;
+	   j ++, option ++)
       {
-       /*
-	* Line feed or carriage return...
-	*/
-
-        pg->ppd_line ++;
-	col = 0;
+        choices = 0;
 
-	if (ch == '\r')
+	if (option->num_choices > 0)
 	{
-	 /*
-          * Check for a trailing line feed...
-	  */
+	  choices = ppd_image_add(buf, option->choices,
+				  (size_t)option->num_choices *
+				  sizeof(ppd_choice_t));
 
-	  if ((ch = cupsFilePeekChar(fp)) == EOF)
+	  for (k = 0; k < option->num_choices; k ++)
 	  {
-	    ch = '\n';
-	    break;
-	  }
+	    code = ppd_image_add_string(buf, option->choices[k].code);
+	    if (buf->error)
+	      return (0);
 
-	  if (ch == 0x0a)
-	    cupsFileGetChar(fp);
+	    ((ppd_choice_t *)(buf->data + choices))[k].code =
+	        PPD_IMAGE_PTR(code);
+	    ((ppd_choice_t *)(buf->data + choices))[k].option = NULL;
+	  }
 	}
 
-	if (lineptr == line->buffer && ignoreblank)
-          continue;			/* Skip blank lines */
-
-	ch = '\n';
-
-	if (!endquote)			/* Continue for multi-line text */
-          break;
+	if (buf->error)
+	  return (0);
 
-	*lineptr++ = '\n';
+	((ppd_option_t *)(buf->data + options))[j].choices =
+	    PPD_IMAGE_PTR(choices);
       }
-      else if (ch < ' ' && ch != '\t' && pg->ppd_conform == PPD_CONFORM_STRICT)
-      {
-       /*
-        * Other control characters...
-	*/
+    }
 
-        pg->ppd_line   = startline;
-        pg->ppd_status = PPD_ILLEGAL_CHARACTER;
+    subgroups = ppd_image_add_groups(buf, group->subgroups,
+				     group->num_subgroups);
+    if (buf->error)
+      return (0);
 
-        return (0);
-      }
-      else if (ch != 0x1a)
-      {
-       /*
-	* Any other character...
-	*/
+    ((ppd_group_t *)(buf->data + offset))[i].options   =
+        PPD_IMAGE_PTR(options);
+    ((ppd_group_t *)(buf->data + offset))[i].subgroups =
+        PPD_IMAGE_PTR(subgroups);
+  }
 
-	*lineptr++ = (char)ch;
-	col ++;
+  return (offset);
+}
 
-	if (col > (PPD_MAX_LINE - 1))
-	{
-	 /*
-          * Line is too long...
-	  */
 
-          pg->ppd_line   = startline;
-          pg->ppd_status = PPD_LINE_TOO_LONG;
+/*
+ * 'ppd_image_add_string()' - Add a string to a PPD image.
+ */
 
-          return (0);
-	}
+static size_t				/* O - Offset of the string, 0 for @code NULL@ */
+ppd_image_add_string(
+    ppd_image_buffer_t *buf,		/* I - PPD image */
+    const char         *s)		/* I - String or @code NULL@ */
+{
+  if (!s)
+    return (0);
 
-	if (ch == ':' && strncmp(line->buffer, "*%", 2) != 0)
-	  colon = 1;
+  return (ppd_image_add(buf, s, strlen(s) + 1));
+}
 
-	if (ch == '\"' && colon)
-	  endquote = !endquote;
-      }
-    }
 
-    if (endquote)
-    {
-     /*
-      * Didn't finish this quoted string...
-      */
+/*
+ * 'ppd_image_add_strings()' - Add an array of strings to a PPD image.
+ */
 
-      while ((ch = cupsFileGetChar(fp)) != EOF)
-        if (ch == '\"')
-	  break;
-	else if (ch == '\r' || ch == '\n')
-	{
-	  pg->ppd_line ++;
-	  col = 0;
+static size_t				/* O - Offset of the string offsets */
+ppd_image_add_strings(
+    ppd_image_buffer_t *buf,		/* I - PPD image */
+    char               **strings,	/* I - Strings */
+    int                num_strings)	/* I - Number of strings */
+{
+  int		i;			/* Looping var */
+  size_t	offset,			/* Offset of the string offsets */
+		string;			/* Offset of current string */
 
-	  if (ch == '\r')
-	  {
-	   /*
-            * Check for a trailing line feed...
-	    */
 
-	    if ((ch = cupsFilePeekChar(fp)) == EOF)
-	      break;
-	    if (ch == 0x0a)
-	      cupsFileGetChar(fp);
-	  }
-	}
-	else if (ch < ' ' && ch != '\t' && pg->ppd_conform == PPD_CONFORM_STRICT)
-	{
-	 /*
-          * Other control characters...
-	  */
+  if (num_strings <= 0)
+    return (0);
+
+  offset = ppd_image_add(buf, NULL, (size_t)num_strings * sizeof(size_t));
+
+  for (i = 0; i < num_strings; i ++)
+  {
+    string = ppd_image_add_string(buf, strings[i]);
+    if (buf->error)
+      return (0);
+
+    ((size_t *)(buf->data + offset))[i] = string;
+  }
+
+  return (offset);
+}
+
+
+/*
+ * 'ppd_image_attr_index()' - Find the attribute which a ppd_file_t string
+ *                            points into.
+ */
+
+static int				/* O - Index + 1, 0 if not found */
+ppd_image_attr_index(ppd_file_t *ppd,	/* I - PPD file */
+		     const char *value)	/* I - String */
+{
+  int		i;			/* Looping var */
+
+
+  for (i = 0; i < ppd->num_attrs; i ++)
+    if (ppd->attrs[i]->value == value)
+      return (i + 1);
+
+  return (0);
+}
+
+
+/*
+ * 'ppd_image_check_name()' - Check that a fixed-size string in a PPD image
+ *                            is nul-terminated.
+ *
+ * Sets the error flag of the image if it is not.
+ */
+
+static int				/* O - 1 if terminated, 0 otherwise */
+ppd_image_check_name(ppd_image_t *img,	/* I - PPD image */
+		     const char  *s,	/* I - String in the image */
+		     size_t      size)	/* I - Size of the string field */
+{
+  if (memchr(s, '\0', size))
+    return (1);
+
+  img->error = 1;
+  return (0);
+}
+
+
+/*
+ * 'ppd_image_get()' - Get a pointer to records in a mapped PPD image.
+ *
+ * Sets the error flag of the image if the records are not completely
+ * inside the image.
+ */
+
+static const void *			/* O - Records or @code NULL@ */
+ppd_image_get(ppd_image_t *img,		/* I - PPD image */
+	      const void  *ptr,		/* I - Stored offset */
+	      size_t      count,	/* I - Number of records */
+	      size_t      size)		/* I - Size of a record */
+{
+  size_t	offset = PPD_IMAGE_OFFSET(ptr);
+					/* Offset of the records */
+
+
+  if (count == 0)
+    return (NULL);
+
+  if (offset == 0 || (offset & 7) || offset >= img->length ||
+      count > (img->length - offset) / size)
+  {
+    img->error = 1;
+    return (NULL);
+  }
+
+  return (img->data + offset);
+}
+
+
+/*
+ * 'ppd_image_layout()' - Get a value for the sizes of the records in a
+ *                        PPD image.
+ */
+
+static size_t				/* O - Layout value */
+ppd_image_layout(void)
+{
+  size_t	i,			/* Looping var */
+		layout;			/* Layout value */
+  static const size_t sizes[] =		/* Sizes of the records */
+  {
+    sizeof(ppd_file_t),
+    sizeof(ppd_group_t),
+    sizeof(ppd_option_t),
+    sizeof(ppd_choice_t),
+    sizeof(ppd_size_t),
+    sizeof(ppd_const_t),
+    sizeof(ppd_emul_t),
+    sizeof(ppd_profile_t),
+    sizeof(ppd_attr_t),
+    sizeof(ppd_coption_t),
+    sizeof(ppd_cparam_t),
+    sizeof(ppd_image_array_t),
+    sizeof(void *)
+  };
+
+
+  for (i = 0, layout = 0; i < sizeof(sizes) / sizeof(sizes[0]); i ++)
+    layout = layout * 31 + sizes[i];
+
+  return (layout);
+}
+
+
+/*
+ * 'ppd_image_load()' - Load a PPD image.
+ */
+
+static ppd_file_t *			/* O - PPD file record or @code NULL@ if the image is not usable */
+ppd_image_load(const char  *imagefile,	/* I - PPD image file */
+	       struct stat *fileinfo,	/* I - PPD file information */
+	       const char  *language,	/* I - Language of the localization */
+	       int         conform)	/* I - Conformance level */
+{
+  int			i, j;		/* Looping vars */
+  int			fd;		/* Image file */
+  struct stat		imageinfo;	/* Image file information */
+  void			*data;		/* Mapped image */
+  ppd_image_t		img;		/* PPD image */
+  const ppd_image_header_t *header;	/* Image header */
+  const ppd_file_t	*src;		/* PPD file record in the image */
+  const ppd_group_t	*groups;	/* Groups in the image */
+  const ppd_attr_t	*attrs;		/* Attributes in the image */
+  const ppd_image_array_t *array;	/* Custom options/parameters */
+  const ppd_coption_t	*coptions;	/* Custom options in the image */
+  const ppd_cparam_t	*cparams;	/* Custom parameters in the image */
+  const void		*records;	/* Other records in the image */
+  ppd_file_t		*ppd;		/* PPD file record */
+  ppd_attr_t		*attr;		/* New attribute */
+  ppd_coption_t		*coption;	/* New custom option */
+  ppd_cparam_t		*cparam;	/* New custom parameter */
+  const char * const	*aliases[8];	/* Strings in the image which point into attributes */
+  char			**targets[8];	/* ... and where they go */
+
+
+ /*
+  * Map the image and check whether it fits to the PPD file...
+  */
+
+  if ((fd = open(imagefile, O_RDONLY)) < 0)
+    return (NULL);
+
+  if (fstat(fd, &imageinfo) ||
+      imageinfo.st_size < (off_t)sizeof(ppd_image_header_t) ||
+      (data = mmap(NULL, (size_t)imageinfo.st_size, PROT_READ, MAP_PRIVATE,
+		   fd, 0)) == MAP_FAILED)
+  {
+    close(fd);
+    return (NULL);
+  }
+
+  close(fd);
+
+  img.data   = data;
+  img.length = (size_t)imageinfo.st_size;
+  img.error  = 0;
+  header     = (const ppd_image_header_t *)data;
+
+  if (memcmp(header->magic, PPD_IMAGE_MAGIC, sizeof(header->magic)) ||
+      header->version != PPD_IMAGE_VERSION ||
+      header->layout != ppd_image_layout() ||
+      header->conform != conform ||
+      header->dev != fileinfo->st_dev ||
+      header->ino != fileinfo->st_ino ||
+      header->mtime != fileinfo->st_mtime ||
+      header->ctime != fileinfo->st_ctime ||
+      header->size != fileinfo->st_size ||
+      header->length != img.length ||
+      !memchr(header->language, '\0', sizeof(header->language)) ||
+      strncmp(header->language, language, sizeof(header->language)) ||
+      (src = ppd_image_get(&img, PPD_IMAGE_PTR(header->ppd), 1,
+			   sizeof(ppd_file_t))) == NULL)
+  {
+    DEBUG_printf(("2ppd_image_load: \"%s\" is out of date.", imagefile));
+    munmap(data, img.length);
+    return (NULL);
+  }
+
+  if ((ppd = calloc(1, sizeof(ppd_file_t))) == NULL)
+  {
+    munmap(data, img.length);
+    return (NULL);
+  }
+
+ /*
+  * Copy the values and strings...
+  */
+
+  ppd->language_level   = src->language_level;
+  ppd->color_device     = src->color_device;
+  ppd->variable_sizes   = src->variable_sizes;
+  ppd->accurate_screens = src->accurate_screens;
+  ppd->contone_only     = src->contone_only;
+  ppd->landscape        = src->landscape;
+  ppd->model_number     = src->model_number;
+  ppd->manual_copies    = src->manual_copies;
+  ppd->throughput       = src->throughput;
+  ppd->colorspace       = src->colorspace;
+  ppd->flip_duplex      = src->flip_duplex;
+  ppd->cur_attr         = src->cur_attr;
+  memcpy(ppd->custom_min, src->custom_min, sizeof(ppd->custom_min));
+  memcpy(ppd->custom_max, src->custom_max, sizeof(ppd->custom_max));
+  memcpy(ppd->custom_margins, src->custom_margins,
+	 sizeof(ppd->custom_margins));
+
+  ppd->patches       = ppd_image_load_string(&img, src->patches);
+  ppd->jcl_begin     = ppd_image_load_string(&img, src->jcl_begin);
+  ppd->jcl_ps        = ppd_image_load_string(&img, src->jcl_ps);
+#if HAVE_CUPS_3_X
+  ppd->jcl_pdf       = ppd_image_load_string(&img, src->jcl_pdf);
+#endif
+  ppd->jcl_end       = ppd_image_load_string(&img, src->jcl_end);
+  ppd->lang_encoding = ppd_image_load_string(&img, src->lang_encoding);
+  ppd->nickname      = ppd_image_load_string(&img, src->nickname);
+
+  if ((records = ppd_image_get(&img, src->emulations,
+			       (size_t)src->num_emulations,
+			       sizeof(ppd_emul_t))) != NULL)
+  {
+    if ((ppd->emulations = calloc((size_t)src->num_emulations,
+				  sizeof(ppd_emul_t))) == NULL)
+      img.error = 1;
+    else
+    {
+      for (i = 0; i < src->num_emulations; i ++)
+        if (ppd_image_check_name(&img, ((const ppd_emul_t *)records)[i].name,
+				 sizeof(ppd->emulations[i].name)))
+	  strlcpy(ppd->emulations[i].name,
+		  ((const ppd_emul_t *)records)[i].name,
+		  sizeof(ppd->emulations[i].name));
+      ppd->num_emulations = src->num_emulations;
+    }
+  }
+
+ /*
+  * Groups, options, and choices...
+  */
+
+  if ((groups = ppd_image_get(&img, src->groups, (size_t)src->num_groups,
+			      sizeof(ppd_group_t))) != NULL)
+  {
+    if ((ppd->groups = calloc((size_t)src->num_groups,
+			      sizeof(ppd_group_t))) == NULL)
+      img.error = 1;
+    else
+    {
+      ppd->num_groups = src->num_groups;
+      ppd_image_load_groups(&img, groups, ppd->groups, ppd->num_groups, 0);
+    }
+  }
+
+ /*
+  * Page sizes, constraints, and color profiles are copied as they are...
+  */
+
+  if ((records = ppd_image_get(&img, src->sizes, (size_t)src->num_sizes,
+			       sizeof(ppd_size_t))) != NULL)
+  {
+    if ((ppd->sizes = malloc((size_t)src->num_sizes *
+			     sizeof(ppd_size_t))) == NULL)
+      img.error = 1;
+    else
+    {
+      memcpy(ppd->sizes, records, (size_t)src->num_sizes * sizeof(ppd_size_t));
+      ppd->num_sizes = src->num_sizes;
+
+      for (i = 0; i < ppd->num_sizes; i ++)
+      {
+        ppd->sizes[i].marked = 0;
+	ppd_image_check_name(&img, ppd->sizes[i].name,
+			     sizeof(ppd->sizes[i].name));
+      }
+    }
+  }
+
+  if ((records = ppd_image_get(&img, src->consts, (size_t)src->num_consts,
+			       sizeof(ppd_const_t))) != NULL)
+  {
+    if ((ppd->consts = malloc((size_t)src->num_consts *
+			      sizeof(ppd_const_t))) == NULL)
+      img.error = 1;
+    else
+    {
+      memcpy(ppd->consts, records,
+	     (size_t)src->num_consts * sizeof(ppd_const_t));
+      ppd->num_consts = src->num_consts;
+
+      for (i = 0; i < ppd->num_consts; i ++)
+      {
+        ppd_const_t *c = ppd->consts + i;
+					/* Current constraint */
+
+	ppd_image_check_name(&img, c->option1, sizeof(c->option1));
+	ppd_image_check_name(&img, c->choice1, sizeof(c->choice1));
+	ppd_image_check_name(&img, c->option2, sizeof(c->option2));
+	ppd_image_check_name(&img, c->choice2, sizeof(c->choice2));
+      }
+    }
+  }
+
+  if ((records = ppd_image_get(&img, src->profiles,
+			       (size_t)src->num_profiles,
+			       sizeof(ppd_profile_t))) != NULL)
+  {
+    if ((ppd->profiles = malloc((size_t)src->num_profiles *
+				sizeof(ppd_profile_t))) == NULL)
+      img.error = 1;
+    else
+    {
+      memcpy(ppd->profiles, records,
+	     (size_t)src->num_profiles * sizeof(ppd_profile_t));
+      ppd->num_profiles = src->num_profiles;
+
+      for (i = 0; i < ppd->num_profiles; i ++)
+      {
+        ppd_image_check_name(&img, ppd->profiles[i].resolution,
+			     sizeof(ppd->profiles[i].resolution));
+        ppd_image_check_name(&img, ppd->profiles[i].media_type,
+			     sizeof(ppd->profiles[i].media_type));
+      }
+    }
+  }
+
+  if ((ppd->fonts = ppd_image_load_strings(&img, src->fonts,
+					   src->num_fonts)) != NULL)
+    ppd->num_fonts = src->num_fonts;
+
+  if ((ppd->filters = ppd_image_load_strings(&img, src->filters,
+					     src->num_filters)) != NULL)
+    ppd->num_filters = src->num_filters;
+
+ /*
+  * Attributes, in the original order, and the strings which point into
+  * their values...
+  */
+
+  if ((attrs = ppd_image_get(&img, src->attrs, (size_t)src->num_attrs,
+			     sizeof(ppd_attr_t))) != NULL)
+  {
+    if ((ppd->attrs = calloc((size_t)src->num_attrs,
+			     sizeof(ppd_attr_t *))) == NULL)
+      img.error = 1;
+    else
+    {
+      ppd->sorted_attrs = cupsArrayNew((cups_array_func_t)ppd_compare_attrs,
+				       NULL);
+
+      for (i = 0; i < src->num_attrs && !img.error; i ++, attrs ++)
+      {
+        if ((attr = malloc(sizeof(ppd_attr_t))) == NULL)
+	{
+	  img.error = 1;
+	  break;
+	}
+
+        memcpy(attr, attrs, sizeof(ppd_attr_t));
+	attr->value = ppd_image_load_string(&img, attrs->value);
+
+	ppd->attrs[i]  = attr;
+	ppd->num_attrs = i + 1;
+
+	if (!ppd_image_check_name(&img, attr->name, sizeof(attr->name)) ||
+	    !ppd_image_check_name(&img, attr->spec, sizeof(attr->spec)) ||
+	    !ppd_image_check_name(&img, attr->text, sizeof(attr->text)))
+	  break;
+
+	cupsArrayAdd(ppd->sorted_attrs, attr);
+      }
+
+      if (ppd->num_attrs == 0)
+      {
+        free(ppd->attrs);
+	ppd->attrs = NULL;
+      }
+    }
+  }
+
+  aliases[0] = (const char * const *)&src->lang_version;
+  targets[0] = &ppd->lang_version;
+  aliases[1] = (const char * const *)&src->modelname;
+  targets[1] = &ppd->modelname;
+  aliases[2] = (const char * const *)&src->ttrasterizer;
+  targets[2] = &ppd->ttrasterizer;
+  aliases[3] = (const char * const *)&src->manufacturer;
+  targets[3] = &ppd->manufacturer;
+  aliases[4] = (const char * const *)&src->product;
+  targets[4] = &ppd->product;
+  aliases[5] = (const char * const *)&src->shortnickname;
+  targets[5] = &ppd->shortnickname;
+  aliases[6] = (const char * const *)&src->protocols;
+  targets[6] = &ppd->protocols;
+  aliases[7] = (const char * const *)&src->pcfilename;
+  targets[7] = &ppd->pcfilename;
+
+  for (i = 0; i < 8; i ++)
+  {
+    size_t index = PPD_IMAGE_OFFSET(*aliases[i]);
+					/* Index of the attribute + 1 */
+
+    if (index > (size_t)ppd->num_attrs)
+      img.error = 1;
+    else if (index > 0)
+      *targets[i] = ppd->attrs[index - 1]->value;
+  }
+
+ /*
+  * Custom options and their parameters...
+  */
+
+  ppd->coptions = cupsArrayNew((cups_array_func_t)ppd_compare_coptions, NULL);
+
+  if ((array = ppd_image_get(&img, src->coptions, 1,
+			     sizeof(ppd_image_array_t))) != NULL &&
+      (coptions = ppd_image_get(&img, PPD_IMAGE_PTR(array->offset),
+				array->count, sizeof(ppd_coption_t))) != NULL)
+  {
+    for (i = 0; i < (int)array->count && !img.error; i ++, coptions ++)
+    {
+      const ppd_image_array_t *params;	/* Custom parameters */
+
+
+      if ((coption = calloc(1, sizeof(ppd_coption_t))) == NULL)
+      {
+        img.error = 1;
+	break;
+      }
+
+      if (!ppd_image_check_name(&img, coptions->keyword,
+				sizeof(coptions->keyword)))
+      {
+        free(coption);
+	break;
+      }
+
+      strlcpy(coption->keyword, coptions->keyword, sizeof(coption->keyword));
+      coption->params = cupsArrayNew((cups_array_func_t)NULL, NULL);
+      cupsArrayAdd(ppd->coptions, coption);
+
+      if ((params = ppd_image_get(&img, coptions->params, 1,
+				  sizeof(ppd_image_array_t))) == NULL ||
+	  (cparams = ppd_image_get(&img, PPD_IMAGE_PTR(params->offset),
+				   params->count,
+				   sizeof(ppd_cparam_t))) == NULL)
+	continue;
+
+      for (j = 0; j < (int)params->count && !img.error; j ++, cparams ++)
+      {
+        if ((cparam = malloc(sizeof(ppd_cparam_t))) == NULL)
+	{
+	  img.error = 1;
+	  break;
+	}
+
+	memcpy(cparam, cparams, sizeof(ppd_cparam_t));
+
+	if (!ppd_image_check_name(&img, cparam->name, sizeof(cparam->name)) ||
+	    !ppd_image_check_name(&img, cparam->text, sizeof(cparam->text)))
+	{
+	  free(cparam);
+	  break;
+	}
+
+	switch (cparam->type)
+	{
+	  case PPD_CUSTOM_PASSCODE :
+	  case PPD_CUSTOM_PASSWORD :
+	  case PPD_CUSTOM_STRING :
+	      cparam->current.custom_string =
+	          ppd_image_load_string(&img, cparams->current.custom_string);
+	      break;
+
+	  default :
+	      break;
+	}
+
+	cupsArrayAdd(coption->params, cparam);
+      }
+    }
+  }
+
+  munmap(data, img.length);
+
+  if (img.error)
+  {
+    DEBUG_printf(("2ppd_image_load: \"%s\" is damaged.", imagefile));
+    ppdClose(ppd);
+    return (NULL);
+  }
+
+ /*
+  * Create the lookup arrays as ppdOpen() does...
+  */
+
+  ppd_setup_options(ppd);
+
+  return (ppd);
+}
+
+
+/*
+ * 'ppd_image_load_groups()' - Load an array of groups from a PPD image.
+ *
+ * The groups array is allocated and zeroed by the caller, on error the
+ * image's error flag gets set, what is loaded can be freed by ppdClose().
+ */
+
+static void
+ppd_image_load_groups(
+    ppd_image_t       *img,		/* I - PPD image */
+    const ppd_group_t *src,		/* I - Groups in the image */
+    ppd_group_t       *groups,		/* I - Groups to fill */
+    int               num_groups,	/* I - Number of groups */
+    int               depth)		/* I - 0 for groups, 1 for sub-groups */
+{
+  int			i, j, k;	/* Looping vars */
+  ppd_group_t		*group;		/* Current group */
+  ppd_option_t		*option;	/* Current option */
+  ppd_choice_t		*choice;	/* Current choice */
+  const ppd_option_t	*options;	/* Options in the image */
+  const ppd_choice_t	*choices;	/* Choices in the image */
+  const ppd_group_t	*subgroups;	/* Sub-groups in the image */
+
+
+  for (i = 0, group = groups; i < num_groups && !img->error;
+       i ++, group ++, src ++)
+  {
+    if (!ppd_image_check_name(img, src->text, sizeof(src->text)) ||
+	!ppd_image_check_name(img, src->name, sizeof(src->name)))
+      return;
+
+    strlcpy(group->text, src->text, sizeof(group->text));
+    strlcpy(group->name, src->name, sizeof(group->name));
+
+    if ((options = ppd_image_get(img, src->options, (size_t)src->num_options,
+				 sizeof(ppd_option_t))) != NULL)
+    {
+      if ((group->options = calloc((size_t)src->num_options,
+				   sizeof(ppd_option_t))) == NULL)
+      {
+        img->error = 1;
+	return;
+      }
+
+      group->num_options = src->num_options;
+
+      for (j = 0, option = group->options; j < group->num_options;
+	   j ++, option ++, options ++)
+      {
+        memcpy(option, options, sizeof(ppd_option_t));
+	option->conflicted  = 0;
+	option->num_choices = 0;
+	option->choices     = NULL;
+
+	if (!ppd_image_check_name(img, option->keyword,
+				  sizeof(option->keyword)) ||
+	    !ppd_image_check_name(img, option->defchoice,
+				  sizeof(option->defchoice)) ||
+	    !ppd_image_check_name(img, option->text, sizeof(option->text)))
+	  return;
+
+	if ((choices = ppd_image_get(img, options->choices,
+				     (size_t)options->num_choices,
+				     sizeof(ppd_choice_t))) == NULL)
+	  continue;
+
+	if ((option->choices = calloc((size_t)options->num_choices,
+				      sizeof(ppd_choice_t))) == NULL)
+	{
+	  img->error = 1;
+	  return;
+	}
+
+	option->num_choices = options->num_choices;
+
+	for (k = 0, choice = option->choices; k < option->num_choices;
+	     k ++, choice ++, choices ++)
+	{
+	  if (!ppd_image_check_name(img, choices->choice,
+				    sizeof(choices->choice)) ||
+	      !ppd_image_check_name(img, choices->text,
+				    sizeof(choices->text)))
+	    return;
+
+	  strlcpy(choice->choice, choices->choice, sizeof(choice->choice));
+	  strlcpy(choice->text, choices->text, sizeof(choice->text));
+	  choice->code = ppd_image_load_string(img, choices->code);
+	}
+      }
+    }
+
+   /*
+    * Sub-groups do not have sub-groups themselves...
+    */
+
+    if (depth == 0 &&
+	(subgroups = ppd_image_get(img, src->subgroups,
+				   (size_t)src->num_subgroups,
+				   sizeof(ppd_group_t))) != NULL)
+    {
+      if ((group->subgroups = calloc((size_t)src->num_subgroups,
+				     sizeof(ppd_group_t))) == NULL)
+      {
+        img->error = 1;
+	return;
+      }
+
+      group->num_subgroups = src->num_subgroups;
+
+      ppd_image_load_groups(img, subgroups, group->subgroups,
+			    group->num_subgroups, 1);
+    }
+  }
+}
+
+
+/*
+ * 'ppd_image_load_string()' - Copy a string from a PPD image.
+ */
+
+static char *				/* O - String or @code NULL@ */
+ppd_image_load_string(ppd_image_t *img,	/* I - PPD image */
+		      const void  *ptr)	/* I - Stored offset */
+{
+  size_t	offset = PPD_IMAGE_OFFSET(ptr);
+					/* Offset of the string */
+  char		*s;			/* Copy of the string */
+
+
+  if (offset == 0)
+    return (NULL);
+
+  if (offset >= img->length ||
+      !memchr(img->data + offset, '\0', img->length - offset))
+  {
+    img->error = 1;
+    return (NULL);
+  }
+
+  if ((s = strdup((const char *)img->data + offset)) == NULL)
+    img->error = 1;
+
+  return (s);
+}
+
+
+/*
+ * 'ppd_image_load_strings()' - Copy an array of strings from a PPD image.
+ */
+
+static char **				/* O - Strings or @code NULL@ */
+ppd_image_load_strings(
+    ppd_image_t *img,			/* I - PPD image */
+    const void  *ptr,			/* I - Stored offset */
+    int         num_strings)		/* I - Number of strings */
+{
+  int		i;			/* Looping var */
+  const size_t	*offsets;		/* Offsets of the strings */
+  char		**strings;		/* Copies of the strings */
+
+
+  if ((offsets = ppd_image_get(img, ptr, (size_t)num_strings,
+			       sizeof(size_t))) == NULL)
+    return (NULL);
+
+  if ((strings = calloc((size_t)num_strings, sizeof(char *))) == NULL)
+  {
+    img->error = 1;
+    return (NULL);
+  }
+
+  for (i = 0; i < num_strings; i ++)
+    strings[i] = ppd_image_load_string(img, PPD_IMAGE_PTR(offsets[i]));
+
+  return (strings);
+}
+
+
+/*
+ * 'ppd_image_name()' - Get the file name of the PPD image for a PPD file.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+ppd_image_name(const char *filename,	/* I - PPD file */
+	       const char *cachedir,	/* I - Directory for images or @code NULL@ */
+	       const char *language,	/* I - Language of the localization */
+	       char       *imagefile,	/* O - PPD image file */
+	       size_t     imagesize)	/* I - Size of file name buffer */
+{
+  char		*path,			/* Absolute path of the PPD file */
+		key[2048],		/* Key for the image name */
+		hash_string[65];	/* Hex string of the hash */
+  unsigned char	hash[32];		/* SHA-256 hash of the key */
+  ssize_t	hashlen;		/* Length of hash */
+
+
+  if (!cachedir || !*cachedir)
+    return (snprintf(imagefile, imagesize, "%s%s", filename,
+		     PPD_IMAGE_SUFFIX) < (int)imagesize);
+
+ /*
+  * In a cache directory the images of all PPD files are side by side,
+  * name them by a hash of the PPD file's path and the language...
+  */
+
+  path = realpath(filename, NULL);
+  snprintf(key, sizeof(key), "%s\n%s", path ? path : filename, language);
+  free(path);
+
+  if ((hashlen = cupsHashData("sha2-256", key, strlen(key), hash,
+			      sizeof(hash))) < 0)
+    return (0);
+
+  cupsHashString(hash, (size_t)hashlen, hash_string, sizeof(hash_string));
+
+  return (snprintf(imagefile, imagesize, "%s/%.32s.ppd%s", cachedir,
+		   hash_string, PPD_IMAGE_SUFFIX) < (int)imagesize);
+}
+
+
+/*
+ * 'ppd_image_write()' - Write the PPD image of a PPD file.
+ *
+ * The image gets written to a temporary file and renamed, so that other
+ * processes never see an incomplete image.
+ */
+
+static void
+ppd_image_write(ppd_file_t  *ppd,	/* I - PPD file */
+		const char  *imagefile,	/* I - PPD image file */
+		struct stat *fileinfo,	/* I - PPD file information */
+		const char  *language,	/* I - Language of the localization */
+		int         conform)	/* I - Conformance level */
+{
+  int			i, j;		/* Looping vars */
+  ppd_image_buffer_t	buf;		/* Image being created */
+  ppd_image_header_t	header;		/* Image header */
+  ppd_file_t		record;		/* PPD file record for the image */
+  ppd_image_array_t	coptions,	/* Custom options */
+			params;		/* Custom parameters */
+  ppd_coption_t		*coption;	/* Current custom option */
+  ppd_cparam_t		*cparam;	/* Current custom parameter */
+  size_t		offset,		/* Offset of current data */
+			string;		/* Offset of current string */
+  int			fd;		/* Temporary file */
+  ssize_t		bytes;		/* Bytes written */
+  char			tempfile[1024];	/* Temporary file name */
+  char			*const *aliases[8];
+					/* Strings which point into attributes */
+  char			**targets[8];	/* ... and where they go */
+
+
+  memset(&buf, 0, sizeof(buf));
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PPD_IMAGE_MAGIC, sizeof(header.magic));
+  header.version = PPD_IMAGE_VERSION;
+  header.conform = conform;
+  header.layout  = ppd_image_layout();
+  header.dev     = fileinfo->st_dev;
+  header.ino     = fileinfo->st_ino;
+  header.mtime   = fileinfo->st_mtime;
+  header.ctime   = fileinfo->st_ctime;
+  header.size    = fileinfo->st_size;
+  strlcpy(header.language, language, sizeof(header.language));
+
+  ppd_image_add(&buf, &header, sizeof(header));
+
+ /*
+  * Copy the PPD file record and replace all pointers...
+  */
+
+  record = *ppd;
+
+  record.patches       = PPD_IMAGE_PTR(ppd_image_add_string(&buf, ppd->patches));
+  record.jcl_begin     = PPD_IMAGE_PTR(ppd_image_add_string(&buf, ppd->jcl_begin));
+  record.jcl_ps        = PPD_IMAGE_PTR(ppd_image_add_string(&buf, ppd->jcl_ps));
+#if HAVE_CUPS_3_X
+  record.jcl_pdf       = PPD_IMAGE_PTR(ppd_image_add_string(&buf, ppd->jcl_pdf));
+#endif
+  record.jcl_end       = PPD_IMAGE_PTR(ppd_image_add_string(&buf, ppd->jcl_end));
+  record.lang_encoding = PPD_IMAGE_PTR(ppd_image_add_string(&buf, ppd->lang_encoding));
+  record.nickname      = PPD_IMAGE_PTR(ppd_image_add_string(&buf, ppd->nickname));
+
+  record.emulations = NULL;
+  if (ppd->num_emulations > 0)
+    record.emulations =
+        PPD_IMAGE_PTR(ppd_image_add(&buf, ppd->emulations,
+				    (size_t)ppd->num_emulations *
+				    sizeof(ppd_emul_t)));
+
+  record.groups = PPD_IMAGE_PTR(ppd_image_add_groups(&buf, ppd->groups,
+						     ppd->num_groups));
+
+  record.sizes = NULL;
+  if (ppd->num_sizes > 0)
+    record.sizes = PPD_IMAGE_PTR(ppd_image_add(&buf, ppd->sizes,
+					       (size_t)ppd->num_sizes *
+					       sizeof(ppd_size_t)));
+
+  record.consts = NULL;
+  if (ppd->num_consts > 0)
+    record.consts = PPD_IMAGE_PTR(ppd_image_add(&buf, ppd->consts,
+						(size_t)ppd->num_consts *
+						sizeof(ppd_const_t)));
+
+  record.profiles = NULL;
+  if (ppd->num_profiles > 0)
+    record.profiles = PPD_IMAGE_PTR(ppd_image_add(&buf, ppd->profiles,
+						  (size_t)ppd->num_profiles *
+						  sizeof(ppd_profile_t)));
+
+  record.fonts   = PPD_IMAGE_PTR(ppd_image_add_strings(&buf, ppd->fonts,
+						       ppd->num_fonts));
+  record.filters = PPD_IMAGE_PTR(ppd_image_add_strings(&buf, ppd->filters,
+						       ppd->num_filters));
+
+ /*
+  * Attributes...
+  */
+
+  record.attrs = NULL;
+  if (ppd->num_attrs > 0)
+  {
+    offset = ppd_image_add(&buf, NULL,
+			   (size_t)ppd->num_attrs * sizeof(ppd_attr_t));
+
+    for (i = 0; i < ppd->num_attrs && !buf.error; i ++)
+    {
+      string = ppd_image_add_string(&buf, ppd->attrs[i]->value);
+      if (buf.error)
+        break;
+
+      memcpy(buf.data + offset + (size_t)i * sizeof(ppd_attr_t),
+	     ppd->attrs[i], sizeof(ppd_attr_t));
+      ((ppd_attr_t *)(buf.data + offset))[i].value = PPD_IMAGE_PTR(string);
+    }
+
+    record.attrs = PPD_IMAGE_PTR(offset);
+  }
+
+  aliases[0] = &ppd->lang_version;
+  targets[0] = &record.lang_version;
+  aliases[1] = &ppd->modelname;
+  targets[1] = &record.modelname;
+  aliases[2] = &ppd->ttrasterizer;
+  targets[2] = &record.ttrasterizer;
+  aliases[3] = &ppd->manufacturer;
+  targets[3] = &record.manufacturer;
+  aliases[4] = &ppd->product;
+  targets[4] = &record.product;
+  aliases[5] = &ppd->shortnickname;
+  targets[5] = &record.shortnickname;
+  aliases[6] = &ppd->protocols;
+  targets[6] = &record.protocols;
+  aliases[7] = &ppd->pcfilename;
+  targets[7] = &record.pcfilename;
+
+  for (i = 0; i < 8; i ++)
+  {
+    if (!*aliases[i])
+      *targets[i] = NULL;
+    else if ((j = ppd_image_attr_index(ppd, *aliases[i])) > 0)
+      *targets[i] = PPD_IMAGE_PTR(j);
+    else
+    {
+     /*
+      * Not pointing into an attribute, we cannot reproduce this...
+      */
+
+      DEBUG_puts("2ppd_image_write: String outside of the attributes.");
+      buf.error = 1;
+    }
+  }
+
+ /*
+  * Custom options and their parameters...
+  */
+
+  coptions.count  = (size_t)cupsArrayCount(ppd->coptions);
+  coptions.offset = ppd_image_add(&buf, NULL,
+				  coptions.count * sizeof(ppd_coption_t));
+
+  for (i = 0, coption = (ppd_coption_t *)cupsArrayFirst(ppd->coptions);
+       coption && !buf.error;
+       i ++, coption = (ppd_coption_t *)cupsArrayNext(ppd->coptions))
+  {
+    params.count  = (size_t)cupsArrayCount(coption->params);
+    params.offset = ppd_image_add(&buf, NULL,
+				  params.count * sizeof(ppd_cparam_t));
+
+    for (j = 0, cparam = (ppd_cparam_t *)cupsArrayFirst(coption->params);
+         cparam && !buf.error;
+	 j ++, cparam = (ppd_cparam_t *)cupsArrayNext(coption->params))
+    {
+      switch (cparam->type)
+      {
+        case PPD_CUSTOM_PASSCODE :
+        case PPD_CUSTOM_PASSWORD :
+        case PPD_CUSTOM_STRING :
+	    string = ppd_image_add_string(&buf, cparam->current.custom_string);
+	    break;
+
+	default :
+	    string = 0;
+	    break;
+      }
+
+      if (buf.error)
+        break;
+
+      memcpy(buf.data + params.offset + (size_t)j * sizeof(ppd_cparam_t),
+	     cparam, sizeof(ppd_cparam_t));
+      if (string)
+        ((ppd_cparam_t *)(buf.data + params.offset))[j].current.custom_string =
+	    PPD_IMAGE_PTR(string);
+    }
+
+    offset = ppd_image_add(&buf, &params, sizeof(params));
+    if (buf.error)
+      break;
+
+    memcpy(buf.data + coptions.offset + (size_t)i * sizeof(ppd_coption_t),
+	   coption, sizeof(ppd_coption_t));
+    ((ppd_coption_t *)(buf.data + coptions.offset))[i].option = NULL;
+    ((ppd_coption_t *)(buf.data + coptions.offset))[i].params =
+        PPD_IMAGE_PTR(offset);
+  }
+
+  record.coptions = PPD_IMAGE_PTR(ppd_image_add(&buf, &coptions,
+						sizeof(coptions)));
+
+ /*
+  * The lookup arrays get re-created when loading...
+  */
+
+  record.sorted_attrs       = NULL;
+  record.options            = NULL;
+  record.marked             = NULL;
+  record.cups_uiconstraints = NULL;
+  record.cache              = NULL;
+  record.cups_uiindex       = NULL;
+  record.cups_index         = NULL;
+  record.cups_raster_cache  = NULL;
+
+  header.ppd = ppd_image_add(&buf, &record, sizeof(record));
+
+  if (buf.error)
+  {
+    DEBUG_printf(("2ppd_image_write: Unable to create image for \"%s\".",
+		  imagefile));
+    free(buf.data);
+    return;
+  }
+
+  header.length = buf.used;
+  memcpy(buf.data, &header, sizeof(header));
+
+ /*
+  * Write the image...
+  */
+
+  snprintf(tempfile, sizeof(tempfile), "%s.XXXXXX", imagefile);
+
+  if ((fd = mkstemp(tempfile)) < 0)
+  {
+    DEBUG_printf(("2ppd_image_write: Unable to create \"%s\": %s",
+		  tempfile, strerror(errno)));
+    free(buf.data);
+    return;
+  }
+
+  fchmod(fd, 0644);
+
+  for (offset = 0; offset < buf.used; offset += (size_t)bytes)
+    if ((bytes = write(fd, buf.data + offset, buf.used - offset)) <= 0)
+      break;
+
+  if (close(fd) || offset < buf.used || rename(tempfile, imagefile))
+  {
+    DEBUG_printf(("2ppd_image_write: Unable to write \"%s\": %s",
+		  imagefile, strerror(errno)));
+    unlink(tempfile);
+  }
+
+  free(buf.data);
+}
+
+
+/*
+ * 'ppd_peek_char()' - Return the next character of a PPD file without
+ *                     consuming it.
+ */
+
+static int				/* O - Character or EOF */
+ppd_peek_char(cups_file_t *fp,		/* I - File to read from */
+	      _ppd_line_t *line)	/* I - Line buffer */
+{
+  if (line->blockpos >= line->blocklen && !ppd_read_block(fp, line))
+    return (EOF);
+
+  return ((unsigned char)line->block[line->blockpos]);
+}
+
+
+/*
+ * 'ppd_read()' - Read a line from a PPD file, skipping comment lines as
+ *                necessary.
+ */
+
+static int				/* O - Bitmask of fields read */
+ppd_read(cups_file_t    *fp,		/* I - File to read from */
+         _ppd_line_t    *line,		/* I - Line buffer */
+         char           *keyword,	/* O - Keyword from line */
+	 char           *option,	/* O - Option from line */
+         char           *text,		/* O - Human-readable text from line */
+	 char           **string,	/* O - Code/string data */
+         int            ignoreblank,	/* I - Ignore blank lines? */
+	 ppd_globals_t *pg)		/* I - Global data */
+{
+  int		ch,			/* Character from file */
+		col,			/* Column in line */
+		colon,			/* Colon seen? */
+		endquote,		/* Waiting for an end quote */
+		mask,			/* Mask to be returned */
+		startline,		/* Start line */
+		textlen;		/* Length of text */
+  char		*keyptr,		/* Keyword pointer */
+		*optptr,		/* Option pointer */
+		*textptr,		/* Text pointer */
+		*strptr,		/* Pointer into string */
+		*lineptr,		/* Current position in line buffer */
+		*blockptr,		/* Current position in block */
+		*blockend,		/* End of block */
+		*runptr;		/* End of run of ordinary characters */
+  size_t	runlen;			/* Length of run */
+
+
+ /*
+  * Now loop until we have a valid line...
+  */
+
+  *string   = NULL;
+  col       = 0;
+  startline = pg->ppd_line + 1;
+
+  if (!line->buffer)
+  {
+    line->bufsize = 1024;
+    line->buffer  = malloc(1024);
+
+    if (!line->buffer)
+      return (0);
+  }
+
+  do
+  {
+   /*
+    * Read the line...
+    */
+
+    lineptr  = line->buffer;
+    endquote = 0;
+    colon    = 0;
+
+    for (;;)
+    {
+      if (line->blockpos >= line->blocklen && !ppd_read_block(fp, line))
+      {
+        ch = EOF;
+	break;
+      }
+
+     /*
+      * Copy the run of ordinary characters up to the next line end,
+      * control character, colon or quote at once...
+      */
+
+      blockptr = line->block + line->blockpos;
+      blockend = line->block + line->blocklen;
+
+      for (runptr = blockptr;
+           runptr < blockend && !ppd_special_chars[(unsigned char)*runptr];
+	   runptr ++);
+
+      if (runptr > blockptr)
+      {
+        runlen = (size_t)(runptr - blockptr);
+
+	if (col + (int)runlen > (PPD_MAX_LINE - 1))
+	{
+	 /*
+          * Line is too long...
+	  */
+
+          pg->ppd_line   = startline;
+          pg->ppd_status = PPD_LINE_TOO_LONG;
+
+          return (0);
+	}
+
+        while ((size_t)(lineptr - line->buffer) + runlen > line->bufsize - 1)
+	{
+	 /*
+	  * Expand the line buffer...
+	  */
+
+          char *temp;			/* Temporary line pointer */
+
+
+          line->bufsize += 1024;
+	  if (line->bufsize > 262144)
+	  {
+	   /*
+	    * Don't allow lines longer than 256k!
+	    */
+
+            pg->ppd_line   = startline;
+            pg->ppd_status = PPD_LINE_TOO_LONG;
+
+	    return (0);
+	  }
+
+          temp = realloc(line->buffer, line->bufsize);
+	  if (!temp)
+	  {
+            pg->ppd_line   = startline;
+            pg->ppd_status = PPD_LINE_TOO_LONG;
+
+	    return (0);
+	  }
+
+          lineptr      = temp + (lineptr - line->buffer);
+	  line->buffer = temp;
+	}
+
+	memcpy(lineptr, blockptr, runlen);
+	lineptr         += runlen;
+	col             += (int)runlen;
+	line->blockpos  += runlen;
+	ch              = (unsigned char)runptr[-1];
+	continue;
+      }
+
+      ch = (unsigned char)line->block[line->blockpos ++];
+
+      if (lineptr >= (line->buffer + line->bufsize - 1))
+      {
+       /*
+        * Expand the line buffer...
+	*/
+
+        char *temp;			/* Temporary line pointer */
+
+
+        line->bufsize += 1024;
+	if (line->bufsize > 262144)
+	{
+	 /*
+	  * Don't allow lines longer than 256k!
+	  */
+
+          pg->ppd_line   = startline;
+          pg->ppd_status = PPD_LINE_TOO_LONG;
+
+	  return (0);
+	}
+
+        temp = realloc(line->buffer, line->bufsize);
+	if (!temp)
+	{
+          pg->ppd_line   = startline;
+          pg->ppd_status = PPD_LINE_TOO_LONG;
+
+	  return (0);
+	}
+
+        lineptr      = temp + (lineptr - line->buffer);
+	line->buffer = temp;
+      }
+
+      if (ch == '\r' || ch == '\n')
+      {
+       /*
+	* Line feed or carriage return...
+	*/
+
+        pg->ppd_line ++;
+	col = 0;
+
+	if (ch == '\r')
+	{
+	 /*
+          * Check for a trailing line feed...
+	  */
+
+	  if ((ch = ppd_peek_char(fp, line)) == EOF)
+	  {
+	    ch = '\n';
+	    break;
+	  }
+
+	  if (ch == 0x0a)
+	    line->blockpos ++;
+	}
+
+	if (lineptr == line->buffer && ignoreblank)
+          continue;			/* Skip blank lines */
+
+	ch = '\n';
+
+	if (!endquote)			/* Continue for multi-line text */
+          break;
+
+	*lineptr++ = '\n';
+      }
+      else if (ch < ' ' && ch != '\t' && pg->ppd_conform == PPD_CONFORM_STRICT)
+      {
+       /*
+        * Other control characters...
+	*/
+
+        pg->ppd_line   = startline;
+        pg->ppd_status = PPD_ILLEGAL_CHARACTER;
+
+        return (0);
+      }
+      else if (ch != 0x1a)
+      {
+       /*
+	* Any other character...
+	*/
+
+	*lineptr++ = (char)ch;
+	col ++;
+
+	if (col > (PPD_MAX_LINE - 1))
+	{
+	 /*
+          * Line is too long...
+	  */
+
+          pg->ppd_line   = startline;
+          pg->ppd_status = PPD_LINE_TOO_LONG;
+
+          return (0);
+	}
+
+	if (ch == ':' && strncmp(line->buffer, "*%", 2) != 0)
+	  colon = 1;
+
+	if (ch == '\"' && colon)
+	  endquote = !endquote;
+      }
+    }
+
+    if (endquote)
+    {
+     /*
+      * Didn't finish this quoted string...
+      */
+
+      while ((ch = ppd_read_char(fp, line)) != EOF)
+        if (ch == '\"')
+	  break;
+	else if (ch == '\r' || ch == '\n')
+	{
+	  pg->ppd_line ++;
+	  col = 0;
+
+	  if (ch == '\r')
+	  {
+	   /*
+            * Check for a trailing line feed...
+	    */
+
+	    if ((ch = ppd_peek_char(fp, line)) == EOF)
+	      break;
+	    if (ch == 0x0a)
+	      line->blockpos ++;
+	  }
+	}
+	else if (ch < ' ' && ch != '\t' && pg->ppd_conform == PPD_CONFORM_STRICT)
+	{
+	 /*
+          * Other control characters...
+	  */
 
           pg->ppd_line   = startline;
           pg->ppd_status = PPD_ILLEGAL_CHARACTER;
@@ -3087,7 +4544,7 @@ ppd_read(cups_file_t    *fp,		/* I - File to read from */
       * Didn't finish this line...
       */
 
-      while ((ch = cupsFileGetChar(fp)) != EOF)
+      while ((ch = ppd_read_char(fp, line)) != EOF)
 	if (ch == '\r' || ch == '\n')
 	{
 	 /*
@@ -3103,10 +4560,10 @@ ppd_read(cups_file_t    *fp,		/* I - File to read from */
             * Check for a trailing line feed...
 	    */
 
-	    if ((ch = cupsFilePeekChar(fp)) == EOF)
+	    if ((ch = ppd_peek_char(fp, line)) == EOF)
 	      break;
 	    if (ch == 0x0a)
-	      cupsFileGetChar(fp);
+	      line->blockpos ++;
 	  }
 
 	  break;
@@ -3359,6 +4816,121 @@ ppd_read(cups_file_t    *fp,		/* I - File to read from */
 }
 
 
+/*
+ * 'ppd_read_block()' - Read the next block of a PPD file.
+ *
+ * ppd_read() works on blocks of the file instead of calling
+ * cupsFileGetChar() for each character, so that it can copy runs of
+ * ordinary characters at once.
+ */
+
+static int				/* O - 1 on success, 0 on EOF or error */
+ppd_read_block(cups_file_t *fp,		/* I - File to read from */
+	       _ppd_line_t *line)	/* I - Line buffer */
+{
+  ssize_t	bytes;			/* Bytes read */
+
+
+  if (!line->block && (line->block = malloc(PPD_BLOCK_SIZE)) == NULL)
+    return (0);
+
+  line->blocklen = 0;
+  line->blockpos = 0;
+
+  if ((bytes = cupsFileRead(fp, line->block, PPD_BLOCK_SIZE)) <= 0)
+    return (0);
+
+  line->blocklen = (size_t)bytes;
+
+  return (1);
+}
+
+
+/*
+ * 'ppd_read_char()' - Read the next character of a PPD file.
+ */
+
+static int				/* O - Character or EOF */
+ppd_read_char(cups_file_t *fp,		/* I - File to read from */
+	      _ppd_line_t *line)	/* I - Line buffer */
+{
+  if (line->blockpos >= line->blocklen && !ppd_read_block(fp, line))
+    return (EOF);
+
+  return ((unsigned char)line->block[line->blockpos ++]);
+}
+
+
+/*
+ * 'ppd_read_end()' - Free the buffers of ppd_read() and seek back over
+ *                    the part of the last block which was not parsed.
+ *
+ * So the caller's file is positioned as if it had been read character by
+ * character, for example after "*%APLWORKSET START" or a syntax error.
+ */
+
+static void
+ppd_read_end(cups_file_t *fp,		/* I - File to read from */
+	     _ppd_line_t *line)		/* I - Line buffer */
+{
+  if (line->blockpos < line->blocklen)
+    cupsFileSeek(fp, cupsFileTell(fp) -
+		     (off_t)(line->blocklen - line->blockpos));
+
+  free(line->buffer);
+  free(line->block);
+
+  line->buffer   = NULL;
+  line->block    = NULL;
+  line->blocklen = 0;
+  line->blockpos = 0;
+}
+
+
+/*
+ * 'ppd_setup_options()' - Create the sorted options array, the array
+ *                         of marked choices, and the lookup index, and set
+ *                         the option back-pointer for each choice and
+ *                         custom option.
+ */
+
+static void
+ppd_setup_options(ppd_file_t *ppd)	/* I - PPD file */
+{
+  int		i, j, k;		/* Looping vars */
+  ppd_group_t	*group;			/* Current group */
+  ppd_option_t	*option;		/* Current option */
+  ppd_coption_t	*coption;		/* Custom option */
+
+
+  ppd->options = cupsArrayNew2((cups_array_func_t)ppd_compare_options, NULL,
+                               (cups_ahash_func_t)ppd_hash_option,
+			       PPD_HASHSIZE);
+
+  for (i = ppd->num_groups, group = ppd->groups;
+       i > 0;
+       i --, group ++)
+  {
+    for (j = group->num_options, option = group->options;
+         j > 0;
+	 j --, option ++)
+    {
+      cupsArrayAdd(ppd->options, option);
+
+      for (k = 0; k < option->num_choices; k ++)
+        option->choices[k].option = option;
+
+      if ((coption = ppdFindCustomOption(ppd, option->keyword)) != NULL)
+        coption->option = option;
+    }
+  }
+
+  ppd->marked = cupsArrayNew((cups_array_func_t)ppd_compare_choices, NULL);
+
+  _ppdIndexCreate(ppd);
+}
+
+
 /*
  * 'ppd_update_filters()' - Update the filters array as needed.
  *
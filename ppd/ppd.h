@@ -69,6 +69,7 @@ extern "C" {
  */
 
 #  define PPD_SYNC	0x50504441	/* Sync word for ppds.dat (PPDA) */
+#  define PPD_SYNC2	0x50504442	/* Sync word for indexed ppds.dat (PPDB) */
 #  define PPD_MAX_LANG	32		/* Maximum languages */
 #  define PPD_MAX_PROD	32		/* Maximum products */
 #  define PPD_MAX_VERS	32		/* Maximum versions */
@@ -449,6 +450,7 @@ struct ppd_cache_s		   /**** PPD cache and PWG conversion data ****/
 };
 typedef struct ppd_cache_s ppd_cache_t;
 					/**** PPD cache and mapping data ****/
+typedef struct ppd_emit_s ppd_emit_t;	/**** Option code of all sections ****/
 
 typedef struct ppd_file_s		/**** PPD File ****/
 {
@@ -539,6 +541,15 @@ typedef struct ppd_file_s		/**** PPD File ****/
   /**** New in CUPS 1.5 ****/
   ppd_cache_t	*cache;			/* PPD cache and mapping data @since
 					   CUPS 1.5/macOS 10.7@ @private@ */
+
+  /**** New in cups-filters 2.0.0 ****/
+  struct ppd_uiindex_s *cups_uiindex;	/* Compiled cupsUIConstraints
+					   @private@ */
+  struct ppd_index_s *cups_index;	/* Hash index of options, choices,
+					   and attributes @private@ */
+  struct ppd_raster_cache_s *cups_raster_cache;
+					/* Page headers from the option code
+					   @private@ */
 } ppd_file_t;
 
 /**** New in cups-filters 2.0.0: Ovetaken from cups-driverd ****/
@@ -773,6 +784,8 @@ extern ppd_file_t	*ppdOpenWithLocalization(cups_file_t *fp,
 				  ppd_localization_t localization);
 extern ppd_file_t	*ppdOpenFileWithLocalization(const char *filename,
 				      ppd_localization_t localization);
+extern ppd_file_t	*ppdOpenFileImage(const char *filename,
+					 const char *cachedir);
 extern int		ppdParseOptions(const char *s, int num_options,
 					cups_option_t **options,
 					ppd_parse_t which);
@@ -850,6 +863,10 @@ char            *ppdCreatePPDFromIPP2(char *buffer, size_t bufsize,
 				      char* default_pagesize,
 				      const char *default_cluster_color,
 				      char *status_msg, size_t status_msg_size);
+void		ppdCreatePPDFromIPPCacheSize(int max_ppds);
+void		ppdCreatePPDFromIPPCacheStats(unsigned long *hits,
+					      unsigned long *misses,
+					      int *num_ppds);
 
 /**** New in cups-filters 2.0.0: Functions to load color profile data from
       PPD files, from driver.h ****/
@@ -880,6 +897,16 @@ extern cf_cmyk_t	*ppdCMYKLoad(ppd_file_t *ppd,
 				    cf_logfunc_t log,
 				    void *ld);
 
+/**** New in cups-filters 2.0.0: Option code collected once per job ****/
+extern ppd_emit_t	*ppdEmitCreate(ppd_file_t *ppd);
+extern void		ppdEmitDestroy(ppd_emit_t *emit);
+extern const char	*ppdEmitGetCode(ppd_emit_t *emit,
+					ppd_section_t section,
+					size_t *length);
+extern int		ppdEmitWriteFd(ppd_emit_t *emit, int fd,
+				       int num_sections,
+				       const ppd_section_t *sections);
+
 
 /*
  * C++ magic...
@@ -16,6 +16,18 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+
+
+//
+// Local types...
+//
+
+typedef struct				// Generated PPD file
+{
+  char		*filename;		// PPD filename
+  int		job;			// Writer process of the file
+} ppdc_file_t;
 
 
 //
@@ -29,6 +41,7 @@ const char *progname;
 // Local functions...
 //
 
+static int	compare_files(ppdc_file_t *a, ppdc_file_t *b);
 static void	usage(void);
 
 
@@ -40,7 +53,8 @@ int					// O - Exit status
 main(int  argc,				// I - Number of command-line arguments
      char *argv[])			// I - Command-line arguments
 {
-  int			i, j;		// Looping vars
+  int			i, j,		// Looping vars
+			n;		// Number of distinct PPD files
   ppdcCatalog		*catalog;	// Message catalog
   const char		*outdir;	// Output directory
   ppdcSource		*src;		// PPD source file data
@@ -58,16 +72,24 @@ main(int  argc,				// I - Number of command-line arguments
 			do_test,	// Test PPD files
 			single_language,// Generate single-language files
 			use_model_name,	// Use ModelName for filename
-			verbose;	// Verbosity
+			verbose,	// Verbosity
+			jobs,		// Number of writer processes
+			job,		// Current writer process
+			status,		// Exit status of writer processes
+			failed;		// Writing PPD files failed
   ppdcLineEnding	le;		// Line ending to use
   ppdcArray		*locales;	// List of locales
-  cups_array_t		*filenames;	// List of generated filenames
+  cups_array_t		*filenames;	// List of generated files
+  ppdc_file_t		key,		// Search key
+			*file;		// Current generated file
 
 
   // Scan the command-line...
   catalog         = NULL;
   comp            = 0;
   do_test         = 0;
+  failed          = 0;
+  jobs            = 1;
   le              = PPDC_LFONLY;
   locales         = NULL;
   outdir          = "ppd";
@@ -75,7 +97,7 @@ main(int  argc,				// I - Number of command-line arguments
   src             = new ppdcSource();
   use_model_name  = 0;
   verbose         = 0;
-  filenames       = cupsArrayNew((cups_array_func_t)strcasecmp, NULL);
+  filenames       = cupsArrayNew((cups_array_func_t)compare_files, NULL);
 
   progname        = strrchr(argv[0], '/');
   if (progname)
@@ -152,6 +174,15 @@ main(int  argc,				// I - Number of command-line arguments
 	      outdir = argv[i];
 	      break;
 
+          case 'j' :			// Number of writer processes...
+	      i ++;
+	      if (i >= argc)
+        	usage();
+
+	      if ((jobs = atoi(argv[i])) < 1)
+	        usage();
+	      break;
+
           case 'l' :			// Language(s)...
 	      i ++;
 	      if (i >= argc)
@@ -270,8 +301,44 @@ main(int  argc,				// I - Number of command-line arguments
       }
     }
 
+    // Fork the writer processes, each one writing every "jobs"th PPD
+    // file with its own copy of the driver information.  All drivers
+    // with the same filename go to the same writer, so that the last
+    // one wins as when writing serially...
+    job = 0;
+
+    if (do_test)
+      jobs = 1;
+    else if (jobs > (int)src->drivers->count)
+      jobs = (int)src->drivers->count;
+
+    if (jobs > 1)
+    {
+      fflush(stdout);
+      fflush(stderr);
+
+      for (job = 1; job < jobs; job ++)
+      {
+        int	pid;			// Process ID
+
+	if ((pid = fork()) == 0)
+	  break;
+	else if (pid < 0)
+	{
+	  fprintf(stderr, _("%s: Unable to create writer process: %s\n"),
+		  progname, strerror(errno));
+	  job    = 0;
+	  failed = 1;
+	  goto done;
+	}
+      }
+
+      if (job >= jobs)
+        job = 0;
+    }
+
     // Write PPD files...
-    for (d = (ppdcDriver *)src->drivers->first();
+    for (d = (ppdcDriver *)src->drivers->first(), n = 0;
          d;
 	 d = (ppdcDriver *)src->drivers->next())
     {
@@ -287,7 +354,8 @@ main(int  argc,				// I - Number of command-line arguments
 	  fprintf(stderr,
 		  _("%s: Unable to create output pipes: %s\n"),
 		  progname, strerror(errno));
-	  return (1);
+	  failed = 1;
+	  goto done;
 	}
 
 	if ((pid = fork()) == 0)
@@ -361,12 +429,32 @@ main(int  argc,				// I - Number of command-line arguments
 	else
 	  snprintf(filename, sizeof(filename), "%s/%s", outdir, pcfilename);
 
-        if (cupsArrayFind(filenames, filename))
-	  fprintf(stderr,
-		  _("%s: Warning - overlapping filename \"%s\".\n"),
-		  progname, filename);
+        key.filename = filename;
+
+        if ((file = (ppdc_file_t *)cupsArrayFind(filenames, &key)) != NULL)
+	{
+	  if (file->job == job)
+	    fprintf(stderr,
+		    _("%s: Warning - overlapping filename \"%s\".\n"),
+		    progname, filename);
+	}
+	else if ((file = (ppdc_file_t *)calloc(1, sizeof(ppdc_file_t))) !=
+	             NULL &&
+		 (file->filename = strdup(filename)) != NULL)
+	{
+	  file->job = (n ++) % jobs;
+	  cupsArrayAdd(filenames, file);
+	}
 	else
-	  cupsArrayAdd(filenames, strdup(filename));
+	{
+	  fprintf(stderr, _("%s: Unable to allocate memory.\n"), progname);
+	  failed = 1;
+	  goto done;
+	}
+
+        // Leave the other PPD files to the other writer processes...
+	if (file->job != job)
+	  continue;
 
 	fp = cupsFileOpen(filename, comp ? "w9" : "w");
 	if (!fp)
@@ -374,7 +462,8 @@ main(int  argc,				// I - Number of command-line arguments
 	  fprintf(stderr,
 		  _("%s: Unable to create PPD file \"%s\" - %s.\n"),
 		  progname, filename, strerror(errno));
-	  return (1);
+	  failed = 1;
+	  goto done;
 	}
 
 	if (verbose)
@@ -402,7 +491,8 @@ main(int  argc,				// I - Number of command-line arguments
       if (d->write_ppd_file(fp, catalog, templocales, src, le))
       {
 	cupsFileClose(fp);
-	return (1);
+	failed = 1;
+	goto done;
       }
 
       if (templocales && templocales != locales)
@@ -410,6 +500,19 @@ main(int  argc,				// I - Number of command-line arguments
 
       cupsFileClose(fp);
     }
+
+    // Wait for the other writer processes, also when this one failed...
+    done:
+
+    if (jobs > 1 && job == 0)
+    {
+      while (wait(&status) > 0)
+        if (status)
+	  failed = 1;
+    }
+
+    if (failed)
+      return (1);
   }
   else
     usage();
@@ -426,6 +529,18 @@ main(int  argc,				// I - Number of command-line arguments
 }
 
 
+//
+// 'compare_files()' - Compare two generated PPD files by filename.
+//
+
+static int				// O - Result of comparison
+compare_files(ppdc_file_t *a,		// I - First file
+              ppdc_file_t *b)		// I - Second file
+{
+  return (strcasecmp(a->filename, b->filename));
+}
+
+
 //
 // 'usage()' - Show usage and exit.
 //
@@ -444,6 +559,8 @@ usage(void)
 		    "message catalog.\n"));
   fprintf(stdout, _("  -d output-dir           Specify the output "
 		    "directory.\n"));
+  fprintf(stdout, _("  -j jobs                 Write PPD files using the "
+		    "given number of processes.\n"));
   fprintf(stdout, _("  -l lang[,lang,...]      Specify the output "
 		    "language(s) (locale).\n"));
   fprintf(stdout, _("  -m                      Use the ModelName value "
@@ -14,10 +14,18 @@
 
 #include "raster-private.h"
 #include "ppd.h"
+#include "ppd-private.h"
 #include "debug-internal.h"
 #include <math.h>
 
 
+/*
+ * Constants...
+ */
+
+#define PPD_MAX_HEADERS	8		/* Maximum number of page headers kept */
+
+
 /*
  * Stack values for the PostScript mini-interpreter...
  */
@@ -67,6 +75,28 @@ typedef struct
 } _ppd_ps_stack_t;
 
 
+/*
+ * Page headers from the option code of a PPD file...
+ */
+
+typedef struct
+{
+  unsigned		hash;		/* Hash of the code */
+  size_t		keylen;		/* Length of the code */
+  char			*key;		/* Code that was run */
+  cups_page_header2_t	header;		/* Resulting page header */
+  int			preferred_bits;	/* Resulting preferred bits per color */
+} _ppd_header_t;
+
+typedef struct ppd_raster_cache_s
+{
+  int			num_headers,	/* Number of page headers */
+			next_header;	/* Next page header to replace */
+  _ppd_header_t		headers[PPD_MAX_HEADERS];
+					/* Page headers */
+} _ppd_raster_cache_t;
+
+
 /*
  * Local functions...
  */
@@ -76,12 +106,21 @@ static int		ppd_copy_stack(_ppd_ps_stack_t *st, int count);
 static void		ppd_delete_stack(_ppd_ps_stack_t *st);
 static void		ppd_error_object(_ppd_ps_obj_t *obj);
 static void		ppd_error_stack(_ppd_ps_stack_t *st, const char *title);
+static int		ppd_find_header(ppd_file_t *ppd, const char *key,
+			                size_t keylen, cups_page_header2_t *h,
+					int *preferred_bits);
+static unsigned		ppd_header_hash(const char *key, size_t keylen);
+static char		*ppd_header_key(char *code[], int num_code,
+			                size_t *keylen);
 static _ppd_ps_obj_t	*ppd_index_stack(_ppd_ps_stack_t *st, int n);
 static _ppd_ps_stack_t	*ppd_new_stack(void);
 static _ppd_ps_obj_t	*ppd_pop_stack(_ppd_ps_stack_t *st);
 static _ppd_ps_obj_t	*ppd_push_stack(_ppd_ps_stack_t *st,
 			            _ppd_ps_obj_t *obj);
 static int		ppd_roll_stack(_ppd_ps_stack_t *st, int c, int s);
+static void		ppd_save_header(ppd_file_t *ppd, char *key,
+			                size_t keylen, cups_page_header2_t *h,
+					int preferred_bits);
 static _ppd_ps_obj_t	*ppd_scan_ps(_ppd_ps_stack_t *st, char **ptr);
 static int		ppd_setpagedevice(_ppd_ps_stack_t *st,
 			                cups_page_header2_t *h,
@@ -130,8 +169,11 @@ ppdRasterInterpretPPD(
     cups_option_t       *options,	/* I - Options */
     cups_interpret_cb_t func)		/* I - Optional page header callback (@code NULL@ for none) */
 {
-  int		status;			/* Cummulative status */
-  char		*code;			/* Code to run */
+  int		i,			/* Looping var */
+		status;			/* Cummulative status */
+  char		*code[5],		/* Code to run */
+		*key;			/* Key for the page header cache */
+  size_t	keylen;			/* Length of key */
   const char	*val;			/* Option value */
   ppd_size_t	*size;			/* Current size */
   float		left,			/* Left position */
@@ -197,39 +239,40 @@ ppdRasterInterpretPPD(
   if (ppd)
   {
    /*
-    * Apply any patch code (used to override the defaults...)
+    * Collect any patch code (used to override the defaults...) and the
+    * code of the printer options in the proper order...
     */
 
-    if (ppd->patches)
-      status |= ppdRasterExecPS(h, &preferred_bits, ppd->patches);
+    code[0] = ppd->patches;
+    code[1] = ppdEmitString(ppd, PPD_ORDER_DOCUMENT, 0.0);
+    code[2] = ppdEmitString(ppd, PPD_ORDER_ANY, 0.0);
+    code[3] = ppdEmitString(ppd, PPD_ORDER_PROLOG, 0.0);
+    code[4] = ppdEmitString(ppd, PPD_ORDER_PAGE, 0.0);
 
    /*
-    * Then apply printer options in the proper order...
+    * The header only depends on the code, so use the result of an earlier
+    * call with the same code or run the code and remember the result...
     */
 
-    if ((code = ppdEmitString(ppd, PPD_ORDER_DOCUMENT, 0.0)) != NULL)
-    {
-      status |= ppdRasterExecPS(h, &preferred_bits, code);
-      free(code);
-    }
+    key = ppd_header_key(code, 5, &keylen);
 
-    if ((code = ppdEmitString(ppd, PPD_ORDER_ANY, 0.0)) != NULL)
+    if (!key || !ppd_find_header(ppd, key, keylen, h, &preferred_bits))
     {
-      status |= ppdRasterExecPS(h, &preferred_bits, code);
-      free(code);
-    }
+      for (i = 0; i < 5; i ++)
+	if (code[i])
+	  status |= ppdRasterExecPS(h, &preferred_bits, code[i]);
 
-    if ((code = ppdEmitString(ppd, PPD_ORDER_PROLOG, 0.0)) != NULL)
-    {
-      status |= ppdRasterExecPS(h, &preferred_bits, code);
-      free(code);
+      if (key && !status)
+      {
+	ppd_save_header(ppd, key, keylen, h, preferred_bits);
+	key = NULL;
+      }
     }
 
-    if ((code = ppdEmitString(ppd, PPD_ORDER_PAGE, 0.0)) != NULL)
-    {
-      status |= ppdRasterExecPS(h, &preferred_bits, code);
-      free(code);
-    }
+    free(key);
+
+    for (i = 1; i < 5; i ++)
+      free(code[i]);
   }
 
  /*
@@ -832,6 +875,29 @@ ppdRasterExecPS(
 }
 
 
+/*
+ * '_ppdRasterDeleteCache()' - Free the page headers kept for a PPD file.
+ */
+
+void
+_ppdRasterDeleteCache(ppd_file_t *ppd)	/* I - PPD file */
+{
+  int			i;		/* Looping var */
+  _ppd_raster_cache_t	*cache;		/* Page header cache */
+
+
+  if ((cache = ppd->cups_raster_cache) == NULL)
+    return;
+
+  for (i = 0; i < cache->num_headers; i ++)
+    free(cache->headers[i].key);
+
+  free(cache);
+
+  ppd->cups_raster_cache = NULL;
+}
+
+
 /*
  * 'ppd_cleartomark_stack()' - Clear to the last mark ([) on the stack.
  */
@@ -1010,6 +1076,110 @@ ppd_error_stack(_ppd_ps_stack_t *st,	/* I - Stack */
 }
 
 
+/*
+ * 'ppd_find_header()' - Find the page header for the code of a PPD file.
+ */
+
+static int				/* O - 1 if found, 0 otherwise */
+ppd_find_header(
+    ppd_file_t          *ppd,		/* I - PPD file */
+    const char          *key,		/* I - Code that is run */
+    size_t              keylen,		/* I - Length of code */
+    cups_page_header2_t *h,		/* O - Page header */
+    int                 *preferred_bits)/* O - Preferred bits per color */
+{
+  int			i;		/* Looping var */
+  unsigned		hash;		/* Hash of the code */
+  _ppd_raster_cache_t	*cache;		/* Page header cache */
+  _ppd_header_t		*header;	/* Current page header */
+
+
+  if ((cache = ppd->cups_raster_cache) == NULL)
+    return (0);
+
+  hash = ppd_header_hash(key, keylen);
+
+  for (i = cache->num_headers, header = cache->headers; i > 0; i --, header ++)
+    if (header->hash == hash && header->keylen == keylen &&
+        !memcmp(header->key, key, keylen))
+    {
+      DEBUG_printf(("4ppd_find_header: Using page header %d.",
+                    (int)(header - cache->headers)));
+
+      memcpy(h, &(header->header), sizeof(cups_page_header2_t));
+      *preferred_bits = header->preferred_bits;
+
+      return (1);
+    }
+
+  return (0);
+}
+
+
+/*
+ * 'ppd_header_hash()' - Compute the hash of a page header key.
+ */
+
+static unsigned				/* O - Hash */
+ppd_header_hash(const char *key,	/* I - Key */
+                size_t     keylen)	/* I - Length of key */
+{
+  unsigned	hash = 2166136261U;	/* Hash (FNV-1a) */
+
+
+  while (keylen > 0)
+  {
+    hash = (hash ^ (unsigned char)*key++) * 16777619U;
+    keylen --;
+  }
+
+  return (hash);
+}
+
+
+/*
+ * 'ppd_header_key()' - Make the key for the page header of some code.
+ *
+ * The key is the code strings with their nul bytes, so different splits
+ * of the same text give different keys.
+ */
+
+static char *				/* O - Key or NULL on error */
+ppd_header_key(char   *code[],		/* I - Code strings, may be NULL */
+               int    num_code,		/* I - Number of code strings */
+	       size_t *keylen)		/* O - Length of key */
+{
+  int		i;			/* Looping var */
+  size_t	len[5];			/* Lengths of code strings */
+  char		*key,			/* Key */
+		*ptr;			/* Pointer into key */
+
+
+  if (num_code > (int)(sizeof(len) / sizeof(len[0])))
+    return (NULL);
+
+  for (i = 0, *keylen = 0; i < num_code; i ++)
+  {
+    len[i]  = code[i] ? strlen(code[i]) : 0;
+    *keylen += len[i] + 1;
+  }
+
+  if ((key = malloc(*keylen)) == NULL)
+    return (NULL);
+
+  for (i = 0, ptr = key; i < num_code; i ++)
+  {
+    if (len[i])
+      memcpy(ptr, code[i], len[i]);
+
+    ptr    += len[i];
+    *ptr++ = '\0';
+  }
+
+  return (key);
+}
+
+
 /*
  * 'ppd_index_stack()' - Copy the Nth value on the stack.
  */
@@ -1173,6 +1343,55 @@ ppd_roll_stack(_ppd_ps_stack_t *st,	/* I - Stack */
 }
 
 
+/*
+ * 'ppd_save_header()' - Remember the page header for the code of a PPD file.
+ *
+ * The key is freed with the page header.
+ */
+
+static void
+ppd_save_header(
+    ppd_file_t          *ppd,		/* I - PPD file */
+    char                *key,		/* I - Code that was run */
+    size_t              keylen,		/* I - Length of code */
+    cups_page_header2_t *h,		/* I - Page header */
+    int                 preferred_bits)	/* I - Preferred bits per color */
+{
+  _ppd_raster_cache_t	*cache;		/* Page header cache */
+  _ppd_header_t		*header;	/* New page header */
+
+
+  if ((cache = ppd->cups_raster_cache) == NULL &&
+      (cache = ppd->cups_raster_cache =
+           calloc(1, sizeof(_ppd_raster_cache_t))) == NULL)
+  {
+    free(key);
+    return;
+  }
+
+ /*
+  * Replace the oldest page header once the cache is full...
+  */
+
+  if (cache->num_headers < PPD_MAX_HEADERS)
+    header = cache->headers + cache->num_headers ++;
+  else
+  {
+    header = cache->headers + cache->next_header;
+    cache->next_header = (cache->next_header + 1) % PPD_MAX_HEADERS;
+
+    free(header->key);
+  }
+
+  header->hash           = ppd_header_hash(key, keylen);
+  header->keylen         = keylen;
+  header->key            = key;
+  header->preferred_bits = preferred_bits;
+
+  memcpy(&(header->header), h, sizeof(cups_page_header2_t));
+}
+
+
 /*
  * 'ppd_scan_ps()' - Scan a string for the next PS object.
  */
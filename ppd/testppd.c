@@ -21,6 +21,7 @@
 #else
 #  include <unistd.h>
 #  include <fcntl.h>
+#  include <sys/time.h>
 #endif /* _WIN32 */
 #include <math.h>
 
@@ -31,6 +32,28 @@
 
 static int	do_ppd_tests(const char *filename, int num_options, cups_option_t *options);
 static int	do_ps_tests(void);
+static int	do_interpret_tests(void);
+static int	do_emit_tests(const char *filename);
+static int	do_generator_tests(void);
+static int	do_image_tests(void);
+static int	do_lexer_tests(void);
+static int	do_constraint_tests(const char *filename);
+static int	do_lookup_tests(const char *filename);
+static int	do_collection_tests(void);
+static int	do_image_benchmark(int num_files, char *files[]);
+static const char *compare_ppds(ppd_file_t *a, ppd_file_t *b);
+static int	list_collection(cups_array_t *collections,
+		                const char *cachename, const char *name,
+				const char *value, char *first,
+				size_t firstsize);
+static int	read_collection_ppd(cups_array_t *collections,
+		                    const char *name, char *buffer,
+				    size_t bufsize);
+static char	*read_file(const char *filename, size_t *length);
+static cups_array_t *test_constraints(ppd_file_t *ppd, const char *option,
+		                      const char *choice, int num_options,
+				      cups_option_t *options, int installable);
+static ipp_t	*generator_response(const char *more_info);
 static void	print_changes(cups_page_header2_t *header, cups_page_header2_t *expected);
 
 
@@ -1132,6 +1155,26 @@ main(int  argc,				/* I - Number of command-line arguments */
     }
 
     status += do_ps_tests();
+    status += do_interpret_tests();
+    status += do_emit_tests("ppd/test.ppd");
+    status += do_generator_tests();
+    status += do_image_tests();
+    status += do_lexer_tests();
+    status += do_constraint_tests("ppd/test.ppd");
+    status += do_constraint_tests("ppd/test2.ppd");
+    status += do_lookup_tests("ppd/test.ppd");
+    status += do_lookup_tests("ppd/test2.ppd");
+    status += do_collection_tests();
+  }
+  else if (!strcmp(argv[1], "--image"))
+  {
+    if (argc < 3)
+    {
+      puts("Usage: testppd --image filename.ppd [... filename.ppd]");
+      return (1);
+    }
+
+    status = do_image_benchmark(argc - 2, argv + 2);
   }
   else if (!strcmp(argv[1], "--raster"))
   {
@@ -1713,6 +1756,1645 @@ do_ps_tests(void)
 }
 
 
+/*
+ * 'do_interpret_tests()' - Test the page header cache of
+ *                          ppdRasterInterpretPPD().
+ */
+
+static int				/* O - Number of errors */
+do_interpret_tests(void)
+{
+  char			filename[256];	/* Test PPD file */
+  FILE			*fp;		/* Test PPD file */
+  ppd_file_t		*ppd;		/* PPD file data */
+  cups_page_header2_t	first,		/* Page header for the defaults */
+			second,		/* Page header for other options */
+			third;		/* Page header for the defaults again */
+  int			errors = 0;	/* Number of errors */
+
+
+  snprintf(filename, sizeof(filename), "/tmp/testppd-interpret.%d.ppd",
+           (int)getpid());
+  if ((fp = fopen(filename, "w")) == NULL)
+  {
+    printf("ppdRasterInterpretPPD (cache): FAIL (unable to create %s)\n",
+           filename);
+    return (1);
+  }
+
+  fputs("*PPD-Adobe: \"4.3\"\n"
+        "*OpenUI *Resolution/Resolution: PickOne\n"
+        "*OrderDependency: 10 AnySetup *Resolution\n"
+        "*DefaultResolution: 300dpi\n"
+        "*Resolution 300dpi/300 DPI: \"<</HWResolution[300 300]>>"
+	"setpagedevice\"\n"
+        "*Resolution 600dpi/600 DPI: \"<</HWResolution[600 600]>>"
+	"setpagedevice\"\n"
+        "*CloseUI: *Resolution\n"
+        "*OpenUI *ColorModel/Color Mode: PickOne\n"
+        "*OrderDependency: 10 AnySetup *ColorModel\n"
+        "*DefaultColorModel: Gray\n"
+        "*ColorModel Gray/Grayscale: \"<</cupsColorSpace 18"
+	"/cupsBitsPerColor 8>>setpagedevice\"\n"
+        "*ColorModel RGB/Color: \"<</cupsColorSpace 1"
+	"/cupsBitsPerColor 8>>setpagedevice\"\n"
+        "*CloseUI: *ColorModel\n", fp);
+  fclose(fp);
+
+  fputs("ppdRasterInterpretPPD (cache): ", stdout);
+
+  if ((ppd = ppdOpenFile(filename)) == NULL)
+  {
+    puts("FAIL (unable to open)");
+    unlink(filename);
+    return (1);
+  }
+
+  ppdMarkDefaults(ppd);
+
+  if (ppdRasterInterpretPPD(&first, ppd, 0, NULL, NULL))
+  {
+    printf("FAIL (%s)\n", _ppdRasterErrorString());
+    errors ++;
+  }
+  else if (first.HWResolution[0] != 300 ||
+           first.cupsColorSpace != CUPS_CSPACE_SW)
+  {
+    printf("FAIL (got %ddpi, colorspace %d, expected 300dpi, colorspace "
+           "%d)\n", first.HWResolution[0], first.cupsColorSpace,
+	   CUPS_CSPACE_SW);
+    errors ++;
+  }
+  else
+  {
+    ppdMarkOption(ppd, "Resolution", "600dpi");
+    ppdMarkOption(ppd, "ColorModel", "RGB");
+
+    if (ppdRasterInterpretPPD(&second, ppd, 0, NULL, NULL))
+    {
+      printf("FAIL (%s)\n", _ppdRasterErrorString());
+      errors ++;
+    }
+    else if (second.HWResolution[0] != 600 ||
+             second.cupsColorSpace != CUPS_CSPACE_RGB)
+    {
+      printf("FAIL (got %ddpi, colorspace %d, expected 600dpi, colorspace "
+             "%d)\n", second.HWResolution[0], second.cupsColorSpace,
+	     CUPS_CSPACE_RGB);
+      errors ++;
+    }
+    else
+    {
+      ppdMarkDefaults(ppd);
+
+      if (ppdRasterInterpretPPD(&third, ppd, 0, NULL, NULL))
+      {
+	printf("FAIL (%s)\n", _ppdRasterErrorString());
+	errors ++;
+      }
+      else if (memcmp(&first, &third, sizeof(first)))
+      {
+	puts("FAIL (different page header for the same options)");
+	print_changes(&first, &third);
+	errors ++;
+      }
+      else
+	puts("PASS");
+    }
+  }
+
+  ppdClose(ppd);
+  unlink(filename);
+
+  return (errors);
+}
+
+
+/*
+ * 'do_emit_tests()' - Test ppdEmitCreate() and friends.
+ */
+
+static int				/* O - Number of errors */
+do_emit_tests(const char *filename)	/* I - PPD file */
+{
+  int			i;		/* Looping var */
+  ppd_file_t		*ppd;		/* PPD file data */
+  ppd_emit_t		*emit;		/* Option code */
+  const char		*code;		/* Option code of a section */
+  char			*expected,	/* Expected option code */
+			*data,		/* Data written */
+			tempfile[256];	/* Temporary file */
+  size_t		length,		/* Length of option code */
+			datalen,	/* Length of data written */
+			offset;		/* Offset into data written */
+  int			fd;		/* Temporary file */
+  static const ppd_section_t sections[] =
+  {					/* Sections to write */
+    PPD_ORDER_DOCUMENT,
+    PPD_ORDER_ANY,
+    PPD_ORDER_PAGE
+  };
+  int			errors = 0;	/* Number of errors */
+
+
+  fputs("ppdEmitGetCode: ", stdout);
+
+  if ((ppd = ppdOpenFile(filename)) == NULL)
+  {
+    puts("FAIL (unable to open)");
+    return (1);
+  }
+
+  ppdMarkDefaults(ppd);
+
+  if ((emit = ppdEmitCreate(ppd)) == NULL)
+  {
+    puts("FAIL (returned NULL)");
+    ppdClose(ppd);
+    return (1);
+  }
+
+  for (i = PPD_ORDER_ANY; i <= PPD_ORDER_PROLOG && !errors; i ++)
+  {
+    code     = ppdEmitGetCode(emit, (ppd_section_t)i, &length);
+    expected = ppdEmitString(ppd, (ppd_section_t)i, 0.0);
+
+    if (!code != !expected ||
+        (code && (length != strlen(expected) || strcmp(code, expected))))
+    {
+      printf("FAIL (section %d is \"%s\", expected \"%s\")\n", i,
+             code ? code : "(null)", expected ? expected : "(null)");
+      errors ++;
+    }
+
+    free(expected);
+  }
+
+  if (!errors)
+    puts("PASS");
+
+  fputs("ppdEmitWriteFd: ", stdout);
+
+  snprintf(tempfile, sizeof(tempfile), "/tmp/testppd-emit.%d",
+           (int)getpid());
+
+  if ((fd = open(tempfile, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+  {
+    printf("FAIL (unable to create %s)\n", tempfile);
+    errors ++;
+  }
+  else if (ppdEmitWriteFd(emit, fd, (int)(sizeof(sections) /
+                                          sizeof(sections[0])), sections))
+  {
+    puts("FAIL (returned -1)");
+    errors ++;
+    close(fd);
+  }
+  else
+  {
+    close(fd);
+
+    if ((data = read_file(tempfile, &datalen)) == NULL)
+    {
+      puts("FAIL (unable to read)");
+      errors ++;
+    }
+    else
+    {
+      for (i = 0, offset = 0;
+           i < (int)(sizeof(sections) / sizeof(sections[0]));
+	   i ++, offset += length)
+      {
+	if ((code = ppdEmitGetCode(emit, sections[i], &length)) != NULL &&
+	    (offset + length > datalen ||
+	     memcmp(data + offset, code, length)))
+	  break;
+      }
+
+      if (i < (int)(sizeof(sections) / sizeof(sections[0])) ||
+          offset != datalen)
+      {
+	printf("FAIL (got %d bytes, expected %d)\n", (int)datalen,
+	       (int)offset);
+	errors ++;
+      }
+      else
+	puts("PASS");
+
+      free(data);
+    }
+  }
+
+  unlink(tempfile);
+  ppdEmitDestroy(emit);
+  ppdClose(ppd);
+
+  return (errors);
+}
+
+
+/*
+ * 'do_generator_tests()' - Test the cache of ppdCreatePPDFromIPP2().
+ */
+
+static int				/* O - Number of errors */
+do_generator_tests(void)
+{
+  ipp_t		*printer_a,		/* Attributes of first printer */
+		*printer_b;		/* Attributes of second printer */
+  char		ppdname[1024];		/* Generated PPD file */
+  char		*uncached = NULL,	/* PPD generated without cache */
+		*cached = NULL,		/* PPD from the cache */
+		*other = NULL;		/* PPD of the other printer */
+  size_t	uncached_len = 0,	/* Lengths of the PPD files */
+		cached_len = 0,
+		other_len = 0;
+  unsigned long	hits,			/* Cache hits */
+		misses;			/* Cache misses */
+  int		num_ppds;		/* PPD files in the cache */
+  int		errors = 0;		/* Number of errors */
+
+
+  printer_a = generator_response("http://printer-a.local/");
+  printer_b = generator_response("http://printer-b.local/");
+
+  fputs("ppdCreatePPDFromIPP2 (no cache): ", stdout);
+  ppdCreatePPDFromIPPCacheSize(0);
+  if (ppdCreatePPDFromIPP2(ppdname, sizeof(ppdname), printer_a, NULL, NULL,
+			   0, 0, NULL, NULL, NULL, NULL, NULL, 0) &&
+      (uncached = read_file(ppdname, &uncached_len)) != NULL)
+    puts("PASS");
+  else
+  {
+    puts("FAIL");
+    errors ++;
+  }
+  unlink(ppdname);
+
+  fputs("ppdCreatePPDFromIPP2 (cache miss): ", stdout);
+  ppdCreatePPDFromIPPCacheSize(16);
+  if (ppdCreatePPDFromIPP2(ppdname, sizeof(ppdname), printer_b, NULL, NULL,
+			   0, 0, NULL, NULL, NULL, NULL, NULL, 0) &&
+      (other = read_file(ppdname, &other_len)) != NULL &&
+      strstr(other, "*APSupplies: \"http://printer-b.local/\"\n"))
+    puts("PASS");
+  else
+  {
+    puts("FAIL");
+    errors ++;
+  }
+  unlink(ppdname);
+
+  fputs("ppdCreatePPDFromIPP2 (cache hit): ", stdout);
+  if (ppdCreatePPDFromIPP2(ppdname, sizeof(ppdname), printer_a, NULL, NULL,
+			   0, 0, NULL, NULL, NULL, NULL, NULL, 0) &&
+      (cached = read_file(ppdname, &cached_len)) != NULL)
+  {
+    ppdCreatePPDFromIPPCacheStats(&hits, &misses, &num_ppds);
+    if (hits != 1 || misses != 1 || num_ppds != 1)
+    {
+      printf("FAIL (%lu hits, %lu misses, %d PPD files, expected 1, 1, 1)\n",
+	     hits, misses, num_ppds);
+      errors ++;
+    }
+    else if (!uncached || cached_len != uncached_len ||
+	     memcmp(cached, uncached, cached_len))
+    {
+      puts("FAIL (differs from the PPD generated without cache)");
+      errors ++;
+    }
+    else
+      puts("PASS");
+  }
+  else
+  {
+    puts("FAIL");
+    errors ++;
+  }
+  unlink(ppdname);
+
+  free(uncached);
+  free(cached);
+  free(other);
+  ippDelete(printer_a);
+  ippDelete(printer_b);
+
+  return (errors);
+}
+
+
+/*
+ * 'do_image_tests()' - Test loading PPD files from a PPD image.
+ */
+
+static int				/* O - Number of errors */
+do_image_tests(void)
+{
+  ppd_file_t	*parsed,		/* PPD file parsed with ppdOpenFile() */
+		*image;			/* PPD file loaded from the image */
+  char		cachedir[256],		/* Directory for the image */
+		command[1024];		/* Command to remove it */
+  const char	*diff;			/* First difference */
+  int		errors = 0;		/* Number of errors */
+
+
+  snprintf(cachedir, sizeof(cachedir), "/tmp/testppd-image.%d", (int)getpid());
+  mkdir(cachedir, 0700);
+
+  fputs("ppdOpenFileImage(\"ppd/test.ppd\") (create image): ", stdout);
+  parsed = ppdOpenFile("ppd/test.ppd");
+  if ((image = ppdOpenFileImage("ppd/test.ppd", cachedir)) == NULL)
+  {
+    puts("FAIL");
+    errors ++;
+  }
+  else if ((diff = compare_ppds(parsed, image)) != NULL)
+  {
+    printf("FAIL (%s)\n", diff);
+    errors ++;
+  }
+  else
+    puts("PASS");
+  ppdClose(image);
+
+  fputs("ppdOpenFileImage(\"ppd/test.ppd\") (load image): ", stdout);
+  if ((image = ppdOpenFileImage("ppd/test.ppd", cachedir)) == NULL)
+  {
+    puts("FAIL");
+    errors ++;
+  }
+  else if ((diff = compare_ppds(parsed, image)) != NULL)
+  {
+    printf("FAIL (%s)\n", diff);
+    errors ++;
+  }
+  else
+  {
+    ppdMarkOption(image, "PageSize", "Letter");
+
+    if (!ppdIsMarked(image, "PageSize", "Letter") ||
+        !ppdFindAttr(image, "cupsFilter", NULL))
+    {
+      puts("FAIL (lookups on the loaded PPD file)");
+      errors ++;
+    }
+    else
+      puts("PASS");
+  }
+  ppdClose(image);
+
+  ppdClose(parsed);
+
+  snprintf(command, sizeof(command), "rm -rf %s", cachedir);
+  if (system(command))
+    printf("Unable to remove %s.\n", cachedir);
+
+  return (errors);
+}
+
+
+/*
+ * 'do_lexer_tests()' - Test reading PPD files with other line endings,
+ *                      compressed, and with errors.
+ */
+
+static int				/* O - Number of errors */
+do_lexer_tests(void)
+{
+  int		i;			/* Looping var */
+  ppd_file_t	*parsed,		/* test.ppd as is */
+		*ppd;			/* Other variant of test.ppd */
+  char		*data,			/* Contents of test.ppd */
+		*ptr,			/* Pointer into contents */
+		filename[256];		/* Temporary PPD file */
+  size_t	length;			/* Length of contents */
+  cups_file_t	*fp;			/* Temporary PPD file */
+  const char	*diff;			/* First difference */
+  ppd_status_t	err;			/* Last error */
+  int		line;			/* Line number of last error */
+  int		errors = 0;		/* Number of errors */
+  static const char * const variants[] =/* Variants of test.ppd */
+  {
+    "CR LF",
+    "CR",
+    "gzip"
+  };
+  static const struct
+  {
+    const char		*name,		/* Name of test */
+			*data;		/* PPD file */
+    ppd_conform_t	conform;	/* Conformance level */
+    ppd_status_t	status;		/* Expected error */
+    int			line;		/* Expected line */
+  }		bad[] =			/* PPD files with errors */
+  {
+    { "line too long",
+      "*PPD-Adobe: \"4.3\"\n*A: \""
+      "0123456789012345678901234567890123456789012345678901234567890123456789"
+      "0123456789012345678901234567890123456789012345678901234567890123456789"
+      "0123456789012345678901234567890123456789012345678901234567890123456789"
+      "0123456789012345678901234567890123456789012345678901234567890123456789"
+      "\"\n", PPD_CONFORM_RELAXED, PPD_LINE_TOO_LONG, 2 },
+    { "control character",
+      "*PPD-Adobe: \"4.3\"\r\n*A: x\001y\r\n", PPD_CONFORM_STRICT,
+      PPD_ILLEGAL_CHARACTER, 2 },
+    { "multi-line string",
+      "*PPD-Adobe: \"4.3\"\n*A: \"abc\n\ndef\"\n*B: 1\nfoo\n",
+      PPD_CONFORM_RELAXED, PPD_MISSING_ASTERISK, 6 },
+    { "whitespace",
+      "*PPD-Adobe: \"4.3\"\r*OpenUI *Foo Bar: PickOne\r*B: 1\r",
+      PPD_CONFORM_STRICT, PPD_ILLEGAL_WHITESPACE, 2 }
+  };
+
+
+  snprintf(filename, sizeof(filename), "/tmp/testppd-lexer.%d.ppd",
+	   (int)getpid());
+
+  parsed = ppdOpenFile("ppd/test.ppd");
+  data   = read_file("ppd/test.ppd", &length);
+
+  for (i = 0; i < (int)(sizeof(variants) / sizeof(variants[0])); i ++)
+  {
+    printf("ppdOpenFile(%s): ", variants[i]);
+
+    if ((fp = cupsFileOpen(filename, i == 2 ? "w9" : "w")) == NULL || !data)
+    {
+      puts("FAIL (unable to create file)");
+      errors ++;
+      continue;
+    }
+
+    for (ptr = data; *ptr; ptr ++)
+      if (*ptr == '\n' && i < 2)
+      {
+        cupsFilePutChar(fp, '\r');
+	if (i == 0)
+	  cupsFilePutChar(fp, '\n');
+      }
+      else
+        cupsFilePutChar(fp, *ptr);
+
+    cupsFileClose(fp);
+
+    if ((ppd = ppdOpenFile(filename)) == NULL)
+    {
+      err = ppdLastError(&line);
+      printf("FAIL (%s on line %d)\n", ppdErrorString(err), line);
+      errors ++;
+    }
+    else if ((diff = compare_ppds(parsed, ppd)) != NULL)
+    {
+      printf("FAIL (%s)\n", diff);
+      errors ++;
+    }
+    else
+      puts("PASS");
+
+    ppdClose(ppd);
+  }
+
+  for (i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i ++)
+  {
+    printf("ppdOpenFile(%s): ", bad[i].name);
+
+    if ((fp = cupsFileOpen(filename, "w")) == NULL)
+    {
+      puts("FAIL (unable to create file)");
+      errors ++;
+      continue;
+    }
+
+    cupsFilePuts(fp, bad[i].data);
+    cupsFileClose(fp);
+
+    ppdSetConformance(bad[i].conform);
+
+    if ((ppd = ppdOpenFile(filename)) != NULL)
+    {
+      puts("FAIL (no error)");
+      errors ++;
+      ppdClose(ppd);
+    }
+    else if ((err = ppdLastError(&line)) != bad[i].status ||
+             line != bad[i].line)
+    {
+      printf("FAIL (%s on line %d, expected %s on line %d)\n",
+             ppdErrorString(err), line, ppdErrorString(bad[i].status),
+	     bad[i].line);
+      errors ++;
+    }
+    else
+      puts("PASS");
+  }
+
+  ppdSetConformance(PPD_CONFORM_RELAXED);
+
+ /*
+  * The caller's file must be positioned right after the PPD data...
+  */
+
+  fputs("ppdOpen2(file position): ", stdout);
+
+  if ((fp = cupsFileOpen(filename, "w")) == NULL)
+  {
+    puts("FAIL (unable to create file)");
+    errors ++;
+  }
+  else
+  {
+    cupsFilePuts(fp, "*PPD-Adobe: \"4.3\"\n*A: 1\n*%APLWORKSET START\n"
+		     "trailer\n");
+    cupsFileClose(fp);
+
+    if ((fp = cupsFileOpen(filename, "r")) == NULL ||
+        (ppd = ppdOpen2(fp)) == NULL)
+    {
+      puts("FAIL (unable to open file)");
+      errors ++;
+    }
+    else
+    {
+      char	trailer[256];		/* Line after the PPD data */
+
+      if (!cupsFileGets(fp, trailer, sizeof(trailer)) ||
+          strcmp(trailer, "trailer"))
+      {
+	puts("FAIL (wrong position after ppdOpen2)");
+	errors ++;
+      }
+      else
+	puts("PASS");
+
+      ppdClose(ppd);
+    }
+
+    cupsFileClose(fp);
+  }
+
+  unlink(filename);
+  free(data);
+  ppdClose(parsed);
+
+  return (errors);
+}
+
+
+/*
+ * 'do_constraint_tests()' - Compare the conflicts found for all options and
+ *                           marked choices with the ones found by
+ *                           test_constraints().
+ */
+
+static int				/* O - Number of errors */
+do_constraint_tests(
+    const char *filename)		/* I - PPD file */
+{
+  int			i, j, k, m,	/* Looping vars */
+			num_options,	/* Number of conflicting options */
+			num_expected,	/* Number of expected options */
+			num_tests = 0;	/* Number of tests */
+  ppd_file_t		*ppd;		/* PPD file */
+  ppd_option_t		*mo,		/* Option to mark */
+			*o;		/* Option to test */
+  ppd_choice_t		*mc,		/* Choice to mark */
+			*c;		/* Choice to test */
+  ppd_cups_uiconsts_t	*consts;	/* Current constraints */
+  ppd_cups_uiconst_t	*constptr;	/* Current constraint */
+  ppd_choice_t		*marked;	/* Marked choice */
+  cups_array_t		*active;	/* Expected active constraints */
+  cups_option_t		*options,	/* Conflicting options */
+			*expected;	/* Expected options */
+  char			error[1024] = "";
+					/* First error */
+
+
+  printf("ppdConflicts(\"%s\") (all choices): ", filename);
+
+  if ((ppd = ppdOpenFile(filename)) == NULL)
+  {
+    puts("FAIL (unable to open)");
+    return (1);
+  }
+
+  ppdMarkDefaults(ppd);
+  ppdConflicts(ppd);
+
+ /*
+  * Test with the defaults and then with each choice marked...
+  */
+
+  for (k = 0, m = -1; k < cupsArrayCount(ppd->options) && !error[0];)
+  {
+    mo = (ppd_option_t *)cupsArrayIndex(ppd->options, k);
+    mc = (m >= 0 && m < mo->num_choices) ? mo->choices + m : NULL;
+
+    ppdMarkDefaults(ppd);
+
+    if (mc)
+      ppdMarkOption(ppd, mo->keyword, mc->choice);
+
+    active = test_constraints(ppd, NULL, NULL, 0, NULL, 0);
+    i      = ppdConflicts(ppd);
+    num_tests ++;
+
+    if (i != cupsArrayCount(active))
+      snprintf(error, sizeof(error), "%s=%s: %d conflicts, expected %d",
+               mo->keyword, mc ? mc->choice : "(defaults)", i,
+	       cupsArrayCount(active));
+
+    for (consts = (ppd_cups_uiconsts_t *)cupsArrayFirst(active);
+         consts && !error[0];
+	 consts = (ppd_cups_uiconsts_t *)cupsArrayNext(active))
+      for (i = consts->num_constraints, constptr = consts->constraints;
+           i > 0;
+	   i --, constptr ++)
+        if (!constptr->option->conflicted)
+	{
+	  snprintf(error, sizeof(error), "%s=%s: %s not conflicted",
+		   mo->keyword, mc ? mc->choice : "(defaults)",
+		   constptr->option->keyword);
+	  break;
+	}
+
+    cupsArrayDelete(active);
+
+    if (!error[0])
+    {
+      num_options = 0;
+      options     = NULL;
+
+      if (ppdResolveConflicts(ppd, NULL, NULL, &num_options, &options) &&
+          (active = test_constraints(ppd, NULL, NULL, num_options, options,
+	                             0)) != NULL)
+      {
+	snprintf(error, sizeof(error), "%s=%s: %d conflicts after resolving",
+		 mo->keyword, mc ? mc->choice : "(defaults)",
+		 cupsArrayCount(active));
+        cupsArrayDelete(active);
+      }
+
+      cupsFreeOptions(num_options, options);
+    }
+
+   /*
+    * Test each choice of each option against the marked choices...
+    */
+
+    for (o = ppdFirstOption(ppd); o && !error[0]; o = ppdNextOption(ppd))
+      for (j = o->num_choices, c = o->choices; j > 0 && !error[0]; j --, c ++)
+      {
+        num_tests ++;
+
+        active = test_constraints(ppd, o->keyword, c->choice, 0, NULL, 1);
+
+        if (ppdInstallableConflict(ppd, o->keyword, c->choice) !=
+	        (active != NULL))
+	  snprintf(error, sizeof(error),
+	           "%s=%s: ppdInstallableConflict(%s=%s) returned %d",
+		   mo->keyword, mc ? mc->choice : "(defaults)", o->keyword,
+		   c->choice, active == NULL);
+
+        cupsArrayDelete(active);
+
+        active       = test_constraints(ppd, o->keyword, c->choice, 0, NULL,
+	                                0);
+	num_expected = 0;
+	expected     = NULL;
+
+	for (consts = (ppd_cups_uiconsts_t *)cupsArrayFirst(active);
+	     consts;
+	     consts = (ppd_cups_uiconsts_t *)cupsArrayNext(active))
+	  for (i = consts->num_constraints, constptr = consts->constraints;
+	       i > 0;
+	       i --, constptr ++)
+	    if (strcasecmp(constptr->option->keyword, o->keyword))
+	    {
+	      if (constptr->choice)
+		num_expected = cupsAddOption(constptr->option->keyword,
+					     constptr->choice->choice,
+					     num_expected, &expected);
+	      else if ((marked = ppdFindMarkedChoice(ppd,
+					constptr->option->keyword)) != NULL)
+		num_expected = cupsAddOption(constptr->option->keyword,
+					     marked->choice, num_expected,
+					     &expected);
+	    }
+
+        cupsArrayDelete(active);
+
+        num_options = ppdGetConflicts(ppd, o->keyword, c->choice, &options);
+
+        if (num_options != num_expected)
+	  snprintf(error, sizeof(error),
+	           "%s=%s: ppdGetConflicts(%s=%s) returned %d, expected %d",
+		   mo->keyword, mc ? mc->choice : "(defaults)", o->keyword,
+		   c->choice, num_options, num_expected);
+
+        for (i = 0; i < num_options && !error[0]; i ++)
+	  if (strcmp(options[i].value,
+	             cupsGetOption(options[i].name, num_expected, expected) ?
+		         cupsGetOption(options[i].name, num_expected,
+			               expected) : ""))
+	    snprintf(error, sizeof(error),
+		     "%s=%s: ppdGetConflicts(%s=%s) returned %s=%s",
+		     mo->keyword, mc ? mc->choice : "(defaults)", o->keyword,
+		     c->choice, options[i].name, options[i].value);
+
+        cupsFreeOptions(num_options, options);
+        cupsFreeOptions(num_expected, expected);
+      }
+
+   /*
+    * Mark the next choice...
+    */
+
+    if (++ m >= mo->num_choices)
+    {
+      k ++;
+      m = 0;
+    }
+  }
+
+  ppdClose(ppd);
+
+  if (error[0])
+  {
+    printf("FAIL (%s)\n", error);
+    return (1);
+  }
+
+  printf("PASS (%d tests)\n", num_tests);
+
+  return (0);
+}
+
+
+/*
+ * 'do_lookup_tests()' - Compare option, choice, and attribute lookups with
+ *                       linear searches.
+ */
+
+static int				/* O - Number of errors */
+do_lookup_tests(const char *filename)	/* I - PPD file */
+{
+  int		i, j, k;		/* Looping vars */
+  ppd_file_t	*ppd;			/* PPD file */
+  ppd_group_t	*group;			/* Current group */
+  ppd_option_t	*option;		/* Current option */
+  ppd_choice_t	*choice,		/* Current choice */
+		*expected;		/* Expected choice */
+  ppd_attr_t	*attr,			/* Current attribute */
+		*found;			/* Attribute found */
+  char		name[PPD_MAX_NAME],	/* Name in other case */
+		*ptr;			/* Pointer into name */
+  char		error[1024] = "";	/* First error */
+
+
+  printf("ppdFindOption/Choice/Attr(\"%s\"): ", filename);
+
+  if ((ppd = ppdOpenFile(filename)) == NULL)
+  {
+    puts("FAIL (unable to open)");
+    return (1);
+  }
+
+ /*
+  * Look up each option by its keyword in upper case, and mark each choice...
+  */
+
+  for (i = ppd->num_groups, group = ppd->groups;
+       i > 0 && !error[0];
+       i --, group ++)
+    for (j = group->num_options, option = group->options;
+         j > 0 && !error[0];
+	 j --, option ++)
+    {
+      strlcpy(name, option->keyword, sizeof(name));
+      for (ptr = name; *ptr; ptr ++)
+        *ptr = (char)toupper(*ptr & 255);
+
+      if (ppdFindOption(ppd, name) != option)
+      {
+        snprintf(error, sizeof(error), "ppdFindOption(%s) failed", name);
+	break;
+      }
+
+      for (k = option->num_choices, choice = option->choices;
+           k > 0;
+	   k --, choice ++)
+      {
+        if (!strncmp(choice->choice, "Custom", 6) ||
+	    option->ui == PPD_UI_PICKMANY)
+	  continue;
+
+        ppdMarkOption(ppd, option->keyword, choice->choice);
+
+        expected = ppdFindChoice(option, choice->choice);
+
+        if (ppdFindMarkedChoice(ppd, option->keyword) != expected)
+	{
+	  snprintf(error, sizeof(error), "ppdMarkOption(%s=%s) failed",
+	           option->keyword, choice->choice);
+	  break;
+	}
+      }
+    }
+
+  if (!error[0] && ppdFindOption(ppd, "NoSuchOption"))
+    strlcpy(error, "ppdFindOption(NoSuchOption) found an option", sizeof(error));
+
+ /*
+  * Look up each attribute by name and by name and spec, and check that
+  * ppdFindNextAttr() continues after it...
+  */
+
+  for (i = 0; i < ppd->num_attrs && !error[0]; i ++)
+  {
+    attr = ppd->attrs[i];
+
+    for (j = 0; j < i; j ++)
+      if (!strcasecmp(ppd->attrs[j]->name, attr->name))
+        break;
+
+    if ((found = ppdFindAttr(ppd, attr->name, NULL)) != ppd->attrs[j])
+    {
+      snprintf(error, sizeof(error), "ppdFindAttr(%s) failed", attr->name);
+      break;
+    }
+
+    for (j = 0; j < i; j ++)
+      if (!strcasecmp(ppd->attrs[j]->name, attr->name) &&
+          !strcasecmp(ppd->attrs[j]->spec, attr->spec))
+        break;
+
+    if ((found = ppdFindAttr(ppd, attr->name, attr->spec)) != ppd->attrs[j])
+    {
+      snprintf(error, sizeof(error), "ppdFindAttr(%s, %s) failed", attr->name,
+               attr->spec);
+      break;
+    }
+
+    for (j ++; j < ppd->num_attrs; j ++)
+      if (!strcasecmp(ppd->attrs[j]->name, attr->name) &&
+          !strcasecmp(ppd->attrs[j]->spec, attr->spec))
+        break;
+
+    if ((found = ppdFindNextAttr(ppd, attr->name, attr->spec)) !=
+            (j < ppd->num_attrs ? ppd->attrs[j] : NULL))
+      snprintf(error, sizeof(error), "ppdFindNextAttr(%s, %s) failed",
+               attr->name, attr->spec);
+  }
+
+  if (!error[0] && (ppdFindAttr(ppd, "NoSuchAttr", NULL) ||
+                    ppdFindNextAttr(ppd, "NoSuchAttr", NULL)))
+    strlcpy(error, "ppdFindAttr(NoSuchAttr) found an attribute", sizeof(error));
+
+  ppdClose(ppd);
+
+  if (error[0])
+  {
+    printf("FAIL (%s)\n", error);
+    return (1);
+  }
+
+  puts("PASS");
+
+  return (0);
+}
+
+
+/*
+ * 'do_collection_tests()' - Test listing PPD files with the indexed
+ *                           ppds.dat file.
+ */
+
+static int				/* O - Number of errors */
+do_collection_tests(void)
+{
+  cups_array_t	*collections;		/* PPD collections */
+  ppd_collection_t col;			/* PPD collection */
+  char		cachedir[256],		/* Directory for the test */
+		ppddir[256],		/* Directory with the PPD files */
+		cachename[256],		/* ppds.dat file */
+		command[1024],		/* Commands to set up and clean up */
+		first[256],		/* First PPD listed */
+		second[256],		/* First PPD listed from the cache */
+		buffer[65536];		/* PPD generated from a .drv file */
+  int		count;			/* Number of PPDs listed */
+  unsigned	sync = 0;		/* Sync word of ppds.dat */
+  FILE		*fp = NULL;		/* ppds.dat file */
+  int		errors = 0;		/* Number of errors */
+
+
+  snprintf(cachedir, sizeof(cachedir), "/tmp/testppd-collection.%d",
+           (int)getpid());
+  snprintf(ppddir, sizeof(ppddir), "%s/ppds", cachedir);
+  snprintf(cachename, sizeof(cachename), "%s/ppds.dat", cachedir);
+  mkdir(cachedir, 0700);
+  mkdir(ppddir, 0700);
+
+  snprintf(command, sizeof(command), "cp ppd/test.ppd ppd/test2.ppd %s",
+           ppddir);
+  if (system(command))
+    printf("Unable to copy PPD files to %s.\n", ppddir);
+
+  col.name    = "test";
+  col.path    = ppddir;
+  collections = cupsArrayNew(NULL, NULL);
+  cupsArrayAdd(collections, &col);
+
+  fputs("ppdCollectionListPPDs (write ppds.dat): ", stdout);
+  if ((count = list_collection(collections, cachename, NULL, NULL, first,
+                               sizeof(first))) != 2)
+  {
+    printf("FAIL (%d PPDs)\n", count);
+    errors ++;
+  }
+  else if ((fp = fopen(cachename, "rb")) == NULL ||
+           fread(&sync, sizeof(sync), 1, fp) != 1 || sync != PPD_SYNC2)
+  {
+    puts("FAIL (no indexed ppds.dat)");
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  if (fp)
+    fclose(fp);
+
+  fputs("ppdCollectionListPPDs (read ppds.dat): ", stdout);
+  if ((count = list_collection(collections, cachename, NULL, NULL, second,
+                               sizeof(second))) != 2 || strcmp(first, second))
+  {
+    printf("FAIL (%d PPDs, first \"%s\")\n", count, second);
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  fputs("ppdCollectionListPPDs (make): ", stdout);
+  if ((count = list_collection(collections, cachename, "make", "APPLE",
+                               NULL, 0)) != 2)
+  {
+    printf("FAIL (%d PPDs)\n", count);
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  fputs("ppdCollectionListPPDs (product): ", stdout);
+  if ((count = list_collection(collections, cachename, "product", "(Test2)",
+                               first, sizeof(first))) != 1 ||
+      strcmp(first, "Test2 for CUPS"))
+  {
+    printf("FAIL (%d PPDs, first \"%s\")\n", count, first);
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  fputs("ppdCollectionListPPDs (make-and-model): ", stdout);
+  if ((count = list_collection(collections, cachename, "make-and-model",
+                               "test for cups", first, sizeof(first))) != 1 ||
+      strcmp(first, "Test for CUPS"))
+  {
+    printf("FAIL (%d PPDs, first \"%s\")\n", count, first);
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  fputs("ppdCollectionListPPDs (changed PPD): ", stdout);
+  snprintf(command, sizeof(command),
+           "sed -e 's/Test2 for CUPS/Changed Test2 for CUPS/' ppd/test2.ppd "
+	   ">%s/test2.ppd.new && mv %s/test2.ppd.new %s/test2.ppd", ppddir,
+	   ppddir, ppddir);
+  if (system(command))
+    printf("Unable to change %s/test2.ppd.\n", ppddir);
+  if ((count = list_collection(collections, cachename, "product", "(Test2)",
+                               first, sizeof(first))) != 1 ||
+      strcmp(first, "Changed Test2 for CUPS"))
+  {
+    printf("FAIL (%d PPDs, first \"%s\")\n", count, first);
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  fputs("ppdCollectionListPPDs (removed PPD): ", stdout);
+  snprintf(command, sizeof(command), "%s/test2.ppd", ppddir);
+  unlink(command);
+  if ((count = list_collection(collections, cachename, "product", "(Test",
+                               first, sizeof(first))) != 1 ||
+      strcmp(first, "Test for CUPS"))
+  {
+    printf("FAIL (%d PPDs, first \"%s\")\n", count, first);
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  fputs("ppdCollectionGetPPD (drv): ", stdout);
+  snprintf(command, sizeof(command), "%s/test.drv", ppddir);
+  if ((fp = fopen(command, "w")) != NULL)
+  {
+    fputs("{\n  Manufacturer \"Test\"\n  ModelName \"Test Drv\"\n"
+          "  PCFileName \"drvtest.ppd\"\n}\n", fp);
+    fclose(fp);
+  }
+  if (read_collection_ppd(collections, "test/test.drv:drvtest.ppd", buffer,
+                          sizeof(buffer)) ||
+      !strstr(buffer, "*ModelName: \"Test Drv\""))
+  {
+    puts("FAIL (no PPD)");
+    errors ++;
+  }
+  else if (read_collection_ppd(collections, "test/test.drv:drvtest.ppd",
+                               buffer, sizeof(buffer)) ||
+	   !strstr(buffer, "*ModelName: \"Test Drv\""))
+  {
+    puts("FAIL (no PPD from parsed file)");
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  fputs("ppdCollectionGetPPD (changed drv): ", stdout);
+  if ((fp = fopen(command, "w")) != NULL)
+  {
+    fputs("{\n  Manufacturer \"Test\"\n  ModelName \"Test Changed Drv\"\n"
+          "  PCFileName \"drvtest.ppd\"\n}\n", fp);
+    fclose(fp);
+  }
+  if (read_collection_ppd(collections, "test/test.drv:drvtest.ppd", buffer,
+                          sizeof(buffer)) ||
+      !strstr(buffer, "*ModelName: \"Test Changed Drv\""))
+  {
+    puts("FAIL (old PPD)");
+    errors ++;
+  }
+  else
+    puts("PASS");
+
+  cupsArrayDelete(collections);
+
+  snprintf(command, sizeof(command), "rm -rf %s", cachedir);
+  if (system(command))
+    printf("Unable to remove %s.\n", cachedir);
+
+  return (errors);
+}
+
+
+/*
+ * 'do_image_benchmark()' - Compare the times of parsing PPD files and of
+ *                          loading them from PPD images.
+ */
+
+static int				/* O - Number of errors */
+do_image_benchmark(int  num_files,	/* I - Number of PPD files */
+		   char *files[])	/* I - PPD files */
+{
+  int		i, j;			/* Looping vars */
+  ppd_file_t	*parsed,		/* PPD file parsed with ppdOpenFile() */
+		*image;			/* PPD file loaded from the image */
+  char		cachedir[256],		/* Directory for the images */
+		command[1024];		/* Command to remove it */
+  const char	*diff;			/* First difference */
+  struct timeval start,			/* Start time */
+		end;			/* End time */
+  double	parse_time = 0.0,	/* Time for ppdOpenFile() */
+		image_time = 0.0;	/* Time for ppdOpenFileImage() */
+  int		errors = 0;		/* Number of errors */
+
+
+  snprintf(cachedir, sizeof(cachedir), "/tmp/testppd-image.%d", (int)getpid());
+  mkdir(cachedir, 0700);
+
+  for (i = 0; i < num_files; i ++)
+  {
+    if ((parsed = ppdOpenFile(files[i])) == NULL)
+    {
+      printf("%s: Unable to open.\n", files[i]);
+      errors ++;
+      continue;
+    }
+
+    ppdClose(ppdOpenFileImage(files[i], cachedir));
+
+    gettimeofday(&start, NULL);
+    for (j = 0; j < 10; j ++)
+      ppdClose(ppdOpenFile(files[i]));
+    gettimeofday(&end, NULL);
+    parse_time += end.tv_sec - start.tv_sec +
+                  0.000001 * (end.tv_usec - start.tv_usec);
+
+    gettimeofday(&start, NULL);
+    for (j = 0; j < 10; j ++)
+      ppdClose(ppdOpenFileImage(files[i], cachedir));
+    gettimeofday(&end, NULL);
+    image_time += end.tv_sec - start.tv_sec +
+                  0.000001 * (end.tv_usec - start.tv_usec);
+
+    image = ppdOpenFileImage(files[i], cachedir);
+    if ((diff = compare_ppds(parsed, image)) != NULL)
+    {
+      printf("%s: Image differs (%s).\n", files[i], diff);
+      errors ++;
+    }
+
+    ppdClose(image);
+    ppdClose(parsed);
+  }
+
+  printf("%d PPD files, 10 times each: ppdOpenFile %.3f seconds, "
+         "ppdOpenFileImage %.3f seconds\n", num_files, parse_time, image_time);
+
+  snprintf(command, sizeof(command), "rm -rf %s", cachedir);
+  if (system(command))
+    printf("Unable to remove %s.\n", cachedir);
+
+  return (errors);
+}
+
+
+/*
+ * 'compare_ppds()' - Compare a parsed PPD file with one loaded from its image.
+ */
+
+static const char *			/* O - First difference or NULL */
+compare_ppds(ppd_file_t *a,		/* I - Parsed PPD file */
+	     ppd_file_t *b)		/* I - PPD file from the image */
+{
+  int		i, j, k;		/* Looping vars */
+  ppd_group_t	*ga, *gb;		/* Groups */
+  ppd_option_t	*oa, *ob;		/* Options */
+  ppd_choice_t	*ca, *cb;		/* Choices */
+  ppd_attr_t	*aa, *ab;		/* Attributes */
+  ppd_coption_t	*coa, *cob;		/* Custom options */
+
+
+#define STREQ(x,y) ((!(x) && !(y)) || ((x) && (y) && !strcmp((x), (y))))
+
+  if (!a || !b)
+    return ("missing PPD file");
+
+  if (a->language_level != b->language_level ||
+      a->color_device != b->color_device ||
+      a->variable_sizes != b->variable_sizes ||
+      a->accurate_screens != b->accurate_screens ||
+      a->contone_only != b->contone_only ||
+      a->landscape != b->landscape || a->model_number != b->model_number ||
+      a->manual_copies != b->manual_copies ||
+      a->throughput != b->throughput || a->colorspace != b->colorspace ||
+      a->flip_duplex != b->flip_duplex)
+    return ("scalar values");
+
+  if (!STREQ(a->patches, b->patches) || !STREQ(a->jcl_begin, b->jcl_begin) ||
+      !STREQ(a->jcl_ps, b->jcl_ps) || !STREQ(a->jcl_end, b->jcl_end) ||
+      !STREQ(a->lang_encoding, b->lang_encoding) ||
+      !STREQ(a->lang_version, b->lang_version) ||
+      !STREQ(a->modelname, b->modelname) ||
+      !STREQ(a->ttrasterizer, b->ttrasterizer) ||
+      !STREQ(a->manufacturer, b->manufacturer) ||
+      !STREQ(a->product, b->product) || !STREQ(a->nickname, b->nickname) ||
+      !STREQ(a->shortnickname, b->shortnickname) ||
+      !STREQ(a->protocols, b->protocols) ||
+      !STREQ(a->pcfilename, b->pcfilename))
+    return ("strings");
+
+  if (a->num_groups != b->num_groups)
+    return ("number of groups");
+
+  for (i = 0, ga = a->groups, gb = b->groups; i < a->num_groups;
+       i ++, ga ++, gb ++)
+  {
+    if (strcmp(ga->name, gb->name) || strcmp(ga->text, gb->text) ||
+        ga->num_options != gb->num_options ||
+	ga->num_subgroups != gb->num_subgroups)
+      return ("groups");
+
+    for (j = 0, oa = ga->options, ob = gb->options; j < ga->num_options;
+         j ++, oa ++, ob ++)
+    {
+      if (strcmp(oa->keyword, ob->keyword) || strcmp(oa->text, ob->text) ||
+          strcmp(oa->defchoice, ob->defchoice) || oa->ui != ob->ui ||
+	  oa->section != ob->section || oa->order != ob->order ||
+	  oa->num_choices != ob->num_choices)
+	return ("options");
+
+      for (k = 0, ca = oa->choices, cb = ob->choices; k < oa->num_choices;
+           k ++, ca ++, cb ++)
+	if (strcmp(ca->choice, cb->choice) || strcmp(ca->text, cb->text) ||
+	    !STREQ(ca->code, cb->code) || cb->option != ob)
+	  return ("choices");
+    }
+  }
+
+  if (a->num_sizes != b->num_sizes ||
+      (a->num_sizes > 0 &&
+       memcmp(a->sizes, b->sizes, (size_t)a->num_sizes * sizeof(ppd_size_t))))
+    return ("sizes");
+
+  if (a->num_consts != b->num_consts ||
+      (a->num_consts > 0 &&
+       memcmp(a->consts, b->consts,
+	      (size_t)a->num_consts * sizeof(ppd_const_t))))
+    return ("constraints");
+
+  if (a->num_profiles != b->num_profiles ||
+      (a->num_profiles > 0 &&
+       memcmp(a->profiles, b->profiles,
+	      (size_t)a->num_profiles * sizeof(ppd_profile_t))))
+    return ("profiles");
+
+  if (a->num_fonts != b->num_fonts)
+    return ("number of fonts");
+
+  for (i = 0; i < a->num_fonts; i ++)
+    if (strcmp(a->fonts[i], b->fonts[i]))
+      return ("fonts");
+
+  if (a->num_filters != b->num_filters)
+    return ("number of filters");
+
+  for (i = 0; i < a->num_filters; i ++)
+    if (strcmp(a->filters[i], b->filters[i]))
+      return ("filters");
+
+  if (a->num_attrs != b->num_attrs)
+    return ("number of attributes");
+
+  for (i = 0; i < a->num_attrs; i ++)
+  {
+    aa = a->attrs[i];
+    ab = b->attrs[i];
+
+    if (strcmp(aa->name, ab->name) || strcmp(aa->spec, ab->spec) ||
+        strcmp(aa->text, ab->text) || !STREQ(aa->value, ab->value))
+      return ("attributes");
+  }
+
+  for (aa = (ppd_attr_t *)cupsArrayFirst(a->sorted_attrs),
+           ab = (ppd_attr_t *)cupsArrayFirst(b->sorted_attrs);
+       aa && ab;
+       aa = (ppd_attr_t *)cupsArrayNext(a->sorted_attrs),
+           ab = (ppd_attr_t *)cupsArrayNext(b->sorted_attrs))
+    if (strcmp(aa->name, ab->name) || strcmp(aa->spec, ab->spec))
+      return ("sorted attributes");
+
+  if (aa || ab)
+    return ("number of sorted attributes");
+
+  if (cupsArrayCount(a->options) != cupsArrayCount(b->options))
+    return ("number of sorted options");
+
+  for (oa = (ppd_option_t *)cupsArrayFirst(a->options); oa;
+       oa = (ppd_option_t *)cupsArrayNext(a->options))
+    if ((ob = ppdFindOption(b, oa->keyword)) == NULL ||
+        strcmp(oa->defchoice, ob->defchoice))
+      return ("sorted options");
+
+  if (cupsArrayCount(a->coptions) != cupsArrayCount(b->coptions))
+    return ("number of custom options");
+
+  for (coa = (ppd_coption_t *)cupsArrayFirst(a->coptions); coa;
+       coa = (ppd_coption_t *)cupsArrayNext(a->coptions))
+    if ((cob = ppdFindCustomOption(b, coa->keyword)) == NULL ||
+        cupsArrayCount(coa->params) != cupsArrayCount(cob->params) ||
+	(coa->option == NULL) != (cob->option == NULL))
+      return ("custom options");
+
+#undef STREQ
+
+  return (NULL);
+}
+
+
+/*
+ * 'generator_response()' - Make the attributes of a driverless printer.
+ */
+
+static ipp_t *				/* O - Get-Printer-Attributes response */
+generator_response(
+    const char *more_info)		/* I - printer-more-info */
+{
+  ipp_t		*response;		/* Get-Printer-Attributes response */
+  static const char * const formats[] =	/* document-format-supported */
+  {
+    "application/octet-stream",
+    "application/pdf",
+    "image/jpeg"
+  };
+  static const char * const media[] =	/* media-supported */
+  {
+    "iso_a4_210x297mm",
+    "na_letter_8.5x11in",
+    "na_legal_8.5x14in"
+  };
+  static const char * const sides[] =	/* sides-supported */
+  {
+    "one-sided",
+    "two-sided-long-edge",
+    "two-sided-short-edge"
+  };
+
+
+  response = ippNew();
+
+  ippAddString(response, IPP_TAG_PRINTER, IPP_TAG_TEXT,
+	       "printer-make-and-model", NULL, "Acme Copier 9000");
+  ippAddString(response, IPP_TAG_PRINTER, IPP_TAG_URI,
+	       "printer-more-info", NULL, more_info);
+  ippAddString(response, IPP_TAG_PRINTER, IPP_TAG_URI,
+	       "printer-uuid", NULL, more_info);
+  ippAddInteger(response, IPP_TAG_PRINTER, IPP_TAG_INTEGER,
+		"printer-up-time", (int)strlen(more_info));
+  ippAddStrings(response, IPP_TAG_PRINTER, IPP_TAG_MIMETYPE,
+		"document-format-supported",
+		(int)(sizeof(formats) / sizeof(formats[0])), NULL, formats);
+  ippAddString(response, IPP_TAG_PRINTER, IPP_TAG_KEYWORD,
+	       "media-default", NULL, media[0]);
+  ippAddStrings(response, IPP_TAG_PRINTER, IPP_TAG_KEYWORD,
+		"media-supported", (int)(sizeof(media) / sizeof(media[0])),
+		NULL, media);
+  ippAddStrings(response, IPP_TAG_PRINTER, IPP_TAG_KEYWORD,
+		"sides-supported", (int)(sizeof(sides) / sizeof(sides[0])),
+		NULL, sides);
+  ippAddBoolean(response, IPP_TAG_PRINTER, "color-supported", 1);
+
+  return (response);
+}
+
+
+/*
+ * 'list_collection()' - List the PPD files of a collection.
+ */
+
+static int				/* O - Number of PPDs */
+list_collection(
+    cups_array_t *collections,		/* I - PPD collections */
+    const char   *cachename,		/* I - ppds.dat file */
+    const char   *name,			/* I - Option name or NULL */
+    const char   *value,		/* I - Option value */
+    char         *first,		/* O - Make and model of first PPD */
+    size_t       firstsize)		/* I - Size of buffer */
+{
+  cups_array_t	*ppds;			/* PPDs listed */
+  ppd_info_t	*ppd;			/* Current PPD */
+  int		num_options = 0;	/* Number of options */
+  cups_option_t	*options = NULL;	/* Options */
+  int		count;			/* Number of PPDs */
+
+
+  num_options = cupsAddOption("ppd-cache", cachename, num_options, &options);
+  if (name)
+    num_options = cupsAddOption(name, value, num_options, &options);
+
+  ppds = ppdCollectionListPPDs(collections, 0, num_options, options, NULL,
+                               NULL);
+  count = cupsArrayCount(ppds);
+
+  if (first)
+  {
+    if ((ppd = (ppd_info_t *)cupsArrayFirst(ppds)) != NULL)
+      strlcpy(first, ppd->record.make_and_model, firstsize);
+    else
+      *first = '\0';
+  }
+
+  for (ppd = (ppd_info_t *)cupsArrayFirst(ppds);
+       ppd;
+       ppd = (ppd_info_t *)cupsArrayNext(ppds))
+    free(ppd);
+
+  cupsArrayDelete(ppds);
+  cupsFreeOptions(num_options, options);
+
+  return (count);
+}
+
+
+/*
+ * 'read_collection_ppd()' - Read a PPD from the PPD collections.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+read_collection_ppd(
+    cups_array_t *collections,		/* I - PPD collections */
+    const char   *name,			/* I - PPD name */
+    char         *buffer,		/* O - PPD file contents */
+    size_t       bufsize)		/* I - Size of buffer */
+{
+  cups_file_t	*fp;			/* PPD file */
+  size_t	length = 0;		/* Length of contents */
+  ssize_t	bytes;			/* Bytes read */
+
+
+  *buffer = '\0';
+
+  if ((fp = ppdCollectionGetPPD(name, collections, NULL, NULL)) == NULL)
+    return (-1);
+
+  while (length < bufsize - 1 &&
+         (bytes = cupsFileRead(fp, buffer + length,
+	                       bufsize - 1 - length)) > 0)
+    length += (size_t)bytes;
+
+  buffer[length] = '\0';
+
+  cupsFileClose(fp);
+
+  return (0);
+}
+
+
+/*
+ * 'read_file()' - Read a file into memory.
+ */
+
+static char *				/* O - File contents or NULL */
+read_file(const char *filename,		/* I - File name */
+	  size_t     *length)		/* O - Length of contents */
+{
+  cups_file_t	*fp;			/* File */
+  char		*data,			/* Contents */
+		*ptr;			/* New buffer */
+  size_t	size = 65536;		/* Size of buffer */
+  ssize_t	bytes;			/* Bytes read */
+
+
+  *length = 0;
+
+  if ((fp = cupsFileOpen(filename, "r")) == NULL)
+    return (NULL);
+
+  if ((data = malloc(size)) == NULL)
+  {
+    cupsFileClose(fp);
+    return (NULL);
+  }
+
+  while ((bytes = cupsFileRead(fp, data + *length,
+			       size - *length - 1)) > 0)
+  {
+    *length += (size_t)bytes;
+    if (*length + 1 >= size)
+    {
+      size *= 2;
+      if ((ptr = realloc(data, size)) == NULL)
+      {
+	free(data);
+	cupsFileClose(fp);
+	return (NULL);
+      }
+      data = ptr;
+    }
+  }
+
+  cupsFileClose(fp);
+  data[*length] = '\0';
+
+  return (data);
+}
+
+
+/*
+ * 'test_constraints()' - See if any constraints are active, the same way as
+ *                        libppd did before compiling the constraints.
+ */
+
+static cups_array_t *			/* O - Array of active constraints */
+test_constraints(
+    ppd_file_t    *ppd,			/* I - PPD file */
+    const char    *option,		/* I - Current option */
+    const char    *choice,		/* I - Current choice */
+    int           num_options,		/* I - Number of additional options */
+    cups_option_t *options,		/* I - Additional options */
+    int           installable)		/* I - Only test installable options? */
+{
+  int			i;		/* Looping var */
+  ppd_cups_uiconsts_t	*consts;	/* Current constraints */
+  ppd_cups_uiconst_t	*constptr;	/* Current constraint */
+  ppd_choice_t		key,		/* Search key */
+			*marked;	/* Marked choice */
+  ppd_size_t		*size;		/* Current page size */
+  cups_array_t		*active = NULL;	/* Active constraints */
+  const char		*value,		/* Current value */
+			*firstvalue;	/* AP_FIRSTPAGE_Keyword value */
+  char			firstpage[255];	/* AP_FIRSTPAGE_Keyword string */
+
+
+  for (consts = (ppd_cups_uiconsts_t *)cupsArrayFirst(ppd->cups_uiconstraints);
+       consts;
+       consts = (ppd_cups_uiconsts_t *)cupsArrayNext(ppd->cups_uiconstraints))
+  {
+    if (installable)
+    {
+      if (!consts->installable)
+        continue;
+
+      for (i = consts->num_constraints, constptr = consts->constraints;
+	   i > 0;
+	   i --, constptr ++)
+        if (!strcasecmp(constptr->option->keyword, option) ||
+	    (!strncasecmp(option, "AP_FIRSTPAGE_", 13) &&
+	     !strcasecmp(constptr->option->keyword, option + 13)))
+	  break;
+
+      if (!i)
+        continue;
+    }
+
+    for (i = consts->num_constraints, constptr = consts->constraints;
+         i > 0;
+	 i --, constptr ++)
+    {
+      if (constptr->choice &&
+          (!strcasecmp(constptr->option->keyword, "PageSize") ||
+           !strcasecmp(constptr->option->keyword, "PageRegion")))
+      {
+        if (option && choice &&
+	    (!strcasecmp(option, "PageSize") ||
+	     !strcasecmp(option, "PageRegion")))
+	  value = choice;
+	else if ((value = cupsGetOption("PageSize", num_options,
+	                                options)) == NULL &&
+	         (value = cupsGetOption("PageRegion", num_options,
+		                        options)) == NULL &&
+		 (value = cupsGetOption("media", num_options,
+		                        options)) == NULL &&
+		 (size = ppdPageSize(ppd, NULL)) != NULL)
+	  value = size->name;
+
+        if (option && choice &&
+	    (!strcasecmp(option, "AP_FIRSTPAGE_PageSize") ||
+	     !strcasecmp(option, "AP_FIRSTPAGE_PageRegion")))
+	  firstvalue = choice;
+	else if ((firstvalue = cupsGetOption("AP_FIRSTPAGE_PageSize",
+	                                     num_options, options)) == NULL)
+	  firstvalue = cupsGetOption("AP_FIRSTPAGE_PageRegion", num_options,
+	                             options);
+      }
+      else if (constptr->choice)
+      {
+        snprintf(firstpage, sizeof(firstpage), "AP_FIRSTPAGE_%s",
+	         constptr->option->keyword);
+
+        if (option && choice &&
+	    !strcasecmp(option, constptr->option->keyword))
+	  value = choice;
+	else if ((value = cupsGetOption(constptr->option->keyword,
+	                                num_options, options)) == NULL)
+	  value = constptr->choice->marked ? constptr->choice->choice : NULL;
+
+        if (option && choice && !strcasecmp(option, firstpage))
+	  firstvalue = choice;
+	else
+	  firstvalue = cupsGetOption(firstpage, num_options, options);
+      }
+      else
+      {
+        if (option && choice &&
+	    !strcasecmp(option, constptr->option->keyword))
+	  value = choice;
+	else if ((value = cupsGetOption(constptr->option->keyword,
+	                                num_options, options)) == NULL)
+	{
+	  key.option = constptr->option;
+	  marked     = (ppd_choice_t *)cupsArrayFind(ppd->marked, &key);
+	  value      = marked ? marked->choice : NULL;
+	}
+
+        if (!value || !strcasecmp(value, "None") ||
+	    !strcasecmp(value, "Off") || !strcasecmp(value, "False"))
+	  break;
+
+        continue;
+      }
+
+      if (value && !strncasecmp(value, "Custom.", 7))
+        value = "Custom";
+
+      if (firstvalue && !strncasecmp(firstvalue, "Custom.", 7))
+        firstvalue = "Custom";
+
+      if ((!value || strcasecmp(value, constptr->choice->choice)) &&
+	  (!firstvalue || strcasecmp(firstvalue, constptr->choice->choice)))
+	break;
+    }
+
+    if (i <= 0)
+    {
+      if (!active)
+        active = cupsArrayNew(NULL, NULL);
+
+      cupsArrayAdd(active, consts);
+    }
+  }
+
+  return (active);
+}
 
 
 /*
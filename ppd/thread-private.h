@@ -29,6 +29,7 @@ extern "C" {
 #    include <pthread.h>
 typedef pthread_mutex_t _ppd_mutex_t;
 typedef pthread_key_t	_ppd_threadkey_t;
+typedef pthread_t	_ppd_thread_t;
 #    define _PPD_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
 #    define _PPD_THREADKEY_INITIALIZER 0
 #    define _ppdThreadGetData(k) pthread_getspecific(k)
@@ -44,6 +45,7 @@ typedef struct _ppd_mutex_s
 					/* Win32 Critical Section */
 } _ppd_mutex_t;
 typedef DWORD	_ppd_threadkey_t;
+typedef uintptr_t	_ppd_thread_t;
 #    define _PPD_MUTEX_INITIALIZER { 0, 0 }
 #    define _PPD_THREADKEY_INITIALIZER 0
 #    define _ppdThreadGetData(k) TlsGetValue(k)
@@ -52,12 +54,15 @@ typedef DWORD	_ppd_threadkey_t;
 #  else					/* No threading */
 typedef char	_ppd_mutex_t;
 typedef void	*_ppd_threadkey_t;
+typedef int	_ppd_thread_t;
 #    define _PPD_MUTEX_INITIALIZER 0
 #    define _PPD_THREADKEY_INITIALIZER (void *)0
 #    define _ppdThreadGetData(k) k
 #    define _ppdThreadSetData(k,p) k=p
 #  endif /* HAVE_PTHREAD_H */
 
+typedef void *(*_ppd_thread_func_t)(void *arg);
+
 
 /*
  * Functions...
@@ -66,6 +71,8 @@ typedef void	*_ppd_threadkey_t;
 extern void	_ppdMutexInit(_ppd_mutex_t *mutex);
 extern void	_ppdMutexLock(_ppd_mutex_t *mutex);
 extern void	_ppdMutexUnlock(_ppd_mutex_t *mutex);
+extern _ppd_thread_t _ppdThreadCreate(_ppd_thread_func_t func, void *arg);
+extern void	*_ppdThreadWait(_ppd_thread_t thread);
 
 #  ifdef __cplusplus
 }
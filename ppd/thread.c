@@ -48,6 +48,42 @@ _ppdMutexUnlock(_ppd_mutex_t *mutex)	/* I - Mutex */
 }
 
 
+/*
+ * '_ppdThreadCreate()' - Create a thread.
+ */
+
+_ppd_thread_t				/* O - Thread ID or 0 on failure */
+_ppdThreadCreate(
+    _ppd_thread_func_t func,		/* I - Entry point */
+    void               *arg)		/* I - Entry point context */
+{
+  pthread_t thread;			/* Thread ID */
+
+
+  if (pthread_create(&thread, NULL, (void *(*)(void *))func, arg))
+    return (0);
+  else
+    return (thread);
+}
+
+
+/*
+ * '_ppdThreadWait()' - Wait for a thread to exit.
+ */
+
+void *					/* O - Return value */
+_ppdThreadWait(_ppd_thread_t thread)	/* I - Thread ID */
+{
+  void	*ret;				/* Return value */
+
+
+  if (pthread_join(thread, &ret))
+    return (NULL);
+  else
+    return (ret);
+}
+
+
 #elif defined(_WIN32)
 #  include <process.h>
 
@@ -102,6 +138,37 @@ _ppdMutexUnlock(_ppd_mutex_t *mutex)	/* I - Mutex */
 }
 
 
+/*
+ * '_ppdThreadCreate()' - Create a thread.
+ */
+
+_ppd_thread_t				/* O - Thread ID or 0 on failure */
+_ppdThreadCreate(
+    _ppd_thread_func_t func,		/* I - Entry point */
+    void               *arg)		/* I - Entry point context */
+{
+  return (_beginthreadex(NULL, 0, (LPTHREAD_START_ROUTINE)func, arg, 0,
+                         NULL));
+}
+
+
+/*
+ * '_ppdThreadWait()' - Wait for a thread to exit.
+ */
+
+void *					/* O - Return value */
+_ppdThreadWait(_ppd_thread_t thread)	/* I - Thread ID */
+{
+  HANDLE	th = (HANDLE)thread;	/* Thread handle */
+
+
+  WaitForSingleObject(th, INFINITE);
+  CloseHandle(th);
+
+  return (NULL);
+}
+
+
 #else /* No threading */
 
 
@@ -138,4 +205,35 @@ _ppdMutexUnlock(_ppd_mutex_t *mutex)	/* I - Mutex */
 }
 
 
+/*
+ * '_ppdThreadCreate()' - Create a thread.
+ *
+ * Always fails, so callers do the work themselves.
+ */
+
+_ppd_thread_t				/* O - Thread ID or 0 on failure */
+_ppdThreadCreate(
+    _ppd_thread_func_t func,		/* I - Entry point */
+    void               *arg)		/* I - Entry point context */
+{
+  (void)func;
+  (void)arg;
+
+  return (0);
+}
+
+
+/*
+ * '_ppdThreadWait()' - Wait for a thread to exit.
+ */
+
+void *					/* O - Return value */
+_ppdThreadWait(_ppd_thread_t thread)	/* I - Thread ID */
+{
+  (void)thread;
+
+  return ((void *)0);
+}
+
+
 #endif /* HAVE_PTHREAD_H */
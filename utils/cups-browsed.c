@@ -36,9 +36,13 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/time.h>
 #include <signal.h>
 #include <regex.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdatomic.h>
 
 #include <glib.h>
 
@@ -142,6 +146,37 @@ static int  ldap_rebind_proc(LDAP *RebindLDAPHandle,
 #define TIMEOUT_REMOVE      -1
 #define TIMEOUT_CHECK_LIST   2
 
+/* The list of local CUPS queues gets updated by the printer events of
+   CUPS, and read completely only every this many seconds, as a
+   consistency check */
+#define LOCAL_PRINTERS_RESYNC_INTERVAL 3600
+
+/* Printer events of CUPS which we have seen for a local queue, if
+   there are several, the most significant one counts */
+#define LOCAL_PRINTER_EVENT_STATE    1
+#define LOCAL_PRINTER_EVENT_CHANGED  2
+#define LOCAL_PRINTER_EVENT_DELETED  3
+
+/* Cached printer attributes are used without asking the printer for
+   this time (in sec), afterwards only when printer-config-change-time
+   did not change. Entries older than PRINTER_ATTRS_CACHE_MAX_AGE are
+   dropped when loading and saving the cache file, and the oldest
+   entries get dropped when all together are larger than
+   PRINTER_ATTRS_CACHE_MAX_SIZE (bytes of IPP data) */
+#define PRINTER_ATTRS_CACHE_FRESH     60
+#define PRINTER_ATTRS_CACHE_MAX_AGE   (7 * 24 * 60 * 60)
+#define PRINTER_ATTRS_CACHE_MAX_SIZE  (16 * 1024 * 1024)
+
+/* Load model of the cluster members (LoadBalancing QueueOnServers):
+   Weight of a new measurement in the moving averages, time per job
+   and pages per job assumed as long as we have no measurements, and
+   time after which we forget about a job which we never saw
+   finishing (all in sec) */
+#define LOAD_MODEL_WEIGHT        0.3
+#define LOAD_MODEL_JOB_TIME      60.0
+#define LOAD_MODEL_PAGES_PER_JOB 5
+#define LOAD_MODEL_JOB_MAX_AGE   (24 * 60 * 60)
+
 #define CUPS_DBUS_NAME "org.cups.cupsd.Notifier"
 #define CUPS_DBUS_PATH "/org/cups/cupsd/Notifier"
 #define CUPS_DBUS_INTERFACE "org.cups.cupsd.Notifier"
@@ -151,6 +186,13 @@ static int  ldap_rebind_proc(LDAP *RebindLDAPHandle,
 #define LOCAL_DEFAULT_PRINTER_FILE "/cups-browsed-local-default-printer"
 #define REMOTE_DEFAULT_PRINTER_FILE "/cups-browsed-remote-default-printer"
 #define SAVE_OPTIONS_FILE "/cups-browsed-options-%s"
+#define PRINTER_ATTRS_CACHE_FILE "/cups-browsed-printer-attributes"
+#define REMOTE_PRINTERS_FILE "/cups-browsed-printers"
+#define REMOTE_PRINTERS_FILE_VERSION 1
+#define CREATE_QUEUE_STATS_FILE "/cups-browsed-queue-creation"
+#define CREATE_QUEUE_STATS_INTERVAL 10 /* Rewrite stats file at most every
+					  10 sec */
+#define CREATE_QUEUE_WAIT_WARN 60      /* Warn when a job waited longer */
 #define DEBUG_LOG_FILE "/cups-browsed_log"
 #define DEBUG_LOG_FILE_2 "/cups-browsed_previous_logs"
 
@@ -204,8 +246,67 @@ typedef struct remote_printer_s {
   int timeouted;
   pthread_rwlock_t lock;
   int called;
+  unsigned long seq; /* Position in remote_printers, for sorting the lists
+			in the indexes in the same order */
+  char *profile; /* Fingerprint of the capabilities, see printer_profile() */
+  char *merge_key; /* Status and profile, see printer_merge_key() */
+  /* Load model, see load_model_select() */
+  time_t load_updated; /* Time of last poll, 0: No valid data */
+  ipp_pstate_t load_state;
+  int load_accepting;
+  int load_jobs; /* Jobs on the server, printing and waiting */
+  int load_impressions; /* printer-impressions-completed at last poll */
+  double load_ppm; /* Pages per minute, moving average */
+  double load_job_time; /* Seconds per job, moving average */
+  int load_job_count; /* Jobs measured for load_job_time */
+  int restored; /* Queue kept from the previous session without
+		   re-creating it, see restore_remote_printers() */
 } remote_printer_t;
 
+/* Remote printer as saved by save_remote_printers() */
+typedef struct remote_printer_rec_s {
+  char *queue_name;
+  char *uri;
+  char *host;
+  char *ip;
+  int port;
+  char *resource;
+  char *service_name;
+  char *type;
+  char *domain;
+  char *location;
+  char *info;
+  char *make_model;
+  char *pdl;
+  int color;
+  int duplex;
+  int netprinter;
+  cups_array_t *ipp_discoveries;
+  char *profile; /* printer_profile() when saved */
+  int restored; /* Used by restore_remote_printers() */
+} remote_printer_rec_t;
+
+/* Job which we have sent to a cluster member, for the load model */
+typedef struct load_job_s {
+  char *uri;
+  time_t started;
+  int ahead; /* Jobs which were on the server before */
+} load_job_t;
+
+/* Result of polling a cluster member, for the load model */
+typedef struct load_poll_s {
+  char *uri;
+  char *host;
+  int port;
+  time_t time;
+  int ok;
+  ipp_pstate_t state;
+  int accepting;
+  int jobs;
+  int ppm;
+  int impressions;
+} load_poll_t;
+
 /* Data structure for network interfaces */
 typedef struct netif_s {
   char *address;
@@ -376,7 +477,6 @@ typedef struct pagesize_count_s{
 }pagesize_count_t;
 
 typedef struct resolver_args_s{
-  AvahiServiceResolver *r;
   AvahiIfIndex interface;
   AvahiProtocol protocol;
   AvahiResolverEvent event;
@@ -389,14 +489,107 @@ typedef struct resolver_args_s{
   AvahiStringList *txt;
   AvahiLookupResultFlags flags;
   void* userdata;
+  int error; /* Avahi error code for AVAHI_RESOLVER_FAILURE */
+  unsigned long generation; /* resolver_queue.generation when queued */
 }resolver_args_t;
 
+/* Queue of resolved DNS-SD services: Events for the same service
+   arriving within DNSSDEventDelay msec are coalesced and then handed
+   over as a batch to a worker thread, see resolver_wrapper() */
+typedef struct resolver_queue_s {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GHashTable *pending;     /* resolver_args_t by service key */
+  cups_array_t *order;     /* Pending events in order of arrival */
+  guint timer_id;
+  cups_array_t *batches;   /* Batches waiting for the worker */
+  unsigned long generation; /* Number of REMOVE events so far */
+  GHashTable *removed;     /* Service key -> generation of its last
+			      REMOVE, while batches handed over before
+			      it are not processed yet */
+  pthread_t thread;
+  int running;
+  int stopping;
+  unsigned long received;  /* Events from Avahi */
+  unsigned long coalesced; /* Replaced by a later event for the service */
+  unsigned long dropped;   /* Service removed before processing */
+  unsigned long processed;
+  unsigned long batches_done;
+} resolver_queue_t;
+
+/* Per cluster: members to look at for merging the attributes and the
+   last merge result, see cluster_merge_refresh() */
+typedef struct cluster_merge_s {
+  GHashTable *profile_refs; /* Member key -> number of members with it,
+			       keys owned by the members */
+  cups_array_t *reps;       /* First member with each key, in member order */
+  GString *reps_key;        /* Keys of reps, in this order */
+  char *key;                /* reps_key of the result below */
+  ipp_t *attrs;
+  cups_array_t *conflicts;
+  cups_array_t *sizes;
+  char default_pagesize[41];
+  const char *default_color;
+} cluster_merge_t;
+
+/* Entry of the printer attribute cache */
+typedef struct printer_attrs_cache_s {
+  ipp_t *attrs;
+  int config_change_time;  /* printer-config-change-time of attrs, -1 if
+			      the printer does not support it */
+  time_t fetched;          /* Last fetched or validated */
+  int loaded;              /* From the cache file, not validated yet */
+  size_t size;             /* ippLength() of attrs */
+} printer_attrs_cache_t;
+
 typedef struct create_args_s {
+  remote_printer_t *printer; /* Stays allocated while printer->called is set */
   char* queue;
   char* uri;
+  struct timeval queued;
+  int timeout_reached;       /* Set by http_timeout_cb() while this job
+				uses the local CUPS connection */
 } create_args_t;
 
+/* Fixed set of worker threads which create/update the CUPS queues
+   (create_queue()), fed by update_cups_queues() */
+typedef struct create_queue_pool_s {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  cups_array_t *jobs;       /* Waiting create_args_t, first in, first out */
+  pthread_t *threads;
+  int num_threads;
+  int stopping;
+  /* Statistics, logged by log_create_queue_pool() */
+  int busy;                 /* Workers currently in create_queue() */
+  int max_depth;            /* Highest number of waiting jobs */
+  unsigned long done;       /* Jobs finished */
+  double total_wait, max_wait; /* Time between queuing and start (sec) */
+  double total_run, max_run;   /* Time spent in create_queue() (sec) */
+  double last_wait, last_run;  /* Of the last finished job (sec) */
+  unsigned long slow;       /* Jobs waiting longer than
+			       CREATE_QUEUE_WAIT_WARN */
+  time_t stats_saved;       /* Last save_create_queue_pool_stats() */
+} create_queue_pool_t;
+
 cups_array_t *remote_printers;
+/* Indexes on remote_printers, see remote_printer_add() */
+static GHashTable *remote_printers_by_queue = NULL;
+static GHashTable *remote_printers_by_uri = NULL;
+static GHashTable *remote_printers_by_service = NULL;
+static GHashTable *remote_printers_by_host = NULL;
+/* Full printer attributes by printer URI, see
+   get_printer_attributes_cached() */
+static GHashTable *printer_attrs_cache = NULL;
+static int printer_attrs_cache_changed = 0;
+static size_t printer_attrs_cache_size = 0; /* Sum of the entries' size */
+/* Remote printers of the previous session, cups_array_t of
+   remote_printer_rec_t by queue name, see load_remote_printers() */
+static GHashTable *saved_remote_printers = NULL;
+static int remote_printers_changed = 0;
+/* cluster_merge_t by queue name */
+static GHashTable *cluster_merges = NULL;
+static unsigned long remote_printers_seq = 0;
 static char *alt_config_file = NULL;
 static cups_array_t *command_line_config;
 static cups_array_t *netifs;
@@ -410,6 +603,7 @@ static cups_array_t *browsefilter;
 static GHashTable *local_printers;
 static GHashTable *cups_supported_remote_printers;
 static browsepoll_t *local_printers_context = NULL;
+static time_t local_printers_resync_time = 0;
 static http_t *local_conn = NULL;
 static gboolean inhibit_local_printers_update = FALSE;
 
@@ -423,6 +617,10 @@ static AvahiGLibPoll *glib_poll = NULL;
 static AvahiClient *client = NULL;
 static AvahiServiceBrowser *sb1 = NULL, *sb2 = NULL;
 static int avahi_present = 0;
+static unsigned int DNSSDEventDelay = 500;
+static resolver_queue_t resolver_queue = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
 #endif /* HAVE_AVAHI */
 #ifdef HAVE_LDAP
 static const char * const ldap_attrs[] =/* CUPS LDAP attributes */
@@ -497,6 +695,13 @@ static load_balancing_type_t LoadBalancingType = QUEUE_ON_CLIENT;
 static char *DefaultOptions = NULL;
 static int update_cups_queues_max_per_call = 10;
 static int pause_between_cups_queue_updates = 1;
+static int CreateQueueThreads = 4;
+static int LoadPollInterval = 30;
+static int load_poll_running = 0;
+static GHashTable *load_model_jobs = NULL; /* load_job_t by job ID */
+static create_queue_pool_t create_queue_pool = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
 static remote_printer_t *deleted_master = NULL;
 static int terminating = 0; /* received SIGTERM, ignore callbacks,
              break loops */
@@ -517,12 +722,44 @@ static int FrequentNetifUpdate = 0;
 static int debug_stderr = 0;
 static int debug_logfile = 0;
 static FILE *lfp = NULL;
+static long lfp_size = 0;
+
+/* Debug log message, see debug_printf() */
+typedef struct log_msg_s {
+  struct log_msg_s * _Atomic next;
+  size_t len;
+  char text[1];
+} log_msg_t;
+
+/* Writer thread for the debug log with its lock-free queue (multiple
+   producers, single consumer): Producers append at head, the writer
+   takes the messages from tail */
+typedef struct log_writer_s {
+  log_msg_t * _Atomic head;
+  log_msg_t *tail;
+  log_msg_t stub;
+  sem_t wakeup;
+  pthread_t thread;
+  atomic_int running;
+  atomic_int stopping;
+  atomic_int pushing;     /* Producers between checking running and
+			     having appended their message */
+} log_writer_t;
+
+static log_writer_t log_writer;
+
+/* Per-thread buffer for formatting debug log messages */
+#define LOG_LINE_SIZE 4096
+static __thread char log_line[LOG_LINE_SIZE];
 
 static char cachedir[1024];
 static char logdir[1024];
 static char local_default_printer_file[2048];
 static char remote_default_printer_file[2048];
 static char save_options_file[2048];
+static char printer_attrs_cache_file[2048];
+static char remote_printers_file[2048];
+static char create_queue_stats_file[2048];
 static char debug_log_file[2048];
 static char debug_log_file_bckp[2048];
 
@@ -547,9 +784,6 @@ static char* ppd_keywords[] =
       "print-scaling",
     };
 
-/* Static global variable for indicating we have reached the HTTP timeout */
-static int timeout_reached = 0;
-
 /* read-write locks */
 pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
 pthread_rwlock_t loglock = PTHREAD_RWLOCK_INITIALIZER;
@@ -557,13 +791,27 @@ pthread_rwlock_t loglock = PTHREAD_RWLOCK_INITIALIZER;
 pthread_rwlock_t resolvelock = PTHREAD_RWLOCK_INITIALIZER;
 pthread_rwlock_t netiflock = PTHREAD_RWLOCK_INITIALIZER;
 pthread_rwlock_t update_lock = PTHREAD_RWLOCK_INITIALIZER;
+/* cfResolveURI() redirects stderr and unsets DEVICE_URI, which is
+   process-wide state, so only one thread may resolve a URI at a time */
+pthread_mutex_t resolveurilock = PTHREAD_MUTEX_INITIALIZER;
+pthread_rwlock_t attrcachelock = PTHREAD_RWLOCK_INITIALIZER;
 
 
 static void recheck_timer (void);
+static void log_create_queue_pool (void);
+#ifdef HAVE_AVAHI
+static void log_resolver_queue (void);
+#endif /* HAVE_AVAHI */
+static void cluster_merge_free (gpointer data);
+cups_array_t *cluster_members (const char *queue_name);
+void remote_printers_check_index (int check_masters);
+cups_array_t *remote_printers_with_uri (const char *uri);
+static void save_remote_printers (void);
 static void browse_poll_create_subscription (browsepoll_t *context,
 					     http_t *conn);
 static gboolean browse_poll_get_notifications (browsepoll_t *context,
-					       http_t *conn);
+					       http_t *conn,
+					       GHashTable *events);
 static remote_printer_t
 *examine_discovered_printer_record(const char *host,
 				   const char *ip,
@@ -731,108 +979,1132 @@ start_debug_logging()
       debug_log_file);
     exit(1);
   }
+  fseek(lfp, 0L, SEEK_END);
+  lfp_size = ftell(lfp);
 }
 
 void
 stop_debug_logging()
 {
+  pthread_rwlock_wrlock(&loglock);
   debug_logfile = 0;
   if (lfp)
     fclose(lfp);
   lfp = NULL;
+  pthread_rwlock_unlock(&loglock);
+}
+
+/* Write a formatted message to the log destinations. When the log file
+   gets larger than DebugLogFileSize KB it is renamed to the backup file
+   (replacing the previous one) and a new log file is started */
+static void
+log_write(const char *text, size_t len, int flush) {
+  pthread_rwlock_wrlock(&loglock);
+  if (debug_stderr) {
+    fwrite(text, 1, len, stderr);
+    if (flush)
+      fflush(stderr);
+  }
+  if (debug_logfile && lfp) {
+    fwrite(text, 1, len, lfp);
+    if (flush)
+      fflush(lfp);
+    lfp_size += len;
+    if (DebugLogFileSize > 0 &&
+	lfp_size > (long int)DebugLogFileSize * 1024) {
+      fclose(lfp);
+      rename(debug_log_file, debug_log_file_bckp);
+      lfp = fopen(debug_log_file, "w");
+      lfp_size = 0;
+    }
+  }
+  pthread_rwlock_unlock(&loglock);
 }
 
-// returns the size of debug log file
-long int findLogFileSize() 
-{ 
-    FILE* fp = fopen(debug_log_file, "r"); 
-    if (fp == NULL) { 
-        return -1; 
-    } 
-    fseek(fp, 0L, SEEK_END); 
-    long int res = ftell(fp); 
-    fclose(fp); 
-    return res; 
-}
-
-void copyToFile(FILE **fp1, FILE **fp2){
-  int buffer_size = 2048;
-  char *buf = (char*) malloc(sizeof(char)*buffer_size);
-  if(!buf){
-    fprintf(stderr,"Error creating buffer for debug logging\n");
+static void
+log_flush(void) {
+  pthread_rwlock_wrlock(&loglock);
+  if (debug_stderr)
+    fflush(stderr);
+  if (debug_logfile && lfp)
+    fflush(lfp);
+  pthread_rwlock_unlock(&loglock);
+}
+
+static void
+log_push(log_msg_t *m) {
+  log_msg_t *prev;
+
+  atomic_store(&m->next, NULL);
+  prev = atomic_exchange(&log_writer.head, m);
+  atomic_store(&prev->next, m);
+}
+
+/* Take the oldest message from the queue, NULL if it is empty or a
+   producer is just in the middle of appending (its wakeup will follow) */
+static log_msg_t *
+log_pop(void) {
+  log_writer_t *w = &log_writer;
+  log_msg_t *tail = w->tail, *next = atomic_load(&tail->next);
+
+  if (tail == &w->stub) {
+    if (next == NULL)
+      return NULL;
+    w->tail = tail = next;
+    next = atomic_load(&tail->next);
+  }
+  if (next) {
+    w->tail = next;
+    return tail;
+  }
+  if (tail != atomic_load(&w->head))
+    return NULL;
+  log_push(&w->stub);
+  if ((next = atomic_load(&tail->next)) != NULL) {
+    w->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+static int
+log_drain(void) {
+  log_msg_t *m;
+  int n = 0;
+
+  while ((m = log_pop()) != NULL) {
+    log_write(m->text, m->len, 0);
+    free(m);
+    n ++;
+  }
+  if (n)
+    log_flush();
+  return n;
+}
+
+static void *
+log_writer_thread(void *unused) {
+  log_writer_t *w = &log_writer;
+
+  for (;;) {
+    while (sem_wait(&w->wakeup) && errno == EINTR);
+    log_drain();
+    if (atomic_load(&w->stopping))
+      break;
+  }
+  return NULL;
+}
+
+/* Stop the writer thread after it has written all messages, messages
+   get written directly afterwards */
+static void
+log_writer_stop(void) {
+  log_writer_t *w = &log_writer;
+
+  if (!atomic_load(&w->running))
+    return;
+  atomic_store(&w->running, 0);
+  /* Producers which have seen running set still append to the queue,
+     the ones coming later write directly */
+  while (atomic_load(&w->pushing) > 0)
+    sched_yield();
+  atomic_store(&w->stopping, 1);
+  sem_post(&w->wakeup);
+  pthread_join(w->thread, NULL);
+  /* No append is in progress now, so log_pop() only returns NULL when
+     the queue is really empty */
+  while (log_drain() ||
+	 w->tail != &w->stub || atomic_load(&w->head) != &w->stub);
+}
+
+/* Start the writer thread, so that threads do not need to wait for
+   each other (and for the disk) when writing debug log messages */
+static void
+log_writer_start(void) {
+  log_writer_t *w = &log_writer;
+
+  atomic_store(&w->stub.next, NULL);
+  atomic_store(&w->head, &w->stub);
+  w->tail = &w->stub;
+  if (sem_init(&w->wakeup, 0, 0))
+    return;
+  atomic_store(&w->stopping, 0);
+  atomic_store(&w->running, 1);
+  if (pthread_create(&w->thread, NULL, log_writer_thread, NULL)) {
+    atomic_store(&w->running, 0);
+    sem_destroy(&w->wakeup);
     return;
   }
-  fseek(*fp1, 0, SEEK_SET);
-  size_t r;
-  do {
-    r = fread(buf, sizeof(char), buffer_size, *fp1);
-    fwrite(buf, sizeof(char), r, *fp2);
-  } while(r==buffer_size);
+  /* Do not lose the last messages when exiting with exit() */
+  atexit(log_writer_stop);
+}
 
+/* Format prefix and message into a log message and hand it over to the
+   writer thread, or write it directly if there is none */
+static void
+log_submit(const char *prefix, const char *format, va_list arglist) {
+  va_list ap;
+  size_t plen = strlen(prefix);
+  int len;
+  log_msg_t *m;
+
+  va_copy(ap, arglist);
+  snprintf(log_line, sizeof(log_line), "%s", prefix);
+  len = vsnprintf(log_line + plen, sizeof(log_line) - plen, format, ap);
+  va_end(ap);
+  if (len < 0)
+    return;
+  if (!atomic_load(&log_writer.running)) {
+    if (plen + len < sizeof(log_line)) {
+      log_write(log_line, plen + len, 1);
+      return;
+    }
+  }
+  if ((m = (log_msg_t *)malloc(sizeof(log_msg_t) + plen + len)) == NULL)
+    return;
+  m->len = plen + len;
+  if (m->len < sizeof(log_line))
+    memcpy(m->text, log_line, m->len + 1);
+  else {
+    /* Too long for the buffer, format again */
+    memcpy(m->text, prefix, plen);
+    va_copy(ap, arglist);
+    vsnprintf(m->text + plen, len + 1, format, ap);
+    va_end(ap);
+  }
+  /* Announce the append before checking running, so that
+     log_writer_stop() waits for it */
+  atomic_fetch_add(&log_writer.pushing, 1);
+  if (atomic_load(&log_writer.running)) {
+    log_push(m);
+    sem_post(&log_writer.wakeup);
+    atomic_fetch_sub(&log_writer.pushing, 1);
+  } else {
+    atomic_fetch_sub(&log_writer.pushing, 1);
+    log_write(m->text, m->len, 1);
+    free(m);
+  }
+}
+
+static void
+log_submit_printf(const char *prefix, const char *format, ...) {
+  va_list arglist;
+
+  va_start(arglist, format);
+  log_submit(prefix, format, arglist);
+  va_end(arglist);
+}
+
+static void
+log_time(char *buf) {
+  time_t curtime = time(NULL);
+
+  ctime_r(&curtime, buf);
+  while(isspace(buf[strlen(buf)-1])) buf[strlen(buf)-1] = '\0';
 }
 
 void
 debug_printf(const char *format, ...) {
-  pthread_rwlock_wrlock(&loglock);
   if (debug_stderr || debug_logfile) {
-    time_t curtime = time(NULL);
-    char buf[64];
-    ctime_r(&curtime, buf);
-    while(isspace(buf[strlen(buf)-1])) buf[strlen(buf)-1] = '\0';
+    char buf[64], prefix[96];
     va_list arglist;
-    if (debug_stderr) {
-      va_start(arglist, format);
-      fprintf(stderr, "%s ", buf);
-      fprintf(stderr, "%ld ", pthread_self());
-      vfprintf(stderr, format, arglist);
-      fflush(stderr);
-      va_end(arglist);
-    }
-    if (debug_logfile && lfp) {
-      va_start(arglist, format);
-      fprintf(lfp, "%s ", buf);
-      fprintf(lfp, "%ld ", pthread_self());
-      vfprintf(lfp, format, arglist);
-      fflush(lfp);
-      va_end(arglist);
-    }
-
-    long int log_file_size = findLogFileSize(); 
-    if(DebugLogFileSize>0 && log_file_size>(long int)DebugLogFileSize*1024){
-      fclose(lfp);
-      FILE *fp1 = fopen(debug_log_file, "r");
-      FILE *fp2 = fopen(debug_log_file_bckp, "w");
-      copyToFile(&fp1,&fp2);
-      fclose(fp1);
-      fclose(fp2);
-      lfp = fopen(debug_log_file, "w");
-    }
+    log_time(buf);
+    snprintf(prefix, sizeof(prefix), "%s %ld ", buf, pthread_self());
+    va_start(arglist, format);
+    log_submit(prefix, format, arglist);
+    va_end(arglist);
   }
-  pthread_rwlock_unlock(&loglock);
 }
 
 void
 debug_log_out(char *log) {
-  pthread_rwlock_wrlock(&loglock);
   if (debug_stderr || debug_logfile) {
-    time_t curtime = time(NULL);
     char buf[64];
     char *ptr1, *ptr2;
-    ctime_r(&curtime, buf);
-    while(isspace(buf[strlen(buf)-1])) buf[strlen(buf)-1] = '\0';
+    log_time(buf);
+    strcat(buf, " ");
     ptr1 = log;
     while(ptr1) {
       ptr2 = strchr(ptr1, '\n');
       if (ptr2) *ptr2 = '\0';
-      if (debug_stderr)
-	fprintf(stderr, "%s %s\n", buf, ptr1);
-      if (debug_logfile && lfp)
-	fprintf(lfp, "%s %s\n", buf, ptr1);
+      log_submit_printf(buf, "%s\n", ptr1);
       if (ptr2) *ptr2 = '\n';
       ptr1 = ptr2 ? (ptr2 + 1) : NULL;
     }
   }
-  pthread_rwlock_unlock(&loglock);
+}
+
+/* Wrapper for cfGetPrinterAttributes2() which can be called from any
+   thread, with or without holding the global lock. Only the URI
+   resolution is serialized, the IPP request itself runs in parallel,
+   logging into a buffer of its own */
+static ipp_t *
+get_printer_attributes(http_t *http_printer,
+		       const char *raw_uri,
+		       const char * const pattrs[],
+		       int pattrs_size,
+		       const char * const req_attrs[],
+		       int req_attrs_size,
+		       int debug)
+{
+  ipp_t *response;
+  char *uri, *log;
+
+  pthread_mutex_lock(&resolveurilock);
+  uri = cfResolveURI(raw_uri);
+  pthread_mutex_unlock(&resolveurilock);
+  if (uri == NULL) {
+    debug_printf("get-printer-attibutes: Cannot resolve URI: %s\n", raw_uri);
+    return NULL;
+  }
+
+  if ((log = malloc(CF_GET_PRINTER_ATTRIBUTES_LOGSIZE)) == NULL) {
+    debug_printf("get-printer-attributes: Out of memory for the log of %s\n",
+		 uri);
+    free(uri);
+    return NULL;
+  }
+
+  /* The URI is resolved already, so cfResolveURI() is not called again */
+  response = cfGetPrinterAttributes6(http_printer, uri,
+				     pattrs, pattrs_size,
+				     req_attrs, req_attrs_size, debug, NULL,
+				     log, CF_GET_PRINTER_ATTRIBUTES_LOGSIZE);
+  debug_log_out(log);
+  free(log);
+  free(uri);
+
+  return response;
+}
+
+
+/*
+ * Cache of the full printer attributes ("all" and "media-col-database")
+ *
+ * These responses can be several hundreds of KB and the same printer
+ * gets polled several times when it appears, when it gets a cluster
+ * member, and when its queue gets (re-)created. So we keep the last
+ * response per printer URI. Within PRINTER_ATTRS_CACHE_FRESH seconds
+ * after fetching it is used as it is, later we only ask the printer for
+ * its printer-config-change-time and fetch everything again only if
+ * this has changed (or if the printer does not support it).
+ * printer-state-change-time is not used, as it changes with every job.
+ *
+ * The cache is saved in the cache directory on shutdown, so that after
+ * a restart the printers only need to get asked for their
+ * printer-config-change-time.
+ *
+ * An entry is dropped when the last remote printer with its URI gets
+ * removed (not on shutdown, so that it gets saved), when it is older
+ * than PRINTER_ATTRS_CACHE_MAX_AGE, or, oldest first, when the cache
+ * exceeds PRINTER_ATTRS_CACHE_MAX_SIZE.
+ */
+
+static void
+printer_attrs_cache_free(gpointer data) {
+  printer_attrs_cache_t *entry = (printer_attrs_cache_t *)data;
+
+  ippDelete(entry->attrs);
+  free(entry);
+}
+
+static int
+printer_attrs_config_change_time(ipp_t *attrs) {
+  ipp_attribute_t *attr;
+
+  if ((attr = ippFindAttribute(attrs, "printer-config-change-time",
+			       IPP_TAG_INTEGER)) != NULL)
+    return ippGetInteger(attr, 0);
+  return -1;
+}
+
+static ipp_t *
+printer_attrs_copy(ipp_t *attrs) {
+  ipp_t *copy = ippNew();
+
+  ippCopyAttributes(copy, attrs, 0, NULL, NULL);
+  return copy;
+}
+
+/* Drop the entry of uri, the caller must hold attrcachelock */
+static void
+printer_attrs_cache_drop(const char *uri) {
+  printer_attrs_cache_t *entry;
+
+  if ((entry = (printer_attrs_cache_t *)
+       g_hash_table_lookup(printer_attrs_cache, uri)) == NULL)
+    return;
+  printer_attrs_cache_size -= entry->size;
+  g_hash_table_remove(printer_attrs_cache, uri);
+  printer_attrs_cache_changed = 1;
+}
+
+/* Drop entries older than PRINTER_ATTRS_CACHE_MAX_AGE and then the
+   oldest ones until the cache is not larger than
+   PRINTER_ATTRS_CACHE_MAX_SIZE, keeping the entry of keep_uri. The
+   caller must hold attrcachelock */
+static void
+printer_attrs_cache_prune(const char *keep_uri) {
+  GHashTableIter iter;
+  gpointer key, value;
+  printer_attrs_cache_t *entry;
+  const char *oldest_uri;
+  time_t oldest, now = time(NULL);
+
+  g_hash_table_iter_init(&iter, printer_attrs_cache);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    entry = (printer_attrs_cache_t *)value;
+    if (now - entry->fetched > PRINTER_ATTRS_CACHE_MAX_AGE &&
+	(keep_uri == NULL || strcmp((char *)key, keep_uri))) {
+      debug_printf("Dropping outdated cached attributes of printer %s.\n",
+		   (char *)key);
+      printer_attrs_cache_size -= entry->size;
+      g_hash_table_iter_remove(&iter);
+      printer_attrs_cache_changed = 1;
+    }
+  }
+
+  while (printer_attrs_cache_size > PRINTER_ATTRS_CACHE_MAX_SIZE) {
+    oldest_uri = NULL;
+    oldest = 0;
+    g_hash_table_iter_init(&iter, printer_attrs_cache);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      entry = (printer_attrs_cache_t *)value;
+      if ((keep_uri == NULL || strcmp((char *)key, keep_uri)) &&
+	  (oldest_uri == NULL || entry->fetched < oldest)) {
+	oldest_uri = (const char *)key;
+	oldest = entry->fetched;
+      }
+    }
+    if (oldest_uri == NULL)
+      break;
+    debug_printf("Printer attribute cache full, dropping cached attributes of printer %s.\n",
+		 oldest_uri);
+    printer_attrs_cache_drop(oldest_uri);
+  }
+}
+
+/* Put attrs into the cache (the cache takes them over), the caller
+   must hold attrcachelock */
+static void
+printer_attrs_cache_put(const char *uri, ipp_t *attrs, int config_change_time,
+			time_t fetched, int loaded) {
+  printer_attrs_cache_t *entry;
+
+  if ((entry = (printer_attrs_cache_t *)
+       calloc(1, sizeof(printer_attrs_cache_t))) == NULL) {
+    ippDelete(attrs);
+    return;
+  }
+  entry->attrs = attrs;
+  entry->config_change_time = config_change_time;
+  entry->fetched = fetched;
+  entry->loaded = loaded;
+  entry->size = ippLength(attrs);
+  printer_attrs_cache_drop(uri);
+  g_hash_table_insert(printer_attrs_cache, g_strdup(uri), entry);
+  printer_attrs_cache_size += entry->size;
+  printer_attrs_cache_prune(uri);
+}
+
+static void
+printer_attrs_cache_init(void) {
+  printer_attrs_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+					      g_free,
+					      printer_attrs_cache_free);
+}
+
+/* Called when the last remote printer with the given URI is gone */
+static void
+printer_attrs_cache_remove(const char *uri) {
+  pthread_rwlock_wrlock(&attrcachelock);
+  printer_attrs_cache_drop(uri);
+  pthread_rwlock_unlock(&attrcachelock);
+}
+
+/* Get the full attributes of the printer with the given URI, from the
+   cache if they are still valid. Returns a new ipp_t which the caller
+   has to free, or NULL if the printer did not answer */
+static ipp_t *
+get_printer_attributes_cached(const char *uri) {
+  printer_attrs_cache_t *entry;
+  ipp_t *response, *check;
+  int config_change_time = -1, new_config_change_time;
+  time_t fetched = 0, now = time(NULL);
+  static const char * const pattrs_check[] = {
+    "printer-config-change-time"
+  };
+
+  pthread_rwlock_rdlock(&attrcachelock);
+  if ((entry = (printer_attrs_cache_t *)
+       g_hash_table_lookup(printer_attrs_cache, uri)) != NULL) {
+    config_change_time = entry->config_change_time;
+    fetched = entry->fetched;
+    if (!entry->loaded && now - fetched < PRINTER_ATTRS_CACHE_FRESH) {
+      response = printer_attrs_copy(entry->attrs);
+      pthread_rwlock_unlock(&attrcachelock);
+      debug_printf("Using cached attributes of printer %s (%ld sec old).\n",
+		   uri, (long)(now - fetched));
+      return response;
+    }
+  }
+  pthread_rwlock_unlock(&attrcachelock);
+
+  if (entry && config_change_time >= 0) {
+    /* Cheap request to see whether the printer's configuration has
+       changed */
+    check = get_printer_attributes(NULL, uri, pattrs_check, 1, NULL, 0, 0);
+    if (check == NULL) {
+      debug_printf("Printer %s did not answer, not using its cached attributes.\n",
+		   uri);
+      return NULL;
+    }
+    new_config_change_time = printer_attrs_config_change_time(check);
+    ippDelete(check);
+    if (new_config_change_time == config_change_time) {
+      response = NULL;
+      pthread_rwlock_wrlock(&attrcachelock);
+      if ((entry = (printer_attrs_cache_t *)
+	   g_hash_table_lookup(printer_attrs_cache, uri)) != NULL &&
+	  entry->config_change_time == config_change_time) {
+	entry->fetched = now;
+	entry->loaded = 0;
+	printer_attrs_cache_changed = 1;
+	response = printer_attrs_copy(entry->attrs);
+      }
+      pthread_rwlock_unlock(&attrcachelock);
+      if (response) {
+	debug_printf("Configuration of printer %s unchanged, using cached attributes.\n",
+		     uri);
+	return response;
+      }
+    } else
+      debug_printf("Configuration of printer %s changed, re-fetching its attributes.\n",
+		   uri);
+  }
+
+  if ((response = get_printer_attributes(NULL, uri, NULL, 0, NULL, 0, 1)) ==
+      NULL)
+    return NULL;
+
+  pthread_rwlock_wrlock(&attrcachelock);
+  printer_attrs_cache_put(uri, printer_attrs_copy(response),
+			  printer_attrs_config_change_time(response),
+			  time(NULL), 0);
+  printer_attrs_cache_changed = 1;
+  pthread_rwlock_unlock(&attrcachelock);
+
+  return response;
+}
+
+/* Copy of the cached attributes of the printer with the given URI,
+   without asking the printer, NULL if there are none */
+static ipp_t *
+printer_attrs_cache_lookup(const char *uri) {
+  printer_attrs_cache_t *entry;
+  ipp_t *attrs = NULL;
+
+  pthread_rwlock_rdlock(&attrcachelock);
+  if ((entry = (printer_attrs_cache_t *)
+       g_hash_table_lookup(printer_attrs_cache, uri)) != NULL)
+    attrs = printer_attrs_copy(entry->attrs);
+  pthread_rwlock_unlock(&attrcachelock);
+
+  return attrs;
+}
+
+/* Load the printer attribute cache saved by save_printer_attrs_cache().
+   The file consists of records of the form
+
+   URI <printer URI>
+   ConfigChangeTime <printer-config-change-time or -1>
+   Time <time of fetching/validation>
+   IPP <length>
+   <IPP message with the attributes> */
+static void
+load_printer_attrs_cache(void) {
+  cups_file_t *fp;
+  char line[2048], uri[HTTP_MAX_URI];
+  int config_change_time = -1;
+  time_t fetched = 0, now = time(NULL);
+  long length;
+  off_t pos;
+  ipp_t *attrs;
+  int num_loaded = 0;
+
+  if ((fp = cupsFileOpen(printer_attrs_cache_file, "r")) == NULL)
+    return;
+
+  debug_printf("Loading printer attribute cache from %s\n",
+	       printer_attrs_cache_file);
+
+  uri[0] = '\0';
+  pthread_rwlock_wrlock(&attrcachelock);
+  while (cupsFileGets(fp, line, sizeof(line))) {
+    if (!strncmp(line, "URI ", 4)) {
+      strncpy(uri, line + 4, sizeof(uri) - 1);
+      uri[sizeof(uri) - 1] = '\0';
+    } else if (!strncmp(line, "ConfigChangeTime ", 17))
+      config_change_time = atoi(line + 17);
+    else if (!strncmp(line, "Time ", 5))
+      fetched = (time_t)atol(line + 5);
+    else if (!strncmp(line, "IPP ", 4)) {
+      length = atol(line + 4);
+      pos = cupsFileTell(fp);
+      attrs = ippNew();
+      if (length <= 0 || uri[0] == '\0' ||
+	  ippReadIO(fp, (ipp_iocb_t)cupsFileRead, 1, NULL, attrs) !=
+	  IPP_STATE_DATA ||
+	  cupsFileTell(fp) != pos + length) {
+	debug_printf("Printer attribute cache file %s is corrupt, ignoring the rest of it.\n",
+		     printer_attrs_cache_file);
+	ippDelete(attrs);
+	break;
+      }
+      if (now - fetched > PRINTER_ATTRS_CACHE_MAX_AGE)
+	ippDelete(attrs);
+      else {
+	/* Make the printer always get asked for its
+	   printer-config-change-time before using the loaded attributes,
+	   keep the time for expiring the entry */
+	printer_attrs_cache_put(uri, attrs, config_change_time, fetched, 1);
+	num_loaded ++;
+      }
+      uri[0] = '\0';
+      config_change_time = -1;
+      fetched = 0;
+    }
+  }
+  pthread_rwlock_unlock(&attrcachelock);
+  cupsFileClose(fp);
+
+  debug_printf("Loaded attributes of %d printers from the cache.\n",
+	       num_loaded);
+}
+
+static void
+save_printer_attrs_cache(void) {
+  cups_file_t *fp;
+  char tempfile[2048];
+  GHashTableIter iter;
+  gpointer key, value;
+  printer_attrs_cache_t *entry;
+
+  pthread_rwlock_wrlock(&attrcachelock);
+  printer_attrs_cache_prune(NULL);
+  if (!printer_attrs_cache_changed) {
+    pthread_rwlock_unlock(&attrcachelock);
+    return;
+  }
+
+  snprintf(tempfile, sizeof(tempfile), "%s.N", printer_attrs_cache_file);
+  if ((fp = cupsFileOpen(tempfile, "w")) == NULL) {
+    pthread_rwlock_unlock(&attrcachelock);
+    debug_printf("Unable to write printer attribute cache file %s: %s\n",
+		 tempfile, strerror(errno));
+    return;
+  }
+
+  g_hash_table_iter_init(&iter, printer_attrs_cache);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    entry = (printer_attrs_cache_t *)value;
+    cupsFilePrintf(fp, "URI %s\n", (char *)key);
+    cupsFilePrintf(fp, "ConfigChangeTime %d\n", entry->config_change_time);
+    cupsFilePrintf(fp, "Time %ld\n", (long)entry->fetched);
+    cupsFilePrintf(fp, "IPP %ld\n", (long)ippLength(entry->attrs));
+    ippSetState(entry->attrs, IPP_STATE_IDLE);
+    ippWriteIO(fp, (ipp_iocb_t)cupsFileWrite, 1, NULL, entry->attrs);
+  }
+  pthread_rwlock_unlock(&attrcachelock);
+
+  if (cupsFileClose(fp) || rename(tempfile, printer_attrs_cache_file)) {
+    debug_printf("Unable to write printer attribute cache file %s: %s\n",
+		 printer_attrs_cache_file, strerror(errno));
+    unlink(tempfile);
+  } else
+    debug_printf("Saved printer attribute cache to %s\n",
+		 printer_attrs_cache_file);
+}
+
+
+/*
+ * Indexes on the list of remote printers
+ *
+ * On networks with thousands of DNS-SD-advertised printers scanning the
+ * whole remote_printers list for each Avahi event, each cluster attribute
+ * merge, or each job gets expensive. Therefore we keep hash tables pointing
+ * from the queue name, the URI, the DNS-SD service name + domain, and the
+ * host name to the entries of remote_printers. The value for each key is a
+ * CUPS array of the entries with this key, in the order of remote_printers.
+ * As all printers of a cluster share the queue name, the list for a queue
+ * name is the member list of the cluster.
+ *
+ * Entries get added to and removed from remote_printers only through
+ * remote_printer_add() and remote_printer_remove(). When one of the key
+ * fields of an entry (queue_name, uri, service_name, domain, host) gets
+ * changed, remote_printer_unindex() has to be called before and
+ * remote_printer_index() after the change. The indexes are protected by
+ * the same lock as remote_printers.
+ *
+ * Queue names, service names, and host names are looked up
+ * case-insensitively. CUPS treats queue names case-insensitively, so
+ * remote printers whose names only differ in case end up on the same
+ * local queue, and join_cluster_if_needed() and
+ * examine_discovered_printer_record() always matched them
+ * case-insensitively. So they have to be one cluster, otherwise a slave
+ * could point to a master which is not among the members used for
+ * merging the cluster's attributes, and the queue would get created from
+ * the attributes of only a part of its printers. DNS-SD service names,
+ * domains, and host names are case-insensitive anyway. URIs are compared
+ * case-sensitively.
+ *
+ * When debug logging is on, remote_printers_check_index() verifies the
+ * complete indexes and the cluster masters (slave_of) of all entries
+ * whenever the list of printers gets logged. It runs through all
+ * printers, so it is not done on each change.
+ */
+
+static guint
+str_case_hash(gconstpointer key)
+{
+  const char *s;
+  guint h = 5381;
+
+  for (s = (const char *)key; *s; s ++)
+    h = (h << 5) + h + (guint)g_ascii_tolower(*s);
+  return h;
+}
+
+static gboolean
+str_case_equal(gconstpointer a, gconstpointer b)
+{
+  return (g_ascii_strcasecmp((const char *)a, (const char *)b) == 0);
+}
+
+static int
+remote_printer_seq_cmp(void *va, void *vb, void *data)
+{
+  remote_printer_t *a = (remote_printer_t *)va;
+  remote_printer_t *b = (remote_printer_t *)vb;
+
+  return (a->seq < b->seq ? -1 : (a->seq > b->seq ? 1 : 0));
+}
+
+static char *
+service_key(const char *service_name, const char *domain)
+{
+  return g_strdup_printf("%s\t%s", service_name ? service_name : "",
+			 domain ? domain : "");
+}
+
+static void
+index_add(GHashTable *index, const char *key, remote_printer_t *p)
+{
+  cups_array_t *list;
+
+  if (key == NULL)
+    return;
+  if ((list = (cups_array_t *)g_hash_table_lookup(index, key)) == NULL) {
+    list = cupsArrayNew(remote_printer_seq_cmp, NULL);
+    g_hash_table_insert(index, g_strdup(key), list);
+  }
+  cupsArrayAdd(list, p);
+}
+
+static void
+index_remove(GHashTable *index, const char *key, remote_printer_t *p)
+{
+  cups_array_t *list;
+
+  if (key == NULL ||
+      (list = (cups_array_t *)g_hash_table_lookup(index, key)) == NULL)
+    return;
+  cupsArrayRemove(list, p);
+  if (cupsArrayCount(list) == 0)
+    g_hash_table_remove(index, key);
+}
+
+static void
+remote_printers_init(void)
+{
+  remote_printers = cupsArrayNew(NULL, NULL);
+  remote_printers_by_queue =
+    g_hash_table_new_full(str_case_hash, str_case_equal, g_free,
+			  (GDestroyNotify)cupsArrayDelete);
+  remote_printers_by_uri =
+    g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+			  (GDestroyNotify)cupsArrayDelete);
+  remote_printers_by_service =
+    g_hash_table_new_full(str_case_hash, str_case_equal, g_free,
+			  (GDestroyNotify)cupsArrayDelete);
+  remote_printers_by_host =
+    g_hash_table_new_full(str_case_hash, str_case_equal, g_free,
+			  (GDestroyNotify)cupsArrayDelete);
+  cluster_merges =
+    g_hash_table_new_full(str_case_hash, str_case_equal, g_free,
+			  cluster_merge_free);
+}
+
+void
+remote_printer_index(remote_printer_t *p) {
+  char *key;
+
+  index_add(remote_printers_by_queue, p->queue_name, p);
+  index_add(remote_printers_by_uri, p->uri, p);
+  key = service_key(p->service_name, p->domain);
+  index_add(remote_printers_by_service, key, p);
+  g_free(key);
+  index_add(remote_printers_by_host, p->host, p);
+  remote_printers_changed = 1;
+}
+
+void
+remote_printer_unindex(remote_printer_t *p) {
+  char *key;
+
+  index_remove(remote_printers_by_queue, p->queue_name, p);
+  index_remove(remote_printers_by_uri, p->uri, p);
+  key = service_key(p->service_name, p->domain);
+  index_remove(remote_printers_by_service, key, p);
+  g_free(key);
+  index_remove(remote_printers_by_host, p->host, p);
+}
+
+void
+remote_printer_add(remote_printer_t *p) {
+  p->seq = remote_printers_seq ++;
+  cupsArrayAdd(remote_printers, p);
+  remote_printer_index(p);
+}
+
+void
+remote_printer_remove(remote_printer_t *p) {
+  remote_printer_unindex(p);
+  /* As with a direct cupsArrayRemove() call a loop running through
+     remote_printers with cupsArrayFirst()/cupsArrayNext() continues
+     with the element right after p */
+  cupsArrayRemove(remote_printers, p);
+  remote_printers_changed = 1;
+  /* Last printer with this URI gone, its cached attributes are not
+     needed any more, but on shutdown they get saved for the next
+     session */
+  if (!in_shutdown && p->uri && remote_printers_with_uri(p->uri) == NULL)
+    printer_attrs_cache_remove(p->uri);
+  /* Last member of the cluster gone, drop its merge state */
+  if (p->queue_name && cluster_members(p->queue_name) == NULL)
+    g_hash_table_remove(cluster_merges, p->queue_name);
+}
+
+/* Entries with the given queue name (case-insensitive), i. e. the members
+   of the cluster, NULL if there are none. Loop through the list with
+   cupsArrayIndex(), so that nested loops through the same list do not
+   interfere with each other. */
+cups_array_t *
+cluster_members(const char *queue_name) {
+  if (queue_name == NULL)
+    return NULL;
+  return (cups_array_t *)g_hash_table_lookup(remote_printers_by_queue,
+					     queue_name);
+}
+
+/*
+ * Merging the attributes of a cluster
+ *
+ * In a cluster of many printers most of the members are usually
+ * identical (e. g. 40 copiers of the same model), but the functions
+ * merging the cluster's attributes (add_*_attributes(),
+ * generate_cluster_conflicts(), ...) would look at each of them. So
+ * we give each member a fingerprint of its capabilities
+ * (printer_profile()) and the merging functions only look at the
+ * first member with each fingerprint (cluster_merge_members()). As all
+ * the merging is taking the union of the values, taking the first
+ * match, or checking whether any member supports something, the
+ * result is exactly the same as when looking at all members.
+ *
+ * The merge result is kept (get_cluster_merged_attributes()) and only
+ * re-generated when the set of distinct fingerprints changes, not when
+ * one of the identical members disappears or re-appears.
+ */
+
+/* Attributes which identify the device or describe its state, they are
+   not used for merging and so left out of the fingerprint. Prefixes. */
+static const char * const profile_ignored_attrs[] = {
+  "marker-",
+  "printer-alert",
+  "printer-config-change-",
+  "printer-current-time",
+  "printer-device-id",
+  "printer-dns-sd-name",
+  "printer-firmware-",
+  "printer-geo-location",
+  "printer-icons",
+  "printer-id",
+  "printer-impressions-completed",
+  "printer-info",
+  "printer-input-tray",
+  "printer-is-accepting-jobs",
+  "printer-location",
+  "printer-media-sheets-completed",
+  "printer-more-info",
+  "printer-name",
+  "printer-organization",
+  "printer-output-tray",
+  "printer-pages-completed",
+  "printer-serial-number",
+  "printer-state",
+  "printer-static-resource-",
+  "printer-strings-uri",
+  "printer-supply",
+  "printer-up-time",
+  "printer-uri-supported",
+  "printer-uuid",
+  "queued-job-count"
+};
+
+/* Fingerprint (SHA1) of the printer group attributes of attrs without
+   the ones in profile_ignored_attrs[], free it with g_free() */
+static char *
+attrs_profile(ipp_t *attrs) {
+  GChecksum *sum;
+  ipp_attribute_t *attr;
+  const char *name;
+  char *value, *profile;
+  size_t valuesize = 65536, len;
+  int i, num_ignored = sizeof(profile_ignored_attrs) /
+    sizeof(profile_ignored_attrs[0]);
+
+  sum = g_checksum_new(G_CHECKSUM_SHA1);
+  value = g_malloc(valuesize);
+  for (attr = ippFirstAttribute(attrs); attr;
+       attr = ippNextAttribute(attrs)) {
+    if ((name = ippGetName(attr)) == NULL ||
+	ippGetGroupTag(attr) != IPP_TAG_PRINTER)
+      continue;
+    for (i = 0; i < num_ignored; i ++)
+      if (!strncmp(name, profile_ignored_attrs[i],
+		   strlen(profile_ignored_attrs[i])))
+	break;
+    if (i < num_ignored)
+      continue;
+    /* Do not let long values (media-col-database) get truncated */
+    while ((len = ippAttributeString(attr, value, valuesize)) >=
+	   valuesize - 1) {
+      valuesize *= 4;
+      value = g_realloc(value, valuesize);
+    }
+    g_checksum_update(sum, (const guchar *)name, -1);
+    g_checksum_update(sum, (const guchar *)"=", 1);
+    g_checksum_update(sum, (const guchar *)value, len);
+    g_checksum_update(sum, (const guchar *)"\n", 1);
+  }
+  g_free(value);
+  profile = g_strdup(g_checksum_get_string(sum));
+  g_checksum_free(sum);
+
+  return profile;
+}
+
+/* Fingerprint of p->prattrs, see attrs_profile(). Computed once, as
+   p->prattrs does not change during the lifetime of an entry (except
+   in validate_restored_printers_done(), which resets p->profile and
+   p->merge_key) */
+static const char *
+printer_profile(remote_printer_t *p) {
+  if (p->profile)
+    return p->profile;
+  if (p->prattrs == NULL)
+    return "";
+  p->profile = attrs_profile(p->prattrs);
+  return p->profile;
+}
+
+/* Key under which cluster_merge_refresh() groups the members: whether
+   the merging functions skip the member ('-') or not ('+'), followed by
+   printer_profile(). Built only once the member has its attributes, a
+   status change only updates the first character */
+static const char *
+printer_merge_key(remote_printer_t *p) {
+  if (p->merge_key == NULL ||
+      (p->merge_key[1] == '\0' && p->prattrs != NULL)) {
+    g_free(p->merge_key);
+    p->merge_key = g_strdup_printf("+%s", printer_profile(p));
+  }
+  p->merge_key[0] = (p->status == STATUS_DISAPPEARED ||
+		     p->status == STATUS_UNCONFIRMED ||
+		     p->status == STATUS_TO_BE_RELEASED) ? '-' : '+';
+  return p->merge_key;
+}
+
+static void
+cluster_merge_free(gpointer data) {
+  cluster_merge_t *m = (cluster_merge_t *)data;
+
+  g_hash_table_destroy(m->profile_refs);
+  cupsArrayDelete(m->reps);
+  g_string_free(m->reps_key, TRUE);
+  g_free(m->key);
+  if (m->attrs)
+    ippDelete(m->attrs);
+  cupsArrayDelete(m->conflicts);
+  cupsArrayDelete(m->sizes);
+  free(m);
+}
+
+/* Re-determine which members of the cluster have distinct fingerprints.
+   The members which get skipped by the merging functions (status
+   check) are counted separately. The reps array is refilled in place,
+   so that it stays valid for callers which are looping through it when
+   a nested merging function calls this again */
+static cluster_merge_t *
+cluster_merge_refresh(const char *cluster_name) {
+  cluster_merge_t *m;
+  cups_array_t *members;
+  remote_printer_t *p;
+  const char *key;
+  unsigned int count;
+  int i;
+
+  if ((m = (cluster_merge_t *)g_hash_table_lookup(cluster_merges,
+						  cluster_name)) == NULL) {
+    if ((m = (cluster_merge_t *)calloc(1, sizeof(cluster_merge_t))) == NULL)
+      return NULL;
+    m->profile_refs = g_hash_table_new(g_str_hash, g_str_equal);
+    m->reps = cupsArrayNew(NULL, NULL);
+    m->reps_key = g_string_new(NULL);
+    g_hash_table_insert(cluster_merges, g_strdup(cluster_name), m);
+  }
+
+  cupsArrayClear(m->reps);
+  g_hash_table_remove_all(m->profile_refs);
+  g_string_truncate(m->reps_key, 0);
+
+  members = cluster_members(cluster_name);
+  for (i = 0; i < cupsArrayCount(members); i ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, i);
+    key = printer_merge_key(p);
+    count = GPOINTER_TO_UINT(g_hash_table_lookup(m->profile_refs, key));
+    if (count == 0) {
+      cupsArrayAdd(m->reps, p);
+      g_string_append(m->reps_key, key);
+      g_string_append_c(m->reps_key, '\n');
+    }
+    g_hash_table_insert(m->profile_refs, (gpointer)key,
+			GUINT_TO_POINTER(count + 1));
+  }
+
+  return m;
+}
+
+/* The members of the cluster which the merging functions need to look
+   at, one for each distinct fingerprint. Loop through them with
+   cupsArrayIndex() */
+cups_array_t *
+cluster_merge_members(char *cluster_name) {
+  cluster_merge_t *m;
+
+  if ((m = cluster_merge_refresh(cluster_name)) == NULL)
+    return cluster_members(cluster_name);
+  return m->reps;
+}
+
+/* Entries with the given URI, NULL if there are none */
+cups_array_t *
+remote_printers_with_uri(const char *uri) {
+  if (uri == NULL)
+    return NULL;
+  return (cups_array_t *)g_hash_table_lookup(remote_printers_by_uri, uri);
+}
+
+/* Entries with the given DNS-SD service name and domain (case-insensitive),
+   NULL if there are none */
+cups_array_t *
+remote_printers_with_service(const char *service_name, const char *domain) {
+  cups_array_t *list;
+  char *key;
+
+  key = service_key(service_name, domain);
+  list = (cups_array_t *)g_hash_table_lookup(remote_printers_by_service, key);
+  g_free(key);
+  return list;
+}
+
+/* Entries on the given host (case-insensitive), NULL if there are none */
+cups_array_t *
+remote_printers_on_host(const char *host) {
+  if (host == NULL)
+    return NULL;
+  return (cups_array_t *)g_hash_table_lookup(remote_printers_by_host, host);
+}
+
+static int
+index_check(GHashTable *index, const char *name, const char *key,
+	    remote_printer_t *p) {
+  cups_array_t *list;
+
+  if ((list = (cups_array_t *)g_hash_table_lookup(index, key)) == NULL ||
+      cupsArrayFind(list, p) != p) {
+    debug_printf("ERROR: Printer %s (%s) missing in the %s index!\n",
+		 p->queue_name, p->uri, name);
+    return 0;
+  }
+  return cupsArrayCount(list);
+}
+
+static int
+index_count(GHashTable *index) {
+  GHashTableIter iter;
+  gpointer list;
+  int count = 0;
+
+  g_hash_table_iter_init(&iter, index);
+  while (g_hash_table_iter_next(&iter, NULL, &list))
+    count += cupsArrayCount((cups_array_t *)list);
+  return count;
+}
+
+/* Verify that the indexes reflect the current state of remote_printers,
+   and with check_masters set that each cluster member's master is an
+   entry of the same cluster, only used when debug logging is on. Masters
+   which are deleted or on their way out are skipped, their slaves get
+   re-parented when they are actually removed */
+void
+remote_printers_check_index(int check_masters) {
+  remote_printer_t *p;
+  int i, count, ok = 1;
+  char *key;
+
+  count = cupsArrayCount(remote_printers);
+  for (i = 0; i < count; i ++) {
+    p = (remote_printer_t *)cupsArrayIndex(remote_printers, i);
+    if (check_masters && p->slave_of && p->slave_of != deleted_master &&
+	p->slave_of->uri && p->slave_of->status != STATUS_DISAPPEARED &&
+	p->slave_of->status != STATUS_TO_BE_RELEASED &&
+	cupsArrayFind(cluster_members(p->queue_name), p->slave_of) !=
+	p->slave_of) {
+      debug_printf("ERROR: Master of printer %s (%s) is not in its cluster!\n",
+		   p->queue_name, p->uri);
+      ok = 0;
+    }
+    if (!index_check(remote_printers_by_queue, "queue name", p->queue_name,
+		     p) ||
+	!index_check(remote_printers_by_uri, "URI", p->uri, p) ||
+	!index_check(remote_printers_by_host, "host", p->host, p))
+      ok = 0;
+    key = service_key(p->service_name, p->domain);
+    if (!index_check(remote_printers_by_service, "service name", key, p))
+      ok = 0;
+    g_free(key);
+  }
+  if (index_count(remote_printers_by_queue) != count ||
+      index_count(remote_printers_by_uri) != count ||
+      index_count(remote_printers_by_service) != count ||
+      index_count(remote_printers_by_host) != count) {
+    debug_printf("ERROR: Remote printer indexes contain stale entries!\n");
+    ok = 0;
+  }
+  if (!ok)
+    debug_printf("ERROR: Remote printer indexes out of sync with the list of %d printers!\n",
+		 count);
 }
 
 
@@ -1324,7 +2596,9 @@ int
 http_timeout_cb(http_t *http, void *user_data)
 {
   debug_printf("HTTP timeout! (consider increasing HttpLocalTimeout/HttpRemoteTimeout value)\n");
-  timeout_reached = 1;
+  /* create_queue() passes its job's flag */
+  if (user_data)
+    *(int *)user_data = 1;
   return 0;
 }
 
@@ -1343,10 +2617,12 @@ http_connect_local (void)
 		   server, port);
     local_conn = httpConnectEncryptShortTimeout(server, port,
 						cupsEncryption());
+    /* Only set on a new connection, as create_queue() sets its own
+       timeout flag as user data while it uses the connection */
+    if (local_conn)
+      httpSetTimeout(local_conn, HttpLocalTimeout, http_timeout_cb, NULL);
   }
-  if (local_conn)
-    httpSetTimeout(local_conn, HttpLocalTimeout, http_timeout_cb, NULL);
-  else {
+  if (!local_conn) {
     if (server[0] == '/')
       debug_printf("cups-browsed: Failed creating http connection to local CUPS daemon via domain socket: %s\n",
 		   server);
@@ -1414,6 +2690,8 @@ void add_mimetype_attributes(char* cluster_name, ipp_t **merged_attributes)
 {
   int                  count, i;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   const char           *str;
   char                 *q;
   cups_array_t         *list;
@@ -1430,10 +2708,9 @@ void add_mimetype_attributes(char* cluster_name, ipp_t **merged_attributes)
       return ;
 
     num_value = 0;
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(cluster_name,p->queue_name))
-        continue;
+    members = cluster_merge_members(cluster_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      p = (remote_printer_t *)cupsArrayIndex(members, m);
       if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
 	 p->status ==  STATUS_TO_BE_RELEASED )
         continue;
@@ -1478,6 +2755,8 @@ void add_tagzero_attributes(char* cluster_name, ipp_t **merged_attributes)
 {
   int                  count, i;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   const char           *str;
   char                 *q;
   cups_array_t         *list;
@@ -1500,10 +2779,9 @@ void add_tagzero_attributes(char* cluster_name, ipp_t **merged_attributes)
 
     num_value = 0;
     /* Iterating over all the printers in the cluster*/
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(cluster_name, p->queue_name))
-	continue;
+    members = cluster_merge_members(cluster_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      p = (remote_printer_t *)cupsArrayIndex(members, m);
       if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
 	 p->status ==  STATUS_TO_BE_RELEASED )
 	continue;
@@ -1551,6 +2829,8 @@ void add_keyword_attributes(char* cluster_name, ipp_t **merged_attributes)
 {
   int                  count, i;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   const char           *str;
   char                 *q;
   cups_array_t         *list;
@@ -1573,10 +2853,9 @@ void add_keyword_attributes(char* cluster_name, ipp_t **merged_attributes)
       return;
 
     num_value = 0;
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-         p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(cluster_name, p->queue_name))
-        continue;
+    members = cluster_merge_members(cluster_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      p = (remote_printer_t *)cupsArrayIndex(members, m);
       if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
 	 p->status == STATUS_TO_BE_RELEASED )
         continue;
@@ -1621,6 +2900,8 @@ void add_enum_attributes(char* cluster_name, ipp_t **merged_attributes)
 {
   int                  count, i, value;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   char                 *str = NULL;
   char                 *q;
   cups_array_t         *list;
@@ -1639,11 +2920,10 @@ void add_enum_attributes(char* cluster_name, ipp_t **merged_attributes)
 			      (cups_afree_func_t)free)) == NULL)
       return ;
     str = malloc(sizeof(char) * 10);
-    num_value = 0;
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-         p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(cluster_name,p->queue_name))
-        continue;
+    num_value = 0;
+    members = cluster_merge_members(cluster_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      p = (remote_printer_t *)cupsArrayIndex(members, m);
       if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
         p->status ==  STATUS_TO_BE_RELEASED )
         continue;
@@ -1684,6 +2964,8 @@ void add_margin_attributes(char* cluster_name, ipp_t **merged_attributes)
 {
   int                  count, i, value;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   char                 *str;
   char                 *q;
   cups_array_t         *list;
@@ -1703,10 +2985,9 @@ void add_margin_attributes(char* cluster_name, ipp_t **merged_attributes)
       return ;
     str = malloc(sizeof(char)*10);
     num_value = 0;
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-         p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(cluster_name,p->queue_name))
-        continue;
+    members = cluster_merge_members(cluster_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      p = (remote_printer_t *)cupsArrayIndex(members, m);
       if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
       p->status ==  STATUS_TO_BE_RELEASED )
         continue;
@@ -1748,6 +3029,8 @@ void add_resolution_attributes(char* cluster_name, ipp_t **merged_attributes)
 {
   int                  count, i;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   ipp_attribute_t      *attr;
   int                  num_resolution, attr_no;
   cups_array_t         *res_array;
@@ -1762,10 +3045,9 @@ void add_resolution_attributes(char* cluster_name, ipp_t **merged_attributes)
     res_array = NULL;
     res_array = cfNewResolutionArray();
     num_resolution = 0;
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(cluster_name, p->queue_name))
-	continue;
+    members = cluster_merge_members(cluster_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      p = (remote_printer_t *)cupsArrayIndex(members, m);
       if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
 	 p->status == STATUS_TO_BE_RELEASED )
 	continue;
@@ -1804,6 +3086,8 @@ void add_mediasize_attributes(char* cluster_name, ipp_t **merged_attributes)
 {
   int                  count, i = 0;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   ipp_attribute_t      *attr, *media_size_supported, *x_dim, *y_dim;
   int                  num_sizes, attr_no,num_ranges;
   ipp_t                *media_size;
@@ -1826,10 +3110,9 @@ void add_mediasize_attributes(char* cluster_name, ipp_t **merged_attributes)
   for (attr_no = 0; attr_no < 1; attr_no ++) {
     num_sizes = 0;
     num_ranges = 0;
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(cluster_name,p->queue_name))
-        continue;
+    members = cluster_merge_members(cluster_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      p = (remote_printer_t *)cupsArrayIndex(members, m);
       if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
 	 p->status ==  STATUS_TO_BE_RELEASED )
         continue;
@@ -1908,6 +3191,8 @@ add_mediadatabase_attributes(char* cluster_name, ipp_t **merged_attributes)
 {
   int                  count, i;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   ipp_attribute_t      *attr, *media_attr;
   int                  num_database, attr_no;
   cups_array_t         *media_database;
@@ -1926,10 +3211,9 @@ add_mediadatabase_attributes(char* cluster_name, ipp_t **merged_attributes)
 				 (cups_afree_func_t)free);
   for (attr_no = 0; attr_no < 1; attr_no ++) {
     num_database = 0;
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-         p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(cluster_name, p->queue_name))
-        continue;
+    members = cluster_merge_members(cluster_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      p = (remote_printer_t *)cupsArrayIndex(members, m);
       if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
 	 p->status == STATUS_TO_BE_RELEASED )
         continue;
@@ -2026,6 +3310,8 @@ void add_jobpresets_attribute(char* cluster_name, ipp_t ** merged_attributes)
 {
   int                  count, i, num_preset = 0, preset_no = 0;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   cups_array_t         *list, *added_presets;
   ipp_t                *preset;
   ipp_attribute_t      *attr;
@@ -2043,10 +3329,9 @@ void add_jobpresets_attribute(char* cluster_name, ipp_t ** merged_attributes)
 				     (cups_afree_func_t)free)) == NULL)
     return;
 
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-    if (strcmp(cluster_name, p->queue_name))
-      continue;
+  members = cluster_merge_members(cluster_name);
+  for (m = 0; m < cupsArrayCount(members); m ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, m);
     if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
        p->status == STATUS_TO_BE_RELEASED )
       continue;
@@ -2074,8 +3359,11 @@ void add_jobpresets_attribute(char* cluster_name, ipp_t ** merged_attributes)
 				       "job-presets-supported", num_preset,
 				       NULL);
 
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
+  for (m = 0; m < cupsArrayCount(members); m ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, m);
+    if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
+       p->status == STATUS_TO_BE_RELEASED )
+      continue;
     if ((attr = ippFindAttribute(p->prattrs, "job-presets-supported",
 				 IPP_TAG_BEGIN_COLLECTION)) != NULL) {
       for (i = 0, count = ippGetCount(attr); i < count; i ++) {
@@ -2633,6 +3921,8 @@ int check_printer_with_options(char* cluster_name, int idx_option1,
 			       char* option1, int idx_option2, char* option2)
 {
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   cups_array_t         *first_attributes_value;
   cups_array_t         *second_attributes_value;
   char                 *borderless_pagesize = NULL;
@@ -2682,10 +3972,9 @@ int check_printer_with_options(char* cluster_name, int idx_option1,
       option2_is_size = 1;
     }
   }
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-    if(strcmp(cluster_name, p->queue_name))
-      continue;
+  members = cluster_merge_members(cluster_name);
+  for (m = 0; m < cupsArrayCount(members); m ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, m);
     first_attributes_value = get_supported_options(p->prattrs,
 						   ppd_keywords[idx_option1]);
     if(cupsArrayFind(first_attributes_value, (void*)option1) ||
@@ -2715,6 +4004,8 @@ cups_array_t* get_cluster_sizes(char* cluster_name)
                        *sizes_ppdname;
   cups_size_t          *size;
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   char                 pagesize[128];
   char*                first_space;
 
@@ -2725,33 +4016,32 @@ cups_array_t* get_cluster_sizes(char* cluster_name)
   sizes_ppdname = cupsArrayNew3((cups_array_func_t)strcasecmp, NULL, NULL, 0,
 				(cups_acopy_func_t)strdup,
 				(cups_afree_func_t)free);
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-    if (!strcmp(p->queue_name, cluster_name)) {
-      if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
-	 p->status == STATUS_TO_BE_RELEASED )
-	continue;
-      cfGenerateSizes(p->prattrs, CF_GEN_SIZES_DEFAULT,
-		      &sizes, NULL, NULL, NULL, NULL,
-		      NULL, NULL, NULL, NULL, NULL, NULL,
-		      NULL, NULL, NULL, NULL, NULL, NULL, NULL);
-      for (size = (cups_size_t *)cupsArrayFirst(sizes);
-	   size; size = (cups_size_t *)cupsArrayNext(sizes)) {
-	if (!cupsArrayFind(cluster_sizes, size)) {
-	  strcpy(pagesize, size->media);
-	  if ((first_space = strchr(pagesize, ' ')) != NULL) {
-	    *first_space = '\0';
-	  }
-	  if (!cupsArrayFind(sizes_ppdname, pagesize)) {
-	    cupsArrayAdd(cluster_sizes, size);
-	    cupsArrayAdd(sizes_ppdname, pagesize);
-	  }
-        }
+  members = cluster_merge_members(cluster_name);
+  for (m = 0; m < cupsArrayCount(members); m ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, m);
+    if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
+       p->status == STATUS_TO_BE_RELEASED )
+      continue;
+    cfGenerateSizes(p->prattrs, CF_GEN_SIZES_DEFAULT,
+		    &sizes, NULL, NULL, NULL, NULL,
+		    NULL, NULL, NULL, NULL, NULL, NULL,
+		    NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+    for (size = (cups_size_t *)cupsArrayFirst(sizes);
+	 size; size = (cups_size_t *)cupsArrayNext(sizes)) {
+      if (!cupsArrayFind(cluster_sizes, size)) {
+	strcpy(pagesize, size->media);
+	if ((first_space = strchr(pagesize, ' ')) != NULL) {
+	  *first_space = '\0';
+	}
+	if (!cupsArrayFind(sizes_ppdname, pagesize)) {
+	  cupsArrayAdd(cluster_sizes, size);
+	  cupsArrayAdd(sizes_ppdname, pagesize);
+	}
       }
-
-      cupsArrayDelete(sizes);
-      sizes = NULL;
     }
+
+    cupsArrayDelete(sizes);
+    sizes = NULL;
   }
 
   cupsArrayDelete(sizes_ppdname);
@@ -2769,7 +4059,7 @@ cups_array_t* generate_cluster_conflicts(char* cluster_name,
   cups_array_t         *printer_first_options = NULL,
                        *printer_second_options = NULL;
   char                 *opt1, *opt2, constraint[100], *ppdsizename, *temp;
-  cups_array_t         *sizes = NULL, *pagesizes;
+  cups_array_t         *sizes = NULL, *pagesizes, *members;
   cups_size_t          *size;
 
   /* Cups Array to store the conflicts*/
@@ -2818,11 +4108,10 @@ cups_array_t* generate_cluster_conflicts(char* cluster_name,
      such printer exists then the pair is a conflict, we add it to
      conflict_pairs array */
 
-  no_of_printers = cupsArrayCount(remote_printers);
+  members = cluster_merge_members(cluster_name);
+  no_of_printers = cupsArrayCount(members);
   for (j = 0; j < no_of_printers; j ++) {
-    p = (remote_printer_t *)cupsArrayIndex(remote_printers, j);
-    if (strcmp(cluster_name, p->queue_name))
-      continue;
+    p = (remote_printer_t *)cupsArrayIndex(members, j);
     if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
        p->status == STATUS_TO_BE_RELEASED )
       continue;
@@ -2887,16 +4176,17 @@ cups_array_t* generate_cluster_conflicts(char* cluster_name,
 ipp_t* get_cluster_attributes(char* cluster_name)
 {
   remote_printer_t     *p;
+  cups_array_t         *members;
+  int                  m;
   ipp_t                *merged_attributes = NULL;
   char                 printer_make_and_model[256];
   ipp_attribute_t      *attr;
   int                  color_supported = 0, make_model_done = 0, i;
   char                 valuebuffer[65536];
   merged_attributes = ippNew();
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-    if (strcmp(cluster_name, p->queue_name))
-      continue;
+  members = cluster_merge_members(cluster_name);
+  for (m = 0; m < cupsArrayCount(members); m ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, m);
     if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
        p->status == STATUS_TO_BE_RELEASED )
       continue;
@@ -2947,13 +4237,14 @@ int cluster_supports_given_attribute(char* cluster_name, ipp_tag_t tag,
 				     const char* attribute)
 {
   remote_printer_t        *p;
+  cups_array_t            *members;
+  int                     m;
   ipp_attribute_t         *attr;
   int                     count;
 
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-    if (strcmp(cluster_name, p->queue_name))
-      continue;
+  members = cluster_merge_members(cluster_name);
+  for (m = 0; m < cupsArrayCount(members); m ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, m);
     if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
        p->status == STATUS_TO_BE_RELEASED )
       continue;
@@ -2972,6 +4263,8 @@ void get_cluster_default_attributes(ipp_t** merged_attributes,
 {
   int                     max_pages_per_min = 0, pages_per_min;
   remote_printer_t        *p, *def_printer = NULL;
+  cups_array_t            *members;
+  int                     m;
   int                     i, count;
   ipp_attribute_t         *attr, *media_attr, *media_col_default;
   ipp_t                   *media_col,
@@ -2986,10 +4279,9 @@ void get_cluster_default_attributes(ipp_t** merged_attributes,
 
   /*The printer with the maximum Throughtput(pages_per_min) is selected as 
     the default printer*/
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-    if (strcmp(p->queue_name, cluster_name))
-      continue;
+  members = cluster_merge_members(cluster_name);
+  for (m = 0; m < cupsArrayCount(members); m ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, m);
     if(p->status == STATUS_DISAPPEARED || p->status == STATUS_UNCONFIRMED ||
        p->status == STATUS_TO_BE_RELEASED )
       continue;
@@ -3005,17 +4297,8 @@ void get_cluster_default_attributes(ipp_t** merged_attributes,
 
   /* If none of the printer in the cluster has "pages-per-minute" in the ipp
      response message, then select the first printer in the cluster */
-  if (!def_printer) {
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (strcmp(p->queue_name, cluster_name))
-        continue;
-      else {
-        def_printer = p;
-        break;
-      }
-    }
-  }
+  if (!def_printer)
+    def_printer = (remote_printer_t *)cupsArrayIndex(members, 0);
   
   debug_printf("Selecting printer (%s) as the default for the cluster %s\n",
 	       def_printer->uri, cluster_name);
@@ -3247,9 +4530,66 @@ void get_cluster_default_attributes(ipp_t** merged_attributes,
   }
 }
 
+/* Merged attributes, constraints, page sizes, and defaults of the
+   cluster, as needed for generating its PPD file. They are only
+   re-generated when the set of distinct members (see
+   cluster_merge_refresh()) has changed since the last call, otherwise
+   copies of the last result are returned. Caller has to free them */
+int get_cluster_merged_attributes(char *cluster_name,
+				  ipp_t **merged_attributes,
+				  cups_array_t **conflicts,
+				  cups_array_t **sizes,
+				  char *default_pagesize,
+				  size_t default_pagesize_size,
+				  const char **default_color)
+{
+  cluster_merge_t *m;
+
+  if ((m = cluster_merge_refresh(cluster_name)) == NULL)
+    return (0);
+
+  if (m->key && m->attrs && !strcmp(m->key, m->reps_key->str))
+    debug_printf("Members of cluster %s have the same capabilities as "
+		 "before, re-using the merged attributes\n", cluster_name);
+  else {
+    g_free(m->key);
+    m->key = NULL;
+    if (m->attrs)
+      ippDelete(m->attrs);
+    cupsArrayDelete(m->conflicts);
+    cupsArrayDelete(m->sizes);
+    m->default_pagesize[0] = '\0';
+    m->default_color = NULL;
+    m->attrs = get_cluster_attributes(cluster_name);
+    debug_printf("Generated Merged Attributes for local queue %s\n",
+		 cluster_name);
+    m->conflicts = generate_cluster_conflicts(cluster_name, m->attrs);
+    debug_printf("Generated Constraints for queue %s\n", cluster_name);
+    m->sizes = get_cluster_sizes(cluster_name);
+    get_cluster_default_attributes(&(m->attrs), cluster_name,
+				   m->default_pagesize, &(m->default_color));
+    debug_printf("Generated Default Attributes for local queue %s\n",
+		 cluster_name);
+    /* The merging functions have refreshed the members themselves, so
+       m->reps_key is still the one the result got generated for */
+    m->key = g_strdup(m->reps_key->str);
+  }
+
+  *merged_attributes = ippNew();
+  ippCopyAttributes(*merged_attributes, m->attrs, 0, NULL, NULL);
+  *conflicts = m->conflicts ? cupsArrayDup(m->conflicts) : NULL;
+  *sizes = m->sizes ? cupsArrayDup(m->sizes) : NULL;
+  snprintf(default_pagesize, default_pagesize_size, "%s",
+	   m->default_pagesize);
+  *default_color = m->default_color;
+
+  return (1);
+}
+
 /* Function to see which printer in the cluster supports the
    requested job attributes*/
-int supports_job_attributes_requested(const gchar* printer, int printer_index,
+int supports_job_attributes_requested(const gchar* printer,
+				      remote_printer_t *p,
                                       int job_id, int *print_quality)
 {
   char                  uri[1024];
@@ -3262,13 +4602,11 @@ int supports_job_attributes_requested(const gchar* printer, int printer_index,
                         *media_type_supported = NULL, *staplelocation_supported = NULL,
                         *foldtype_supported = NULL, *punchmedia_supported = NULL,
                         *color_supported = NULL;
-  remote_printer_t      *p;
   int                   i, count, side_found, orien_req, orien,
                         orien_found;
   cups_array_t          *sizes = NULL;
   int                   ret = 1;
 
-  p = (remote_printer_t *)cupsArrayIndex(remote_printers, printer_index);
   static const char * const jattrs[] =  /* Job attributes we want */
   {
     "all"
@@ -3805,138 +5143,269 @@ add_dest_cb(dest_list_t *user_data, unsigned flags, cups_dest_t *dest)
 }
 
 
-const char *
-get_printer_uuid(http_t *http_printer,
-		 const char* raw_uri)
+/*
+ * Local CUPS queues
+ *
+ * The list of the local CUPS queues (local_printers, and with
+ * OnlyUnsupportedByCUPS also cups_supported_remote_printers) gets read
+ * completely only on startup, when we lose our subscription to the
+ * printer events of CUPS, and every LOCAL_PRINTERS_RESYNC_INTERVAL
+ * seconds as a consistency check. Otherwise it gets updated queue by
+ * queue from the printer events, with one IPP request for each queue
+ * which got added or modified. All attributes, including the UUIDs of
+ * the queues, come with one CUPS-Get-Printers request and not with one
+ * Get-Printer-Attributes request per queue.
+ */
+
+static const char * const local_printer_attrs[] = {
+  "printer-name",
+  "device-uri",
+  "printer-uri-supported",
+  "printer-uuid",
+  "printer-is-temporary",
+  CUPS_BROWSED_MARK "-default"
+};
+
+/* Read the attributes of one queue from the printer attribute group of
+   an IPP response starting at *attr. *attr points to the first
+   attribute after the group afterwards. Returns NULL if the queue is
+   not to be listed (or has no name), *name is the queue name */
+static local_printer_t *
+local_printer_from_attrs (ipp_t *response,
+			  ipp_attribute_t **attr,
+			  const char **name,
+			  gboolean *is_cups_supported_remote)
+{
+  const char *attrname, *val;
+  const char *device_uri = "";
+  char *uuid = NULL;
+  gboolean has_uri_supported = FALSE;
+  gboolean is_temporary = FALSE;
+  gboolean cups_browsed_controlled = FALSE;
+  local_printer_t *printer;
+
+  *name = NULL;
+  *is_cups_supported_remote = FALSE;
+
+  for (; *attr && ippGetGroupTag(*attr) == IPP_TAG_PRINTER;
+       *attr = ippNextAttribute(response)) {
+    if ((attrname = ippGetName(*attr)) == NULL)
+      continue;
+    if (!strcmp(attrname, "printer-name") &&
+	ippGetValueTag(*attr) == IPP_TAG_NAME)
+      *name = ippGetString(*attr, 0, NULL);
+    else if (!strcmp(attrname, "device-uri") &&
+	     ippGetValueTag(*attr) == IPP_TAG_URI)
+      device_uri = ippGetString(*attr, 0, NULL);
+    else if (!strcmp(attrname, "printer-uri-supported"))
+      has_uri_supported = TRUE;
+    else if (!strcmp(attrname, "printer-uuid") &&
+	     ippGetValueTag(*attr) == IPP_TAG_URI && uuid == NULL &&
+	     (val = ippGetString(*attr, 0, NULL)) != NULL &&
+	     !strncmp(val, "urn:uuid:", 9))
+      uuid = strdup(val + 9);
+    else if (!strcmp(attrname, "printer-is-temporary") &&
+	     ippGetValueTag(*attr) == IPP_TAG_BOOLEAN)
+      is_temporary = ippGetBoolean(*attr, 0);
+    else if (!strcmp(attrname, CUPS_BROWSED_MARK "-default")) {
+      if (ippGetValueTag(*attr) == IPP_TAG_BOOLEAN)
+	cups_browsed_controlled = ippGetBoolean(*attr, 0);
+      else if ((val = ippGetString(*attr, 0, NULL)) != NULL)
+	cups_browsed_controlled = (!strcasecmp (val, "yes") ||
+				   !strcasecmp (val, "on") ||
+				   !strcasecmp (val, "true"));
+    }
+  }
+
+  if (*name == NULL) {
+    free(uuid);
+    return (NULL);
+  }
+
+  if (OnlyUnsupportedByCUPS)
+    /* Printer has no local CUPS queue but CUPS would create a
+       temporary queue on-demand */
+    *is_cups_supported_remote = (!has_uri_supported || is_temporary);
+  else if (is_temporary) {
+    free(uuid);
+    return (NULL);
+  }
+
+  printer = new_local_printer (device_uri, uuid, cups_browsed_controlled);
+  debug_printf ("Printer %s: %s, %s%s%s\n",
+		*name, device_uri, printer->uuid,
+		cups_browsed_controlled ? ", cups_browsed" : "",
+		*is_cups_supported_remote ? ", temporary" : "");
+  return (printer);
+}
+
+/* Enter a queue into the list, or remove it from the list if printer is
+   NULL. The caller has to hold the lock */
+static void
+local_printers_set (const char *name,
+		    local_printer_t *printer,
+		    gboolean is_cups_supported_remote)
 {
-  ipp_t *response = NULL;
-  ipp_attribute_t *attr = NULL;
-  const char * uuid = NULL;
+  char *key = g_ascii_strdown (name, -1);
 
-  const char * const pattrs[] = {
-    "printer-uuid",
-  };
-  const char * const req_attrs[] = {
-    "printer-uuid",
-  };
+  g_hash_table_remove (local_printers, key);
+  if (OnlyUnsupportedByCUPS)
+    g_hash_table_remove (cups_supported_remote_printers, key);
 
-  if (http_printer == NULL)
-    debug_printf ("HTTP connection for printer with URI %s not set!\n",
-		  raw_uri);
+  if (printer == NULL)
+    g_free (key);
+  else if (is_cups_supported_remote)
+    g_hash_table_insert (cups_supported_remote_printers, key, printer);
+  else
+    g_hash_table_insert (local_printers, key, printer);
+}
 
-  if ((response =
-       cfGetPrinterAttributes2(http_printer, raw_uri,
-			       pattrs, 1, req_attrs, 1, 0)) == NULL) {
-    debug_printf ("Printer with URI %s has no \"printer-uuid\" IPP attribute!\n",
-		  raw_uri);
-    return NULL;
-  }
+/* Re-read one queue after CUPS told us that it got added or modified */
+static void
+local_printer_update (http_t *conn,
+		      const char *name)
+{
+  ipp_t *request, *response;
+  ipp_attribute_t *attr;
+  ipp_status_t status;
+  local_printer_t *printer;
+  const char *printer_name;
+  gboolean is_cups_supported_remote;
+  char uri[HTTP_MAX_URI];
 
-  attr = ippFindAttribute(response, "printer-uuid", IPP_TAG_URI);
+  debug_printf ("cups-browsed (%s): Re-reading local queue %s\n",
+		local_server_str, name);
 
+  httpAssembleURIf(HTTP_URI_CODING_ALL, uri, sizeof(uri), "ipp", NULL,
+		   "localhost", 0, "/printers/%s", name);
+  request = ippNewRequest(IPP_OP_GET_PRINTER_ATTRIBUTES);
+  ippAddString (request, IPP_TAG_OPERATION, IPP_TAG_URI,
+		"printer-uri", NULL, uri);
+  ippAddStrings (request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD,
+		 "requested-attributes",
+		 sizeof (local_printer_attrs) / sizeof (local_printer_attrs[0]),
+		 NULL, local_printer_attrs);
+  ippAddString (request, IPP_TAG_OPERATION, IPP_TAG_NAME,
+		"requesting-user-name", NULL, cupsUser ());
 
-  if (attr)
-    uuid = strdup(ippGetString(attr, 0, NULL) + 9);
-  else {
-    debug_printf ("Printer with URI %s: Cannot read \"printer-uuid\" IPP attribute!\n",
-		  raw_uri);
-  }
+  response = cupsDoRequest (conn, request, "/");
+  status = (response ? ippGetStatusCode (response) : cupsLastError ());
 
-  ippDelete(response);
+  pthread_rwlock_wrlock(&lock);
+  if (status == IPP_STATUS_ERROR_NOT_FOUND) {
+    /* Queue does not exist (any more) */
+    debug_printf ("Printer %s: removed\n", name);
+    local_printers_set (name, NULL, FALSE);
+  } else if (status <= IPP_STATUS_OK_EVENTS_COMPLETE) {
+    for (attr = ippFirstAttribute(response);
+	 attr && ippGetGroupTag(attr) != IPP_TAG_PRINTER;
+	 attr = ippNextAttribute(response));
+    printer = local_printer_from_attrs (response, &attr, &printer_name,
+					&is_cups_supported_remote);
+    local_printers_set (name, printer, is_cups_supported_remote);
+  } else
+    debug_printf ("cups-browsed (%s): Failed to read local queue %s: %s\n",
+		  local_server_str, name, cupsLastErrorString ());
+  pthread_rwlock_unlock(&lock);
 
-  return uuid;
+  if (response)
+    ippDelete (response);
 }
 
 static void
 get_local_printers (void)
 {
-  pthread_rwlock_wrlock(&lock);
-
-  dest_list_t dest_list = {0, NULL};
+  ipp_t *request, *response;
+  ipp_attribute_t *attr;
   http_t *conn = NULL;
+  local_printer_t *printer;
+  const char *name;
+  gboolean is_cups_supported_remote;
 
   conn = http_connect_local ();
+  if (conn == NULL) {
+    debug_printf ("cups-browsed (%s): Cannot connect to read the local queues\n",
+		  local_server_str);
+    return;
+  }
 
   /* We only want to have a list of actually existing CUPS queues, not of
      DNS-SD-discovered printers for which CUPS can auto-setup a driverless
      print queue */
-  if (OnlyUnsupportedByCUPS)
-    cupsEnumDests(CUPS_DEST_FLAGS_NONE, 1000, NULL, 0, 0,
-		  (cups_dest_cb_t)add_dest_cb, &dest_list);
-  else
-    cupsEnumDests(CUPS_DEST_FLAGS_NONE, 1000, NULL, CUPS_PRINTER_LOCAL,
-		  CUPS_PRINTER_DISCOVERED, (cups_dest_cb_t)add_dest_cb,
-		  &dest_list);
-  debug_printf ("cups-browsed (%s): cupsEnumDests\n", local_server_str);
+  request = ippNewRequest(IPP_OP_CUPS_GET_PRINTERS);
+  ippAddStrings (request, IPP_TAG_OPERATION, IPP_TAG_KEYWORD,
+		 "requested-attributes",
+		 sizeof (local_printer_attrs) / sizeof (local_printer_attrs[0]),
+		 NULL, local_printer_attrs);
+  ippAddString (request, IPP_TAG_OPERATION, IPP_TAG_NAME,
+		"requesting-user-name", NULL, cupsUser ());
+  if (!OnlyUnsupportedByCUPS) {
+    ippAddInteger (request, IPP_TAG_OPERATION, IPP_TAG_ENUM,
+		   "printer-type", CUPS_PRINTER_LOCAL);
+    ippAddInteger (request, IPP_TAG_OPERATION, IPP_TAG_ENUM,
+		   "printer-type-mask", CUPS_PRINTER_DISCOVERED);
+  }
+
+  response = cupsDoRequest (conn, request, "/");
+  debug_printf ("cups-browsed (%s): CUPS-Get-Printers\n", local_server_str);
+  if (cupsLastError() > IPP_STATUS_OK_EVENTS_COMPLETE) {
+    /* Keep the list which we have */
+    debug_printf ("cups-browsed (%s): CUPS-Get-Printers failed: %s\n",
+		  local_server_str, cupsLastErrorString ());
+    if (response)
+      ippDelete (response);
+    return;
+  }
+
+  pthread_rwlock_wrlock(&lock);
+
   g_hash_table_remove_all (local_printers);
   if (OnlyUnsupportedByCUPS)
     g_hash_table_remove_all (cups_supported_remote_printers);
-  int num_dests = dest_list.num_dests;
-  cups_dest_t *dests = dest_list.dests;
-  for (int i = 0; i < num_dests; i++) {
-    const char *val;
-    cups_dest_t *dest = &dests[i];
-    local_printer_t *printer;
-    gboolean cups_browsed_controlled;
-    gboolean is_temporary;
-    gboolean is_cups_supported_remote;
-    char uri[HTTP_MAX_URI];
-
-    const char *device_uri = cupsGetOption ("device-uri",
-					    dest->num_options,
-					    dest->options);
-    if (device_uri == NULL)
-      device_uri = "";
-
-    /* Temporary CUPS queue? */
-    val = cupsGetOption ("printer-is-temporary",
-			 dest->num_options,
-			 dest->options);
-    is_temporary = (val && (!strcasecmp (val, "yes") ||
-			    !strcasecmp (val, "on") ||
-			    !strcasecmp (val, "true")));
-
-    if (OnlyUnsupportedByCUPS) {
-      /* Printer discovered by DNS-SD and supported by CUPS' temporary
-	 queues? */
-      val = cupsGetOption ("printer-uri-supported",
-			   dest->num_options,
-			   dest->options);
-      /* Printer has no local CUPS queue but CUPS would create a
-	 temporary queue on-demand */
-      is_cups_supported_remote = (val == NULL || is_temporary);
-    } else {
-      is_cups_supported_remote = 0;
-      if (is_temporary)
-	continue;
+  for (attr = ippFirstAttribute(response); attr; ) {
+    /* Skip any non-printer attributes */
+    if (ippGetGroupTag(attr) != IPP_TAG_PRINTER) {
+      attr = ippNextAttribute(response);
+      continue;
     }
+    printer = local_printer_from_attrs (response, &attr, &name,
+					&is_cups_supported_remote);
+    if (printer)
+      local_printers_set (name, printer, is_cups_supported_remote);
+  }
+  if (response)
+    ippDelete (response);
 
-    val = cupsGetOption (CUPS_BROWSED_MARK,
-			 dest->num_options,
-			 dest->options);
-    cups_browsed_controlled = val && (!strcasecmp (val, "yes") ||
-				      !strcasecmp (val, "on") ||
-				      !strcasecmp (val, "true"));
-    httpAssembleURIf(HTTP_URI_CODING_ALL, uri, sizeof(uri), "ipp", NULL,
-		     "localhost", 0, "/printers/%s", dest->name);
-    printer = new_local_printer (device_uri, get_printer_uuid(conn, uri),
-				 cups_browsed_controlled);
-    debug_printf ("Printer %s: %s, %s%s%s\n",
-		  dest->name, device_uri, printer->uuid,
-		  cups_browsed_controlled ? ", cups_browsed" : "",
-		  is_cups_supported_remote ? ", temporary" : "");
-
-    if (is_cups_supported_remote)
-      g_hash_table_insert (cups_supported_remote_printers,
-			   g_ascii_strdown (dest->name, -1),
-			   printer);
-    else
-      g_hash_table_insert (local_printers,
-			   g_ascii_strdown (dest->name, -1),
-			   printer);
+  if (OnlyUnsupportedByCUPS) {
+    /* DNS-SD-discovered printers for which CUPS would create a
+       temporary queue on-demand are not in the response of
+       CUPS-Get-Printers as long as they do not have a temporary queue,
+       cupsEnumDests() finds them */
+    dest_list_t dest_list = {0, NULL};
+    cupsEnumDests(CUPS_DEST_FLAGS_NONE, 1000, NULL, 0, 0,
+		  (cups_dest_cb_t)add_dest_cb, &dest_list);
+    debug_printf ("cups-browsed (%s): cupsEnumDests\n", local_server_str);
+    for (int i = 0; i < dest_list.num_dests; i++) {
+      cups_dest_t *dest = &dest_list.dests[i];
+      char *key = g_ascii_strdown (dest->name, -1);
+      const char *device_uri;
+      if (!g_hash_table_contains (local_printers, key) &&
+	  !g_hash_table_contains (cups_supported_remote_printers, key)) {
+	if ((device_uri = cupsGetOption ("device-uri",
+					 dest->num_options,
+					 dest->options)) == NULL)
+	  device_uri = "";
+	debug_printf ("Printer %s: %s, (null), temporary\n",
+		      dest->name, device_uri);
+	g_hash_table_insert (cups_supported_remote_printers, key,
+			     new_local_printer (device_uri, NULL, FALSE));
+      } else
+	g_free (key);
+    }
+    cupsFreeDests (dest_list.num_dests, dest_list.dests);
   }
 
-  cupsFreeDests (num_dests, dests);
+  local_printers_resync_time = time(NULL);
 
   pthread_rwlock_unlock(&lock);
 }
@@ -4150,10 +5619,15 @@ update_local_printers (void)
 {
   gboolean get_printers = FALSE;
   http_t *conn;
+  GHashTable *events;
+  GHashTableIter iter;
+  gpointer name, event;
 
   if (inhibit_local_printers_update)
     return;
 
+  events = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
   conn = http_connect_local ();
   if (conn &&
       (!local_printers_context || local_printers_context->can_subscribe)) {
@@ -4163,22 +5637,42 @@ update_local_printers (void)
       local_printers_create_subscription (conn);
       get_printers = TRUE;
     } else
-      /* We already have a subscription, so use it. */
-
-      /* Note: for the moment, browse_poll_get_notifications() just
-       * tells us whether we should re-fetch the printer list, so it
-       * is safe to use here. */
+      /* We already have a subscription, so use it. We get told which
+	 queues have changed, and only need to re-fetch the complete
+	 printer list if the events do not tell us this */
       get_printers = browse_poll_get_notifications (local_printers_context,
-						    conn);
+						    conn, events);
   } else
     get_printers = TRUE;
 
-  if (get_printers) {
-    get_local_printers ();
+  if (!get_printers &&
+      time(NULL) >= local_printers_resync_time +
+      LOCAL_PRINTERS_RESYNC_INTERVAL) {
+    debug_printf ("cups-browsed (%s): Re-reading all local queues as consistency check\n",
+		  local_server_str);
+    get_printers = TRUE;
+  }
 
-    if (BrowseLocalProtocols & BROWSE_CUPS)
-      prepare_browse_data ();
+  if (get_printers)
+    get_local_printers ();
+  else {
+    g_hash_table_iter_init (&iter, events);
+    while (g_hash_table_iter_next (&iter, &name, &event))
+      if (GPOINTER_TO_INT (event) == LOCAL_PRINTER_EVENT_DELETED) {
+	debug_printf ("Printer %s: removed\n", (char *)name);
+	pthread_rwlock_wrlock(&lock);
+	local_printers_set (name, NULL, FALSE);
+	pthread_rwlock_unlock(&lock);
+      } else if (GPOINTER_TO_INT (event) == LOCAL_PRINTER_EVENT_CHANGED)
+	local_printer_update (conn, name);
   }
+
+  /* The browse data contains the printer states, so any event counts */
+  if ((get_printers || g_hash_table_size (events) > 0) &&
+      (BrowseLocalProtocols & BROWSE_CUPS))
+    prepare_browse_data ();
+
+  g_hash_table_destroy (events);
 }
 
 int
@@ -5104,37 +6598,372 @@ cancel_subscription (int id)
   ippDelete (resp);
 }
 
-int
-is_created_by_cups_browsed (const char *printer) {
+remote_printer_t *
+printer_record (const char *printer) {
+  remote_printer_t *p;
+  cups_array_t *members;
+  int i;
+
+  if (printer == NULL)
+    return NULL;
+  members = cluster_members(printer);
+  for (i = 0; i < cupsArrayCount(members); i ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, i);
+    if (!p->slave_of)
+      return p;
+  }
+
+  return NULL;
+}
+
+int
+is_created_by_cups_browsed (const char *printer) {
+  return (printer_record(printer) != NULL);
+}
+
+/*
+ * Load model of the cluster members
+ *
+ * With "LoadBalancing QueueOnServers" a job gets sent to the member of
+ * the cluster which will be done with it first. Instead of asking each
+ * member for its state and its jobs when a job arrives, the members
+ * get polled every LoadPollInterval seconds in a separate thread
+ * (load_poll()), and the jobs which we send and see finishing update
+ * the model right away. Members for which we do not have an up-to-date
+ * model get asked when the job arrives, as before.
+ */
+
+/* Time a member needs for one job: Measured on our own jobs, otherwise
+   estimated from its speed */
+static double
+load_model_job_time(remote_printer_t *p) {
+  if (p->load_job_count > 0)
+    return p->load_job_time;
+  if (p->load_ppm > 0)
+    return LOAD_MODEL_PAGES_PER_JOB * 60.0 / p->load_ppm;
+  return LOAD_MODEL_JOB_TIME;
+}
+
+/* Predicted time (in sec) until a job which we send now is done */
+static double
+load_model_predict(remote_printer_t *p) {
+  return (p->load_jobs + 1) * load_model_job_time(p);
+}
+
+static double
+load_model_average(double average, double value, int count) {
+  if (count == 0)
+    return value;
+  return LOAD_MODEL_WEIGHT * value + (1.0 - LOAD_MODEL_WEIGHT) * average;
+}
+
+static void
+load_job_free(gpointer data) {
+  load_job_t *j = (load_job_t *)data;
+
+  free(j->uri);
+  free(j);
+}
+
+/* We have sent the job job_id to p */
+static void
+load_model_job_started(remote_printer_t *p, int job_id) {
+  load_job_t *j;
+
+  if ((j = (load_job_t *)calloc(1, sizeof(load_job_t))) == NULL)
+    return;
+  if ((j->uri = strdup(p->uri)) == NULL) {
+    free(j);
+    return;
+  }
+  j->started = time(NULL);
+  j->ahead = p->load_jobs;
+  /* Count the job already now, so that the next job does not go to the
+     same member before the next poll */
+  p->load_jobs ++;
+  if (load_model_jobs == NULL)
+    load_model_jobs = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					    NULL, load_job_free);
+  g_hash_table_insert(load_model_jobs, GINT_TO_POINTER(job_id), j);
+}
+
+/* The job job_id has finished, if we have sent it to a cluster member,
+   update the time per job of that member */
+static void
+load_model_job_finished(int job_id, ipp_jstate_t job_state) {
+  load_job_t *j;
+  cups_array_t *list;
+  remote_printer_t *p;
+  double job_time;
+  int i;
+
+  if (load_model_jobs == NULL ||
+      (j = (load_job_t *)g_hash_table_lookup(load_model_jobs,
+					     GINT_TO_POINTER(job_id))) == NULL)
+    return;
+  /* The job was finished when all the jobs which were on the server
+     before were done, too */
+  job_time = (double)(time(NULL) - j->started) / (j->ahead + 1);
+  list = (cups_array_t *)g_hash_table_lookup(remote_printers_by_uri, j->uri);
+  for (i = 0; i < cupsArrayCount(list); i ++) {
+    p = (remote_printer_t *)cupsArrayIndex(list, i);
+    if (p->load_jobs > 0)
+      p->load_jobs --;
+    if (job_state == IPP_JOB_COMPLETED) {
+      p->load_job_time = load_model_average(p->load_job_time, job_time,
+					    p->load_job_count);
+      p->load_job_count ++;
+      debug_printf("Job %d on %s took %.1f sec, average time per job now %.1f sec.\n",
+		   job_id, p->uri, job_time, p->load_job_time);
+    }
+  }
+  g_hash_table_remove(load_model_jobs, GINT_TO_POINTER(job_id));
+}
+
+static gboolean
+load_job_expired(gpointer key, gpointer value, gpointer user_data) {
+  return (((load_job_t *)value)->started <
+	  time(NULL) - LOAD_MODEL_JOB_MAX_AGE);
+}
+
+/* Apply the result of polling a member to the model */
+static void
+load_model_update(remote_printer_t *p, load_poll_t *r) {
+  double minutes;
+
+  if (!r->ok) {
+    /* Ask the member directly on the next job */
+    p->load_updated = 0;
+    return;
+  }
+  /* Speed: Pages printed since the last poll, if it was printing all
+     the time */
+  if (p->load_updated && r->impressions >= p->load_impressions &&
+      p->load_state == IPP_PRINTER_PROCESSING &&
+      r->state == IPP_PRINTER_PROCESSING &&
+      (minutes = (r->time - p->load_updated) / 60.0) > 0 &&
+      r->impressions > p->load_impressions)
+    p->load_ppm = load_model_average(p->load_ppm,
+				     (r->impressions - p->load_impressions) /
+				     minutes, p->load_ppm > 0);
+  else if (p->load_ppm <= 0 && r->ppm > 0)
+    p->load_ppm = r->ppm;
+  p->load_impressions = r->impressions;
+  p->load_state = r->state;
+  p->load_accepting = r->accepting;
+  p->load_jobs = r->jobs;
+  p->load_updated = r->time;
+}
+
+static void
+load_poll_free(cups_array_t *polls) {
+  load_poll_t *r;
+
+  for (r = (load_poll_t *)cupsArrayFirst(polls); r;
+       r = (load_poll_t *)cupsArrayNext(polls)) {
+    free(r->uri);
+    free(r->host);
+    free(r);
+  }
+  cupsArrayDelete(polls);
+}
+
+/* Called in the main loop when the poll thread has finished */
+static gboolean
+load_poll_done(gpointer data) {
+  cups_array_t *polls = (cups_array_t *)data, *list;
+  load_poll_t *r;
+  int i;
+
+  if (in_shutdown == 0) {
+    pthread_rwlock_wrlock(&lock);
+    for (r = (load_poll_t *)cupsArrayFirst(polls); r;
+	 r = (load_poll_t *)cupsArrayNext(polls)) {
+      list = (cups_array_t *)g_hash_table_lookup(remote_printers_by_uri,
+						 r->uri);
+      for (i = 0; i < cupsArrayCount(list); i ++)
+	load_model_update((remote_printer_t *)cupsArrayIndex(list, i), r);
+    }
+    pthread_rwlock_unlock(&lock);
+    debug_printf("Updated the load model of %d cluster members.\n",
+		 cupsArrayCount(polls));
+  }
+  load_poll_free(polls);
+  load_poll_running = 0;
+  return FALSE;
+}
+
+/* Poll thread, works only on the copies in the load_poll_t records, not
+   on the remote printer list */
+static void *
+load_poll_thread(void *data) {
+  cups_array_t *polls = (cups_array_t *)data;
+  load_poll_t *r;
+  ipp_t *response;
+  ipp_attribute_t *attr;
+  http_t *http;
+  int i;
+  static const char *pattrs[] =
+    {
+     "printer-state",
+     "printer-is-accepting-jobs",
+     "queued-job-count",
+     "pages-per-minute",
+     "printer-impressions-completed"
+    };
+
+  for (i = 0; i < cupsArrayCount(polls); i ++) {
+    r = (load_poll_t *)cupsArrayIndex(polls, i);
+    response = get_printer_attributes(NULL, r->uri, pattrs,
+				      sizeof(pattrs) / sizeof(pattrs[0]),
+				      NULL, 0, 0);
+    r->time = time(NULL);
+    if (response == NULL) {
+      debug_printf("Polling the load of %s failed.\n", r->uri);
+      continue;
+    }
+    r->ok = 1;
+    r->state = IPP_PRINTER_IDLE;
+    r->jobs = -1;
+    if ((attr = ippFindAttribute(response, "printer-state",
+				 IPP_TAG_ENUM)) != NULL)
+      r->state = (ipp_pstate_t)ippGetInteger(attr, 0);
+    if ((attr = ippFindAttribute(response, "printer-is-accepting-jobs",
+				 IPP_TAG_BOOLEAN)) != NULL)
+      r->accepting = ippGetBoolean(attr, 0);
+    if ((attr = ippFindAttribute(response, "queued-job-count",
+				 IPP_TAG_INTEGER)) != NULL)
+      r->jobs = ippGetInteger(attr, 0);
+    if ((attr = ippFindAttribute(response, "pages-per-minute",
+				 IPP_TAG_INTEGER)) != NULL)
+      r->ppm = ippGetInteger(attr, 0);
+    if ((attr = ippFindAttribute(response, "printer-impressions-completed",
+				 IPP_TAG_INTEGER)) != NULL)
+      r->impressions = ippGetInteger(attr, 0);
+    ippDelete(response);
+    /* No queued-job-count, count the jobs */
+    if (r->jobs < 0 && r->state != IPP_PRINTER_IDLE &&
+	(http = httpConnectEncryptShortTimeout(r->host, r->port,
+					       HTTP_ENCRYPT_IF_REQUESTED)) !=
+	NULL) {
+      r->jobs = get_number_of_jobs(http, r->uri, 0, CUPS_WHICHJOBS_ACTIVE);
+      httpClose(http);
+    }
+    if (r->jobs < 0)
+      r->jobs = (r->state == IPP_PRINTER_IDLE ? 0 : 1);
+  }
+
+  g_idle_add(load_poll_done, polls);
+  return NULL;
+}
+
+/* Timer: Start polling all members of clusters in a separate thread */
+static gboolean
+load_poll(gpointer data) {
+  cups_array_t *polls;
   remote_printer_t *p;
+  load_poll_t *r;
+  pthread_t thread;
+  pthread_attr_t attr;
 
-  if (printer == NULL)
-    return 0;
+  if (load_model_jobs)
+    g_hash_table_foreach_remove(load_model_jobs, load_job_expired, NULL);
+  if (load_poll_running)
+    return TRUE;
+
+  if ((polls = cupsArrayNew(NULL, NULL)) == NULL)
+    return TRUE;
   for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
-    if (!p->slave_of && !strcasecmp(printer, p->queue_name))
-      return 1;
+       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
+    if (p->status != STATUS_CONFIRMED || p->queue_name == NULL ||
+	cupsArrayCount(cluster_members(p->queue_name)) < 2)
+      continue;
+    if ((r = (load_poll_t *)calloc(1, sizeof(load_poll_t))) == NULL)
+      break;
+    r->uri = strdup(p->uri);
+    r->host = strdup(p->ip ? p->ip : p->host);
+    r->port = p->port;
+    cupsArrayAdd(polls, r);
+    if (r->uri == NULL || r->host == NULL)
+      break;
+  }
+  if (p != NULL || cupsArrayCount(polls) == 0) {
+    if (p != NULL)
+      debug_printf("ERROR: Unable to allocate memory.\n");
+    load_poll_free(polls);
+    return TRUE;
+  }
 
-  return 0;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&thread, &attr, load_poll_thread, polls)) {
+    debug_printf("Unable to create a thread for polling the load of the cluster members!\n");
+    load_poll_free(polls);
+  } else
+    load_poll_running = 1;
+  pthread_attr_destroy(&attr);
+
+  return TRUE;
 }
 
-remote_printer_t *
-printer_record (const char *printer) {
+/* Select the member of q's cluster to which the job gets sent, the one
+   which is predicted to finish it first. Returns its index in the
+   member list, -1 if no member can take the job, or -2 if we do not
+   have an up-to-date model for all candidates */
+static int
+load_model_select(remote_printer_t *q, const char *printer, int job_id,
+		  int *print_quality) {
+  cups_array_t *members;
   remote_printer_t *p;
+  int i, n, num_of_printers = 0, best = -1;
+  double predicted, best_predicted = 0;
+  time_t stale = time(NULL) - 3 * LoadPollInterval;
+
+  if (LoadPollInterval <= 0)
+    return -2;
+  members = cluster_members(q->queue_name);
+  if ((n = cupsArrayCount(members)) == 0)
+    return -1;
+  for (i = 0; i < n; i ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, i);
+    if (p->status == STATUS_CONFIRMED &&
+	(p->load_updated == 0 || p->load_updated < stale))
+      return -2;
+    if (p->status != STATUS_DISAPPEARED && p->status != STATUS_UNCONFIRMED &&
+	p->status != STATUS_TO_BE_RELEASED)
+      num_of_printers ++;
+  }
+
+  /* Start after the member used last time, so that members with the
+     same prediction get used in turn */
+  for (i = q->last_printer + 1; i <= q->last_printer + n; i ++) {
+    p = (remote_printer_t *)cupsArrayIndex(members, i % n);
+    if (p->status != STATUS_CONFIRMED || !p->load_accepting ||
+	p->load_state == IPP_PRINTER_STOPPED)
+      continue;
+    if (num_of_printers > 1 &&
+	!supports_job_attributes_requested(printer, p, job_id,
+					   print_quality)) {
+      debug_printf("Printer with uri %s in cluster %s doesn't support the requested job attributes\n",
+		   p->uri, p->queue_name);
+      continue;
+    }
+    predicted = load_model_predict(p);
+    debug_printf("Printer %s on host %s, port %d: %d jobs, completion of the job predicted in %.0f sec.\n",
+		 p->uri, p->host, p->port, p->load_jobs, predicted);
+    if (best < 0 || predicted < best_predicted) {
+      best = i % n;
+      best_predicted = predicted;
+    }
+  }
 
-  if (printer == NULL)
-    return NULL;
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
-    if (!p->slave_of && !strcasecmp(printer, p->queue_name))
-      return p;
-
-  return NULL;
+  return best;
 }
 
 void
 log_cluster(remote_printer_t *p) {
   remote_printer_t *q, *r;
+  cups_array_t *members;
   int i;
   if (p == NULL || (!debug_stderr && !debug_logfile))
     return;
@@ -5145,14 +6974,25 @@ log_cluster(remote_printer_t *p) {
   if (q->queue_name == NULL)
     return;
   debug_printf("Remote CUPS printers clustered as queue %s:\n", q->queue_name);
-  for (r = (remote_printer_t *)cupsArrayFirst(remote_printers), i = 0;
-       r; r = (remote_printer_t *)cupsArrayNext(remote_printers), i ++)
-    if (r->status != STATUS_DISAPPEARED && r->status != STATUS_UNCONFIRMED &&
+  members = cluster_members(q->queue_name);
+  for (i = 0; i < cupsArrayCount(members); i ++)
+    if ((r = (remote_printer_t *)cupsArrayIndex(members, i)) != NULL &&
+	r->status != STATUS_DISAPPEARED && r->status != STATUS_UNCONFIRMED &&
 	r->status != STATUS_TO_BE_RELEASED &&
-	(r == q || r->slave_of == q))
+	(r == q || r->slave_of == q)) {
       debug_printf("  %s%s%s\n", r->uri,
 		   (r == q ? "*" : ""),
 		   (i == q->last_printer ? " (last job printed)" : ""));
+      if (r->load_updated)
+	debug_printf("    Load: %s%s, %d jobs, %.1f pages/min, %.1f sec/job (%d jobs measured), completion of new job in %.0f sec, polled %ld sec ago\n",
+		     (r->load_state == IPP_PRINTER_IDLE ? "idle" :
+		      (r->load_state == IPP_PRINTER_PROCESSING ? "printing" :
+		       "stopped")),
+		     (r->load_accepting ? "" : ", not accepting jobs"),
+		     r->load_jobs, r->load_ppm, load_model_job_time(r),
+		     r->load_job_count, load_model_predict(r),
+		     (long)(time(NULL) - r->load_updated));
+    }
 }
 
 void
@@ -5176,6 +7016,11 @@ log_all_printers() {
 		    (p->status == STATUS_TO_BE_CREATED ?
 		     " (To be created/updated)" : "")))));
   debug_printf("===============================\n");
+  log_create_queue_pool();
+#ifdef HAVE_AVAHI
+  log_resolver_queue();
+#endif /* HAVE_AVAHI */
+  remote_printers_check_index(1);
 }
 
 char*
@@ -6027,17 +7872,20 @@ join_cluster_if_needed(remote_printer_t *p,
   /* is_cups_queue: -1: Unknown, 0: IPP printer, 1: Remote CUPS queue,
      2: Remote CUPS queue in user-defined cluster      */
 
-  remote_printer_t *q;
+  remote_printer_t *q = NULL;
+  cups_array_t *members;
+  int i;
 
-  for (q = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       q;
-       q = (remote_printer_t *)cupsArrayNext(remote_printers))
+  /* Queues with same name on server */
+  members = cluster_members(p->queue_name);
+  for (i = 0; i < cupsArrayCount(members); i ++) {
+    q = (remote_printer_t *)cupsArrayIndex(members, i);
     if (q != p &&
-	!strcasecmp(q->queue_name, p->queue_name) && /* Queue with same name
-							on server */
 	!q->slave_of) /* Find the master of the queues with this name,
 			 to avoid "daisy chaining" */
       break;
+    q = NULL;
+  }
   if (q && AutoClustering == 0 && (is_cups_queue == 1 ||is_cups_queue == 0) ) {
     debug_printf("We have already created a queue with the name %s for another remote CUPS printer but automatic clustering of equally named printers is turned off nor did we find a manually defined cluster this printer belongs to. Skipping this printer.\n", p->queue_name);
     debug_printf("In cups-browsed.conf try setting \"AutoClustering On\" to cluster equally-named remote CUPS printers, \"LocalQueueNamingRemoteCUPS DNS-SD\" to avoid queue name clashes, or define clusters with the \"Cluster\" directive.\n");
@@ -6171,9 +8019,10 @@ on_job_state (CupsNotifier *object,
 	      guint job_impressions_completed,
 	      gpointer user_data)
 {
-  int i, count;
+  int i, j, count;
   char buf[2048];
   remote_printer_t *p, *q, *r, *s=NULL;
+  cups_array_t *members;
   http_t *http = NULL;
   ipp_t *request, *response, *printer_attributes = NULL;
   ipp_attribute_t *attr;
@@ -6197,6 +8046,7 @@ on_job_state (CupsNotifier *object,
   cf_res_t     *max_res = NULL, *min_res = NULL, *res = NULL;
   int          xres, yres;
   int          got_printer_info;
+  int          model_used = 0;
   static const char *pattrs[] =
     {
      "printer-name",
@@ -6245,6 +8095,9 @@ on_job_state (CupsNotifier *object,
     }
   }
 
+  if (job_id != 0 && job_state >= IPP_JOB_CANCELED)
+    load_model_job_finished(job_id, (ipp_jstate_t)job_state);
+
   if (job_id != 0 && job_state == IPP_JOB_PROCESSING) {
     /* Printer started processing a job, check if it uses the implicitclass
        backend and if so, we select the remote queue to which to send the job
@@ -6310,32 +8163,51 @@ on_job_state (CupsNotifier *object,
 	 printer in the list. Method taken from the cupsdFindAvailablePrinter()
 	 function of the scheduler/classes.c file of CUPS. */
 
+      /* q->last_printer is the index of the printer in the member list
+	 of the cluster */
+      members = cluster_members(q->queue_name);
       if (q->last_printer < 0 ||
-	  q->last_printer >= cupsArrayCount(remote_printers))
+	  q->last_printer >= cupsArrayCount(members))
 	q->last_printer = 0;
       log_cluster(q);
-      for (i = q->last_printer + 1; ; i++) {
-	if (i >= cupsArrayCount(remote_printers))
+
+      /* With the jobs queuing on the servers take the member which is
+	 predicted to finish the job first, if we have an up-to-date
+	 load model of all members, otherwise ask the members now */
+      if (LoadBalancingType == QUEUE_ON_SERVERS &&
+	  (i = load_model_select(q, printer, job_id, &print_quality)) != -2) {
+	model_used = 1;
+	if (i >= 0) {
+	  p = (remote_printer_t *)cupsArrayIndex(members, i);
+	  valid_dest_found = 1;
+	  dest_host = p->ip ? p->ip : p->host;
+	  strncpy(destination_uri, p->uri, sizeof(destination_uri) - 1);
+	  printer_attributes = p->prattrs;
+	  pdl = p->pdl;
+	  s = p;
+	  dest_index = i;
+	}
+      }
+
+      for (i = q->last_printer + 1; !model_used; i++) {
+	if (i >= cupsArrayCount(members))
 	  i = 0;
-	p = (remote_printer_t *)cupsArrayIndex(remote_printers, i);
-	if (!strcasecmp(p->queue_name, printer) &&
-	    p->status == STATUS_CONFIRMED) {
+	p = (remote_printer_t *)cupsArrayIndex(members, i);
+	if (p->status == STATUS_CONFIRMED) {
 	  num_of_printers = 0;
-	  for (r = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	       r; r = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-	    if (!strcmp(r->queue_name, q->queue_name)) {
-	      if(r->status == STATUS_DISAPPEARED ||
-		 r->status == STATUS_UNCONFIRMED ||
-		 r->status == STATUS_TO_BE_RELEASED )
-		continue;
-	      num_of_printers ++;
-	    }
+	  for (j = 0; j < cupsArrayCount(members); j ++) {
+	    r = (remote_printer_t *)cupsArrayIndex(members, j);
+	    if(r->status == STATUS_DISAPPEARED ||
+	       r->status == STATUS_UNCONFIRMED ||
+	       r->status == STATUS_TO_BE_RELEASED )
+	      continue;
+	    num_of_printers ++;
 	  }
 
 	  /* If we are in a cluster, see whether the printer supports the 
 	     requested job attributes*/
 	  if (num_of_printers > 1) {
-	    if (!supports_job_attributes_requested(printer, i, job_id,
+	    if (!supports_job_attributes_requested(printer, p, job_id,
 						   &print_quality)) {
 	      debug_printf("Printer with uri %s in cluster %s doesn't support the requested job attributes\n",
 			   p->uri, p->queue_name);
@@ -6351,10 +8223,9 @@ on_job_state (CupsNotifier *object,
 	  /* Check whether the printer is idle, processing, or disabled */
 	  debug_printf("HTTP connection to %s:%d established.\n", p->host,
 		       p->port);
-	  response = cfGetPrinterAttributes(p->uri, pattrs,
+	  response = get_printer_attributes(NULL, p->uri, pattrs,
 					    sizeof(pattrs) / sizeof(pattrs[0]),
 					    NULL, 0, 0);
-	  debug_log_out(cf_get_printer_attributes_log);
 	  if (response != NULL) {
 	    debug_printf("IPP request to %s:%d successful.\n", p->host,
 			 p->port);
@@ -6618,6 +8489,8 @@ on_job_state (CupsNotifier *object,
 		   "requesting-user-name", NULL, cupsUser());
       if (dest_host) {
 	q->last_printer = dest_index;
+	if (s)
+	  load_model_job_started(s, job_id);
 	snprintf(buf, sizeof(buf), "\"%d %s %s %s\"", job_id, destination_uri,
 		 document_format, resolution);
 	debug_printf("Destination for job %d to %s: %s\n",
@@ -6677,6 +8550,12 @@ on_printer_deleted (CupsNotifier *object,
     return;
   }
 
+  /* Drop the queue from our list of local queues right away, if it got
+     re-created meanwhile, the printer events of CUPS re-add it */
+  pthread_rwlock_wrlock(&lock);
+  local_printers_set (printer, NULL, FALSE);
+  pthread_rwlock_unlock(&lock);
+
   if (is_created_by_cups_browsed(printer)) {
     /* Get available CUPS queues to check whether the queue did not
        already get re-created */
@@ -6788,11 +8667,10 @@ queue_overwritten (remote_printer_t *p)
 		   sizeof(local_queue_uri),
 		   "ipp", NULL, "localhost", 0,
 		   "/printers/%s", p->queue_name);
-  response = cfGetPrinterAttributes2(conn, local_queue_uri,
-				     pattrs, sizeof(pattrs) / sizeof(pattrs[0]),
-				     pattrs, sizeof(pattrs) / sizeof(pattrs[0]),
-				     1);
-  debug_log_out(cf_get_printer_attributes_log);
+  response = get_printer_attributes(conn, local_queue_uri,
+				    pattrs, sizeof(pattrs) / sizeof(pattrs[0]),
+				    pattrs, sizeof(pattrs) / sizeof(pattrs[0]),
+				    1);
   if (!response || cupsLastError() > IPP_STATUS_OK_CONFLICTING) {
     debug_printf("lpstat: %s\n", cupsLastErrorString());
   } else {
@@ -6871,9 +8749,9 @@ on_printer_modified (CupsNotifier *object,
   remote_printer_t *p;
   http_t        *conn = NULL;
   ipp_t         *request;               /* IPP Request */
-  int           re_create, is_cups_queue;
+  int           i, re_create, is_cups_queue;
   char          *new_queue_name;
-  cups_array_t  *to_be_renamed;
+  cups_array_t  *members, *to_be_renamed;
   char          local_queue_uri[1024];
   char          *resolved_uri = NULL;
 
@@ -6881,6 +8759,11 @@ on_printer_modified (CupsNotifier *object,
 
   debug_printf("[CUPS Notification] Printer modified: %s\n",
 	       text);
+
+  /* Update the queue in our list of local queues right away */
+  if ((conn = http_connect_local ()) != NULL)
+    local_printer_update (conn, printer);
+
   pthread_rwlock_wrlock(&lock);
   if (is_created_by_cups_browsed(printer)) {
     p = printer_record(printer);
@@ -6934,14 +8817,14 @@ on_printer_modified (CupsNotifier *object,
 	 queue name. Drop entries where renaming fails */
       to_be_renamed = cupsArrayNew(NULL, NULL);
       /* Put the printer entries which need attention into
-	 a separate array, as we cannot run two nested loops
-	 on one CUPS array, as our printer entry array */
-      for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	   p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
-	if (strcasecmp(p->queue_name, printer) == 0) {
-	  p->overwritten = 1;
-	  cupsArrayAdd(to_be_renamed, p);
-	}
+	 a separate array, as renaming removes them from the
+	 member list of the cluster with the old name */
+      members = cluster_members(printer);
+      for (i = 0; i < cupsArrayCount(members); i ++) {
+	p = (remote_printer_t *)cupsArrayIndex(members, i);
+	p->overwritten = 1;
+	cupsArrayAdd(to_be_renamed, p);
+      }
       for (p = (remote_printer_t *)cupsArrayFirst(to_be_renamed);
 	   p; p = (remote_printer_t *)cupsArrayNext(to_be_renamed)) {
 	is_cups_queue = (p->netprinter == 0 ? 1 : 0);
@@ -6963,8 +8846,10 @@ on_printer_modified (CupsNotifier *object,
 	  debug_printf("No new name for printer found, no replacement queue to be created.\n");
 	  re_create = 0;
 	} else {
+	  remote_printer_unindex(p);
 	  free(p->queue_name);
 	  p->queue_name = new_queue_name;
+	  remote_printer_index(p);
 	  /* Check whether the queue under its new name will be stand-alone or
 	     part of a cluster */
 	  if (join_cluster_if_needed(p, is_cups_queue) < 0) {
@@ -7278,8 +9163,7 @@ create_remote_printer_entry (const char *queue_name,
        or interface script at this point. */
     p->netprinter = 0;
     if (p->uri[0] != '\0') {
-      p->prattrs = cfGetPrinterAttributes(p->uri, NULL, 0, NULL, 0, 1);
-      debug_log_out(cf_get_printer_attributes_log);
+      p->prattrs = get_printer_attributes_cached(p->uri);
       if (p->prattrs == NULL)
 	debug_printf("get-printer-attributes IPP call failed on printer %s (%s).\n",
 		     p->queue_name, p->uri);
@@ -7336,10 +9220,8 @@ create_remote_printer_entry (const char *queue_name,
     }
 
     /* Check whether we have an equally named queue already */
-    for (q = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 q;
-	 q = (remote_printer_t *)cupsArrayNext(remote_printers))
-      if (!strcasecmp(q->queue_name, p->queue_name)) {/* Queue with same name */
+    if ((q = (remote_printer_t *)
+	 cupsArrayIndex(cluster_members(p->queue_name), 0)) != NULL) {
 	debug_printf("We have already created a queue with the name %s for another printer. Skipping this printer.\n", p->queue_name);
 	debug_printf("Try setting \"LocalQueueNamingIPPPrinter DNS-SD\" in cups-browsed.conf.\n");
 	goto fail;
@@ -7347,8 +9229,7 @@ create_remote_printer_entry (const char *queue_name,
 
     p->slave_of = NULL;
     p->netprinter = 1;
-    p->prattrs = cfGetPrinterAttributes(p->uri, NULL, 0, NULL, 0, 1);
-    debug_log_out(cf_get_printer_attributes_log);
+    p->prattrs = get_printer_attributes_cached(p->uri);
     if (p->prattrs == NULL) {
       debug_printf("get-printer-attributes IPP call failed on printer %s (%s).\n",
 		   p->queue_name, p->uri);
@@ -7560,7 +9441,7 @@ create_remote_printer_entry (const char *queue_name,
     goto fail;
   /* Add the new remote printer entry */
   log_all_printers();
-  cupsArrayAdd(remote_printers, p);
+  remote_printer_add(p);
   log_all_printers();
 
   /* If auto shutdown is active we have perhaps scheduled a timer to shut down
@@ -7580,6 +9461,8 @@ create_remote_printer_entry (const char *queue_name,
  fail:
   debug_printf("ERROR: Unable to create print queue, ignoring printer.\n");
   if (p->prattrs) ippDelete(p->prattrs);
+  g_free(p->profile);
+  g_free(p->merge_key);
   if (http_printer)
     httpClose(http_printer);
   if (p->type) free (p->type);
@@ -7604,31 +9487,35 @@ create_remote_printer_entry (const char *queue_name,
 void
 remove_printer_entry(remote_printer_t *p) {
   remote_printer_t *q = NULL, *r;
+  cups_array_t *members;
+  int i;
 
   if (p == NULL) {
     debug_printf ("ERROR: remove_printer_entry(): Supplied printer entry is NULL");
     return;
   }
 
+  /* Slaves have the same queue name as their master */
+  members = cluster_members(p->queue_name);
   if (!p->slave_of) {
     /* Check whether this queue has a slave from another server and
        find it */
-    for (q = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 q;
-	 q = (remote_printer_t *)cupsArrayNext(remote_printers))
+    for (i = 0; i < cupsArrayCount(members); i ++) {
+      q = (remote_printer_t *)cupsArrayIndex(members, i);
       if (q != p && q->slave_of == p &&
 	  q->status != STATUS_DISAPPEARED && q->status != STATUS_UNCONFIRMED &&
 	  q->status != STATUS_TO_BE_RELEASED)
 	break;
+      q = NULL;
+    }
   }
   if (q) {
     /* Make q the master of the cluster and p a slave of q. This way
        removal of p does not delete the cluster's CUPS queue and update 
        of q makes sure the cluster's queue gets back into working state */
-    for (r = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 r;
-	 r = (remote_printer_t *)cupsArrayNext(remote_printers))
-      if (r != q && r->slave_of == p &&
+    for (i = 0; i < cupsArrayCount(members); i ++)
+      if ((r = (remote_printer_t *)cupsArrayIndex(members, i)) != q &&
+	  r->slave_of == p &&
 	  r->status != STATUS_DISAPPEARED && r->status != STATUS_UNCONFIRMED &&
 	  r->status != STATUS_TO_BE_RELEASED)
 	r->slave_of = q;
@@ -7653,13 +9540,130 @@ remove_printer_entry(remote_printer_t *p) {
   p->timeout = time(NULL) + TIMEOUT_REMOVE;
 }
 
-void create_queue(void* arg) {
+/* Check whether the entry a create_queue() job was queued for is still
+   to be created/updated with the same queue name and URI, after having
+   released the lock for a while */
+static int
+create_queue_entry_unchanged(remote_printer_t *p, create_args_t *a) {
+  return (p->status == STATUS_TO_BE_CREATED &&
+	  p->queue_name && !strcmp(p->queue_name, a->queue) &&
+	  p->uri && !strcmp(p->uri, a->uri));
+}
+
+/* Generate the PPD file for the CUPS queue of p (or of p's cluster).
+   Called with the lock held. The attributes of the printer(s) are
+   merged/copied under the lock and the PPD file is generated after
+   releasing it, so that other threads do not need to wait for it.
+   Returns 1 on success, 0 if the PPD could not get generated, and -1
+   if the entry got changed while the lock was released. Always returns
+   with the lock held. */
+static int
+create_queue_ppd(remote_printer_t *p, create_args_t *a,
+		 char *ppdname, size_t ppdname_size) {
+  remote_printer_t *r;
+  cups_array_t  *members;
+  int           m, ret;
+  ipp_t         *printer_attributes;
+  ipp_attribute_t *attr;
+  char          *make_model = NULL;
+  char          *pdl = NULL;
+  int           color, duplex;
+  cups_array_t  *conflicts = NULL;
+  cups_array_t  *sizes = NULL;
+  char          *default_pagesize = NULL;
+  const char    *default_color = NULL;
+  char          ppdgenerator_msg[1024];
+  unsigned long cache_hits, cache_misses;
+  int           cache_ppds;
+
+  members = cluster_members(p->queue_name);
+  if (cupsArrayCount(members) <= 1) {
+    printer_attributes = ippNew();
+    ippCopyAttributes(printer_attributes, p->prattrs, 0, NULL, NULL);
+    if (p->make_model)
+      make_model = strdup(p->make_model);
+    if (p->pdl)
+      pdl = strdup(p->pdl);
+    color = p->color;
+    duplex = p->duplex;
+  } else {
+    make_model = (char*)calloc(256, sizeof(char));
+    default_pagesize = (char *)malloc(sizeof(char)*32);
+    get_cluster_merged_attributes(p->queue_name, &printer_attributes,
+				  &conflicts, &sizes, default_pagesize, 32,
+				  &default_color);
+    if ((attr = ippFindAttribute(printer_attributes,
+				 "printer-make-and-model",
+				 IPP_TAG_TEXT)) != NULL)
+      strncpy(make_model, ippGetString(attr, 0, NULL), 255);
+    color = 0;
+    duplex = 0;
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      r = (remote_printer_t *)cupsArrayIndex(members, m);
+      if (r->color == 1)
+	color = 1;
+      if (r->duplex == 1)
+	duplex = 1;
+    }
+  }
+
+  pthread_rwlock_unlock(&lock);
+
+  if (ppdCreatePPDFromIPP2(ppdname, ppdname_size, printer_attributes,
+			   make_model, pdl, color, duplex, conflicts, sizes,
+			   default_pagesize, default_color,
+			   ppdgenerator_msg, sizeof(ppdgenerator_msg))) {
+    debug_printf("PPD generation successful: %s\n", ppdgenerator_msg);
+    debug_printf("Created temporary PPD file: %s\n", ppdname);
+    ppdCreatePPDFromIPPCacheStats(&cache_hits, &cache_misses, &cache_ppds);
+    debug_printf("PPD generator cache: %lu hits, %lu misses, %d PPD files cached\n",
+		 cache_hits, cache_misses, cache_ppds);
+    ret = 1;
+  } else {
+    if (errno != 0)
+      debug_printf("Unable to create PPD file: %s\n", strerror(errno));
+    else
+      debug_printf("Unable to create PPD file: %s\n", ppdgenerator_msg);
+    ret = 0;
+  }
+
+  ippDelete(printer_attributes);
+  if (make_model)
+    free(make_model);
+  if (pdl)
+    free(pdl);
+  if (default_pagesize)
+    free(default_pagesize);
+  if (conflicts)
+    cupsArrayDelete(conflicts);
+  if (sizes)
+    cupsArrayDelete(sizes);
 
   pthread_rwlock_wrlock(&lock);
 
+  if (!create_queue_entry_unchanged(p, a)) {
+    debug_printf("Printer entry %s (%s) changed during PPD generation, dropping the PPD.\n",
+		 a->queue, a->uri);
+    if (ret == 1)
+      unlink(ppdname);
+    ret = -1;
+  }
+
+  return ret;
+}
+
+/* Create/update the CUPS queue for a remote printer entry, run by the
+   worker threads of create_queue_pool. The global lock is released
+   while talking to the remote printer and while generating the PPD
+   file. The entry itself cannot get freed meanwhile as
+   update_cups_queues() does not remove entries with p->called set. */
+void create_queue(void* arg) {
+
   create_args_t* a = (create_args_t*)arg;
-  remote_printer_t *p, *r, *s, *master;
-  http_t        *http;
+  remote_printer_t *p = a->printer, *s, *master;
+  cups_array_t  *members;
+  int           m;
+  http_t        *http = NULL;
   char          uri[HTTP_MAX_URI], device_uri[HTTP_MAX_URI], buf[1024],
                 line[1024];
   int           num_options;
@@ -7669,15 +9673,10 @@ void create_queue(void* arg) {
   ipp_t         *request;
   time_t        current_time;
   int           i, ap_remote_queue_id_line_inserted,
-                new_cupsfilter_line_inserted, want_raw,
-                num_cluster_printers = 0;
+                new_cupsfilter_line_inserted, want_raw;
   char          *disabled_str;
-  char          ppdgenerator_msg[1024];
   char          *ppdfile;
   char          ppdname[1024];
-#ifdef HAVE_CUPS_1_6
-  ipp_attribute_t *attr;
-#endif
   const char    *loadedppd = NULL;
   ppd_file_t    *ppd = NULL;
   ppd_choice_t  *choice;
@@ -7687,33 +9686,15 @@ void create_queue(void* arg) {
   const char    *val = NULL;
   cups_dest_t   *dest = NULL;
   int           is_shared;
-  cups_array_t  *conflicts = NULL;
-  ipp_t         *printer_attributes = NULL;
-  cups_array_t  *sizes=NULL;
-  ipp_t         *printer_ipp_response;
-  char          *make_model = NULL;
-  const char    *pdl=NULL;
-  int           color;
-  int           duplex;
-  char          *default_pagesize = NULL;
-  const char    *default_color = NULL;
+  ipp_t         *prattrs;
 
   debug_printf("create_queue() in THREAD %ld\n", pthread_self());
 
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-    if(!strcmp(p->queue_name, a->queue) && p->status == STATUS_TO_BE_CREATED) {
-      break;
-    }
-  }
-
-  pthread_rwlock_unlock(&lock);
-
-  if (!p || (p && p->status!=STATUS_TO_BE_CREATED))
-    return;
-
   pthread_rwlock_wrlock(&lock);
 
+  if (!create_queue_entry_unchanged(p, a))
+    goto end;
+
   current_time = time(NULL);
 
   if (p->slave_of) {
@@ -7752,6 +9733,29 @@ void create_queue(void* arg) {
   debug_printf("Creating/Updating CUPS queue %s\n",
 	       p->queue_name);
 
+  /* Poll the printer's capabilities without holding the lock, the
+     printer can take up to HttpRemoteTimeout seconds to answer (or not
+     to answer). We need them for generating the PPD file of an IPP
+     network printer and for the PPD of a remote CUPS queue when using
+     the implicitclass backend */
+  if (p->prattrs == NULL &&
+      (p->netprinter == 1 || cups_notifier != NULL)) {
+    pthread_rwlock_unlock(&lock);
+    prattrs = get_printer_attributes_cached(a->uri);
+    pthread_rwlock_wrlock(&lock);
+    if (!create_queue_entry_unchanged(p, a)) {
+      debug_printf("Printer entry %s (%s) changed while polling its attributes, retrying later.\n",
+		   a->queue, a->uri);
+      if (prattrs)
+	ippDelete(prattrs);
+      goto end;
+    }
+    if (p->prattrs == NULL)
+      p->prattrs = prattrs;
+    else if (prattrs)
+      ippDelete(prattrs);
+  }
+
   /* Make sure to have a connection to the local CUPS daemon */
   if ((http = http_connect_local ()) == NULL) {
     debug_printf("Unable to connect to CUPS!\n");
@@ -7759,7 +9763,10 @@ void create_queue(void* arg) {
     p->timeout = current_time + TIMEOUT_RETRY;
     goto end;
   }
-  httpSetTimeout(http, HttpLocalTimeout, http_timeout_cb, NULL);
+  /* Several workers share the local connection (one at a time, under
+     the global lock), so time-outs are flagged in our own job */
+  httpSetTimeout(http, HttpLocalTimeout, http_timeout_cb,
+		 &a->timeout_reached);
 
   /* Do not auto-save option settings due to the print queue creation
      process */
@@ -7936,10 +9943,6 @@ void create_queue(void* arg) {
   /* If we did not already obtain a PPD file from the temporary CUPS queue
      for our IPP network printer, we proceed here */
   if (p->netprinter == 1) {
-    if (p->prattrs == NULL) {
-      p->prattrs = cfGetPrinterAttributes(p->uri, NULL, 0, NULL, 0, 1);
-      debug_log_out(cf_get_printer_attributes_log);
-    }
     if (p->prattrs == NULL) {
       debug_printf("get-printer-attributes IPP call failed on printer %s (%s).\n",
 		   p->queue_name, p->uri);
@@ -7949,113 +9952,32 @@ void create_queue(void* arg) {
       cannot_create = 1;
       goto end;
     }
-    num_cluster_printers = 0;
-    for (s = (remote_printer_t *)cupsArrayFirst(remote_printers);
-         s; s = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-      if (!strcmp(s->queue_name, p->queue_name)) {
-        if (s->status == STATUS_DISAPPEARED ||
-	    s->status == STATUS_UNCONFIRMED ||
-	    s->status == STATUS_TO_BE_RELEASED ){
-	  goto end;
-	}
-        num_cluster_printers ++;
+    members = cluster_members(p->queue_name);
+    for (m = 0; m < cupsArrayCount(members); m ++) {
+      s = (remote_printer_t *)cupsArrayIndex(members, m);
+      if (s->status == STATUS_DISAPPEARED ||
+	  s->status == STATUS_UNCONFIRMED ||
+	  s->status == STATUS_TO_BE_RELEASED ){
+	goto end;
       }
     }
 
-    if (num_cluster_printers == 1) {
-      printer_attributes = p->prattrs;
-      conflicts = NULL;
-      default_pagesize = NULL;
-      default_color = NULL;
-      make_model = p->make_model;
-      pdl = p->pdl;
-      color = p->color;
-      duplex = p->duplex;
-      sizes = NULL;
-    } else {
-      make_model = (char*)malloc(sizeof(char) * 256);
-      printer_attributes = get_cluster_attributes(p->queue_name);
-      if ((attr = ippFindAttribute(printer_attributes,
-				   "printer-make-and-model",
-				   IPP_TAG_TEXT)) != NULL)
-        strncpy(make_model, ippGetString(attr, 0, NULL),
-		sizeof(make_model) - 1);
-      color = 0;
-      duplex = 0;
-      for (r = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	   r; r = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-        if (!strcmp(p->queue_name, r->queue_name)) {
-	  if (r->color == 1)
-	    color = 1;
-	  if (r->duplex == 1)
-	    duplex = 1;
-        }
-      }
-      default_pagesize = (char *)malloc(sizeof(char)*32);
-      debug_printf("Generated Merged Attributes for local queue %s\n",
-		   p->queue_name);
-      conflicts = generate_cluster_conflicts(p->queue_name,
-					     printer_attributes);
-      debug_printf("Generated Constraints for queue %s\n",
-		   p->queue_name);
-      sizes = get_cluster_sizes(p->queue_name);
-      get_cluster_default_attributes(&printer_attributes,
-				     p->queue_name, default_pagesize,
-				     &default_color);
-      debug_printf("Generated Default Attributes for local queue %s\n",
-		   p->queue_name);
-    }
     if (ppdfile == NULL) {
       /* If we do not want CUPS-generated PPDs or we cannot obtain a
          CUPS-generated PPD, for example if CUPS does not create a
          temporary queue for this printer, we generate a PPD by
          ourselves */
-      printer_ipp_response = (num_cluster_printers == 1) ? p->prattrs :
-        printer_attributes;
-      if (!ppdCreatePPDFromIPP2(ppdname, sizeof(ppdname), printer_ipp_response,
-				make_model,
-				pdl, color, duplex, conflicts, sizes,
-				default_pagesize, default_color,
-				ppdgenerator_msg, sizeof(ppdgenerator_msg))) {
-        if (errno != 0)
-	  debug_printf("Unable to create PPD file: %s\n",
-		       strerror(errno));
-        else
-	  debug_printf("Unable to create PPD file: %s\n",
-		       ppdgenerator_msg);
+      i = create_queue_ppd(p, a, ppdname, sizeof(ppdname));
+      if (i < 0)
+	goto end;
+      if (i == 0) {
         p->status = STATUS_DISAPPEARED;
 	current_time = time(NULL);
         p->timeout = current_time + TIMEOUT_IMMEDIATELY;
         cannot_create = 1;
         goto end;
-      } else {
-        debug_printf("PPD generation successful: %s\n", ppdgenerator_msg);
-        debug_printf("Created temporary PPD file: %s\n", ppdname);
-        ppdfile = strdup(ppdname);
-      }
-    }
-
-    if (num_cluster_printers != 1) {
-      if (default_pagesize != NULL) {
-	free(default_pagesize);
-	default_pagesize = NULL;
-      }
-      if (make_model != NULL) {
-	free(make_model);
-	make_model = NULL;
-      }
-      if (conflicts != NULL) {
-	cupsArrayDelete(conflicts);
-	conflicts = NULL;
-      }
-      if (printer_attributes != NULL) {
-	ippDelete(printer_attributes);
-	printer_attributes = NULL;
-      }
-      if (sizes != NULL) {
-	cupsArrayDelete(sizes);
-	sizes = NULL;
       }
+      ppdfile = strdup(ppdname);
     }
   }
 #endif /* HAVE_CUPS_1_6 */
@@ -8108,120 +10030,36 @@ void create_queue(void* arg) {
 	 distribution's package installation/update infrastructure
 	 is suppressed. */
       /* Generating the ppd file for the remote cups queue */
-      if (p->prattrs == NULL) {
-	p->prattrs = cfGetPrinterAttributes(p->uri, NULL, 0, NULL, 0, 1);
-	debug_log_out(cf_get_printer_attributes_log);
-      }
       if (p->prattrs == NULL) {
 	debug_printf("get-printer-attributes IPP call failed on printer %s (%s).\n",
 		     p->queue_name, p->uri);
 	cannot_create = 1;
 	goto end;
       }
-      num_cluster_printers = 0;
-      for (s = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	   s; s = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-	if (!strcmp(s->queue_name, p->queue_name)) {
-	  if (s->status == STATUS_DISAPPEARED ||
-	      s->status == STATUS_UNCONFIRMED ||
-	      s->status == STATUS_TO_BE_RELEASED ){
-	    goto end;
-	  }
-	  num_cluster_printers++;
-	}
-      }
-      if (num_cluster_printers == 1) {
-	printer_attributes = p->prattrs;
-	conflicts = NULL;
-	default_pagesize = NULL;
-	default_color = NULL;
-	make_model = p->make_model;
-	pdl = p->pdl;
-	color = p->color;
-	duplex = p->duplex;
-	sizes = NULL;
-      } else {
-	make_model = (char*)malloc(sizeof(char)*256);
-	printer_attributes = get_cluster_attributes(p->queue_name);
-	if((attr = ippFindAttribute(printer_attributes,
-				    "printer-make-and-model",
-				    IPP_TAG_TEXT)) != NULL)
-	  strncpy(make_model, ippGetString(attr, 0, NULL),
-		  sizeof(make_model) - 1);
-	color = 0;
-	duplex = 0;
-	for (r = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	     r; r = (remote_printer_t *)cupsArrayNext(remote_printers)) {
-	  if (!strcmp(p->queue_name, r->queue_name)) {
-	    if (r->color == 1)
-	      color = 1;
-	    if (r->duplex == 1)
-	      duplex = 1;
-	  }
-	}
-	default_pagesize = (char *)malloc(sizeof(char)*32);
-	debug_printf("Generated Merged Attributes for local queue %s\n",
-		     p->queue_name);
-	conflicts = generate_cluster_conflicts(p->queue_name,
-					       printer_attributes);
-	debug_printf("Generated Constraints for queue %s\n",p->queue_name);
-	sizes = get_cluster_sizes(p->queue_name);
-	get_cluster_default_attributes(&printer_attributes, p->queue_name,
-				       default_pagesize,&default_color);
-	debug_printf("Generated Default Attributes for local queue %s\n",
-		     p->queue_name);
-      }
-      if (ppdfile == NULL) {
-	/* If we do not want CUPS-generated PPDs or we cannot obtain a
-	   CUPS-generated PPD, for example if CUPS does not create a
-	   temporary queue for this printer, we generate a PPD by
-	   ourselves */
-	printer_ipp_response = (num_cluster_printers == 1) ? p->prattrs :
-	  printer_attributes;
-	if (!ppdCreatePPDFromIPP2(ppdname, sizeof(ppdname),
-				  printer_ipp_response, make_model,
-				  pdl, color, duplex, conflicts, sizes,
-				  default_pagesize, default_color,
-				  ppdgenerator_msg, sizeof(ppdgenerator_msg))) {
-	  if (errno != 0)
-	    debug_printf("Unable to create PPD file: %s\n",
-			 strerror(errno));
-	  else
-	    debug_printf("Unable to create PPD file: %s\n", ppdgenerator_msg);
-	  p->status = STATUS_DISAPPEARED;
-	  current_time = time(NULL);
-	  p->timeout = current_time + TIMEOUT_IMMEDIATELY;
-	  cannot_create = 1;
+      members = cluster_members(p->queue_name);
+      for (m = 0; m < cupsArrayCount(members); m ++) {
+	s = (remote_printer_t *)cupsArrayIndex(members, m);
+	if (s->status == STATUS_DISAPPEARED ||
+	    s->status == STATUS_UNCONFIRMED ||
+	    s->status == STATUS_TO_BE_RELEASED ){
 	  goto end;
-	} else {
-	  debug_printf("PPD generation successful: %s\n", ppdgenerator_msg);
-	  debug_printf("Created temporary PPD file: %s\n", ppdname);
-	  ppdfile = strdup(ppdname);
 	}
       }
-    }
-
-    if (num_cluster_printers != 1) {
-      if (default_pagesize != NULL) {
-	free(default_pagesize);
-	default_pagesize = NULL;
-      }
-      if (make_model != NULL) {
-	free(make_model);
-	make_model = NULL;
-      }
-      if (conflicts != NULL) {
-	cupsArrayDelete(conflicts);
-	conflicts = NULL;
-      }
-      if (printer_attributes != NULL) {
-	ippDelete(printer_attributes);
-	printer_attributes = NULL;
-      }
-      if (sizes != NULL) {
-	cupsArrayDelete(sizes);
-	sizes = NULL;
+      /* If we do not want CUPS-generated PPDs or we cannot obtain a
+	 CUPS-generated PPD, for example if CUPS does not create a
+	 temporary queue for this printer, we generate a PPD by
+	 ourselves */
+      i = create_queue_ppd(p, a, ppdname, sizeof(ppdname));
+      if (i < 0)
+	goto end;
+      if (i == 0) {
+	p->status = STATUS_DISAPPEARED;
+	current_time = time(NULL);
+	p->timeout = current_time + TIMEOUT_IMMEDIATELY;
+	cannot_create = 1;
+	goto end;
       }
+      ppdfile = strdup(ppdname);
     }
   } else {
     /* Device URI: using implicitclass backend for IPP network printer */
@@ -8582,6 +10420,7 @@ void create_queue(void* arg) {
   }
 
   p->status = STATUS_CONFIRMED;
+  remote_printers_changed = 1;
   if (p->is_legacy) {
     p->timeout = time(NULL) + BrowseTimeout;
     debug_printf("starting BrowseTimeout timer for %s (%ds)\n",
@@ -8594,7 +10433,7 @@ void create_queue(void* arg) {
      because the creation can fall through the process, have state changed
      to STATUS_CONFIRMED and experience the timeout */
   /* If no timeout has happened, clear p->timeouted */
-  if (timeout_reached == 1) {
+  if (a->timeout_reached) {
     fprintf(stderr, "Timeout happened during creation of the queue %s, turn on DebugLogging for more info.\n", p->queue_name);
     p->timeouted ++;
     debug_printf("The queue %s already timeouted %d times in a row.\n",
@@ -8610,6 +10449,9 @@ void create_queue(void* arg) {
   p->no_autosave = 0;
 
  end:
+  /* a gets freed, do not leave a pointer to its flag behind */
+  if (http)
+    httpSetTimeout(http, HttpLocalTimeout, http_timeout_cb, NULL);
   p->called = 0;
   pthread_rwlock_unlock(&lock);
   free(a->uri);
@@ -8619,6 +10461,242 @@ void create_queue(void* arg) {
   return;
 }
 
+static double
+timeval_diff(struct timeval *from, struct timeval *to) {
+  return (to->tv_sec - from->tv_sec) + (to->tv_usec - from->tv_usec) / 1e6;
+}
+
+/* Export the statistics of the queue creation workers for monitoring,
+   one "Key value" line each, into the CREATE_QUEUE_STATS_FILE in the
+   cache directory. Rewritten at most every CREATE_QUEUE_STATS_INTERVAL
+   seconds unless force is set */
+static void
+save_create_queue_pool_stats(int force) {
+  create_queue_pool_t *pool = &create_queue_pool;
+  cups_file_t *fp;
+  char tempfile[2048];
+  time_t now = time(NULL);
+
+  pthread_mutex_lock(&pool->mutex);
+  if (!force && now - pool->stats_saved < CREATE_QUEUE_STATS_INTERVAL) {
+    pthread_mutex_unlock(&pool->mutex);
+    return;
+  }
+  pool->stats_saved = now;
+
+  snprintf(tempfile, sizeof(tempfile), "%s.N", create_queue_stats_file);
+  if ((fp = cupsFileOpen(tempfile, "w")) == NULL) {
+    pthread_mutex_unlock(&pool->mutex);
+    debug_printf("Unable to write queue creation statistics file %s: %s\n",
+		 tempfile, strerror(errno));
+    return;
+  }
+  cupsFilePrintf(fp, "Time %ld\n", (long)now);
+  cupsFilePrintf(fp, "Workers %d\n", pool->num_threads);
+  cupsFilePrintf(fp, "Busy %d\n", pool->busy);
+  cupsFilePrintf(fp, "Waiting %d\n",
+		 (pool->jobs ? cupsArrayCount(pool->jobs) : 0));
+  cupsFilePrintf(fp, "MaxWaiting %d\n", pool->max_depth);
+  cupsFilePrintf(fp, "Done %lu\n", pool->done);
+  cupsFilePrintf(fp, "SlowStart %lu\n", pool->slow);
+  cupsFilePrintf(fp, "LastWait %.3f\n", pool->last_wait);
+  cupsFilePrintf(fp, "AvgWait %.3f\n",
+		 (pool->done ? pool->total_wait / pool->done : 0.0));
+  cupsFilePrintf(fp, "MaxWait %.3f\n", pool->max_wait);
+  cupsFilePrintf(fp, "LastRun %.3f\n", pool->last_run);
+  cupsFilePrintf(fp, "AvgRun %.3f\n",
+		 (pool->done ? pool->total_run / pool->done : 0.0));
+  cupsFilePrintf(fp, "MaxRun %.3f\n", pool->max_run);
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (cupsFileClose(fp) || rename(tempfile, create_queue_stats_file)) {
+    debug_printf("Unable to write queue creation statistics file %s: %s\n",
+		 create_queue_stats_file, strerror(errno));
+    unlink(tempfile);
+  }
+}
+
+/* Called in the main loop when a worker has finished a job, as the
+   timer for update_cups_queues() skips entries with p->called set */
+static gboolean
+create_queue_done(gpointer unused) {
+  save_create_queue_pool_stats(0);
+  if (in_shutdown == 0)
+    recheck_timer();
+  return FALSE;
+}
+
+static void *
+create_queue_worker(void *unused) {
+  create_queue_pool_t *pool = &create_queue_pool;
+  create_args_t *a;
+  struct timeval queued, started, finished;
+  double wait, run;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->stopping && cupsArrayCount(pool->jobs) == 0)
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+    if (pool->stopping) {
+      pthread_mutex_unlock(&pool->mutex);
+      break;
+    }
+    a = (create_args_t *)cupsArrayFirst(pool->jobs);
+    cupsArrayRemove(pool->jobs, a);
+    pool->busy ++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    queued = a->queued;
+    gettimeofday(&started, NULL);
+    create_queue(a); /* Frees a */
+    gettimeofday(&finished, NULL);
+    wait = timeval_diff(&queued, &started);
+    run = timeval_diff(&started, &finished);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->busy --;
+    pool->done ++;
+    pool->total_wait += wait;
+    pool->total_run += run;
+    if (wait > pool->max_wait)
+      pool->max_wait = wait;
+    if (run > pool->max_run)
+      pool->max_run = run;
+    pool->last_wait = wait;
+    pool->last_run = run;
+    if (wait > CREATE_QUEUE_WAIT_WARN)
+      pool->slow ++;
+    pthread_mutex_unlock(&pool->mutex);
+
+    debug_printf("Queue creation job finished after %.3f sec (%.3f sec waiting).\n",
+		 run, wait);
+    if (wait > CREATE_QUEUE_WAIT_WARN)
+      debug_printf("WARNING: Queue creation job waited %.0f sec for a worker, consider increasing CreateQueueThreads.\n",
+		   wait);
+
+    g_idle_add(create_queue_done, NULL);
+  }
+
+  return NULL;
+}
+
+/* Start the worker threads for creating/updating CUPS queues. Their
+   number is limited by the CreateQueueThreads directive, so that a
+   burst of newly discovered printers does not spawn a thread for each
+   of them */
+static void
+create_queue_pool_start(void) {
+  create_queue_pool_t *pool = &create_queue_pool;
+  int i;
+
+  pool->jobs = cupsArrayNew(NULL, NULL);
+  pool->threads = (pthread_t *)calloc(CreateQueueThreads, sizeof(pthread_t));
+  if (pool->jobs == NULL || pool->threads == NULL) {
+    debug_printf("ERROR: Unable to allocate memory.\n");
+    exit(1);
+  }
+  for (i = 0; i < CreateQueueThreads; i ++)
+    if (pthread_create(&pool->threads[pool->num_threads], NULL,
+		       create_queue_worker, NULL))
+      debug_printf("Unable to create a queue creation worker thread!\n");
+    else
+      pool->num_threads ++;
+  debug_printf("Started %d queue creation worker threads.\n",
+	       pool->num_threads);
+}
+
+/* Let the workers finish their current jobs and terminate them. Jobs
+   still waiting are dropped, their printer entries get unmarked so
+   that update_cups_queues() can remove them */
+static void
+create_queue_pool_stop(void) {
+  create_queue_pool_t *pool = &create_queue_pool;
+  create_args_t *a;
+  int i;
+
+  if (pool->threads == NULL)
+    return;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (i = 0; i < pool->num_threads; i ++)
+    pthread_join(pool->threads[i], NULL);
+  free(pool->threads);
+  pool->threads = NULL;
+  pool->num_threads = 0;
+
+  pthread_rwlock_wrlock(&lock);
+  while ((a = (create_args_t *)cupsArrayFirst(pool->jobs)) != NULL) {
+    cupsArrayRemove(pool->jobs, a);
+    a->printer->called = 0;
+    free(a->uri);
+    free(a->queue);
+    free(a);
+  }
+  pthread_rwlock_unlock(&lock);
+  cupsArrayDelete(pool->jobs);
+  pool->jobs = NULL;
+
+  save_create_queue_pool_stats(1);
+}
+
+/* Queue the creation/update of the CUPS queue for p, returns 0 on
+   success, -1 if the job could not get queued */
+static int
+create_queue_pool_add(remote_printer_t *p) {
+  create_queue_pool_t *pool = &create_queue_pool;
+  create_args_t *a;
+  int depth;
+
+  if ((a = (create_args_t *)calloc(1, sizeof(create_args_t))) == NULL)
+    return -1;
+  a->printer = p;
+  a->queue = strdup(p->queue_name);
+  a->uri = strdup(p->uri);
+  gettimeofday(&a->queued, NULL);
+
+  pthread_mutex_lock(&pool->mutex);
+  if (pool->threads == NULL || pool->num_threads == 0 || pool->stopping ||
+      a->queue == NULL || a->uri == NULL) {
+    pthread_mutex_unlock(&pool->mutex);
+    if (a->queue) free(a->queue);
+    if (a->uri) free(a->uri);
+    free(a);
+    return -1;
+  }
+  p->called = 1;
+  cupsArrayAdd(pool->jobs, a);
+  depth = cupsArrayCount(pool->jobs);
+  if (depth > pool->max_depth)
+    pool->max_depth = depth;
+  pthread_cond_signal(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  debug_printf("Queued creation/update of CUPS queue %s, %d jobs waiting.\n",
+	       p->queue_name, depth);
+
+  return 0;
+}
+
+static void
+log_create_queue_pool(void) {
+  create_queue_pool_t *pool = &create_queue_pool;
+
+  pthread_mutex_lock(&pool->mutex);
+  debug_printf("Queue creation workers: %d, busy: %d, jobs waiting: %d (max. %d), jobs done: %lu (%lu waited > %d sec), wait time avg. %.3f sec (max. %.3f sec), run time avg. %.3f sec (max. %.3f sec)\n",
+	       pool->num_threads, pool->busy,
+	       (pool->jobs ? cupsArrayCount(pool->jobs) : 0), pool->max_depth,
+	       pool->done, pool->slow, CREATE_QUEUE_WAIT_WARN,
+	       (pool->done ? pool->total_wait / pool->done : 0.0),
+	       pool->max_wait,
+	       (pool->done ? pool->total_run / pool->done : 0.0),
+	       pool->max_run);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
 
 gboolean update_cups_queues(gpointer unused) {
 
@@ -8669,10 +10747,8 @@ gboolean update_cups_queues(gpointer unused) {
 
     if(cannot_create) goto cannot_create;
 
-    /* We need to get the current time as precise as possible for retries
-       and reset the timeout flag */
+    /* We need to get the current time as precise as possible for retries */
     current_time = time(NULL);
-    timeout_reached = 0;
 
     /* terminating means we have received a signal and should shut down.
        in_shutdown means we have exited the main loop.
@@ -8721,6 +10797,11 @@ gboolean update_cups_queues(gpointer unused) {
       if (p->timeout > current_time)
 	break;
 
+      /* A worker thread still has this entry in its hands, remove it
+	 when the worker is done */
+      if (p->called)
+	break;
+
       debug_printf("Removing entry %s (%s)%s.\n", p->queue_name, p->uri,
 		   (p->slave_of ||
 		    p->status == STATUS_TO_BE_RELEASED ? "" :
@@ -8843,7 +10924,7 @@ gboolean update_cups_queues(gpointer unused) {
 	 the element right after the deleted element. So no skipping
          of an element and especially no reading beyond the end of the
          array. */
-      cupsArrayRemove(remote_printers, p);
+      remote_printer_remove(p);
       if (p->queue_name) free (p->queue_name);
       if (p->location) free (p->location);
       if (p->info) free (p->info);
@@ -8859,6 +10940,8 @@ gboolean update_cups_queues(gpointer unused) {
       if (p->domain) free (p->domain);
       cupsArrayDelete(p->ipp_discoveries);
       if (p->prattrs) ippDelete (p->prattrs);
+      g_free(p->profile);
+      g_free(p->merge_key);
       if (p->nickname) free (p->nickname);
       free(p);
       p = NULL;
@@ -8881,39 +10964,17 @@ gboolean update_cups_queues(gpointer unused) {
     /* DNS-SD has reported a new remote printer, create a CUPS queue for it,
        or upgrade an existing queue, or update a queue to use a backup host
        when it has disappeared on the currently used host */
-    /* (...or, we've just received a CUPS Browsing packet for this queue) */
-    case STATUS_TO_BE_CREATED:
-      {
-        if (p->called)
-	  break;
-
-        create_args_t* arg = (create_args_t*)malloc(sizeof(create_args_t));
-        arg->queue = strdup(p->queue_name);
-        arg->uri = strdup(p->uri);
-
-        pthread_t id;
-        p->called = 1;
-        int err = 0;
-        if ((err = pthread_create(&id, NULL, (void*)create_queue, (void*)arg))){
-	  debug_printf("Unable to create a new thread, retrying!\n");
-
-	  int attempts = 0;
-	  while (attempts < 5) {
-	    if ((err = pthread_create(&id, NULL, (void*)create_queue,
-				      (void*)arg)))
-	      debug_printf("Unable to create a new thread, retrying!\n");
-	    else break;
-	    attempts++;
-	  }
-	  if(attempts == 5){
-	    debug_printf("Could not create new thread even after many attempts for queue %s\n",
-			 p->queue_name);
-	    free(arg);
-	    p->called = 0;
-	    break;
-	  }
-	}
-	pthread_detach(id);
+    /* (...or, we've just received a CUPS Browsing packet for this queue) */
+    case STATUS_TO_BE_CREATED:
+      /* Already queued or being worked on by a worker thread */
+      if (p->called)
+	break;
+
+      if (create_queue_pool_add(p) < 0) {
+	debug_printf("Could not queue the creation of the CUPS queue %s, retrying later.\n",
+		     p->queue_name);
+	if (in_shutdown == 0)
+	  p->timeout = time(NULL) + TIMEOUT_RETRY;
       }
       break;
 
@@ -8953,6 +11014,8 @@ gboolean update_cups_queues(gpointer unused) {
     remove_printer_entry(p);
 
   log_all_printers();
+  if (!in_shutdown)
+    save_remote_printers();
   pthread_rwlock_unlock(&update_lock);
 
   if (in_shutdown == 0)
@@ -9422,6 +11485,8 @@ examine_discovered_printer_record(const char *host,
   char service_host_name[1024];
 #endif /* HAVE_AVAHI */
   remote_printer_t *p = NULL, key_rec;
+  cups_array_t *members;
+  int i;
   char *local_queue_name = NULL;
   int is_cups_queue;
   int raw_queue = 0;
@@ -9635,22 +11700,30 @@ examine_discovered_printer_record(const char *host,
 
   /* Check if we have already created a queue for the discovered
      printer */
-  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-       p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
-    if (!strcasecmp(p->queue_name, local_queue_name) &&
-	(p->host[0] == '\0' ||
-	 p->status == STATUS_UNCONFIRMED ||
-	 p->status == STATUS_DISAPPEARED ||
-	 ((!strcasecmp(p->host, remote_host) ||
-	   (is_local_hostname(p->host) && is_local_hostname(remote_host))) &&
-	  (p->port == port ||
-	   (p->port == 631 && port == 443) ||
-	   (p->port == 443 && port == 631)) &&
-	  (txt ||
-	   (strlen(p->uri) - strlen(resource) > 0 &&
-	    !strcasecmp(p->uri + strlen(p->uri) - strlen(resource),
-			resource))))))
+  members = cluster_members(local_queue_name);
+  /* Prefer an entry kept from the previous session for exactly this
+     service */
+  for (i = 0, p = NULL; i < cupsArrayCount(members); i ++, p = NULL)
+    if ((p = (remote_printer_t *)cupsArrayIndex(members, i)) != NULL &&
+	p->restored && p->status == STATUS_UNCONFIRMED &&
+	!strcmp(p->uri, uri))
       break;
+  if (!p)
+    for (i = 0, p = NULL; i < cupsArrayCount(members); i ++, p = NULL)
+      if ((p = (remote_printer_t *)cupsArrayIndex(members, i)) != NULL &&
+	  (p->host[0] == '\0' ||
+	   p->status == STATUS_UNCONFIRMED ||
+	   p->status == STATUS_DISAPPEARED ||
+	   ((!strcasecmp(p->host, remote_host) ||
+	     (is_local_hostname(p->host) && is_local_hostname(remote_host))) &&
+	    (p->port == port ||
+	     (p->port == 631 && port == 443) ||
+	     (p->port == 443 && port == 631)) &&
+	    (txt ||
+	     (strlen(p->uri) - strlen(resource) > 0 &&
+	      !strcasecmp(p->uri + strlen(p->uri) - strlen(resource),
+			  resource))))))
+	break;
 
   /* Is there a local queue with the same URI as the remote queue? */
   if (!p) {
@@ -9688,17 +11761,24 @@ examine_discovered_printer_record(const char *host,
        having more info in contrary to the existing being
        discovered by legacy CUPS or LDAP */
 
-    int downgrade = 0, upgrade = 0;
+    int downgrade = 0, upgrade = 0, keep = 0;
 
     /* Get first element of array of interfaces on which this printer
        got already discovered, as this one is "lo" when it already got
        discovered through the loopback interface (preferred interface) */
     ipp_discovery_t *ippdis = cupsArrayFirst(p->ipp_discoveries);
 
+    /* The entry of the previous session is for the same service, the
+       queue is still there and up to date, so only confirm it */
+    if (p->status == STATUS_UNCONFIRMED && p->restored &&
+	!strcmp(p->uri, uri)) {
+      keep = 1;
+      debug_printf("Printer entry %s (URI: %s) is the same as in the previous session, keeping its queue.\n",
+		   p->queue_name, p->uri);
     /* Force upgrade if the found entry is marked unconfirmed or
        disappeared */
-    if (p->status == STATUS_UNCONFIRMED ||
-	p->status == STATUS_DISAPPEARED) {
+    } else if (p->status == STATUS_UNCONFIRMED ||
+	       p->status == STATUS_DISAPPEARED) {
       upgrade = 1;
       debug_printf("Replacing printer entry %s (Host: %s, Port: %d) as it was marked %s. New URI: %s\n",
 		   p->queue_name, remote_host, port,
@@ -9729,7 +11809,7 @@ examine_discovered_printer_record(const char *host,
 		   p->queue_name, remote_host, port, uri);
     }
 
-    if (downgrade == 0) {
+    if (downgrade == 0 && keep == 0) {
       /* Check if there is an upgrade */
       /* IPP -> IPPS */
       if (strcasestr(type, "_ipps") &&
@@ -9763,6 +11843,7 @@ examine_discovered_printer_record(const char *host,
 	if (p->status == STATUS_CONFIRMED)
 	  p->timeout = (time_t) -1;
       }
+      remote_printer_unindex(p);
       free(p->queue_name);
       free(p->location);
       free(p->info);
@@ -9792,6 +11873,8 @@ examine_discovered_printer_record(const char *host,
       p->service_name = strdup(service_name);
       p->type = strdup(type);
       p->domain = strdup(domain);
+      p->restored = 0;
+      remote_printer_index(p);
       debug_printf("Switched over to newly discovered entry for this printer.\n");
     } else
       debug_printf("Staying with previously discovered entry for this printer.\n");
@@ -9803,6 +11886,7 @@ examine_discovered_printer_record(const char *host,
       debug_printf("Marking entry for %s (URI: %s) as confirmed.\n",
 		   p->queue_name, p->uri);
       p->status = STATUS_CONFIRMED;
+      remote_printers_changed = 1;
       if (p->is_legacy) {
 	p->timeout = time(NULL) + BrowseTimeout;
 	debug_printf("starting BrowseTimeout timer for %s (%ds)\n",
@@ -9820,6 +11904,7 @@ examine_discovered_printer_record(const char *host,
     }
 
     /* Gather extra info from our new discovery */
+    remote_printer_unindex(p);
     if (p->uri[0] == '\0') {
       free (p->uri);
       p->uri = strdup(uri);
@@ -9868,6 +11953,7 @@ examine_discovered_printer_record(const char *host,
       free (p->domain);
       p->domain = strdup(domain);
     }
+    remote_printer_index(p);
     if (domain != NULL && domain[0] != '\0' &&
 	type != NULL && type[0] != '\0')
       ipp_discoveries_add(p->ipp_discoveries, interface, type, family);
@@ -10001,10 +12087,55 @@ allowed (struct sockaddr *srcaddr)
 }
 
 #ifdef HAVE_AVAHI
+static void
+resolver_args_free(resolver_args_t *a) {
+  if (a->name) free((char*)a->name);
+  if (a->type) free((char*)a->type);
+  if (a->domain) free((char*)a->domain);
+  if (a->host_name) free((char*)a->host_name);
+  if (a->txt) avahi_string_list_free(a->txt);
+  if (a->address) free((AvahiAddress*)a->address);
+  free(a);
+}
+
+static char *
+resolver_queue_key(AvahiIfIndex interface, AvahiProtocol protocol,
+		   const char *name, const char *type, const char *domain) {
+  return g_strdup_printf("%d %d %s.%s.%s", interface, protocol, name, type,
+			 domain);
+}
+
+/* Whether the service got removed after a got queued. Then a is from a
+   batch which was already handed over when the REMOVE came in, and must
+   not add the printer again. Call with lock held, the REMOVE handling in
+   browse_callback() records the removal and removes the printer under
+   the same lock */
+static int
+resolver_args_removed(resolver_args_t *a) {
+  resolver_queue_t *q = &resolver_queue;
+  char *key;
+  gpointer removed;
+  int ret = 0;
+
+  key = resolver_queue_key(a->interface, a->protocol, a->name, a->type,
+			   a->domain);
+  pthread_mutex_lock(&q->mutex);
+  if (q->removed &&
+      g_hash_table_lookup_extended(q->removed, key, NULL, &removed) &&
+      (unsigned long)GPOINTER_TO_SIZE(removed) > a->generation)
+    ret = 1;
+  pthread_mutex_unlock(&q->mutex);
+  g_free(key);
+  if (ret)
+    debug_printf("Avahi Resolver: Service '%s' of type '%s' in domain '%s' got removed in the meantime, skipped.\n",
+		 a->name, a->type, a->domain);
+
+  return ret;
+}
+
 static void resolve_callback(void* arg) {
   resolver_args_t* a = (resolver_args_t*)arg;
 
-  AvahiServiceResolver *r = a->r;
   AvahiIfIndex interface = a->interface;
   AvahiResolverEvent event = a->event;
   const char *name = a->name;
@@ -10023,7 +12154,7 @@ static void resolve_callback(void* arg) {
 
   debug_printf("resolve_callback() in THREAD %ld\n", pthread_self());
 
-  if (r == NULL || name == NULL || type == NULL || domain == NULL)
+  if (name == NULL || type == NULL || domain == NULL)
     return;
 
   /* Get the interface name */
@@ -10086,7 +12217,7 @@ static void resolve_callback(void* arg) {
 		   address->proto == AVAHI_PROTO_INET6 ? "IPv6" :
 		   "IPv4/IPv6 Unknown") :
 		  "IPv4/IPv6 Unknown"),
-		 avahi_strerror(avahi_client_errno(avahi_service_resolver_get_client(r))));
+		 avahi_strerror(a->error));
     break;
 
   /* New remote printer found */
@@ -10211,20 +12342,22 @@ static void resolve_callback(void* arg) {
 	    debug_printf("Avahi Resolver: Service '%s' of type '%s' in domain '%s' with IP address %s.\n",
 			 name, type, domain, addrstr);
 	    pthread_rwlock_wrlock(&lock);
-	    examine_discovered_printer_record((strcasecmp(ifname, "lo") ?
-					       host_name : "localhost"),
-					      addrstr, port, rp_value, name,
-					      "", instance, type, domain,
-					      ifname, addr->sa_family, txt);
+	    if (!resolver_args_removed(a))
+	      examine_discovered_printer_record((strcasecmp(ifname, "lo") ?
+						 host_name : "localhost"),
+						addrstr, port, rp_value, name,
+						"", instance, type, domain,
+						ifname, addr->sa_family, txt);
 	    pthread_rwlock_unlock(&lock);
 	  } else {
 	    pthread_rwlock_wrlock(&lock);
-	    examine_discovered_printer_record((strcasecmp(ifname, "lo") ?
-					       host_name : "localhost"),
-					      NULL, port, rp_value,
-					      name, "", instance, type,
-					      domain, ifname, addr->sa_family,
-					      txt);
+	    if (!resolver_args_removed(a))
+	      examine_discovered_printer_record((strcasecmp(ifname, "lo") ?
+						 host_name : "localhost"),
+						NULL, port, rp_value,
+						name, "", instance, type,
+						domain, ifname, addr->sa_family,
+						txt);
 	    pthread_rwlock_unlock(&lock);
 	  }
 	} else
@@ -10236,17 +12369,18 @@ static void resolve_callback(void* arg) {
 	   point to it */
 	if (host_name) {
 	  pthread_rwlock_wrlock(&lock);
-	  examine_discovered_printer_record((strcasecmp(ifname, "lo") ?
-					     host_name : "localhost"),
-					    NULL, port, rp_value,
-					    name, "", instance, type, domain,
-					    ifname,
-					    (address->proto ==
-					     AVAHI_PROTO_INET ? AF_INET :
-					     (address->proto ==
-					      AVAHI_PROTO_INET6 ? AF_INET6 :
-					      0)),
-					    txt);
+	  if (!resolver_args_removed(a))
+	    examine_discovered_printer_record((strcasecmp(ifname, "lo") ?
+					       host_name : "localhost"),
+					      NULL, port, rp_value,
+					      name, "", instance, type, domain,
+					      ifname,
+					      (address->proto ==
+					       AVAHI_PROTO_INET ? AF_INET :
+					       (address->proto ==
+						AVAHI_PROTO_INET6 ? AF_INET6 :
+						0)),
+					      txt);
 	  pthread_rwlock_unlock(&lock);
 	} else
 	  debug_printf("Avahi Resolver: Service '%s' of type '%s' in domain '%s' skipped, host name not supplied.\n",
@@ -10277,20 +12411,195 @@ static void resolve_callback(void* arg) {
   }
 
  ignore:
-  if(a->r) avahi_service_resolver_free(a->r);
-  if(a->name) free((char*)a->name);
-  if(a->type) free((char*)a->type);
-  if(a->domain) free((char*)a->domain);
-  if(a->host_name) free((char*)a->host_name);
-  if(a->txt) free(a->txt);
-  if(a->address) free((AvahiAddress*)a->address);
-  free(a);
+  resolver_args_free(a);
   pthread_rwlock_unlock(&resolvelock);
 
   if (in_shutdown == 0)
     recheck_timer ();
 }
 
+static void *
+resolver_queue_worker(void *unused) {
+  resolver_queue_t *q = &resolver_queue;
+  cups_array_t *batch;
+  resolver_args_t *a;
+  int n;
+
+  for (;;) {
+    pthread_mutex_lock(&q->mutex);
+    while (!q->stopping && cupsArrayCount(q->batches) == 0)
+      pthread_cond_wait(&q->cond, &q->mutex);
+    if (q->stopping) {
+      pthread_mutex_unlock(&q->mutex);
+      break;
+    }
+    batch = (cups_array_t *)cupsArrayFirst(q->batches);
+    cupsArrayRemove(q->batches, batch);
+    pthread_mutex_unlock(&q->mutex);
+
+    n = cupsArrayCount(batch);
+    debug_printf("Processing batch of %d resolved DNS-SD services.\n", n);
+    for (a = (resolver_args_t *)cupsArrayFirst(batch); a;
+	 a = (resolver_args_t *)cupsArrayNext(batch))
+      resolve_callback(a); /* Frees a */
+    cupsArrayDelete(batch);
+
+    pthread_mutex_lock(&q->mutex);
+    q->processed += n;
+    q->batches_done ++;
+    /* Events which are still pending were queued after the REMOVEs */
+    if (cupsArrayCount(q->batches) == 0)
+      g_hash_table_remove_all(q->removed);
+    pthread_mutex_unlock(&q->mutex);
+  }
+
+  return NULL;
+}
+
+/* Start the worker thread for the resolved DNS-SD services. Without
+   it the batches get processed in the main loop */
+static void
+resolver_queue_start(void) {
+  resolver_queue_t *q = &resolver_queue;
+
+  q->pending = g_hash_table_new_full(str_case_hash, str_case_equal, g_free,
+				     NULL);
+  q->order = cupsArrayNew(NULL, NULL);
+  q->batches = cupsArrayNew(NULL, NULL);
+  q->removed = g_hash_table_new_full(str_case_hash, str_case_equal, g_free,
+				     NULL);
+  if (q->pending == NULL || q->order == NULL || q->batches == NULL ||
+      q->removed == NULL) {
+    debug_printf("ERROR: Unable to allocate memory.\n");
+    exit(1);
+  }
+  if (pthread_create(&q->thread, NULL, resolver_queue_worker, NULL))
+    debug_printf("Unable to create a thread for processing resolved DNS-SD services, processing them in the main loop.\n");
+  else
+    q->running = 1;
+}
+
+/* Drop all events which are not processed yet and stop the worker
+   thread after it has finished the current batch */
+static void
+resolver_queue_stop(void) {
+  resolver_queue_t *q = &resolver_queue;
+  cups_array_t *batch;
+  resolver_args_t *a;
+
+  if (q->pending == NULL)
+    return;
+
+  if (q->timer_id) {
+    g_source_remove(q->timer_id);
+    q->timer_id = 0;
+  }
+  if (q->running) {
+    pthread_mutex_lock(&q->mutex);
+    q->stopping = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+    pthread_join(q->thread, NULL);
+    q->running = 0;
+  }
+
+  cupsArrayAdd(q->batches, q->order);
+  q->order = NULL;
+  for (batch = (cups_array_t *)cupsArrayFirst(q->batches); batch;
+       batch = (cups_array_t *)cupsArrayNext(q->batches)) {
+    for (a = (resolver_args_t *)cupsArrayFirst(batch); a;
+	 a = (resolver_args_t *)cupsArrayNext(batch))
+      resolver_args_free(a);
+    cupsArrayDelete(batch);
+  }
+  cupsArrayDelete(q->batches);
+  q->batches = NULL;
+  g_hash_table_destroy(q->pending);
+  q->pending = NULL;
+  g_hash_table_destroy(q->removed);
+  q->removed = NULL;
+}
+
+/* Timer: Debounce window is over, hand over all pending events */
+static gboolean
+resolver_queue_flush(gpointer unused) {
+  resolver_queue_t *q = &resolver_queue;
+  cups_array_t *batch;
+  resolver_args_t *a;
+
+  q->timer_id = 0;
+  pthread_mutex_lock(&q->mutex);
+  if (cupsArrayCount(q->order) == 0) {
+    pthread_mutex_unlock(&q->mutex);
+    return FALSE;
+  }
+  batch = q->order;
+  q->order = cupsArrayNew(NULL, NULL);
+  g_hash_table_remove_all(q->pending);
+  if (q->running) {
+    cupsArrayAdd(q->batches, batch);
+    pthread_cond_signal(&q->cond);
+  }
+  pthread_mutex_unlock(&q->mutex);
+
+  if (!q->running) {
+    for (a = (resolver_args_t *)cupsArrayFirst(batch); a;
+	 a = (resolver_args_t *)cupsArrayNext(batch))
+      resolve_callback(a);
+    pthread_mutex_lock(&q->mutex);
+    q->processed += cupsArrayCount(batch);
+    q->batches_done ++;
+    g_hash_table_remove_all(q->removed);
+    pthread_mutex_unlock(&q->mutex);
+    cupsArrayDelete(batch);
+  }
+
+  return FALSE;
+}
+
+/* The service got removed, forget about not yet processed events for
+   it, so that it does not get added again. Events in batches which are
+   already handed over get skipped by resolver_args_removed() */
+static void
+resolver_queue_drop(AvahiIfIndex interface, AvahiProtocol protocol,
+		    const char *name, const char *type, const char *domain) {
+  resolver_queue_t *q = &resolver_queue;
+  resolver_args_t *a;
+  char *key;
+
+  if (q->pending == NULL)
+    return;
+  key = resolver_queue_key(interface, protocol, name, type, domain);
+  pthread_mutex_lock(&q->mutex);
+  if ((a = (resolver_args_t *)g_hash_table_lookup(q->pending, key)) != NULL) {
+    g_hash_table_remove(q->pending, key);
+    cupsArrayRemove(q->order, a);
+    q->dropped ++;
+  }
+  q->generation ++;
+  g_hash_table_insert(q->removed, key, GSIZE_TO_POINTER(q->generation));
+  pthread_mutex_unlock(&q->mutex);
+  if (a)
+    resolver_args_free(a);
+}
+
+static void
+log_resolver_queue(void) {
+  resolver_queue_t *q = &resolver_queue;
+
+  pthread_mutex_lock(&q->mutex);
+  debug_printf("Resolved DNS-SD services: %lu received, %lu coalesced, %lu dropped, %lu processed in %lu batches, %d pending, %d batches waiting\n",
+	       q->received, q->coalesced, q->dropped, q->processed,
+	       q->batches_done, cupsArrayCount(q->order),
+	       cupsArrayCount(q->batches));
+  pthread_mutex_unlock(&q->mutex);
+}
+
+/* Called by Avahi in the main loop when a service got resolved. A
+   network-wide burst of announcements (e. g. all printers re-announcing
+   after a switch reboot) would make us examine the same services many
+   times, so we only queue the event here, replacing an older one for
+   the same service, and process the queue in batches */
 void resolver_wrapper(AvahiServiceResolver *r,
 		      AvahiIfIndex interface,
 		      AvahiProtocol protocol,
@@ -10304,63 +12613,69 @@ void resolver_wrapper(AvahiServiceResolver *r,
 		      AvahiStringList *txt,
 		      AvahiLookupResultFlags flags,
 		      AVAHI_GCC_UNUSED void* userdata) {
+  resolver_queue_t *q = &resolver_queue;
+  resolver_args_t *arg, *old;
+  char *key;
 
   debug_printf("resolver_wrapper() in THREAD %ld\n", pthread_self());
 
-  resolver_args_t *arg = (resolver_args_t*)malloc(sizeof(resolver_args_t));
-  AvahiStringList* temp_txt = (AvahiStringList*)malloc(sizeof(AvahiStringList));
-  AvahiAddress* temp_addr = (AvahiAddress*)malloc(sizeof(AvahiAddress));
-
-  temp_txt = avahi_string_list_copy(txt);
-
-  if (address) {
-    temp_addr->proto = address->proto;
-    temp_addr->data = address->data;
+  if (name == NULL || type == NULL || domain == NULL || q->pending == NULL) {
+    avahi_service_resolver_free(r);
+    return;
   }
 
-  arg->r = r;
+  if ((arg = (resolver_args_t*)calloc(1, sizeof(resolver_args_t))) == NULL) {
+    debug_printf("ERROR: Unable to allocate memory.\n");
+    avahi_service_resolver_free(r);
+    return;
+  }
   arg->interface = interface;
   arg->protocol = protocol;
   arg->event = event;
   arg->name = strdup(name);
   arg->type = strdup(type);
   arg->domain = strdup(domain);
-  if(host_name) arg->host_name = strdup(host_name);
-  else arg->host_name = NULL;
-  arg->address = temp_addr;
+  if (host_name) arg->host_name = strdup(host_name);
+  if (address) {
+    AvahiAddress* temp_addr = (AvahiAddress*)malloc(sizeof(AvahiAddress));
+    if (temp_addr)
+      *temp_addr = *address;
+    arg->address = temp_addr;
+  }
   arg->port = port;
-  arg->txt = temp_txt;
+  arg->txt = avahi_string_list_copy(txt);
   arg->flags = flags;
   arg->userdata = userdata;
+  if (event == AVAHI_RESOLVER_FAILURE)
+    arg->error = avahi_client_errno(avahi_service_resolver_get_client(r));
 
-  pthread_t id;
-  int err;
+  /* The resolver has done its job */
+  avahi_service_resolver_free(r);
 
-  if ((err = pthread_create(&id, NULL, (void*)resolve_callback, (void*)arg))) {
-    debug_printf("Unable to create a new thread, retrying!\n");
-    int attempts = 0;
-    while (attempts < 5) {
-      if ((err = pthread_create(&id, NULL, (void*)resolve_callback,
-				(void*)arg)))
-        debug_printf("Unable to create a new thread, retrying!\n");
-      else
-	break;
-      attempts ++;
-    }
-    if (attempts == 5) {
-      debug_printf("Could not create new thread even after many attempts, ignoring this entry.\n");
-      if (arg->r) avahi_service_resolver_free(arg->r);
-      if (arg->name) free((char*)arg->name);
-      if (arg->type) free((char*)arg->type);
-      if (arg->domain) free((char*)arg->domain);
-      if (arg->host_name) free((char*)arg->host_name);
-      if (arg->txt) free(arg->txt);
-      if (arg->address) free((AvahiAddress*)arg->address);
-      free(arg);
+  pthread_mutex_lock(&q->mutex);
+  q->received ++;
+  arg->generation = q->generation;
+  key = resolver_queue_key(interface, protocol, name, type, domain);
+  if ((old = (resolver_args_t *)g_hash_table_lookup(q->pending, key)) !=
+      NULL) {
+    q->coalesced ++;
+    if (event == AVAHI_RESOLVER_FAILURE &&
+	old->event == AVAHI_RESOLVER_FOUND) {
+      /* Keep the successful resolution */
+      pthread_mutex_unlock(&q->mutex);
+      g_free(key);
+      resolver_args_free(arg);
       return;
     }
+    cupsArrayRemove(q->order, old);
+    resolver_args_free(old);
   }
-  pthread_detach(id);
+  g_hash_table_insert(q->pending, key, arg);
+  cupsArrayAdd(q->order, arg);
+  pthread_mutex_unlock(&q->mutex);
+
+  if (q->timer_id == 0)
+    q->timer_id = g_timeout_add(DNSSDEventDelay, resolver_queue_flush, NULL);
 }
 
 static void browse_callback(AvahiServiceBrowser *b,
@@ -10434,6 +12749,8 @@ static void browse_callback(AvahiServiceBrowser *b,
   /* A service (remote printer) has disappeared */
   case AVAHI_BROWSER_REMOVE: {
     remote_printer_t *p;
+    cups_array_t *members;
+    int i;
 
     if (name == NULL || type == NULL || domain == NULL)
       return;
@@ -10450,16 +12767,23 @@ static void browse_callback(AvahiServiceBrowser *b,
 		 protocol != AVAHI_PROTO_UNSPEC ?
 		 avahi_proto_to_string(protocol) : "Unknown");
 
+    /* Record the removal and remove the printer in one go, so that a
+       batch which is being processed cannot add it again in between */
+    pthread_rwlock_wrlock(&lock);
+    resolver_queue_drop(interface, protocol, name, type, domain);
+
     /* Ignore if terminated (by SIGTERM) */
     if (terminating) {
       debug_printf("Avahi Browser: Ignoring because cups-browsed is terminating.\n");
+      pthread_rwlock_unlock(&lock);
       break;
     }
 
     /* Check whether we have listed this printer */
-    for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
-	 p; p = (remote_printer_t *)cupsArrayNext(remote_printers))
-      if (p->status != STATUS_DISAPPEARED &&
+    members = remote_printers_with_service(name, domain);
+    for (i = 0, p = NULL; i < cupsArrayCount(members); i ++, p = NULL)
+      if ((p = (remote_printer_t *)cupsArrayIndex(members, i)) != NULL &&
+	  p->status != STATUS_DISAPPEARED &&
 	  p->status != STATUS_TO_BE_RELEASED &&
 	  !strcasecmp(p->service_name, name) &&
 	  !strcasecmp(p->domain, domain))
@@ -10495,6 +12819,7 @@ static void browse_callback(AvahiServiceBrowser *b,
       if (in_shutdown == 0)
 	recheck_timer ();
     }
+    pthread_rwlock_unlock(&lock);
     break;
   }
 
@@ -11208,8 +13533,13 @@ browse_poll_cancel_subscription (browsepoll_t *context)
     httpClose (conn);
 }
 
+/* Check for printer events on our subscription. Returns TRUE if the
+   printer list has to be re-fetched. If events is not NULL, events
+   which name a printer get collected there (lower-case printer name ->
+   LOCAL_PRINTER_EVENT_...) instead of making us re-fetch the list */
 static gboolean
-browse_poll_get_notifications (browsepoll_t *context, http_t *conn)
+browse_poll_get_notifications (browsepoll_t *context, http_t *conn,
+			       GHashTable *events)
 {
   ipp_t *request, *response = NULL;
   ipp_status_t status;
@@ -11263,22 +13593,67 @@ browse_poll_get_notifications (browsepoll_t *context, http_t *conn)
     int last_seq = context->sequence_number;
     if (response == NULL)
       return FALSE;
-    for (attr = ippFirstAttribute(response); attr;
-	 attr = ippNextAttribute(response))
-      if (ippGetGroupTag (attr) == IPP_TAG_EVENT_NOTIFICATION) {
-	/* There is a printer-* event here. */
-	seen_event = TRUE;
+    for (attr = ippFirstAttribute(response); attr; ) {
+      const char *event = NULL, *printer = NULL;
+      int type, old_type;
+      char *key;
+
+      /* Skip any non-event attributes */
+      if (ippGetGroupTag (attr) != IPP_TAG_EVENT_NOTIFICATION) {
+	attr = ippNextAttribute(response);
+	continue;
+      }
 
+      /* There is a printer-* event here. */
+      seen_event = TRUE;
+
+      for (; attr && ippGetGroupTag (attr) == IPP_TAG_EVENT_NOTIFICATION;
+	   attr = ippNextAttribute(response)) {
+	if (ippGetName (attr) == NULL)
+	  continue;
 	if (!strcmp (ippGetName (attr), "notify-sequence-number") &&
 	    ippGetValueTag (attr) == IPP_TAG_INTEGER)
 	  last_seq = ippGetInteger (attr, 0);
+	else if (!strcmp (ippGetName (attr), "notify-subscribed-event") &&
+		 ippGetValueTag (attr) == IPP_TAG_KEYWORD)
+	  event = ippGetString (attr, 0, NULL);
+	else if (!strcmp (ippGetName (attr), "printer-name") &&
+		 ippGetValueTag (attr) == IPP_TAG_NAME)
+	  printer = ippGetString (attr, 0, NULL);
+      }
+
+      if (events == NULL)
+	continue;
+      if (event == NULL || printer == NULL) {
+	/* We do not know what has changed */
+	get_printers = TRUE;
+	continue;
       }
 
+      if (!strcmp (event, "printer-deleted"))
+	type = LOCAL_PRINTER_EVENT_DELETED;
+      else if (!strcmp (event, "printer-state-changed"))
+	type = LOCAL_PRINTER_EVENT_STATE;
+      else
+	type = LOCAL_PRINTER_EVENT_CHANGED;
+      key = g_ascii_strdown (printer, -1);
+      old_type = GPOINTER_TO_INT (g_hash_table_lookup (events, key));
+      /* A queue which got deleted and added again has changed, a state
+	 change does not undo a deletion or a change */
+      if (type == LOCAL_PRINTER_EVENT_DELETED ||
+	  (type == LOCAL_PRINTER_EVENT_CHANGED &&
+	   old_type == LOCAL_PRINTER_EVENT_DELETED))
+	old_type = 0;
+      g_hash_table_replace (events, key,
+			    GINT_TO_POINTER (MAX (type, old_type)));
+    }
+
     if (seen_event) {
       debug_printf("cups-browsed [BrowsePoll %s:%d]: printer-* event\n",
 		   context->server, context->port);
       context->sequence_number = last_seq;
-      get_printers = TRUE;
+      if (events == NULL)
+	get_printers = TRUE;
     } else
       debug_printf("cups-browsed [BrowsePoll %s:%d]: no events\n",
 		   context->server, context->port);
@@ -11334,7 +13709,7 @@ browse_poll (gpointer data)
     } else
       /* On subsequent runs, check for notifications using our
        * subscription. */
-      get_printers = browse_poll_get_notifications (context, conn);
+      get_printers = browse_poll_get_notifications (context, conn, NULL);
   }
   else
     get_printers = TRUE;
@@ -12081,6 +14456,18 @@ read_configuration (const char *filename)
 	LoadBalancingType = QUEUE_ON_CLIENT;
       else if (!strncasecmp(value, "QueueOnServers", 14))
 	LoadBalancingType = QUEUE_ON_SERVERS;
+    } else if (!strcasecmp(line, "LoadPollInterval") && value) {
+      int t = atoi(value);
+      if (t >= 0) {
+	LoadPollInterval = t;
+	if (t > 0)
+	  debug_printf("Set interval for polling the load of cluster members to %d sec.\n",
+		       t);
+	else
+	  debug_printf("Do not poll the load of cluster members.\n");
+      } else
+	debug_printf("Invalid interval for polling the load of cluster members: %d\n",
+		     t);
     } else if (!strcasecmp(line, "DefaultOptions") && value) {
       if (DefaultOptions == NULL && strlen(value) > 0)
 	DefaultOptions = strdup(value);
@@ -12141,6 +14528,26 @@ read_configuration (const char *filename)
       } else
 	debug_printf("Invalid value for maximum number of CUPS queue updates per call of update_cups_queues(): %d\n",
 		     n);
+    } else if (!strcasecmp(line, "CreateQueueThreads") && value) {
+      int n = atoi(value);
+      if (n > 0) {
+	CreateQueueThreads = n;
+	debug_printf("Set number of threads for creating/updating CUPS queues to %d.\n",
+		     n);
+      } else
+	debug_printf("Invalid value for number of threads for creating/updating CUPS queues: %d\n",
+		     n);
+#ifdef HAVE_AVAHI
+    } else if (!strcasecmp(line, "DNSSDEventDelay") && value) {
+      int t = atoi(value);
+      if (t >= 0) {
+	DNSSDEventDelay = t;
+	debug_printf("Set delay for coalescing DNS-SD events to %d msec.\n",
+		     t);
+      } else
+	debug_printf("Invalid delay for coalescing DNS-SD events: %d\n",
+		     t);
+#endif /* HAVE_AVAHI */
     } else if (!strcasecmp(line, "PauseBetweenCUPSQueueUpdates") && value) {
       int t = atoi(value);
       if (t >= 0) {
@@ -12234,6 +14641,494 @@ nm_properties_changed (GDBusProxy *proxy,
   g_variant_iter_free (iter);
 }
 
+/*
+ * Remote printers of the previous session
+ *
+ * On startup find_previous_queue() finds the queues which we have
+ * created in the previous session only by their names, and each of them
+ * gets re-created (polling the printer, generating the PPD file,
+ * uploading it to CUPS) when its printer gets discovered again. With
+ * thousands of printers this takes a long time, although nearly all
+ * of the queues are still up to date. Therefore we save the confirmed
+ * entries of the remote printer list whenever it changes
+ * (save_remote_printers()), with their DNS-SD discoveries, cluster
+ * membership, and the fingerprint of the printer's capabilities
+ * (printer_profile()). On startup find_previous_queue() fills the
+ * entries of the queues which are still there from this file
+ * (restore_remote_printers()) and examine_discovered_printer_record()
+ * only confirms them when the printer appears again with the same URI,
+ * without re-creating the queue. In the meantime a separate thread
+ * checks with the printer attribute cache whether the capabilities of
+ * the printers have changed while we were not running
+ * (validate_restored_printers()). The queues of the changed ones get
+ * re-created, as well as the ones of printers which did not answer
+ * then, when they appear again.
+ *
+ * The file starts with a line "Version <n>", followed by a record for
+ * each entry:
+ *
+ * Printer <queue name>
+ * URI <printer URI>
+ * Host, IP, Port, Resource, ServiceName, Type, Domain <value>
+ * Location, Info, MakeModel, PDL <value>
+ * Color, Duplex, NetPrinter <0 or 1>
+ * Discovery <address family> <service type> <interface>
+ * Profile <fingerprint of the capabilities>
+ * End
+ *
+ * The entries of a cluster follow each other, the first one is the
+ * master.
+ */
+
+static void
+remote_printer_rec_free(void *data) {
+  remote_printer_rec_t *r = (remote_printer_rec_t *)data;
+
+  free(r->queue_name);
+  free(r->uri);
+  free(r->host);
+  free(r->ip);
+  free(r->resource);
+  free(r->service_name);
+  free(r->type);
+  free(r->domain);
+  free(r->location);
+  free(r->info);
+  free(r->make_model);
+  free(r->pdl);
+  cupsArrayDelete(r->ipp_discoveries);
+  free(r->profile);
+  free(r);
+}
+
+static int
+remote_printer_is_saved(remote_printer_t *p) {
+  /* Unconfirmed entries with URI are the ones of the previous session
+     and the ones kept while Avahi is not running */
+  return ((p->status == STATUS_CONFIRMED ||
+	   p->status == STATUS_UNCONFIRMED) && !p->is_legacy &&
+	  p->queue_name && p->uri && p->uri[0]);
+}
+
+static void
+save_remote_printer_value(cups_file_t *fp,
+			  const char *key,
+			  const char *value) {
+  const char *ptr;
+
+  if (value == NULL)
+    return;
+  cupsFilePrintf(fp, "%s ", key);
+  for (ptr = value; *ptr; ptr ++)
+    cupsFilePutChar(fp, (*ptr == '\n' || *ptr == '\r') ? ' ' : *ptr);
+  cupsFilePutChar(fp, '\n');
+}
+
+static void
+save_remote_printer(cups_file_t *fp,
+		    remote_printer_t *p) {
+  ipp_discovery_t *d;
+  int i;
+
+  save_remote_printer_value(fp, "Printer", p->queue_name);
+  save_remote_printer_value(fp, "URI", p->uri);
+  save_remote_printer_value(fp, "Host", p->host);
+  save_remote_printer_value(fp, "IP", p->ip);
+  cupsFilePrintf(fp, "Port %d\n", p->port);
+  save_remote_printer_value(fp, "Resource", p->resource);
+  save_remote_printer_value(fp, "ServiceName", p->service_name);
+  save_remote_printer_value(fp, "Type", p->type);
+  save_remote_printer_value(fp, "Domain", p->domain);
+  save_remote_printer_value(fp, "Location", p->location);
+  save_remote_printer_value(fp, "Info", p->info);
+  save_remote_printer_value(fp, "MakeModel", p->make_model);
+  save_remote_printer_value(fp, "PDL", p->pdl);
+  cupsFilePrintf(fp, "Color %d\n", p->color);
+  cupsFilePrintf(fp, "Duplex %d\n", p->duplex);
+  cupsFilePrintf(fp, "NetPrinter %d\n", p->netprinter);
+  for (i = 0; i < cupsArrayCount(p->ipp_discoveries); i ++) {
+    d = (ipp_discovery_t *)cupsArrayIndex(p->ipp_discoveries, i);
+    cupsFilePrintf(fp, "Discovery %d %s %s\n", d->family, d->type,
+		   d->interface);
+  }
+  if (p->prattrs)
+    cupsFilePrintf(fp, "Profile %s\n", printer_profile(p));
+  cupsFilePuts(fp, "End\n");
+}
+
+/* Save the confirmed entries of the remote printer list, if it has
+   changed since the last time */
+static void
+save_remote_printers(void) {
+  cups_file_t *fp;
+  char tempfile[2048];
+  remote_printer_t *p, *q;
+  cups_array_t *members;
+  GHashTable *saved;
+  int i, slaves, num_saved = 0;
+
+  pthread_rwlock_wrlock(&lock);
+  if (!remote_printers_changed) {
+    pthread_rwlock_unlock(&lock);
+    return;
+  }
+
+  snprintf(tempfile, sizeof(tempfile), "%s.N", remote_printers_file);
+  if ((fp = cupsFileOpen(tempfile, "w")) == NULL) {
+    pthread_rwlock_unlock(&lock);
+    debug_printf("Unable to write remote printer list file %s: %s\n",
+		 tempfile, strerror(errno));
+    return;
+  }
+
+  cupsFilePrintf(fp, "Version %d\n", REMOTE_PRINTERS_FILE_VERSION);
+  saved = g_hash_table_new(str_case_hash, str_case_equal);
+  for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
+       p; p = (remote_printer_t *)cupsArrayNext(remote_printers)) {
+    if (!remote_printer_is_saved(p) ||
+	g_hash_table_contains(saved, p->queue_name))
+      continue;
+    g_hash_table_add(saved, p->queue_name);
+    /* Whole cluster, master first */
+    members = cluster_members(p->queue_name);
+    for (slaves = 0; slaves <= 1; slaves ++)
+      for (i = 0; i < cupsArrayCount(members); i ++) {
+	q = (remote_printer_t *)cupsArrayIndex(members, i);
+	if (remote_printer_is_saved(q) && (q->slave_of != NULL) == slaves) {
+	  save_remote_printer(fp, q);
+	  num_saved ++;
+	}
+      }
+  }
+  g_hash_table_destroy(saved);
+  remote_printers_changed = 0;
+  pthread_rwlock_unlock(&lock);
+
+  if (cupsFileClose(fp) || rename(tempfile, remote_printers_file)) {
+    debug_printf("Unable to write remote printer list file %s: %s\n",
+		 remote_printers_file, strerror(errno));
+    unlink(tempfile);
+    pthread_rwlock_wrlock(&lock);
+    remote_printers_changed = 1;
+    pthread_rwlock_unlock(&lock);
+  } else
+    debug_printf("Saved %d remote printers to %s\n", num_saved,
+		 remote_printers_file);
+}
+
+static void
+remote_printer_rec_set(char **field,
+		       const char *value) {
+  free(*field);
+  *field = strdup(value);
+}
+
+/* Load the remote printers saved by save_remote_printers() in the
+   previous session into saved_remote_printers */
+static void
+load_remote_printers(void) {
+  cups_file_t *fp;
+  char line[2048], *value, type[256], interface[256];
+  remote_printer_rec_t *r = NULL;
+  cups_array_t *list;
+  int version = -1, family, num_loaded = 0;
+
+  if ((fp = cupsFileOpen(remote_printers_file, "r")) == NULL)
+    return;
+
+  debug_printf("Loading remote printers of the previous session from %s\n",
+	       remote_printers_file);
+
+  saved_remote_printers =
+    g_hash_table_new_full(str_case_hash, str_case_equal, g_free,
+			  (GDestroyNotify)cupsArrayDelete);
+  while (cupsFileGets(fp, line, sizeof(line))) {
+    if ((value = strchr(line, ' ')) != NULL)
+      *value++ = '\0';
+    else
+      value = line + strlen(line);
+    if (version < 0) {
+      if (strcmp(line, "Version") ||
+	  (version = atoi(value)) != REMOTE_PRINTERS_FILE_VERSION) {
+	debug_printf("Remote printer list file %s has an unsupported format, ignoring it.\n",
+		     remote_printers_file);
+	break;
+      }
+    } else if (!strcmp(line, "Printer")) {
+      if (r)
+	remote_printer_rec_free(r);
+      if ((r = (remote_printer_rec_t *)
+	   calloc(1, sizeof(remote_printer_rec_t))) == NULL) {
+	debug_printf("ERROR: Unable to allocate memory.\n");
+	break;
+      }
+      r->queue_name = strdup(value);
+      r->ipp_discoveries =
+	cupsArrayNew3(ipp_discovery_cmp, NULL, NULL, 0, NULL,
+		      ipp_discovery_free);
+    } else if (r == NULL)
+      continue;
+    else if (!strcmp(line, "URI"))
+      remote_printer_rec_set(&r->uri, value);
+    else if (!strcmp(line, "Host"))
+      remote_printer_rec_set(&r->host, value);
+    else if (!strcmp(line, "IP"))
+      remote_printer_rec_set(&r->ip, value);
+    else if (!strcmp(line, "Port"))
+      r->port = atoi(value);
+    else if (!strcmp(line, "Resource"))
+      remote_printer_rec_set(&r->resource, value);
+    else if (!strcmp(line, "ServiceName"))
+      remote_printer_rec_set(&r->service_name, value);
+    else if (!strcmp(line, "Type"))
+      remote_printer_rec_set(&r->type, value);
+    else if (!strcmp(line, "Domain"))
+      remote_printer_rec_set(&r->domain, value);
+    else if (!strcmp(line, "Location"))
+      remote_printer_rec_set(&r->location, value);
+    else if (!strcmp(line, "Info"))
+      remote_printer_rec_set(&r->info, value);
+    else if (!strcmp(line, "MakeModel"))
+      remote_printer_rec_set(&r->make_model, value);
+    else if (!strcmp(line, "PDL"))
+      remote_printer_rec_set(&r->pdl, value);
+    else if (!strcmp(line, "Color"))
+      r->color = atoi(value);
+    else if (!strcmp(line, "Duplex"))
+      r->duplex = atoi(value);
+    else if (!strcmp(line, "NetPrinter"))
+      r->netprinter = atoi(value);
+    else if (!strcmp(line, "Discovery")) {
+      if (sscanf(value, "%d %255s %255s", &family, type, interface) == 3)
+	ipp_discoveries_add(r->ipp_discoveries, interface, type, family);
+    } else if (!strcmp(line, "Profile"))
+      remote_printer_rec_set(&r->profile, value);
+    else if (!strcmp(line, "End")) {
+      if (r->queue_name && r->uri && r->host && r->resource &&
+	  r->service_name && r->type && r->domain && r->location &&
+	  r->info && r->ipp_discoveries) {
+	if ((list = (cups_array_t *)
+	     g_hash_table_lookup(saved_remote_printers,
+				 r->queue_name)) == NULL) {
+	  list = cupsArrayNew3(NULL, NULL, NULL, 0, NULL,
+			       (cups_afree_func_t)remote_printer_rec_free);
+	  g_hash_table_insert(saved_remote_printers, g_strdup(r->queue_name),
+			      list);
+	}
+	cupsArrayAdd(list, r);
+	num_loaded ++;
+      } else {
+	debug_printf("Incomplete entry for %s in remote printer list file %s, ignoring it.\n",
+		     r->queue_name ? r->queue_name : "(null)",
+		     remote_printers_file);
+	remote_printer_rec_free(r);
+      }
+      r = NULL;
+    }
+  }
+  if (r)
+    remote_printer_rec_free(r);
+  cupsFileClose(fp);
+
+  debug_printf("Loaded %d remote printers of the previous session.\n",
+	       num_loaded);
+}
+
+static void
+restore_remote_printer(remote_printer_t *p,
+		       remote_printer_rec_t *r) {
+  ipp_discovery_t *d;
+  int i;
+
+  remote_printer_unindex(p);
+  free(p->uri);
+  free(p->host);
+  free(p->ip);
+  free(p->resource);
+  free(p->service_name);
+  free(p->type);
+  free(p->domain);
+  free(p->location);
+  free(p->info);
+  free(p->make_model);
+  free(p->pdl);
+  p->uri = strdup(r->uri);
+  p->host = strdup(r->host);
+  p->ip = (r->ip != NULL ? strdup(r->ip) : NULL);
+  p->port = (r->port != 0 ? r->port : 631);
+  p->resource = strdup(r->resource);
+  p->service_name = strdup(r->service_name);
+  p->type = strdup(r->type);
+  p->domain = strdup(r->domain);
+  p->location = strdup(r->location);
+  p->info = strdup(r->info);
+  p->make_model = (r->make_model != NULL ? strdup(r->make_model) : NULL);
+  p->pdl = (r->pdl != NULL ? strdup(r->pdl) : NULL);
+  p->color = r->color;
+  p->duplex = r->duplex;
+  p->netprinter = r->netprinter;
+  for (i = 0; i < cupsArrayCount(r->ipp_discoveries); i ++) {
+    d = (ipp_discovery_t *)cupsArrayIndex(r->ipp_discoveries, i);
+    ipp_discoveries_add(p->ipp_discoveries, d->interface, d->type,
+			d->family);
+  }
+  /* Only from the cache, the printer gets asked when checking for
+     changes, see validate_restored_printers() */
+  if (p->prattrs == NULL)
+    p->prattrs = printer_attrs_cache_lookup(p->uri);
+  p->restored = 1;
+  r->restored = 1;
+  remote_printer_index(p);
+}
+
+/* Fill the entry p of a queue of the previous session with the saved
+   data of its printer, and add the other members of its cluster */
+static void
+restore_remote_printers(remote_printer_t *p) {
+  cups_array_t *list;
+  remote_printer_rec_t *r;
+  remote_printer_t *q;
+  int i;
+
+  if (saved_remote_printers == NULL ||
+      (list = (cups_array_t *)g_hash_table_lookup(saved_remote_printers,
+						  p->queue_name)) == NULL)
+    return;
+
+  for (i = 0; i < cupsArrayCount(list); i ++) {
+    r = (remote_printer_rec_t *)cupsArrayIndex(list, i);
+    if (i == 0)
+      q = p;
+    else if ((q = create_remote_printer_entry (p->queue_name, "", "", "",
+					       "", "", 0, "", "", "", "", "",
+					       0, NULL, 0, 0, NULL,
+					       -1)) != NULL) {
+      q->status = p->status;
+      q->timeout = p->timeout;
+      q->slave_of = p;
+    } else {
+      debug_printf("ERROR: Unable to create print queue entry for printer of previous session: %s (%s).\n",
+		   p->queue_name, r->uri);
+      continue;
+    }
+    restore_remote_printer(q, r);
+    debug_printf("Restored entry for %s (URI: %s) from previous session.\n",
+		 q->queue_name, q->uri);
+  }
+}
+
+/* Apply the result of validate_restored_printers_thread(): Only the
+   queues of the printers which answered with unchanged capabilities
+   are kept as they are, the ones of the printers which have changed
+   or did not answer get re-created (when they appear) */
+static gboolean
+validate_restored_printers_done(gpointer data) {
+  cups_array_t *unchanged = (cups_array_t *)data;
+  remote_printer_t *p;
+  int i, num_changed = 0;
+
+  if (in_shutdown == 0) {
+    pthread_rwlock_wrlock(&lock);
+    for (i = 0; i < cupsArrayCount(remote_printers); i ++) {
+      p = (remote_printer_t *)cupsArrayIndex(remote_printers, i);
+      if (!p->restored || cupsArrayFind(unchanged, p->uri))
+	continue;
+      p->restored = 0;
+      if (p->prattrs) {
+	ippDelete(p->prattrs);
+	p->prattrs = NULL;
+      }
+      g_free(p->profile);
+      p->profile = NULL;
+      g_free(p->merge_key);
+      p->merge_key = NULL;
+      if (p->status == STATUS_CONFIRMED) {
+	p->status = STATUS_TO_BE_CREATED;
+	p->timeout = time(NULL) + TIMEOUT_IMMEDIATELY;
+      }
+      debug_printf("Printer %s (%s) has changed since the previous session or could not be checked, its queue will get re-created.\n",
+		   p->queue_name, p->uri);
+      num_changed ++;
+    }
+    pthread_rwlock_unlock(&lock);
+    if (num_changed)
+      recheck_timer();
+  }
+  cupsArrayDelete(unchanged);
+  g_hash_table_destroy(saved_remote_printers);
+  saved_remote_printers = NULL;
+  return FALSE;
+}
+
+/* Check thread, works only on the saved records, which do not change
+   any more */
+static void *
+validate_restored_printers_thread(void *data) {
+  cups_array_t *unchanged, *changed, *list;
+  remote_printer_rec_t *r;
+  char *uri;
+  GHashTableIter iter;
+  gpointer key, value;
+  ipp_t *attrs;
+  char *profile;
+  int i;
+
+  unchanged = cupsArrayNew3((cups_array_func_t)strcmp, NULL, NULL, 0, NULL,
+			    (cups_afree_func_t)free);
+  changed = cupsArrayNew((cups_array_func_t)strcmp, NULL);
+  g_hash_table_iter_init(&iter, saved_remote_printers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    list = (cups_array_t *)value;
+    for (i = 0; i < cupsArrayCount(list); i ++) {
+      r = (remote_printer_rec_t *)cupsArrayIndex(list, i);
+      if (!r->restored)
+	continue;
+      /* If the printer does not answer now, its queue gets re-created
+	 when it appears again */
+      if ((attrs = get_printer_attributes_cached(r->uri)) == NULL)
+	continue;
+      profile = attrs_profile(attrs);
+      ippDelete(attrs);
+      if (r->profile && !strcmp(profile, r->profile)) {
+	if (!cupsArrayFind(unchanged, r->uri))
+	  cupsArrayAdd(unchanged, strdup(r->uri));
+      } else
+	cupsArrayAdd(changed, r->uri);
+      g_free(profile);
+    }
+  }
+  /* Several entries with the same URI, one of them changed (removing
+     frees the string) */
+  for (uri = (char *)cupsArrayFirst(changed); uri;
+       uri = (char *)cupsArrayNext(changed))
+    cupsArrayRemove(unchanged, cupsArrayFind(unchanged, uri));
+  cupsArrayDelete(changed);
+
+  g_idle_add(validate_restored_printers_done, unchanged);
+  return NULL;
+}
+
+/* Start checking the restored printers for changes in a separate
+   thread */
+static void
+validate_restored_printers(void) {
+  pthread_t thread;
+  pthread_attr_t attr;
+
+  if (saved_remote_printers == NULL)
+    return;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&thread, &attr, validate_restored_printers_thread,
+		     NULL)) {
+    debug_printf("Unable to create a thread for checking the printers of the previous session!\n");
+    g_hash_table_destroy(saved_remote_printers);
+    saved_remote_printers = NULL;
+  }
+  pthread_attr_destroy(&attr);
+}
+
 static void
 find_previous_queue (gpointer key,
 		     gpointer value,
@@ -12261,6 +15156,7 @@ find_previous_queue (gpointer key,
       p->slave_of = NULL;
       debug_printf("Found CUPS queue %s (URI: %s) from previous session.\n",
 		   p->queue_name, p->uri);
+      restore_remote_printers(p);
     } else
       debug_printf("ERROR: Unable to create print queue entry for printer of previous session: %s (%s).\n",
 		   name, printer->device_uri);
@@ -12460,6 +15356,21 @@ int main(int argc, char*argv[]) {
   strncpy(save_options_file + strlen(cachedir),
 	  SAVE_OPTIONS_FILE,
 	  sizeof(save_options_file) - strlen(cachedir) - 1);
+  strncpy(printer_attrs_cache_file, cachedir,
+	  sizeof(printer_attrs_cache_file) - 1);
+  strncpy(printer_attrs_cache_file + strlen(cachedir),
+	  PRINTER_ATTRS_CACHE_FILE,
+	  sizeof(printer_attrs_cache_file) - strlen(cachedir) - 1);
+  strncpy(remote_printers_file, cachedir,
+	  sizeof(remote_printers_file) - 1);
+  strncpy(remote_printers_file + strlen(cachedir),
+	  REMOTE_PRINTERS_FILE,
+	  sizeof(remote_printers_file) - strlen(cachedir) - 1);
+  strncpy(create_queue_stats_file, cachedir,
+	  sizeof(create_queue_stats_file) - 1);
+  strncpy(create_queue_stats_file + strlen(cachedir),
+	  CREATE_QUEUE_STATS_FILE,
+	  sizeof(create_queue_stats_file) - strlen(cachedir) - 1);
   strncpy(debug_log_file, logdir,
 	  sizeof(debug_log_file) - 1);
   strncpy(debug_log_file + strlen(logdir),
@@ -12474,6 +15385,7 @@ int main(int argc, char*argv[]) {
   
   if (debug_logfile == 1)
     start_debug_logging();
+  log_writer_start();
 
   debug_printf("main() in THREAD %ld\n", pthread_self());
 
@@ -12572,8 +15484,12 @@ int main(int argc, char*argv[]) {
     default_printer = strdup(val);
     free(val);
   }
-  remote_printers = cupsArrayNew(NULL, NULL);
+  remote_printers_init();
+  printer_attrs_cache_init();
+  load_printer_attrs_cache();
+  load_remote_printers();
   g_hash_table_foreach (local_printers, find_previous_queue, NULL);
+  validate_restored_printers();
 
   /* Redirect SIGINT and SIGTERM so that we do a proper shutdown, removing
      the CUPS queues which we have created
@@ -12616,6 +15532,7 @@ int main(int argc, char*argv[]) {
 #ifdef HAVE_AVAHI
   if (autoshutdown_avahi)
     autoshutdown = 1;
+  resolver_queue_start();
   avahi_init();
 #endif /* HAVE_AVAHI */
 
@@ -12768,6 +15685,12 @@ int main(int argc, char*argv[]) {
       g_timeout_add_seconds (autoshutdown_timeout, autoshutdown_execute, NULL);
   }
 
+  create_queue_pool_start();
+
+  /* Keep the load model of the cluster members up to date */
+  if (LoadBalancingType == QUEUE_ON_SERVERS && LoadPollInterval > 0)
+    g_timeout_add_seconds (LoadPollInterval, load_poll, NULL);
+
   g_main_loop_run (gmainloop);
 
   debug_printf("main loop exited\n");
@@ -12784,6 +15707,18 @@ fail:
   if (proxy)
     g_object_unref (proxy);
 
+  /* Let the queue creation workers finish before removing the queues */
+#ifdef HAVE_AVAHI
+  resolver_queue_stop();
+#endif /* HAVE_AVAHI */
+  create_queue_pool_stop();
+
+  /* Remember the queues which we keep for the next session */
+  if (KeepGeneratedQueuesOnShutdown)
+    save_remote_printers();
+  else
+    unlink(remote_printers_file);
+
   /* Remove all queues which we have set up */
   if (KeepGeneratedQueuesOnShutdown == 0)
     for (p = (remote_printer_t *)cupsArrayFirst(remote_printers);
@@ -12794,6 +15729,9 @@ fail:
     }
   update_cups_queues(NULL);
 
+  /* Save the printer attributes for the next session */
+  save_printer_attrs_cache();
+
   cancel_subscription (subscription_id);
   if (cups_notifier)
     g_object_unref (cups_notifier);
@@ -12850,6 +15788,7 @@ fail:
     g_list_free_full (browse_data, browse_data_free);
 
   /* Close log file if we have one */
+  log_writer_stop();
   if (debug_logfile == 1)
     stop_debug_logging();
   